@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+""" Throughput and latency benchmarks for Wget.
+
+Runs a set of download scenarios against local loopback servers (see
+servers.py) and reports, for each of them, the wall clock time, the
+throughput, the requests per second, the CPU time and the peak resident
+set size of the wget process.  Every scenario is run several times and
+the median run is reported, so that the numbers can be compared across
+builds:
+
+    ./bench.py --wget=../src/wget --json=before.json
+    ... rebuild ...
+    ./bench.py --wget=../src/wget --compare=before.json
+
+Run with --help for the list of scenarios and settings. """
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+import servers
+
+
+SRCDIR = os.path.dirname(os.path.abspath(__file__))
+CERTDIR = os.path.join(SRCDIR, '..', 'testenv', 'certs')
+
+
+class Scenario:
+    """ A wget command line run against one of the servers.  ARGS may
+    refer to {url} (the base URL of the server), {list} (a file listing
+    the small objects) and {ca} (the CA certificate of the TLS server). """
+
+    def __init__(self, name, server, args, description):
+        self.name = name
+        self.server = server
+        self.args = args
+        self.description = description
+
+
+SCENARIOS = [
+    Scenario('large', 'http', ['{url}/big.bin'],
+             'single large file over HTTP'),
+    Scenario('large-chunked', 'http-chunked', ['{url}/big.bin'],
+             'single large file, chunked encoding'),
+    Scenario('large-tls', 'https', ['--ca-certificate={ca}', '{url}/big.bin'],
+             'single large file over HTTPS'),
+    Scenario('large-ftp', 'ftp', ['{url}/big.bin'],
+             'single large file over FTP'),
+    Scenario('small', 'http', ['-i', '{list}'],
+             'many small files through -i, keep-alive'),
+    Scenario('small-close', 'http-close', ['-i', '{list}'],
+             'many small files through -i, a connection each'),
+    Scenario('small-latency', 'http-latency', ['-i', '{list}'],
+             'many small files through -i, with server latency'),
+    Scenario('small-tls', 'https', ['--ca-certificate={ca}', '-i', '{list}'],
+             'many small files through -i over HTTPS'),
+    Scenario('small-ftp', 'ftp', ['-i', '{list}'],
+             'many small files through -i over FTP'),
+    Scenario('mirror', 'http', ['-r', '-l', 'inf', '-np', '-nH',
+                                '{url}/site/index.html'],
+             'recursive mirror'),
+    Scenario('mirror-warc', 'http', ['-r', '-l', 'inf', '-np', '-nH',
+                                     '--warc-file=bench', '--no-warc-compression',
+                                     '{url}/site/index.html'],
+             'recursive mirror with WARC output'),
+    Scenario('mirror-convert', 'http', ['-r', '-l', 'inf', '-np', '-nH',
+                                        '--convert-links',
+                                        '{url}/site/index.html'],
+             'recursive mirror with --convert-links'),
+]
+
+
+def make_server(kind, site, args):
+    if kind == 'ftp':
+        return servers.BenchFTPServer(site)
+    options = {}
+    if kind == 'https':
+        options['certfile'] = os.path.join(args.certdir, 'server-cert.pem')
+        options['keyfile'] = os.path.join(args.certdir, 'server-key.pem')
+    elif kind == 'http-chunked':
+        options['chunked'] = True
+    elif kind == 'http-close':
+        options['keep_alive'] = False
+    elif kind == 'http-latency':
+        options['latency'] = args.latency / 1000.0
+    return servers.BenchHTTPServer(site, **options)
+
+
+def peak_rss(pid):
+    """ Return the peak RSS of PID in KB from /proc, or None.  The
+    ru_maxrss of wait4 cannot be used on Linux: it also counts the RSS
+    of this Python process, which the child had before the exec. """
+    try:
+        with open('/proc/%d/status' % pid) as f:
+            for line in f:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1])
+    except OSError:
+        pass
+    return None
+
+
+def run_wget(argv, cwd):
+    """ Run wget and return its exit code, wall clock time, resource
+    usage, peak RSS in KB and error output. """
+    env = dict(os.environ, WGETRC='/dev/null', SYSTEM_WGETRC='/dev/null')
+    errors = tempfile.TemporaryFile()
+    start = time.monotonic()
+    proc = subprocess.Popen(argv, cwd=cwd, env=env,
+                            stdout=subprocess.DEVNULL, stderr=errors)
+    sampled = None
+    while True:
+        pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+        if pid:
+            break
+        rss = peak_rss(proc.pid)
+        if rss is not None:
+            sampled = max(sampled or 0, rss)
+        time.sleep(0.002)
+    wall = time.monotonic() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    errors.seek(0)
+    text = errors.read().decode('utf-8', 'replace')
+    errors.close()
+    return proc.returncode, wall, usage, sampled or usage.ru_maxrss, text
+
+
+def run_scenario(scenario, server, url, site, args):
+    results = []
+    for _ in range(args.repeat):
+        workdir = tempfile.mkdtemp(prefix='wget-bench-')
+        try:
+            listfile = os.path.join(workdir, 'urls.txt')
+            with open(listfile, 'w') as f:
+                for path in site.small:
+                    f.write(url + path + '\n')
+            ca = os.path.join(args.certdir, 'ca-cert.pem')
+            argv = [args.wget, '-q', '--tries=1']
+            argv += [a.format(url=url, list=listfile, ca=ca)
+                     for a in scenario.args]
+            argv += args.wget_args
+            server.counters.reset()
+            code, wall, usage, maxrss, errors = run_wget(argv, workdir)
+            if code != 0:
+                raise RuntimeError('%s: wget exited with %d\n%s'
+                                   % (scenario.name, code, errors))
+            results.append({
+                'wall': wall,
+                'bytes': server.counters.bytes,
+                'requests': server.counters.requests,
+                'connections': server.counters.connections,
+                'user': usage.ru_utime,
+                'sys': usage.ru_stime,
+                'maxrss': maxrss,
+            })
+        finally:
+            shutil.rmtree(workdir, ignore_errors=True)
+    results.sort(key=lambda r: r['wall'])
+    best = dict(results[len(results) // 2])
+    best['wall_stdev'] = (statistics.stdev(r['wall'] for r in results)
+                          if len(results) > 1 else 0.0)
+    best['throughput'] = best['bytes'] / best['wall']
+    best['rps'] = best['requests'] / best['wall']
+    return best
+
+
+def report(name, r, previous):
+    line = ('%-15s %8.3f s %9.2f MB/s %9.1f req/s %7.3f s cpu %8d KB'
+            % (name, r['wall'], r['throughput'] / 1e6, r['rps'],
+               r['user'] + r['sys'], r['maxrss']))
+    if previous:
+        delta = (r['wall'] - previous['wall']) / previous['wall'] * 100
+        line += '  %+6.1f%%' % delta
+    print(line, flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Benchmark wget against local loopback servers.',
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog='scenarios:\n' + ''.join('  %-15s %s\n' % (s.name, s.description)
+                                        for s in SCENARIOS))
+    parser.add_argument('--wget', default=os.path.join(SRCDIR, '..', 'src', 'wget'),
+                        help='the wget binary to benchmark')
+    parser.add_argument('--scenario', action='append', default=[],
+                        help='run only this scenario (may be repeated)')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='runs of each scenario; the median is reported')
+    parser.add_argument('--large-size', default='256M',
+                        help='size of the large file')
+    parser.add_argument('--count', type=int, default=1000,
+                        help='number of small files')
+    parser.add_argument('--size-dist', default='lognormal:8k:1.0',
+                        help='small file sizes: fixed:SIZE, uniform:MIN:MAX '
+                             'or lognormal:MEDIAN:SIGMA')
+    parser.add_argument('--pages', type=int, default=100,
+                        help='number of HTML pages of the mirrored site')
+    parser.add_argument('--latency', type=float, default=5,
+                        help='server latency of the latency scenarios, in ms')
+    parser.add_argument('--certdir', default=CERTDIR,
+                        help='directory with the TLS certificates')
+    parser.add_argument('--json', help='also write the results to this file')
+    parser.add_argument('--compare',
+                        help='compare the wall times with an earlier --json')
+    parser.add_argument('wget_args', nargs='*',
+                        help='extra arguments to pass to wget (after --)')
+    args = parser.parse_args()
+
+    if not os.access(args.wget, os.X_OK):
+        sys.exit('%s is not executable; build wget first.' % args.wget)
+    selected = [s for s in SCENARIOS
+                if not args.scenario or s.name in args.scenario]
+    unknown = set(args.scenario) - set(s.name for s in SCENARIOS)
+    if unknown:
+        sys.exit('unknown scenarios: ' + ', '.join(sorted(unknown)))
+
+    site = servers.Site(servers.parse_size(args.large_size), args.count,
+                        servers.SizeDistribution(args.size_dist), args.pages)
+    previous = {}
+    if args.compare:
+        with open(args.compare) as f:
+            previous = json.load(f)['results']
+
+    print('wget: %s' % os.path.abspath(args.wget))
+    print('large file %s, %d small files (%s, %d bytes), %d pages, %d runs'
+          % (args.large_size, args.count, args.size_dist, site.small_bytes,
+             args.pages, args.repeat))
+    print()
+
+    running = {}
+    results = {}
+    try:
+        for s in selected:
+            if s.server not in running:
+                server = make_server(s.server, site, args)
+                running[s.server] = (server, servers.start(server))
+            server, url = running[s.server]
+            results[s.name] = run_scenario(s, server, url, site, args)
+            report(s.name, results[s.name], previous.get(s.name))
+    finally:
+        for server, _ in running.values():
+            server.shutdown()
+            server.server_close()
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'wget': os.path.abspath(args.wget),
+                       'settings': {k: v for k, v in vars(args).items()
+                                    if k not in ('json', 'compare')},
+                       'results': results}, f, indent=2)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,368 @@
+""" Loopback HTTP(S) and FTP servers for the Wget benchmarks.
+
+The servers serve a synthetic site generated by the Site class: a set
+of binary objects whose sizes follow a configurable distribution, and a
+tree of HTML pages linking to them for the recursive scenarios.  The
+contents are produced on the fly from a single pattern buffer so that
+the servers spend as little CPU time as possible. """
+
+from http.server import HTTPServer, BaseHTTPRequestHandler
+from socketserver import ThreadingMixIn, ThreadingTCPServer, StreamRequestHandler
+import random
+import socket
+import ssl
+import threading
+import time
+
+
+PATTERN_SIZE = 64 * 1024
+CHUNK_SIZE = 16 * 1024
+
+
+def parse_size(text):
+    """ Parse a size such as 512, 16k or 100M. """
+    suffixes = {'k': 1 << 10, 'm': 1 << 20, 'g': 1 << 30}
+    text = text.strip()
+    mult = suffixes.get(text[-1:].lower())
+    if mult:
+        return int(float(text[:-1]) * mult)
+    return int(text)
+
+
+class SizeDistribution:
+    """ Object size distributions, given as one of
+        fixed:SIZE
+        uniform:MIN:MAX
+        lognormal:MEDIAN:SIGMA """
+
+    def __init__(self, spec):
+        parts = spec.split(':')
+        self.kind = parts[0]
+        if self.kind == 'fixed' and len(parts) == 2:
+            self.args = (parse_size(parts[1]),)
+        elif self.kind == 'uniform' and len(parts) == 3:
+            self.args = (parse_size(parts[1]), parse_size(parts[2]))
+        elif self.kind == 'lognormal' and len(parts) == 3:
+            self.args = (parse_size(parts[1]), float(parts[2]))
+        else:
+            raise ValueError("invalid size distribution: %s" % spec)
+
+    def sample(self, rng):
+        if self.kind == 'fixed':
+            return self.args[0]
+        if self.kind == 'uniform':
+            return rng.randint(self.args[0], self.args[1])
+        median, sigma = self.args
+        return max(1, int(median * rng.lognormvariate(0, sigma)))
+
+
+class Site:
+    """ The synthetic site served by both the HTTP and the FTP server.
+
+    /big.bin           one large object
+    /obj/NNNNN.bin     many objects sized by the distribution
+    /site/index.html   root of a tree of pages, each linking to a few
+                       pages below it and a few objects in /site/obj/ """
+
+    def __init__(self, big_size, count, dist, pages, seed=1):
+        rng = random.Random(seed)
+        self.pattern = bytes(rng.getrandbits(8) for _ in range(PATTERN_SIZE))
+        self.sizes = {'/big.bin': big_size}
+        self.small = []
+        for i in range(count):
+            path = '/obj/%05d.bin' % i
+            self.sizes[path] = dist.sample(rng)
+            self.small.append(path)
+        self.pages = {}
+        per_page = max(1, count // max(1, pages))
+        for p in range(pages):
+            links = ['p%d.html' % c for c in (2 * p + 1, 2 * p + 2)
+                     if c < pages]
+            objs = ['obj/%05d.bin' % i
+                    for i in range(p * per_page, min(count, (p + 1) * per_page))]
+            for o in objs:
+                self.sizes['/site/' + o] = self.sizes['/' + o]
+            name = 'index.html' if p == 0 else 'p%d.html' % p
+            self.pages['/site/' + name] = self.make_page(p, links, objs)
+        self.small_bytes = sum(self.sizes[p] for p in self.small)
+
+    @staticmethod
+    def make_page(p, links, objs):
+        lines = ['<html><head><title>Page %d</title>' % p,
+                 '<link rel="stylesheet" href="/site/style.css">',
+                 '</head><body>', '<h1>Page %d</h1>' % p]
+        for l in links:
+            lines.append('<p><a href="%s">%s</a></p>' % (l, l))
+        for o in objs:
+            lines.append('<p><a href="/site/%s">%s</a> <img src="%s"></p>'
+                         % (o, o, o))
+        lines.append('</body></html>')
+        return ('\n'.join(lines) + '\n').encode('ascii')
+
+    def lookup(self, path):
+        """ Return the (size, generator of byte strings) of a path, or
+        None if there is no such object. """
+        if path in self.pages:
+            data = self.pages[path]
+            return len(data), iter((data,))
+        if path == '/site/style.css':
+            data = b'body { background: url("/site/obj/00000.bin"); }\n'
+            return len(data), iter((data,))
+        size = self.sizes.get(path)
+        if size is None:
+            return None
+        return size, self.generate(size)
+
+    def generate(self, size, chunk=PATTERN_SIZE):
+        view = memoryview(self.pattern)
+        while size > 0:
+            n = min(size, chunk)
+            yield view[:n]
+            size -= n
+
+    def listing(self, directory):
+        """ Return the names in DIRECTORY (with a trailing slash) and
+        their sizes, as an FTP server would list them. """
+        out = []
+        for path, size in sorted(self.sizes.items()):
+            if path.startswith(directory) and '/' not in path[len(directory):]:
+                out.append((path[len(directory):], size))
+        return out
+
+
+class Counters:
+    """ Requests and connections seen by a server. """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.reset()
+
+    def reset(self):
+        self.requests = 0
+        self.connections = 0
+        self.bytes = 0
+
+    def add(self, requests=0, connections=0, nbytes=0):
+        with self.lock:
+            self.requests += requests
+            self.connections += connections
+            self.bytes += nbytes
+
+
+class BenchHTTPHandler(BaseHTTPRequestHandler):
+    """ Serves the site, honouring the latency, chunked and keep-alive
+    settings of the server. """
+
+    server_version = 'WgetBench/1.0'
+    disable_nagle_algorithm = True
+
+    def setup(self):
+        super().setup()
+        self.server.counters.add(connections=1)
+        if self.server.keep_alive:
+            self.protocol_version = 'HTTP/1.1'
+
+    def log_message(self, format, *args):
+        pass
+
+    def do_HEAD(self):
+        self.respond(False)
+
+    def do_GET(self):
+        self.respond(True)
+
+    def respond(self, with_body):
+        self.server.counters.add(requests=1)
+        if self.server.latency:
+            time.sleep(self.server.latency)
+        found = self.server.site.lookup(self.path.split('?', 1)[0])
+        if found is None:
+            self.send_response(404)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        size, body = found
+        chunked = self.server.chunked and self.protocol_version == 'HTTP/1.1'
+        self.send_response(200)
+        if self.path.endswith('.html'):
+            self.send_header('Content-Type', 'text/html')
+        elif self.path.endswith('.css'):
+            self.send_header('Content-Type', 'text/css')
+        else:
+            self.send_header('Content-Type', 'application/octet-stream')
+        self.send_header('Last-Modified',
+                         self.date_time_string(1000000000))
+        if chunked:
+            self.send_header('Transfer-Encoding', 'chunked')
+        else:
+            self.send_header('Content-Length', str(size))
+        if not self.server.keep_alive:
+            self.send_header('Connection', 'close')
+        self.end_headers()
+        if not with_body:
+            return
+        for block in body:
+            if chunked:
+                for i in range(0, len(block), CHUNK_SIZE):
+                    piece = block[i:i + CHUNK_SIZE]
+                    self.wfile.write(b'%x\r\n' % len(piece))
+                    self.wfile.write(piece)
+                    self.wfile.write(b'\r\n')
+            else:
+                self.wfile.write(block)
+        if chunked:
+            self.wfile.write(b'0\r\n\r\n')
+        self.server.counters.add(nbytes=size)
+
+
+class BenchHTTPServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+    request_queue_size = 128
+
+    def __init__(self, site, latency=0.0, chunked=False, keep_alive=True,
+                 certfile=None, keyfile=None):
+        super().__init__(('localhost', 0), BenchHTTPHandler)
+        self.site = site
+        self.latency = latency
+        self.chunked = chunked
+        self.keep_alive = keep_alive
+        self.counters = Counters()
+        self.scheme = 'http'
+        if certfile:
+            ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+            ctx.load_cert_chain(certfile, keyfile)
+            self.socket = ctx.wrap_socket(self.socket, server_side=True)
+            self.scheme = 'https'
+
+
+class BenchFTPHandler(StreamRequestHandler):
+    """ A minimal FTP server: enough of RFC 959 and RFC 2428 for Wget
+    to log in, list directories and retrieve files in passive mode. """
+
+    disable_nagle_algorithm = True
+
+    def setup(self):
+        super().setup()
+        self.server.counters.add(connections=1)
+        self.cwd = '/'
+        self.pasv = None
+
+    def reply(self, text):
+        self.wfile.write((text + '\r\n').encode('ascii'))
+
+    def resolve(self, name):
+        if name.startswith('/'):
+            path = name
+        else:
+            path = self.cwd.rstrip('/') + '/' + name
+        return path.rstrip('/') or '/'
+
+    def open_passive(self):
+        if self.pasv:
+            self.pasv.close()
+        self.pasv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.pasv.bind(('127.0.0.1', 0))
+        self.pasv.listen(1)
+        return self.pasv.getsockname()[1]
+
+    def send_data(self, chunks):
+        if not self.pasv:
+            self.reply('425 Use PASV or EPSV first.')
+            return
+        self.reply('150 Opening BINARY mode data connection.')
+        conn, _ = self.pasv.accept()
+        self.pasv.close()
+        self.pasv = None
+        with conn:
+            for block in chunks:
+                conn.sendall(block)
+        self.reply('226 Transfer complete.')
+
+    def is_dir(self, path):
+        prefix = path.rstrip('/') + '/'
+        return any(p.startswith(prefix) for p in self.server.site.sizes)
+
+    def handle(self):
+        site = self.server.site
+        self.reply('220 WgetBench FTP server ready.')
+        for line in self.rfile:
+            line = line.decode('ascii', 'replace').rstrip('\r\n')
+            cmd, _, arg = line.partition(' ')
+            cmd = cmd.upper()
+            self.server.counters.add(requests=1)
+            if self.server.latency:
+                time.sleep(self.server.latency)
+            if cmd == 'USER':
+                self.reply('331 Password required.')
+            elif cmd == 'PASS':
+                self.reply('230 Logged in.')
+            elif cmd == 'SYST':
+                self.reply('215 UNIX Type: L8')
+            elif cmd == 'PWD':
+                self.reply('257 "%s" is the current directory.' % self.cwd)
+            elif cmd == 'TYPE':
+                self.reply('200 Type set.')
+            elif cmd == 'CWD':
+                path = self.resolve(arg)
+                if path == '/' or self.is_dir(path):
+                    self.cwd = path
+                    self.reply('250 Directory changed.')
+                else:
+                    self.reply('550 No such directory.')
+            elif cmd == 'PASV':
+                port = self.open_passive()
+                self.reply('227 Entering Passive Mode (127,0,0,1,%d,%d).'
+                           % (port >> 8, port & 255))
+            elif cmd == 'EPSV':
+                self.reply('229 Entering Extended Passive Mode (|||%d|).'
+                           % self.open_passive())
+            elif cmd == 'SIZE':
+                size = site.sizes.get(self.resolve(arg))
+                if size is None:
+                    self.reply('550 No such file.')
+                else:
+                    self.reply('213 %d' % size)
+            elif cmd == 'MDTM':
+                self.reply('213 20010909014640')
+            elif cmd == 'REST':
+                self.reply('350 Restarting at %s.' % arg)
+            elif cmd == 'RETR':
+                found = site.lookup(self.resolve(arg))
+                if found is None:
+                    self.reply('550 No such file.')
+                else:
+                    self.send_data(found[1])
+                    self.server.counters.add(nbytes=found[0])
+            elif cmd == 'LIST':
+                entries = site.listing(self.cwd.rstrip('/') + '/')
+                text = ''.join('-rw-r--r--   1 0 0 %12d Sep  9  2001 %s\r\n'
+                               % (size, name) for name, size in entries)
+                self.send_data((text.encode('ascii'),))
+            elif cmd == 'QUIT':
+                self.reply('221 Goodbye.')
+                break
+            else:
+                self.reply('502 Command not implemented.')
+        if self.pasv:
+            self.pasv.close()
+
+
+class BenchFTPServer(ThreadingTCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__(self, site, latency=0.0):
+        super().__init__(('127.0.0.1', 0), BenchFTPHandler)
+        self.site = site
+        self.latency = latency
+        self.counters = Counters()
+        self.scheme = 'ftp'
+
+
+def start(server):
+    """ Serve SERVER in a background thread and return its base URL. """
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    host = 'localhost' if server.scheme == 'https' else '127.0.0.1'
+    return '%s://%s:%d' % (server.scheme, host, server.server_address[1])
@@ -52,6 +52,7 @@ as that of the covered work.  */
 #endif /* not WINDOWS */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/time.h>
 
@@ -63,6 +64,8 @@ as that of the covered work.  */
 #include "host.h"
 #include "connect.h"
 #include "hash.h"
+#include "retr.h"
+#include "stats.h"
 
 #include <stdint.h>
 
@@ -219,6 +222,67 @@ resolve_bind_address (struct sockaddr *sa)
   return true;
 }
 
+/* Whether an operation failed only because it would have blocked. */
+#define WOULD_BLOCK(err) ((err) == EAGAIN || (err) == EWOULDBLOCK)
+
+#ifndef WINDOWS
+
+/* Put socket FD in non-blocking mode.  All the operations on it are
+   then carried out through the event loop, which waits for FD to be
+   ready when they would block.  */
+
+static bool
+set_socket_nonblocking (int fd)
+{
+  int flags = fcntl (fd, F_GETFL, 0);
+  return flags >= 0 && fcntl (fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+/* Like connect, but specifies a timeout.  If connecting takes longer
+   than TIMEOUT seconds, -1 is returned and errno is set to
+   ETIMEDOUT.  FD must be non-blocking.  */
+
+static int
+connect_with_timeout (int fd, const struct sockaddr *addr, socklen_t addrlen,
+                      double timeout)
+{
+  int err, test;
+  socklen_t errlen = sizeof err;
+
+  if (connect (fd, addr, addrlen) == 0)
+    return 0;
+  /* An interrupted connect goes on in the background. */
+  if (errno != EINPROGRESS && errno != EINTR)
+    return -1;
+
+  test = evloop_wait_fd (fd, EVLOOP_WRITE, timeout ? timeout : -1);
+  if (test == 0)
+    errno = ETIMEDOUT;
+  if (test <= 0)
+    return -1;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, (void *) &err, &errlen) < 0)
+    return -1;
+  if (err)
+    {
+      errno = err;
+      return -1;
+    }
+  return 0;
+}
+
+#else  /* WINDOWS */
+
+/* Sockets stay blocking on Windows, where gnulib's select wouldn't
+   preserve their mode anyway.  Operations on them are preceded by a
+   wait on the event loop when a timeout is requested.  */
+
+static bool
+set_socket_nonblocking (int fd _GL_UNUSED)
+{
+  return true;
+}
+
 struct cwt_context {
   int fd;
   const struct sockaddr *addr;
@@ -256,6 +320,8 @@ connect_with_timeout (int fd, const struct sockaddr *addr, socklen_t addrlen,
   return ctx.result;
 }
 
+#endif /* WINDOWS */
+
 /* Connect via TCP to the specified address and port.
 
    If PRINT is non-NULL, it is the host name to print that we're
@@ -309,6 +375,8 @@ connect_to_ip (const ip_address *ip, int port, const char *print)
   sock = socket (sa->sa_family, SOCK_STREAM, 0);
   if (sock < 0)
     goto err;
+  if (!set_socket_nonblocking (sock))
+    goto err;
 
 #if defined(ENABLE_IPV6) && defined(IPV6_V6ONLY)
   if (opt.ipv6_only) {
@@ -325,9 +393,9 @@ connect_to_ip (const ip_address *ip, int port, const char *print)
      hopefully, the kernel's TCP window size) to the per-second limit.
      That way we should never have to sleep for more than 1s between
      network reads.  */
-  if (opt.limit_rate && opt.limit_rate < 8192)
+  if (limit_bandwidth_rate () && limit_bandwidth_rate () < 8192)
     {
-      int bufsize = opt.limit_rate;
+      int bufsize = limit_bandwidth_rate ();
       if (bufsize < 512)
         bufsize = 512;          /* avoid pathologically small values */
 #ifdef SO_RCVBUF
@@ -388,8 +456,11 @@ connect_to_host (const char *host, int port)
 {
   int i, start, end;
   int sock;
+  struct address_list *al;
 
-  struct address_list *al = lookup_host (host, 0);
+  stats_phase_begin (PHASE_DNS);
+  al = lookup_host (host, 0);
+  stats_phase_end (PHASE_DNS);
 
  retry:
   if (!al)
@@ -404,10 +475,13 @@ connect_to_host (const char *host, int port)
   for (i = start; i < end; i++)
     {
       const ip_address *ip = address_list_address_at (al, i);
+      stats_phase_begin (PHASE_CONNECT);
       sock = connect_to_ip (ip, port, host);
+      stats_phase_end (PHASE_CONNECT);
       if (sock >= 0)
         {
           /* Success. */
+          stats_connection (false);
           address_list_set_connected (al);
           address_list_release (al);
           return sock;
@@ -426,7 +500,9 @@ connect_to_host (const char *host, int port)
       /* We connected to AL before, but cannot do so now.  That might
          indicate that our DNS cache entry for HOST has expired.  */
       address_list_release (al);
+      stats_phase_begin (PHASE_DNS);
       al = lookup_host (host, LH_REFRESH);
+      stats_phase_end (PHASE_DNS);
       goto retry;
     }
   address_list_release (al);
@@ -509,7 +585,8 @@ bind_local (const ip_address *bind_address, int *port)
 
    The caller is blocked until a connection is established.  If no
    connection is established for opt.connect_timeout seconds, the
-   function exits with an error status.  */
+   function exits with an error status.  The new socket is
+   non-blocking, like the ones made by connect_to_ip.  */
 
 int
 accept_connection (int local_sock)
@@ -522,16 +599,22 @@ accept_connection (int local_sock)
   struct sockaddr *sa = (struct sockaddr *)&ss;
   socklen_t addrlen = sizeof (ss);
 
-  if (opt.connect_timeout)
-    {
-      int test = select_fd (local_sock, opt.connect_timeout, WAIT_FOR_READ);
-      if (test == 0)
-        errno = ETIMEDOUT;
-      if (test <= 0)
-        return -1;
-    }
+  int test = select_fd (local_sock,
+                        opt.connect_timeout ? opt.connect_timeout : -1,
+                        WAIT_FOR_READ);
+  if (test == 0)
+    errno = ETIMEDOUT;
+  if (test <= 0)
+    return -1;
   sock = accept (local_sock, sa, &addrlen);
   DEBUGP (("Accepted client at socket %d.\n", sock));
+  if (sock >= 0 && !set_socket_nonblocking (sock))
+    {
+      int save_errno = errno;
+      fd_close (sock);
+      errno = save_errno;
+      return -1;
+    }
   return sock;
 }
 
@@ -670,40 +753,15 @@ retryable_socket_connect_error (int err)
    -1 for error.  The argument WAIT_FOR can be a combination of
    WAIT_FOR_READ and WAIT_FOR_WRITE.
 
-   This is a mere convenience wrapper around the select call, and
+   This is a mere convenience wrapper around the event loop, and
    should be taken as such (for example, it doesn't implement Wget's
-   0-timeout-means-no-timeout semantics.)  */
+   0-timeout-means-no-timeout semantics: a MAXTIME of 0 only checks
+   whether FD is available, and a negative one means no timeout.)  */
 
 int
 select_fd (int fd, double maxtime, int wait_for)
 {
-  fd_set fdset;
-  fd_set *rd = NULL, *wr = NULL;
-  struct timeval tmout;
-  int result;
-
-  FD_ZERO (&fdset);
-  FD_SET (fd, &fdset);
-  if (wait_for & WAIT_FOR_READ)
-    rd = &fdset;
-  if (wait_for & WAIT_FOR_WRITE)
-    wr = &fdset;
-
-  tmout.tv_sec = (long) maxtime;
-  tmout.tv_usec = 1000000 * (maxtime - (long) maxtime);
-
-  do
-  {
-    result = select (fd + 1, rd, wr, NULL, &tmout);
-#ifdef WINDOWS
-    /* gnulib select() converts blocking sockets to nonblocking in windows.
-       wget uses blocking sockets so we must convert them back to blocking.  */
-    set_windows_fd_as_blocking_socket (fd);
-#endif
-  }
-  while (result < 0 && errno == EINTR);
-
-  return result;
+  return evloop_wait_fd (fd, wait_for, maxtime);
 }
 
 /* Return true iff the connection to the remote site established
@@ -842,13 +900,14 @@ fd_register_transport (int fd, struct transport_implementation *imp, void *ctx)
 }
 
 /* Return context of the transport registered with
-   fd_register_transport.  This assumes fd_register_transport was
-   previously called on FD.  */
+   fd_register_transport, or NULL if FD has no transport.  */
 
 void *
 fd_transport_context (int fd)
 {
-  struct transport_info *info = hash_table_get (transport_map, (void *)(intptr_t) fd);
+  struct transport_info *info = NULL;
+  if (transport_map)
+    info = hash_table_get (transport_map, (void *)(intptr_t) fd);
   return info ? info->ctx : NULL;
 }
 
@@ -878,26 +937,41 @@ fd_transport_context (int fd)
     }                                                                   \
 } while (0)
 
+/* Wait for FD to be ready for WF after an operation on it would have
+   blocked.  TIMEOUT is as for fd_read; 0 means no timeout.  The
+   transport's poller may wait for another condition than WF, such as
+   writability when TLS needs to write to be able to read.  */
+
 static bool
 poll_internal (int fd, struct transport_info *info, int wf, double timeout)
 {
+  int test;
+
   if (timeout == -1)
     timeout = opt.read_timeout;
-  if (timeout)
-    {
-      int test;
-      if (info && info->imp->poller)
-        test = info->imp->poller (fd, timeout, wf, info->ctx);
-      else
-        test = sock_poll (fd, timeout, wf);
-      if (test == 0)
-        errno = ETIMEDOUT;
-      if (test <= 0)
-        return false;
-    }
-  return true;
+  if (timeout == 0)
+    timeout = -1;
+  if (info && info->imp->poller)
+    test = info->imp->poller (fd, timeout, wf, info->ctx);
+  else
+    test = sock_poll (fd, timeout, wf);
+  if (test == 0)
+    errno = ETIMEDOUT;
+  return test > 0;
 }
 
+#ifdef WINDOWS
+/* The sockets are blocking on Windows: wait before the operations
+   rather than after they would have blocked.  */
+# define PRE_POLL(fd, info, wf, timeout) do {                           \
+  if (((timeout) == -1 ? opt.read_timeout : (timeout))                  \
+      && !poll_internal (fd, info, wf, timeout))                        \
+    return -1;                                                          \
+} while (0)
+#else
+# define PRE_POLL(fd, info, wf, timeout) do { } while (0)
+#endif
+
 /* Read no more than BUFSIZE bytes of data from FD, storing them to
    BUF.  If TIMEOUT is non-zero, the operation aborts if no data is
    received after that many seconds.  If TIMEOUT is -1, the value of
@@ -906,14 +980,21 @@ poll_internal (int fd, struct transport_info *info, int wf, double timeout)
 int
 fd_read (int fd, char *buf, int bufsize, double timeout)
 {
+  int res;
   struct transport_info *info;
   LAZY_RETRIEVE_INFO (info);
-  if (!poll_internal (fd, info, WAIT_FOR_READ, timeout))
-    return -1;
-  if (info && info->imp->reader)
-    return info->imp->reader (fd, buf, bufsize, info->ctx);
-  else
-    return sock_read (fd, buf, bufsize);
+  PRE_POLL (fd, info, WAIT_FOR_READ, timeout);
+  for (;;)
+    {
+      if (info && info->imp->reader)
+        res = info->imp->reader (fd, buf, bufsize, info->ctx);
+      else
+        res = sock_read (fd, buf, bufsize);
+      if (res >= 0 || !WOULD_BLOCK (errno))
+        return res;
+      if (!poll_internal (fd, info, WAIT_FOR_READ, timeout))
+        return -1;
+    }
 }
 
 /* Like fd_read, except it provides a "preview" of the data that will
@@ -931,14 +1012,21 @@ fd_read (int fd, char *buf, int bufsize, double timeout)
 int
 fd_peek (int fd, char *buf, int bufsize, double timeout)
 {
+  int res;
   struct transport_info *info;
   LAZY_RETRIEVE_INFO (info);
-  if (!poll_internal (fd, info, WAIT_FOR_READ, timeout))
-    return -1;
-  if (info && info->imp->peeker)
-    return info->imp->peeker (fd, buf, bufsize, info->ctx);
-  else
-    return sock_peek (fd, buf, bufsize);
+  PRE_POLL (fd, info, WAIT_FOR_READ, timeout);
+  for (;;)
+    {
+      if (info && info->imp->peeker)
+        res = info->imp->peeker (fd, buf, bufsize, info->ctx);
+      else
+        res = sock_peek (fd, buf, bufsize);
+      if (res >= 0 || !WOULD_BLOCK (errno))
+        return res;
+      if (!poll_internal (fd, info, WAIT_FOR_READ, timeout))
+        return -1;
+    }
 }
 
 /* Write the entire contents of BUF to FD.  If TIMEOUT is non-zero,
@@ -958,12 +1046,17 @@ fd_write (int fd, char *buf, int bufsize, double timeout)
   res = 0;
   while (bufsize > 0)
     {
-      if (!poll_internal (fd, info, WAIT_FOR_WRITE, timeout))
-        return -1;
+      PRE_POLL (fd, info, WAIT_FOR_WRITE, timeout);
       if (info && info->imp->writer)
         res = info->imp->writer (fd, buf, bufsize, info->ctx);
       else
         res = sock_write (fd, buf, bufsize);
+      if (res < 0 && WOULD_BLOCK (errno))
+        {
+          if (!poll_internal (fd, info, WAIT_FOR_WRITE, timeout))
+            return -1;
+          continue;
+        }
       if (res <= 0)
         break;
       buf += res;
@@ -1016,6 +1109,7 @@ fd_close (int fd)
   if (transport_map)
     info = hash_table_get (transport_map, (void *)(intptr_t) fd);
 
+  evloop_forget (fd);
   if (info && info->imp->closer)
     info->imp->closer (fd, info->ctx);
   else
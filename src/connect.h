@@ -33,6 +33,7 @@ as that of the covered work.  */
 #define CONNECT_H
 
 #include "host.h"       /* for definition of ip_address */
+#include "evloop.h"
 
 /* Function declarations */
 
@@ -57,12 +58,16 @@ bool retryable_socket_connect_error (int);
 
 /* Flags for select_fd's WAIT_FOR argument. */
 enum {
-  WAIT_FOR_READ = 1,
-  WAIT_FOR_WRITE = 2
+  WAIT_FOR_READ = EVLOOP_READ,
+  WAIT_FOR_WRITE = EVLOOP_WRITE
 };
 int select_fd (int, double, int);
 bool test_socket_open (int);
 
+/* The operations of a transport.  Sockets are non-blocking: when
+   reading, writing or peeking would block, the operation returns -1
+   with errno set to EAGAIN, and the poller is then called to wait
+   until it can go on, with a negative timeout meaning no limit.  */
 struct transport_implementation {
   int (*reader) (int, char *, int, void *);
   int (*writer) (int, char *, int, void *);
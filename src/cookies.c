@@ -51,6 +51,7 @@ as that of the covered work.  */
 #include <assert.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
 #ifdef HAVE_LIBPSL
 # include <libpsl.h>
 #endif
@@ -60,6 +61,10 @@ as that of the covered work.  */
 #include "http.h"               /* for http_atotm */
 #include "c-strcase.h"
 
+#ifdef TESTING
+#include "test.h"
+#include "init.h"                /* for home_dir */
+#endif
 
 /* Declarations of `struct cookie' and the most basic functions. */
 
@@ -73,15 +78,78 @@ as that of the covered work.  */
    course, when sending a cookie to `www.google.com', one must search
    for cookies that belong to either `www.google.com' or `google.com'
    -- but the point is that the code doesn't need to go through *all*
-   the cookies.  */
+   the cookies.
+
+   Since the same Cookie header is typically sent with many requests,
+   the jar also remembers the headers it has generated.  A header is
+   determined by the host, port, and security of the request, plus
+   the longest cookie path that is a prefix of the request path: any
+   two request paths with the same longest prefix match exactly the
+   same cookie paths.  To find that prefix quickly, the paths of all
+   cookies are kept in a trie.  Remembered headers are forgotten
+   whenever a cookie is added or removed, and cookies are removed as
+   soon as they expire, which is cheap to detect with a heap ordered
+   by expiry time.
+
+   A jar loaded from a binary snapshot (see cookie_jar_load) keeps the
+   snapshot mapped, and moves the cookies of a domain into the chains
+   only when the domain is first looked up.  */
+
+/* A node in the trie of cookie paths. */
+struct path_node {
+  int child;                    /* first child, or -1 */
+  int sibling;                  /* next sibling, or -1 */
+  int count;                    /* number of cookies with this path */
+  char c;                       /* character leading to this node */
+};
 
 struct cookie_jar {
   /* Cookie chains indexed by domain.  */
   struct hash_table *chains;
 
   int cookie_count;             /* number of cookies in the jar. */
+
+  /* Cookies that have an expiry time, as a binary heap with the
+     soonest to expire at the top.  */
+  struct cookie **heap;
+  int heap_count;
+  int heap_size;
+
+  /* Trie of the paths of all cookies; nodes[0] is the root. */
+  struct path_node *path_nodes;
+  int path_node_count;
+  int path_node_size;
+
+  /* Generated Cookie headers, keyed by "HOST PORT SECFLAG PATH". */
+  struct hash_table *headers;
+
+  /* Binary snapshot the jar was loaded from, if any.  LOADED is
+     indexed by the first record of each domain.  */
+  struct file_memory *snapshot;
+  char *loaded;
+};
+
+/* Binary snapshot format.  The records are sorted by domain, ignoring
+   case, and the records of a domain are in chain order.  */
+#define COOKIE_SNAPSHOT_MAGIC "WGCOOK\0\1"
+
+struct cookie_snapshot_record {
+  uint32_t domain;              /* offsets in the string table */
+  uint32_t path;
+  uint32_t attr;
+  uint32_t value;
+  int32_t port;
+  uint32_t flags;
+  int64_t expiry_time;
 };
 
+#define SNAPSHOT_SECURE       1
+#define SNAPSHOT_DOMAIN_EXACT 2
+#define SNAPSHOT_PERMANENT    4
+
+/* Whether JAR holds no cookies, loaded or not.  */
+#define JAR_EMPTY_P(jar) (!hash_table_count ((jar)->chains) && !(jar)->snapshot)
+
 /* Value set by entry point functions, so that the low-level
    routines don't need to call time() all the time.  */
 static time_t cookies_now;
@@ -89,9 +157,15 @@ static time_t cookies_now;
 struct cookie_jar *
 cookie_jar_new (void)
 {
-  struct cookie_jar *jar = xnew (struct cookie_jar);
+  struct cookie_jar *jar = xnew0 (struct cookie_jar);
   jar->chains = make_nocase_string_hash_table (0);
-  jar->cookie_count = 0;
+  jar->headers = make_string_hash_table (0);
+  jar->path_node_size = 16;
+  jar->path_nodes = xnew_array (struct path_node, jar->path_node_size);
+  jar->path_nodes[0].child = jar->path_nodes[0].sibling = -1;
+  jar->path_nodes[0].count = 0;
+  jar->path_nodes[0].c = '\0';
+  jar->path_node_count = 1;
   return jar;
 }
 
@@ -120,6 +194,8 @@ struct cookie {
 
   struct cookie *next;          /* used for chaining of cookies in the
                                    same domain. */
+  int heap_index;               /* position in the jar's expiry heap,
+                                   or -1. */
 };
 
 #define PORT_ANY (-1)
@@ -136,6 +212,7 @@ cookie_new (void)
      session (i.e. not written out to disk).  */
 
   cookie->port = PORT_ANY;
+  cookie->heap_index = -1;
   return cookie;
 }
 
@@ -160,6 +237,349 @@ delete_cookie (struct cookie *cookie)
   xfree (cookie);
 }
 
+/* Maintenance of the jar's indexes.  */
+
+/* Forget all the Cookie headers generated so far. */
+
+static void
+forget_headers (struct cookie_jar *jar)
+{
+  hash_table_iterator iter;
+  if (!hash_table_count (jar->headers))
+    return;
+  for (hash_table_iterate (jar->headers, &iter); hash_table_iter_next (&iter); )
+    {
+      xfree (iter.key);
+      xfree (iter.value);
+    }
+  hash_table_clear (jar->headers);
+}
+
+#define HEAP_LESS(jar, i, j) \
+  ((jar)->heap[i]->expiry_time < (jar)->heap[j]->expiry_time)
+
+static void
+heap_swap (struct cookie_jar *jar, int i, int j)
+{
+  struct cookie *tmp = jar->heap[i];
+  jar->heap[i] = jar->heap[j];
+  jar->heap[j] = tmp;
+  jar->heap[i]->heap_index = i;
+  jar->heap[j]->heap_index = j;
+}
+
+/* Restore the heap property for the element at index I. */
+
+static void
+heap_fix (struct cookie_jar *jar, int i)
+{
+  while (i > 0 && HEAP_LESS (jar, i, (i - 1) / 2))
+    {
+      heap_swap (jar, i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  while (1)
+    {
+      int l = 2 * i + 1, r = l + 1, min = i;
+      if (l < jar->heap_count && HEAP_LESS (jar, l, min))
+        min = l;
+      if (r < jar->heap_count && HEAP_LESS (jar, r, min))
+        min = r;
+      if (min == i)
+        break;
+      heap_swap (jar, i, min);
+      i = min;
+    }
+}
+
+static void
+heap_insert (struct cookie_jar *jar, struct cookie *cookie)
+{
+  if (jar->heap_count == jar->heap_size)
+    {
+      jar->heap_size = jar->heap_size ? jar->heap_size << 1 : 16;
+      jar->heap = xrealloc (jar->heap,
+                            jar->heap_size * sizeof (struct cookie *));
+    }
+  cookie->heap_index = jar->heap_count;
+  jar->heap[jar->heap_count++] = cookie;
+  heap_fix (jar, cookie->heap_index);
+}
+
+static void
+heap_remove (struct cookie_jar *jar, struct cookie *cookie)
+{
+  int i = cookie->heap_index;
+  if (i == -1)
+    return;
+  cookie->heap_index = -1;
+  if (i != --jar->heap_count)
+    {
+      jar->heap[i] = jar->heap[jar->heap_count];
+      jar->heap[i]->heap_index = i;
+      heap_fix (jar, i);
+    }
+}
+
+/* Return the trie node for PATH, creating it if CREATE is true.
+   Return -1 if the node doesn't exist and CREATE is false.  */
+
+static int
+path_node (struct cookie_jar *jar, const char *path, bool create)
+{
+  int n = 0;
+  for (; *path; path++)
+    {
+      int child, last = -1;
+      for (child = jar->path_nodes[n].child; child != -1;
+           child = jar->path_nodes[child].sibling)
+        {
+          if (jar->path_nodes[child].c == *path)
+            break;
+          last = child;
+        }
+      if (child == -1)
+        {
+          if (!create)
+            return -1;
+          if (jar->path_node_count == jar->path_node_size)
+            {
+              jar->path_node_size <<= 1;
+              jar->path_nodes = xrealloc (jar->path_nodes,
+                                          jar->path_node_size
+                                          * sizeof (struct path_node));
+            }
+          child = jar->path_node_count++;
+          jar->path_nodes[child].child = jar->path_nodes[child].sibling = -1;
+          jar->path_nodes[child].count = 0;
+          jar->path_nodes[child].c = *path;
+          if (last == -1)
+            jar->path_nodes[n].child = child;
+          else
+            jar->path_nodes[last].sibling = child;
+        }
+      n = child;
+    }
+  return n;
+}
+
+/* Return the length of the longest path of a cookie in JAR that is a
+   prefix of PATH, or -1 if there is none.  */
+
+static int
+longest_cookie_path (const struct cookie_jar *jar, const char *path)
+{
+  const char *p = path;
+  int n = 0, longest = -1;
+  while (1)
+    {
+      int child;
+      if (jar->path_nodes[n].count)
+        longest = p - path;
+      if (!*p)
+        break;
+      for (child = jar->path_nodes[n].child; child != -1;
+           child = jar->path_nodes[child].sibling)
+        if (jar->path_nodes[child].c == *p)
+          break;
+      if (child == -1)
+        break;
+      n = child;
+      ++p;
+    }
+  return longest;
+}
+
+/* Enter COOKIE, which has just been put in a chain, into the indexes
+   of JAR.  */
+
+static void
+index_cookie (struct cookie_jar *jar, struct cookie *cookie)
+{
+  ++jar->path_nodes[path_node (jar, cookie->path, true)].count;
+  if (cookie->expiry_time)
+    heap_insert (jar, cookie);
+  ++jar->cookie_count;
+  forget_headers (jar);
+}
+
+/* Remove COOKIE, which is about to be deleted, from the indexes of
+   JAR.  */
+
+static void
+unindex_cookie (struct cookie_jar *jar, struct cookie *cookie)
+{
+  --jar->path_nodes[path_node (jar, cookie->path, false)].count;
+  heap_remove (jar, cookie);
+  --jar->cookie_count;
+  forget_headers (jar);
+}
+
+/* Functions for binary snapshots. */
+
+/* Return the string at offset OFF of the snapshot string table, or
+   NULL if OFF is out of range.  */
+
+static const char *
+snapshot_string (const struct file_memory *fm, uint32_t off)
+{
+  const struct snapshot_header *hdr = (const void *) fm->content;
+  if (off >= hdr->strings_size)
+    return NULL;
+  return SNAPSHOT_STRINGS (fm, sizeof (struct cookie_snapshot_record)) + off;
+}
+
+/* Create a cookie from snapshot record R, or return NULL if it has
+   expired or is malformed.  */
+
+static struct cookie *
+snapshot_cookie (const struct file_memory *fm,
+                 const struct cookie_snapshot_record *r)
+{
+  struct cookie *cookie;
+  const char *domain = snapshot_string (fm, r->domain);
+  const char *path = snapshot_string (fm, r->path);
+  const char *attr = snapshot_string (fm, r->attr);
+  const char *value = snapshot_string (fm, r->value);
+
+  if (!domain || !path || !attr || !value)
+    return NULL;
+  if (r->expiry_time != 0 && r->expiry_time < cookies_now)
+    return NULL;                /* ignore stale cookie. */
+
+  cookie = cookie_new ();
+  cookie->domain = xstrdup (domain);
+  cookie->path = xstrdup (path);
+  cookie->attr = xstrdup (attr);
+  cookie->value = xstrdup (value);
+  cookie->port = r->port;
+  cookie->secure = !!(r->flags & SNAPSHOT_SECURE);
+  cookie->domain_exact = !!(r->flags & SNAPSHOT_DOMAIN_EXACT);
+  cookie->permanent = !!(r->flags & SNAPSHOT_PERMANENT);
+  cookie->expiry_time = r->expiry_time;
+  return cookie;
+}
+
+static void store_cookie (struct cookie_jar *, struct cookie *);
+static bool numeric_address_p (const char *);
+static int count_char (const char *, char);
+
+/* Move the cookies of the records [LO, HI) into the chains, unless
+   that has been done already.  */
+
+static void
+snapshot_load_records (struct cookie_jar *jar, uint32_t lo, uint32_t hi)
+{
+  const struct cookie_snapshot_record *records = SNAPSHOT_RECORDS (jar->snapshot);
+
+  if (jar->loaded[lo])
+    return;
+  jar->loaded[lo] = 1;
+
+  /* store_cookie places each cookie at the head of its chain, so
+     store them last to first to preserve the order.  */
+  while (hi-- > lo)
+    {
+      struct cookie *cookie = snapshot_cookie (jar->snapshot, records + hi);
+      if (cookie)
+        store_cookie (jar, cookie);
+    }
+}
+
+/* Move the cookies stored under DOMAIN in the snapshot, if any, into
+   the chains.  */
+
+static void
+snapshot_load_domain (struct cookie_jar *jar, const char *domain)
+{
+  const struct snapshot_header *hdr;
+  const struct cookie_snapshot_record *records;
+  uint32_t lo, hi, mid, end;
+  const char *d;
+
+  if (!jar->snapshot)
+    return;
+
+  hdr = (const struct snapshot_header *) jar->snapshot->content;
+  records = SNAPSHOT_RECORDS (jar->snapshot);
+
+  /* Find the first record of DOMAIN. */
+  lo = 0;
+  hi = hdr->count;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      d = snapshot_string (jar->snapshot, records[mid].domain);
+      if (d && c_strcasecmp (d, domain) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  for (end = lo; end < hdr->count; end++)
+    {
+      d = snapshot_string (jar->snapshot, records[end].domain);
+      if (!d || c_strcasecmp (d, domain) != 0)
+        break;
+    }
+  if (end > lo)
+    snapshot_load_records (jar, lo, end);
+}
+
+/* Move the cookies of every domain that HOST can receive cookies
+   from into the chains.  */
+
+static void
+snapshot_load_host (struct cookie_jar *jar, const char *host)
+{
+  int passes, passcnt;
+
+  if (!jar->snapshot)
+    return;
+
+  /* Walk the same domains as find_chains_of_host. */
+  passes = numeric_address_p (host) ? 1 : count_char (host, '.');
+  for (passcnt = 0; ; host = strchr (host, '.') + 1)
+    {
+      snapshot_load_domain (jar, host);
+      if (++passcnt >= passes)
+        break;
+    }
+}
+
+/* Drop the snapshot.  If LOAD is true, the cookies that have not been
+   looked up yet are moved into the chains first.  */
+
+static void
+snapshot_release (struct cookie_jar *jar, bool load)
+{
+  const struct snapshot_header *hdr;
+  const struct cookie_snapshot_record *records;
+  uint32_t lo, hi;
+
+  if (!jar->snapshot)
+    return;
+
+  hdr = (const struct snapshot_header *) jar->snapshot->content;
+  records = SNAPSHOT_RECORDS (jar->snapshot);
+
+  for (lo = 0; load && lo < hdr->count; lo = hi)
+    {
+      const char *d = snapshot_string (jar->snapshot, records[lo].domain);
+      for (hi = lo + 1; hi < hdr->count; hi++)
+        {
+          const char *d2 = snapshot_string (jar->snapshot, records[hi].domain);
+          if (!d || !d2 || c_strcasecmp (d, d2) != 0)
+            break;
+        }
+      snapshot_load_records (jar, lo, hi);
+    }
+
+  wget_read_file_free (jar->snapshot);
+  jar->snapshot = NULL;
+  xfree (jar->loaded);
+}
+
 /* Functions for storing cookies.
 
    All cookies can be reached beginning with jar->chains.  The key in
@@ -180,6 +600,7 @@ find_matching_cookie (struct cookie_jar *jar, struct cookie *cookie,
 {
   struct cookie *chain, *prev;
 
+  snapshot_load_domain (jar, cookie->domain);
   chain = hash_table_get (jar->chains, cookie->domain);
   if (!chain)
     goto nomatch;
@@ -214,6 +635,7 @@ store_cookie (struct cookie_jar *jar, struct cookie *cookie)
   struct cookie *chain_head;
   char *chain_key;
 
+  snapshot_load_domain (jar, cookie->domain);
   if (hash_table_get_pair (jar->chains, cookie->domain,
                            &chain_key, &chain_head))
     {
@@ -239,8 +661,8 @@ store_cookie (struct cookie_jar *jar, struct cookie *cookie)
                  all we need to do is:  */
               cookie->next = victim->next;
             }
+          unindex_cookie (jar, victim);
           delete_cookie (victim);
-          --jar->cookie_count;
           DEBUGP (("Deleted old cookie (to be replaced.)\n"));
         }
       else
@@ -258,7 +680,7 @@ store_cookie (struct cookie_jar *jar, struct cookie *cookie)
     }
 
   hash_table_put (jar->chains, chain_key, cookie);
-  ++jar->cookie_count;
+  index_cookie (jar, cookie);
 
   IF_DEBUG
     {
@@ -280,48 +702,77 @@ store_cookie (struct cookie_jar *jar, struct cookie *cookie)
    former corresponds to netscape cookie spec, while the latter is
    specified by rfc2109.  */
 
+/* Unlink VICTIM, whose predecessor in its chain is PREV (NULL if
+   VICTIM is the head), from JAR and delete it.  */
+
+static void
+remove_cookie (struct cookie_jar *jar, struct cookie *victim,
+               struct cookie *prev)
+{
+  if (prev)
+    /* Simply unchain the victim. */
+    prev->next = victim->next;
+  else
+    {
+      /* VICTIM was head of its chain.  We need to place a new
+         cookie at the head.  */
+      char *chain_key = NULL;
+      int res;
+
+      res = hash_table_get_pair (jar->chains, victim->domain,
+                                 &chain_key, NULL);
+
+      if (res == 0)
+        {
+          logprintf (LOG_VERBOSE, _("Unable to get cookie for %s\n"),
+                     victim->domain);
+        }
+      if (!victim->next)
+        {
+          /* VICTIM was the only cookie in the chain.  Destroy the
+             chain and deallocate the chain key.  */
+          hash_table_remove (jar->chains, victim->domain);
+          xfree (chain_key);
+        }
+      else
+        hash_table_put (jar->chains, chain_key, victim->next);
+    }
+  unindex_cookie (jar, victim);
+  delete_cookie (victim);
+}
+
 static void
 discard_matching_cookie (struct cookie_jar *jar, struct cookie *cookie)
 {
   struct cookie *prev, *victim;
 
-  if (!hash_table_count (jar->chains))
+  if (JAR_EMPTY_P (jar))
     /* No elements == nothing to discard. */
     return;
 
   victim = find_matching_cookie (jar, cookie, &prev);
   if (victim)
     {
-      if (prev)
-        /* Simply unchain the victim. */
-        prev->next = victim->next;
-      else
-        {
-          /* VICTIM was head of its chain.  We need to place a new
-             cookie at the head.  */
-          char *chain_key = NULL;
-          int res;
+      remove_cookie (jar, victim, prev);
+      DEBUGP (("Discarded old cookie.\n"));
+    }
+}
 
-          res = hash_table_get_pair (jar->chains, victim->domain,
-                                     &chain_key, NULL);
+/* Remove the cookies that have expired by cookies_now from JAR.  */
 
-          if (res == 0)
-            {
-              logprintf (LOG_VERBOSE, _("Unable to get cookie for %s\n"),
-                         victim->domain);
-            }
-          if (!victim->next)
-            {
-              /* VICTIM was the only cookie in the chain.  Destroy the
-                 chain and deallocate the chain key.  */
-              hash_table_remove (jar->chains, victim->domain);
-              xfree (chain_key);
-            }
-          else
-            hash_table_put (jar->chains, chain_key, victim->next);
-        }
-      delete_cookie (victim);
-      DEBUGP (("Discarded old cookie.\n"));
+static void
+discard_expired_cookies (struct cookie_jar *jar)
+{
+  while (jar->heap_count && cookie_expired_p (jar->heap[0]))
+    {
+      struct cookie *victim = jar->heap[0];
+      struct cookie *chain = hash_table_get (jar->chains, victim->domain);
+      struct cookie *prev = NULL;
+
+      for (; chain != victim; prev = chain, chain = chain->next)
+        assert (chain != NULL);
+      remove_cookie (jar, victim, prev);
+      DEBUGP (("Discarded expired cookie.\n"));
     }
 }
 
@@ -821,7 +1272,7 @@ find_chains_of_host (struct cookie_jar *jar, const char *host,
   int passes, passcnt;
 
   /* Bail out quickly if there are no cookies in the jar.  */
-  if (!hash_table_count (jar->chains))
+  if (JAR_EMPTY_P (jar))
     return 0;
 
   if (numeric_address_p (host))
@@ -841,7 +1292,9 @@ find_chains_of_host (struct cookie_jar *jar, const char *host,
      srk.fer.hr's, then fer.hr's.  */
   while (1)
     {
-      struct cookie *chain = hash_table_get (jar->chains, host);
+      struct cookie *chain;
+      snapshot_load_domain (jar, host);
+      chain = hash_table_get (jar->chains, host);
       if (chain)
         dest[dest_count++] = chain;
       if (++passcnt >= passes)
@@ -1003,15 +1456,11 @@ goodness_comparator (const void *p1, const void *p2)
   return dgdiff ? dgdiff : pgdiff;
 }
 
-/* Generate a `Cookie' header for a request that goes to HOST:PORT and
-   requests PATH from the server.  The resulting string is allocated
-   with `malloc', and the caller is responsible for freeing it.  If no
-   cookies pertain to this request, i.e. no cookie header should be
-   generated, NULL is returned.  */
+/* Build the `Cookie' header for cookie_header, which see.  */
 
-char *
-cookie_header (struct cookie_jar *jar, const char *host,
-               int port, const char *path, bool secflag)
+static char *
+build_cookie_header (struct cookie_jar *jar, const char *host,
+                     int port, const char *path, bool secflag)
 {
   struct cookie **chains;
   int chain_count;
@@ -1021,7 +1470,6 @@ cookie_header (struct cookie_jar *jar, const char *host,
   int count, i, ocnt;
   char *result;
   int result_size, pos;
-  PREPEND_SLASH (path);         /* see cookie_handle_set_cookie */
 
   /* First, find the cookie chains whose domains match HOST. */
 
@@ -1035,8 +1483,6 @@ cookie_header (struct cookie_jar *jar, const char *host,
   if (!chain_count)
     return NULL;
 
-  cookies_now = time (NULL);
-
   /* Now extract from the chains those cookies that match our host
      (for domain_exact cookies), port (for cookies with port other
      than PORT_ANY), etc.  See matching_cookie for details.  */
@@ -1115,6 +1561,54 @@ cookie_header (struct cookie_jar *jar, const char *host,
   return result;
 }
 
+/* Maximum number of generated headers kept by the jar.  */
+#define MAX_CACHED_HEADERS 4096
+
+/* Generate a `Cookie' header for a request that goes to HOST:PORT and
+   requests PATH from the server.  The resulting string is allocated
+   with `malloc', and the caller is responsible for freeing it.  If no
+   cookies pertain to this request, i.e. no cookie header should be
+   generated, NULL is returned.  */
+
+char *
+cookie_header (struct cookie_jar *jar, const char *host,
+               int port, const char *path, bool secflag)
+{
+  char *key, *header;
+  int prefix_len;
+  PREPEND_SLASH (path);         /* see cookie_handle_set_cookie */
+
+  /* Bail out quickly if there are no cookies in the jar.  */
+  if (JAR_EMPTY_P (jar))
+    return NULL;
+
+  cookies_now = time (NULL);
+  /* The path trie must know the paths of all cookies HOST can get. */
+  snapshot_load_host (jar, host);
+  discard_expired_cookies (jar);
+
+  /* No cookie path is a prefix of PATH, so no cookie matches. */
+  prefix_len = longest_cookie_path (jar, path);
+  if (prefix_len < 0)
+    return NULL;
+
+  key = aprintf ("%s %d %d %.*s", host, port, (int) secflag,
+                 prefix_len, path);
+  header = hash_table_get (jar->headers, key);
+  if (header)
+    {
+      xfree (key);
+      /* An empty string records that no cookies matched. */
+      return *header ? xstrdup (header) : NULL;
+    }
+
+  header = build_cookie_header (jar, host, port, path, secflag);
+  if (hash_table_count (jar->headers) >= MAX_CACHED_HEADERS)
+    forget_headers (jar);
+  hash_table_put (jar->headers, key, xstrdup (header ? header : ""));
+  return header;
+}
+
 /* Support for loading and saving cookies.  The format used for
    loading and saving should be the format of the `cookies.txt' file
    used by Netscape and Mozilla, at least the Unix versions.
@@ -1183,8 +1677,29 @@ cookie_jar_load (struct cookie_jar *jar, const char *file)
 {
   char *line = NULL;
   size_t bufsize = 0;
+  struct file_memory *fm;
+  FILE *fp;
 
-  FILE *fp = fopen (file, "r");
+  /* A binary snapshot is kept mapped, and its cookies are brought in
+     one domain at a time as the domains are looked up.  Text jars are
+     told apart by their first bytes, so that they are not read twice.  */
+  if (file_is_snapshot_p (file, COOKIE_SNAPSHOT_MAGIC))
+    {
+      fm = wget_read_file (file);
+      if (fm && snapshot_valid_p (fm, COOKIE_SNAPSHOT_MAGIC,
+                                  sizeof (struct cookie_snapshot_record)))
+        {
+          cookies_now = time (NULL);
+          snapshot_release (jar, true);
+          jar->snapshot = fm;
+          jar->loaded = xcalloc (1, ((struct snapshot_header *) fm->content)->count + 1);
+          return;
+        }
+      if (fm)
+        wget_read_file_free (fm);
+    }
+
+  fp = fopen (file, "r");
   if (!fp)
     {
       logprintf (LOG_NOTQUIET, _("Cannot open cookies file %s: %s\n"),
@@ -1293,6 +1808,101 @@ cookie_jar_load (struct cookie_jar *jar, const char *file)
   fclose (fp);
 }
 
+/* Whether COOKIE should be written out by cookie_jar_save. */
+
+static bool
+cookie_saved_p (const struct cookie *cookie)
+{
+  return (cookie->permanent || opt.keep_session_cookies)
+    && !cookie_expired_p (cookie);
+}
+
+static int
+chain_key_cmp (const void *p1, const void *p2)
+{
+  return c_strcasecmp (*(char * const *) p1, *(char * const *) p2);
+}
+
+/* Save cookies to FILE as a binary snapshot. */
+
+static void
+cookie_jar_save_snapshot (struct cookie_jar *jar, const char *file)
+{
+  hash_table_iterator iter;
+  char **domains;
+  int domain_count = 0, i;
+  size_t count = 0, strings_size = 0, size;
+  struct snapshot_header *hdr;
+  struct cookie_snapshot_record *r;
+  char *buf, *strings;
+
+#define ADD_STRING(off, str) do {                       \
+  size_t len_ = strlen (str) + 1;                       \
+  memcpy (strings + strings_size, str, len_);           \
+  (off) = strings_size;                                 \
+  strings_size += len_;                                 \
+} while (0)
+
+  /* Size everything up, and sort the domains. */
+  domains = xnew_array (char *, hash_table_count (jar->chains) + 1);
+  for (hash_table_iterate (jar->chains, &iter); hash_table_iter_next (&iter); )
+    {
+      struct cookie *cookie = iter.value;
+      domains[domain_count++] = iter.key;
+      strings_size += strlen (iter.key) + 1;
+      for (; cookie; cookie = cookie->next)
+        if (cookie_saved_p (cookie))
+          {
+            ++count;
+            strings_size += strlen (cookie->path) + strlen (cookie->attr)
+              + strlen (cookie->value) + 3;
+          }
+    }
+  qsort (domains, domain_count, sizeof (*domains), chain_key_cmp);
+
+  size = sizeof (*hdr) + count * sizeof (*r) + strings_size;
+  buf = xcalloc (1, size);
+  hdr = (struct snapshot_header *) buf;
+  memcpy (hdr->magic, COOKIE_SNAPSHOT_MAGIC, sizeof (hdr->magic));
+  hdr->byte_order = SNAPSHOT_BYTE_ORDER;
+  hdr->count = count;
+  hdr->strings_size = strings_size;
+  r = (struct cookie_snapshot_record *) (buf + sizeof (*hdr));
+  strings = (char *) (r + count);
+
+  strings_size = 0;
+  for (i = 0; i < domain_count; i++)
+    {
+      struct cookie *cookie = hash_table_get (jar->chains, domains[i]);
+      uint32_t domain_off;
+
+      ADD_STRING (domain_off, domains[i]);
+      for (; cookie; cookie = cookie->next)
+        {
+          if (!cookie_saved_p (cookie))
+            continue;
+          r->domain = domain_off;
+          ADD_STRING (r->path, cookie->path);
+          ADD_STRING (r->attr, cookie->attr);
+          ADD_STRING (r->value, cookie->value);
+          r->port = cookie->port;
+          r->flags = (cookie->secure ? SNAPSHOT_SECURE : 0)
+            | (cookie->domain_exact ? SNAPSHOT_DOMAIN_EXACT : 0)
+            | (cookie->permanent ? SNAPSHOT_PERMANENT : 0);
+          r->expiry_time = cookie->expiry_time;
+          ++r;
+        }
+    }
+#undef ADD_STRING
+
+  if (!wget_replace_file (file, buf, size))
+    logprintf (LOG_NOTQUIET, _("Error writing to %s: %s\n"),
+               quote (file), strerror (errno));
+
+  xfree (domains);
+  xfree (buf);
+}
+
 /* Save cookies, in format described above, to FILE. */
 
 void
@@ -1304,6 +1914,19 @@ cookie_jar_save (struct cookie_jar *jar, const char *file)
   DEBUGP (("Saving cookies to %s.\n", file));
 
   cookies_now = time (NULL);
+  snapshot_release (jar, true);
+
+  if (opt.binary_snapshots)
+    {
+      cookie_jar_save_snapshot (jar, file);
+      DEBUGP (("Done saving cookies.\n"));
+      return;
+    }
+
+  /* Other processes may have a snapshot at FILE mapped.  Unlink it
+     instead of truncating it under them.  */
+  if (file_is_snapshot_p (file, COOKIE_SNAPSHOT_MAGIC))
+    unlink (file);
 
   fp = fopen (file, "w");
   if (!fp)
@@ -1325,9 +1948,7 @@ cookie_jar_save (struct cookie_jar *jar, const char *file)
       struct cookie *cookie = iter.value;
       for (; cookie; cookie = cookie->next)
         {
-          if (!cookie->permanent && !opt.keep_session_cookies)
-            continue;
-          if (cookie_expired_p (cookie))
+          if (!cookie_saved_p (cookie))
             continue;
           if (!cookie->domain_exact)
             fputc ('.', fp);
@@ -1361,6 +1982,8 @@ cookie_jar_delete (struct cookie_jar *jar)
 {
   /* Iterate over chains (indexed by domain) and free them. */
   hash_table_iterator iter;
+
+  snapshot_release (jar, false);
   for (hash_table_iterate (jar->chains, &iter); hash_table_iter_next (&iter); )
     {
       struct cookie *chain = iter.value;
@@ -1374,6 +1997,10 @@ cookie_jar_delete (struct cookie_jar *jar)
         }
     }
   hash_table_destroy (jar->chains);
+  forget_headers (jar);
+  hash_table_destroy (jar->headers);
+  xfree (jar->heap);
+  xfree (jar->path_nodes);
   xfree (jar);
 }
 
@@ -1463,3 +2090,75 @@ test_cookies (void)
     }
 }
 #endif /* TEST_COOKIES */
+
+#ifdef TESTING
+
+/* Whether the Cookie header JAR makes for HOST and PATH (which, as in
+   a struct url, has no leading slash) is EXPECTED, or NULL.  */
+
+static bool
+cookie_header_is (struct cookie_jar *jar, const char *host, const char *path,
+                  const char *expected)
+{
+  char *header = cookie_header (jar, host, 80, path, false);
+  bool result = expected ? header && !strcmp (header, expected) : !header;
+  xfree (header);
+  return result;
+}
+
+const char *
+test_cookie_snapshot (void)
+{
+  char *file = aprintf ("%s/.wget-cookie-test", home_dir ());
+  bool binary = opt.binary_snapshots;
+  struct cookie_jar *jar = cookie_jar_new ();
+
+  cookie_handle_set_cookie (jar, "foo.com", 80, "", "a=1; Max-Age=3600");
+  cookie_handle_set_cookie (jar, "bar.com", 80, "x/",
+                            "b=2; Max-Age=3600; Path=/x");
+  cookie_handle_set_cookie (jar, "baz.com", 80, "", "c=3");
+
+  opt.binary_snapshots = true;
+  cookie_jar_save (jar, file);
+  opt.binary_snapshots = binary;
+  cookie_jar_delete (jar);
+
+  jar = cookie_jar_new ();
+  cookie_jar_load (jar, file);
+  mu_assert ("The jar should have been loaded as a snapshot",
+             jar->snapshot != NULL);
+  mu_assert ("No domain should have been loaded yet",
+             hash_table_count (jar->chains) == 0);
+  mu_assert ("Wrong cookies for foo.com",
+             cookie_header_is (jar, "foo.com", "", "a=1"));
+  mu_assert ("Only the domain looked up should have been loaded",
+             hash_table_count (jar->chains) == 1);
+  mu_assert ("Wrong cookies for bar.com/x/y",
+             cookie_header_is (jar, "bar.com", "x/y", "b=2"));
+  mu_assert ("Wrong cookies for bar.com/y",
+             cookie_header_is (jar, "bar.com", "y", NULL));
+  mu_assert ("A session cookie should not have been saved",
+             cookie_header_is (jar, "baz.com", "", NULL));
+  mu_assert ("Both saved domains should have been loaded",
+             hash_table_count (jar->chains) == 2);
+
+  /* Save the jar loaded from the snapshot as text, and load that.  */
+  cookie_jar_save (jar, file);
+  cookie_jar_delete (jar);
+  jar = cookie_jar_new ();
+  cookie_jar_load (jar, file);
+  mu_assert ("The jar should have been loaded as text",
+             jar->snapshot == NULL);
+  mu_assert ("Wrong cookies for foo.com",
+             cookie_header_is (jar, "foo.com", "", "a=1"));
+  mu_assert ("Wrong cookies for bar.com/x/y",
+             cookie_header_is (jar, "bar.com", "x/y", "b=2"));
+
+  cookie_jar_delete (jar);
+  unlink (file);
+  xfree (file);
+
+  return NULL;
+}
+
+#endif /* TESTING */
@@ -0,0 +1,414 @@
+/* Deduplication of identical downloaded files.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+/* With --dedup, the body of every file is hashed with SHA-256 as it is
+   downloaded.  The digests of the files downloaded so far are indexed,
+   and a file whose digest is already there is replaced by a link to
+   the earlier copy: a reflink, where the file system can clone files,
+   or a hard link.  With --dedup-index, the index is also kept on disk,
+   so that files can be linked to those of earlier runs.
+
+   An entry of the index is only used if the file it points to still
+   has the size and time it had when it was indexed.  Files changed
+   since, for instance by --convert-links, are not linked to.  */
+
+#include "wget.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_LINUX_FS_H
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+
+#include "utils.h"
+#include "hash.h"
+#include "dedup.h"
+#ifdef TESTING
+#include "test.h"
+#include "init.h"                /* for home_dir */
+#endif
+
+struct dedup_entry {
+  char *file;                   /* the first copy */
+  wgint size;                   /* its size and time when indexed */
+  time_t mtime;
+};
+
+/* The files downloaded, indexed by the hex digest of their contents. */
+static struct hash_table *dedup_index;
+
+/* Whether DEDUP_INDEX differs from what opt.dedup_index holds. */
+static bool dedup_index_changed;
+
+int dedup_linked_files;
+SUM_SIZE_INT dedup_saved_bytes;
+
+static void
+dedup_index_put (const char *digest, const char *file, wgint size,
+                 time_t mtime)
+{
+  struct dedup_entry *e, *old;
+  char *old_digest;
+
+  e = xnew (struct dedup_entry);
+  e->file = xstrdup (file);
+  e->size = size;
+  e->mtime = mtime;
+
+  if (hash_table_get_pair (dedup_index, digest, &old_digest, &old))
+    {
+      xfree (old->file);
+      xfree (old);
+      hash_table_put (dedup_index, old_digest, e);
+    }
+  else
+    hash_table_put (dedup_index, xstrdup (digest), e);
+  dedup_index_changed = true;
+}
+
+/* Read the index saved in opt.dedup_index.  A missing file is not an
+   error.  */
+
+static void
+dedup_index_load (void)
+{
+  struct file_memory *fm;
+  const char *p, *end;
+
+  if (!file_exists_p (opt.dedup_index))
+    return;
+  fm = wget_read_file (opt.dedup_index);
+  if (!fm)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 opt.dedup_index, strerror (errno));
+      return;
+    }
+
+  for (p = fm->content, end = p + fm->length; p < end; )
+    {
+      const char *eol = memchr (p, '\n', end - p);
+      char *line, *size_beg, *tail;
+      wgint size;
+      long mtime;
+
+      if (!eol)
+        eol = end;
+      line = strdupdelim (p, eol);
+      p = eol + 1;
+
+      /* Lines look like "DIGEST SIZE MTIME FILE". */
+      if (*line == '#' || !*line)
+        goto next;
+      size_beg = strchr (line, ' ');
+      if (!size_beg || size_beg - line != 2 * SHA256_DIGEST_SIZE)
+        goto malformed;
+      *size_beg++ = '\0';
+      size = str_to_wgint (size_beg, &tail, 10);
+      if (tail == size_beg || *tail != ' ')
+        goto malformed;
+      mtime = strtol (tail + 1, &tail, 10);
+      if (*tail != ' ' || !tail[1])
+        goto malformed;
+      dedup_index_put (line, tail + 1, size, mtime);
+      goto next;
+
+    malformed:
+      logprintf (LOG_NOTQUIET, _("%s: ignoring malformed index entry.\n"),
+                 opt.dedup_index);
+    next:
+      xfree (line);
+    }
+
+  wget_read_file_free (fm);
+  dedup_index_changed = false;
+  DEBUGP (("Loaded %d digests from %s.\n",
+           hash_table_count (dedup_index), opt.dedup_index));
+}
+
+/* Make TMP a copy of SRC which shares its storage, with the mode of
+   DST_ST.  */
+
+static bool
+link_copy (const char *src, const char *tmp, const struct_stat *dst_st)
+{
+  if (opt.dedup == dedup_reflink)
+    {
+#ifdef FICLONE
+      int sfd, dfd;
+      bool ok;
+
+      sfd = open (src, O_RDONLY);
+      if (sfd < 0)
+        return false;
+      dfd = open (tmp, O_WRONLY | O_CREAT | O_EXCL, dst_st->st_mode & 0777);
+      if (dfd < 0)
+        {
+          close (sfd);
+          return false;
+        }
+      ok = ioctl (dfd, FICLONE, sfd) == 0;
+      close (sfd);
+      close (dfd);
+      if (!ok)
+        unlink (tmp);
+      return ok;
+#else
+      errno = ENOSYS;
+      return false;
+#endif
+    }
+#ifdef HAVE_LINK
+  return link (src, tmp) == 0;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+/* Replace FILE, just downloaded, by a link to the earlier copy E of the
+   same contents.  */
+
+static bool
+dedup_link (const char *file, const struct_stat *st,
+            const struct dedup_entry *e)
+{
+  char *tmp = aprintf ("%s.%ld.dedup", file, (long) getpid ());
+  bool ok = link_copy (e->file, tmp, st);
+
+  if (ok)
+    {
+      /* A reflink is a file of its own, which gets FILE's time.  */
+      if (opt.dedup == dedup_reflink)
+        touch (tmp, st->st_mtime);
+      ok = rename (tmp, file) == 0;
+    }
+  if (!ok)
+    {
+      DEBUGP (("Cannot link %s to %s: %s\n", file, e->file,
+               strerror (errno)));
+      unlink (tmp);
+    }
+  xfree (tmp);
+  return ok;
+}
+
+/* Look up the DIGEST of FILE, which has just been downloaded, in the
+   index.  If an earlier file has the same contents, replace FILE by a
+   link to it; otherwise, index FILE.  */
+
+void
+dedup_file (const char *file, const unsigned char *digest)
+{
+  char hex[2 * SHA256_DIGEST_SIZE + 1];
+  struct dedup_entry *e;
+  struct_stat st, est;
+
+  if (!dedup_index)
+    {
+      dedup_index = make_string_hash_table (0);
+      if (opt.dedup_index)
+        dedup_index_load ();
+    }
+
+  wg_hex_to_string (hex, (const char *) digest, SHA256_DIGEST_SIZE);
+  if (stat (file, &st) != 0)
+    return;
+
+  e = hash_table_get (dedup_index, hex);
+  if (e && strcmp (e->file, file) != 0
+      && stat (e->file, &est) == 0 && S_ISREG (est.st_mode)
+      && est.st_size == e->size && est.st_mtime == e->mtime
+      && est.st_size == st.st_size)
+    {
+      if (est.st_dev == st.st_dev && est.st_ino == st.st_ino)
+        return;                 /* already linked */
+      /* Hard links share one time, so linking files that the server
+         gave different times would make -N miss the updates of one of
+         them.  */
+      if (opt.dedup == dedup_hardlink && est.st_mtime != st.st_mtime)
+        return;
+      if (est.st_dev == st.st_dev && dedup_link (file, &st, e))
+        {
+          logprintf (LOG_VERBOSE, _("%s is identical to %s -- linked.\n"),
+                     quote_n (0, file), quote_n (1, e->file));
+          ++dedup_linked_files;
+          dedup_saved_bytes += st.st_size;
+        }
+      return;
+    }
+
+  /* The digest is new, or its earlier copy has changed or gone.  */
+  dedup_index_put (hex, file, st.st_size, st.st_mtime);
+}
+
+/* Write the index to opt.dedup_index, if it has changed. */
+
+void
+dedup_index_save (void)
+{
+  hash_table_iterator iter;
+  char *tmp;
+  FILE *fp;
+  bool ok;
+
+  if (!dedup_index || !dedup_index_changed)
+    return;
+
+  tmp = aprintf ("%s.%ld.tmp", opt.dedup_index, (long) getpid ());
+  fp = fopen (tmp, "w");
+  if (!fp)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 tmp, strerror (errno));
+      xfree (tmp);
+      return;
+    }
+
+  fputs ("# Wget deduplication index.  Edit at your own risk.\n", fp);
+  for (hash_table_iterate (dedup_index, &iter); hash_table_iter_next (&iter); )
+    {
+      struct dedup_entry *e = iter.value;
+      fprintf (fp, "%s %s %ld %s\n", (char *) iter.key,
+               number_to_static_string (e->size), (long) e->mtime, e->file);
+    }
+
+  ok = !ferror (fp);
+  if (fclose (fp) == EOF)
+    ok = false;
+#ifdef WINDOWS
+  /* rename() does not replace existing files on Windows.  */
+  if (ok)
+    unlink (opt.dedup_index);
+#endif
+  if (ok && rename (tmp, opt.dedup_index) != 0)
+    ok = false;
+  if (!ok)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot write to %s: %s\n"),
+                 opt.dedup_index, strerror (errno));
+      unlink (tmp);
+    }
+  xfree (tmp);
+}
+
+#ifdef TESTING
+
+static void
+dedup_forget (void)
+{
+  hash_table_iterator iter;
+
+  for (hash_table_iterate (dedup_index, &iter); hash_table_iter_next (&iter); )
+    {
+      struct dedup_entry *e = iter.value;
+      xfree (iter.key);
+      xfree (e->file);
+      xfree (e);
+    }
+  hash_table_destroy (dedup_index);
+  dedup_index = NULL;
+  dedup_index_changed = false;
+}
+
+static bool
+write_test_file (const char *file, const char *contents)
+{
+  FILE *fp = fopen (file, "w");
+  if (!fp)
+    return false;
+  fputs (contents, fp);
+  return fclose (fp) == 0;
+}
+
+const char *
+test_dedup (void)
+{
+  static const unsigned char digest[SHA256_DIGEST_SIZE] = { 1, 2, 3 };
+  static const char *contents[] = { "same", "same", "longer", "same" };
+  char *files[countof (contents)];
+  struct_stat st[countof (contents)];
+  int saved_dedup = opt.dedup;
+  char *saved_index = opt.dedup_index;
+  FILE *fp;
+  int i;
+
+  for (i = 0; i < countof (files); i++)
+    {
+      files[i] = aprintf ("%s/.wget-dedup-test-%d", home_dir (), i);
+      mu_assert ("Could not create the dedup test files",
+                 write_test_file (files[i], contents[i]));
+      touch (files[i], i < 3 ? 1000 : 2000);
+    }
+
+  opt.dedup = dedup_hardlink;
+  opt.dedup_index = NULL;
+  for (i = 0; i < countof (files); i++)
+    dedup_file (files[i], digest);
+
+  for (i = 0; i < countof (files); i++)
+    stat (files[i], &st[i]);
+#ifdef HAVE_LINK
+  mu_assert ("An identical file should have been linked",
+             st[0].st_ino == st[1].st_ino && dedup_linked_files == 1);
+#endif
+  mu_assert ("A file of another size should not have been linked",
+             st[2].st_ino != st[0].st_ino && st[2].st_size == 6);
+  mu_assert ("A file of another time should not have been hard-linked",
+             st[3].st_ino != st[0].st_ino && st[3].st_mtime == 2000);
+
+  /* Appending to a link, as -c does, must leave the other name alone.  */
+  fp = fopen_output (files[1], true);
+  mu_assert ("Could not append to a linked file", fp != NULL);
+  fputs ("more", fp);
+  fclose (fp);
+  mu_assert ("Appending to a link should not change the file linked to",
+             stat (files[0], &st[0]) == 0 && st[0].st_size == 4
+             && stat (files[1], &st[1]) == 0 && st[1].st_size == 8);
+
+  dedup_forget ();
+  dedup_linked_files = 0;
+  dedup_saved_bytes = 0;
+  for (i = 0; i < countof (files); i++)
+    {
+      unlink (files[i]);
+      xfree (files[i]);
+    }
+  opt.dedup = saved_dedup;
+  opt.dedup_index = saved_index;
+
+  return NULL;
+}
+#endif
@@ -0,0 +1,450 @@
+/* Event loop for the network descriptors.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+
+/* Wget's sockets are non-blocking.  Rather than waiting on one
+   descriptor at a time with select, the code in connect.c, and the
+   TLS transports through it, ask this event loop to call them back
+   when a descriptor becomes ready, and run the loop until it does.
+   Any number of descriptors and timers can be pending at once, so
+   several connections can make progress from the one thread.
+
+   Watches are one-shot: once a descriptor is reported ready, it must
+   be watched again to be reported again.  This matches the way the
+   descriptors are used, i.e. waited for only after an operation on
+   them would have blocked, and keeps idle connections from waking the
+   loop up.  The loop uses epoll where it is available, and select
+   everywhere else.  */
+
+#include "wget.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#else
+# include <sys/select.h>
+#endif
+
+#include "utils.h"
+#include "ptimer.h"
+#include "evloop.h"
+
+#ifdef WINDOWS
+# include "mswindows.h"
+#endif
+
+struct watcher {
+  evloop_callback callback;     /* NULL when not watched */
+  void *arg;
+  int events;                   /* EVLOOP_READ and/or EVLOOP_WRITE */
+  bool added;                   /* whether the descriptor is in the
+                                   epoll set */
+};
+
+/* The watchers, indexed by descriptor. */
+static struct watcher *watchers;
+static int watchers_size;
+
+struct evloop_timer {
+  double when;                  /* deadline, on the loop's clock */
+  evloop_timer_callback callback;
+  void *arg;
+  struct evloop_timer *next;
+};
+
+/* The pending timers, earliest first. */
+static struct evloop_timer *timers;
+
+static struct ptimer *loop_clock;
+
+#ifdef HAVE_SYS_EPOLL_H
+static int epoll_fd = -1;
+
+/* The most descriptors reported by one call to epoll_wait. */
+# define EPOLL_BATCH 16
+#endif
+
+static double
+evloop_now (void)
+{
+  if (!loop_clock)
+    loop_clock = ptimer_new ();
+  return ptimer_measure (loop_clock);
+}
+
+static struct watcher *
+get_watcher (int fd)
+{
+  if (fd >= watchers_size)
+    {
+      int size = watchers_size ? watchers_size : 16;
+      while (size <= fd)
+        size <<= 1;
+      watchers = xrealloc (watchers, size * sizeof *watchers);
+      memset (watchers + watchers_size, 0,
+              (size - watchers_size) * sizeof *watchers);
+      watchers_size = size;
+    }
+  return &watchers[fd];
+}
+
+/* Arrange for CALLBACK to be called with ARG once FD is ready for
+   EVENTS, the next time the loop is run.  Returns false if FD cannot
+   be watched.  */
+
+bool
+evloop_watch (int fd, int events, evloop_callback callback, void *arg)
+{
+  struct watcher *w = get_watcher (fd);
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+  int op;
+
+  if (epoll_fd < 0)
+    {
+# ifdef EPOLL_CLOEXEC
+      epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+# else
+      epoll_fd = epoll_create (EPOLL_BATCH);
+# endif
+      if (epoll_fd < 0)
+        return false;
+    }
+
+  xzero (ev);
+  ev.events = EPOLLONESHOT;
+  if (events & EVLOOP_READ)
+    ev.events |= EPOLLIN;
+  if (events & EVLOOP_WRITE)
+    ev.events |= EPOLLOUT;
+  ev.data.fd = fd;
+
+  /* A descriptor that was closed and reopened without evloop_forget
+     has left the set, and one inherited from elsewhere may be in it
+     already; try the other operation in these cases.  */
+  op = w->added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl (epoll_fd, op, fd, &ev) < 0)
+    {
+      if (errno == ENOENT)
+        op = EPOLL_CTL_ADD;
+      else if (errno == EEXIST)
+        op = EPOLL_CTL_MOD;
+      else
+        return false;
+      if (epoll_ctl (epoll_fd, op, fd, &ev) < 0)
+        return false;
+    }
+  w->added = true;
+#else  /* not HAVE_SYS_EPOLL_H */
+  if (fd >= FD_SETSIZE)
+    {
+      errno = EINVAL;
+      return false;
+    }
+#endif /* not HAVE_SYS_EPOLL_H */
+
+  w->callback = callback;
+  w->arg = arg;
+  w->events = events;
+  return true;
+}
+
+/* Stop watching FD.  */
+
+void
+evloop_unwatch (int fd)
+{
+  /* An event still armed in the epoll set is ignored when it comes,
+     which also disarms it.  */
+  if (fd < watchers_size)
+    watchers[fd].callback = NULL;
+}
+
+/* Forget about FD, which is about to be closed.  */
+
+void
+evloop_forget (int fd)
+{
+  if (fd < 0 || fd >= watchers_size)
+    return;
+#ifdef HAVE_SYS_EPOLL_H
+  if (watchers[fd].added && epoll_fd >= 0)
+    {
+      struct epoll_event ev;    /* needed by kernels before 2.6.9 */
+      epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+    }
+#endif
+  xzero (watchers[fd]);
+}
+
+/* Arrange for CALLBACK to be called with ARG once SECONDS have
+   elapsed, the next time the loop is run.  */
+
+struct evloop_timer *
+evloop_timer_add (double seconds, evloop_timer_callback callback, void *arg)
+{
+  struct evloop_timer *t = xnew (struct evloop_timer);
+  struct evloop_timer **p = &timers;
+
+  t->when = evloop_now () + seconds;
+  t->callback = callback;
+  t->arg = arg;
+  while (*p && (*p)->when <= t->when)
+    p = &(*p)->next;
+  t->next = *p;
+  *p = t;
+  return t;
+}
+
+/* Cancel timer T, which hasn't expired yet.  */
+
+void
+evloop_timer_cancel (struct evloop_timer *t)
+{
+  struct evloop_timer **p;
+
+  for (p = &timers; *p; p = &(*p)->next)
+    if (*p == t)
+      {
+        *p = t->next;
+        xfree (t);
+        return;
+      }
+}
+
+/* Call back the watcher of FD, which is ready. */
+
+static int
+dispatch (int fd)
+{
+  struct watcher *w;
+  evloop_callback callback;
+
+  if (fd < 0 || fd >= watchers_size || !watchers[fd].callback)
+    return 0;
+  w = &watchers[fd];
+  callback = w->callback;
+  w->callback = NULL;
+  callback (fd, w->events, w->arg);
+  return 1;
+}
+
+/* Wait for at most TIMEOUT seconds, or until a timer expires, for
+   watched descriptors to become ready, and call back the ones that
+   did and the expired timers.  A negative TIMEOUT means no limit, and
+   a zero one doesn't wait at all.  Returns the number of callbacks
+   made, or -1 on error.  */
+
+int
+evloop_run_once (double timeout)
+{
+  int count = 0, n, i;
+  double now = evloop_now ();
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event events[EPOLL_BATCH];
+  int msecs;
+#else
+  fd_set rd, wr;
+  struct timeval tmout;
+  int maxfd = -1;
+#endif
+
+  if (timers)
+    {
+      double until = timers->when - now;
+      if (until < 0)
+        until = 0;
+      if (timeout < 0 || until < timeout)
+        timeout = until;
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (timeout < 0)
+    msecs = -1;
+  else if (timeout >= INT_MAX / 1000)
+    msecs = INT_MAX;
+  else
+    /* Round up, so that timers don't fire a little early. */
+    msecs = (int) (timeout * 1000 + 0.999);
+
+  if (epoll_fd < 0)
+    {
+      /* Nothing was ever watched: just wait for the timers. */
+      if (msecs > 0)
+        xsleep (timeout);
+      n = 0;
+    }
+  else
+    n = epoll_wait (epoll_fd, events, countof (events), msecs);
+  if (n < 0 && errno != EINTR)
+    return -1;
+  for (i = 0; i < n; i++)
+    count += dispatch (events[i].data.fd);
+#else  /* not HAVE_SYS_EPOLL_H */
+  FD_ZERO (&rd);
+  FD_ZERO (&wr);
+  for (i = 0; i < watchers_size; i++)
+    if (watchers[i].callback)
+      {
+        if (watchers[i].events & EVLOOP_READ)
+          FD_SET (i, &rd);
+        if (watchers[i].events & EVLOOP_WRITE)
+          FD_SET (i, &wr);
+        maxfd = i;
+      }
+  if (timeout >= 0)
+    {
+      tmout.tv_sec = (long) timeout;
+      tmout.tv_usec = 1000000 * (timeout - (long) timeout);
+    }
+  n = select (maxfd + 1, &rd, &wr, NULL, timeout < 0 ? NULL : &tmout);
+  if (n < 0 && errno != EINTR)
+    return -1;
+  for (i = 0; n > 0 && i <= maxfd; i++)
+    if (FD_ISSET (i, &rd) || FD_ISSET (i, &wr))
+      {
+#ifdef WINDOWS
+        /* gnulib select() converts blocking sockets to nonblocking in
+           windows.  wget uses blocking sockets there, so we must
+           convert them back to blocking.  */
+        set_windows_fd_as_blocking_socket (i);
+#endif
+        count += dispatch (i);
+      }
+#endif /* not HAVE_SYS_EPOLL_H */
+
+  now = evloop_now ();
+  while (timers && timers->when <= now)
+    {
+      struct evloop_timer *t = timers;
+      timers = t->next;
+      t->callback (t->arg);
+      xfree (t);
+      ++count;
+    }
+  return count;
+}
+
+static void
+wait_fd_ready (int fd _GL_UNUSED, int events _GL_UNUSED, void *arg)
+{
+  *(bool *) arg = true;
+}
+
+static void
+wait_fd_expired (void *arg)
+{
+  *(bool *) arg = true;
+}
+
+/* Run the loop until FD is ready for EVENTS, for at most TIMEOUT
+   seconds.  A negative TIMEOUT means no limit, and a zero one only
+   checks whether FD is ready.  Returns 1 if FD is ready, 0 on
+   timeout, and -1 on error.  This is what the blocking interface of
+   connect.c is built upon.  */
+
+int
+evloop_wait_fd (int fd, int events, double timeout)
+{
+  struct evloop_timer *timer = NULL;
+  bool ready = false, expired = false;
+
+  if (!evloop_watch (fd, events, wait_fd_ready, &ready))
+    return -1;
+
+  if (timeout == 0)
+    {
+      if (evloop_run_once (0) < 0)
+        {
+          evloop_unwatch (fd);
+          return -1;
+        }
+    }
+  else
+    {
+      if (timeout > 0)
+        timer = evloop_timer_add (timeout, wait_fd_expired, &expired);
+      while (!ready && !expired)
+        if (evloop_run_once (-1) < 0)
+          {
+            if (timer)
+              evloop_timer_cancel (timer);
+            evloop_unwatch (fd);
+            return -1;
+          }
+      if (timer && !expired)
+        evloop_timer_cancel (timer);
+    }
+
+  if (!ready)
+    evloop_unwatch (fd);
+  return ready ? 1 : 0;
+}
+
+/* Drop the state inherited from the parent in a child process, which
+   would otherwise share the parent's epoll set.  */
+
+void
+evloop_after_fork (void)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  if (epoll_fd >= 0)
+    close (epoll_fd);
+  epoll_fd = -1;
+#endif
+  if (watchers)
+    memset (watchers, 0, watchers_size * sizeof *watchers);
+}
+
+/* Free the event loop's resources.  */
+
+void
+evloop_cleanup (void)
+{
+  while (timers)
+    {
+      struct evloop_timer *t = timers;
+      timers = t->next;
+      xfree (t);
+    }
+  xfree (watchers);
+  watchers_size = 0;
+#ifdef HAVE_SYS_EPOLL_H
+  if (epoll_fd >= 0)
+    close (epoll_fd);
+  epoll_fd = -1;
+#endif
+  if (loop_clock)
+    ptimer_destroy (loop_clock);
+  loop_clock = NULL;
+}
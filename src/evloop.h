@@ -0,0 +1,60 @@
+/* Declarations for evloop.c.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+/* Readiness conditions a descriptor can be watched for. */
+enum {
+  EVLOOP_READ = 1,
+  EVLOOP_WRITE = 2
+};
+
+/* Called with the descriptor and the conditions it was watched for
+   once it is ready for them (or has an error pending).  */
+typedef void (*evloop_callback) (int, int, void *);
+typedef void (*evloop_timer_callback) (void *);
+
+struct evloop_timer;
+
+bool evloop_watch (int, int, evloop_callback, void *);
+void evloop_unwatch (int);
+void evloop_forget (int);
+
+struct evloop_timer *evloop_timer_add (double, evloop_timer_callback, void *);
+void evloop_timer_cancel (struct evloop_timer *);
+
+int evloop_run_once (double);
+int evloop_wait_fd (int, int, double);
+
+void evloop_after_fork (void);
+void evloop_cleanup (void);
+
+#endif /* EVLOOP_H */
@@ -46,6 +46,39 @@ as that of the covered work.  */
 #include "c-strcase.h"
 
 
+/* Read one line of a server response from FD, strip the trailing
+   CRLF and log it.  Returns NULL if the line could not be read.  */
+
+static char *
+ftp_response_line (int fd)
+{
+  char *p;
+  char *line = fd_read_line (fd);
+  if (!line)
+    return NULL;
+
+  /* Strip trailing CRLF before printing the line, so that
+     quotting doesn't include bogus \012 and \015. */
+  p = strchr (line, '\0');
+  if (p > line && p[-1] == '\n')
+    *--p = '\0';
+  if (p > line && p[-1] == '\r')
+    *--p = '\0';
+
+  if (opt.server_response)
+    logprintf (LOG_NOTQUIET, "%s\n",
+               quotearg_style (escape_quoting_style, line));
+  else
+    DEBUGP (("%s\n", quotearg_style (escape_quoting_style, line)));
+  return line;
+}
+
+/* Whether LINE is the last line of a response, i.e. begins with "ddd ".  */
+#define LAST_RESPONSE_LINE_P(line) (c_isdigit ((line)[0])              \
+                                    && c_isdigit ((line)[1])           \
+                                    && c_isdigit ((line)[2])           \
+                                    && (line)[3] == ' ')
+
 /* Get the response of FTP server and allocate enough room to handle
    it.  <CR> and <LF> characters are stripped from the line, and the
    line is 0-terminated.  All the response lines but the last one are
@@ -60,28 +93,12 @@ ftp_response (int fd, char **ret_line)
 {
   while (1)
     {
-      char *p;
-      char *line = fd_read_line (fd);
+      char *line = ftp_response_line (fd);
       if (!line)
         return FTPRERR;
 
-      /* Strip trailing CRLF before printing the line, so that
-         quotting doesn't include bogus \012 and \015. */
-      p = strchr (line, '\0');
-      if (p > line && p[-1] == '\n')
-        *--p = '\0';
-      if (p > line && p[-1] == '\r')
-        *--p = '\0';
-
-      if (opt.server_response)
-        logprintf (LOG_NOTQUIET, "%s\n",
-                   quotearg_style (escape_quoting_style, line));
-      else
-        DEBUGP (("%s\n", quotearg_style (escape_quoting_style, line)));
-
       /* The last line of output is the one that begins with "ddd ". */
-      if (c_isdigit (line[0]) && c_isdigit (line[1]) && c_isdigit (line[2])
-          && line[3] == ' ')
+      if (LAST_RESPONSE_LINE_P (line))
         {
           *ret_line = line;
           return FTPOK;
@@ -947,10 +964,12 @@ ftp_retr (int csock, const char *file)
 }
 
 /* Sends the LIST command to the server.  If FILE is NULL, send just
-   `LIST' (no space).  */
+   `LIST' (no space).  If USE_MLSD is true, try MLSD first, and fall
+   back to LIST if the server refuses it; *MLSD_USED tells whether the
+   listing that follows is in MLSD format.  */
 uerr_t
 ftp_list (int csock, const char *file, bool avoid_list_a, bool avoid_list,
-          bool *list_a_used)
+          bool use_mlsd, bool *list_a_used, bool *mlsd_used)
 {
   char *request, *respline;
   int nwritten;
@@ -965,13 +984,17 @@ ftp_list (int csock, const char *file, bool avoid_list_a, bool avoid_list,
      If somebody changes the following commands, please, checks also the
      later "i" variable.  */
   static const char *list_commands[] = {
+    "MLSD",
     "LIST -a",
     "LIST"
   };
 
   *list_a_used = false;
+  *mlsd_used = false;
 
-  if (avoid_list_a)
+  if (!use_mlsd)
+    i = 1;
+  if (avoid_list_a && i == 1)
     {
       i = countof (list_commands)- 1;
       DEBUGP (("(skipping \"LIST -a\")"));
@@ -1001,7 +1024,8 @@ ftp_list (int csock, const char *file, bool avoid_list_a, bool avoid_list,
             err = FTPOK;
             ok = true;
             /* Which list command was used? */
-            *list_a_used = (i == 0);
+            *mlsd_used = (i == 0);
+            *list_a_used = (i == 1);
           }
         else
           {
@@ -1010,7 +1034,13 @@ ftp_list (int csock, const char *file, bool avoid_list_a, bool avoid_list,
         xfree (respline);
       }
     ++i;
-    if ((avoid_list) && (i == 1))
+    if ((avoid_list_a) && (i == 1))
+      {
+        /* I skip "LIST -a" */
+        ++i;
+        DEBUGP (("(skipping \"LIST -a\")"));
+      }
+    if ((avoid_list) && (i == 2))
       {
         /* I skip LIST */
         ++i;
@@ -1021,6 +1051,53 @@ ftp_list (int csock, const char *file, bool avoid_list_a, bool avoid_list,
   return err;
 }
 
+/* Sends the FEAT command to the server (RFC 2389), and sets *FEATURES
+   to the extensions it advertises that we know how to use.  Servers
+   that don't understand FEAT simply get no features.  */
+uerr_t
+ftp_feat (int csock, int *features)
+{
+  char *request, *line;
+  int nwritten;
+  bool first = true;
+
+  *features = 0;
+
+  /* Send FEAT request.  */
+  request = ftp_request ("FEAT", NULL);
+  nwritten = fd_write (csock, request, strlen (request), -1);
+  if (nwritten < 0)
+    {
+      xfree (request);
+      return WRITEFAILED;
+    }
+  xfree (request);
+
+  /* The response is "211-" followed by one feature per line, each
+     indented by a space, and a closing "211 " line.  */
+  while ((line = ftp_response_line (csock)) != NULL)
+    {
+      if (LAST_RESPONSE_LINE_P (line))
+        {
+          uerr_t err = (first && *line == '5') ? FTPSRVERR : FTPOK;
+          xfree (line);
+          return err;
+        }
+      if (line[0] == ' ')
+        {
+          char *feature = line + 1;
+          size_t len = strcspn (feature, " ");
+
+          /* MLST implies MLSD (RFC 3659, section 7.8).  */
+          if (len == 4 && !c_strncasecmp (feature, "MLST", 4))
+            *features |= FEAT_MLSD;
+        }
+      first = false;
+      xfree (line);
+    }
+  return FTPRERR;
+}
+
 /* Sends the SYST command to the server. */
 uerr_t
 ftp_syst (int csock, enum stype *server_type, enum ustype *unix_type)
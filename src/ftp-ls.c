@@ -83,18 +83,50 @@ clean_line (char *line, int len)
   return len;
 }
 
-/* Convert the Un*x-ish style directory listing stored in FILE to a
+/* A directory listing held in memory, consumed one line at a time by
+   the parsers below.  */
+struct listing_reader {
+  const char *buf;
+  size_t len;
+  size_t pos;
+};
+
+/* Copy the next line of RD, including its terminating newline, into
+   *LINE, growing it as needed like getline does.  Returns the length
+   of the line, or -1 when the listing is exhausted.  */
+static int
+listing_getline (char **line, size_t *bufsize, struct listing_reader *rd)
+{
+  const char *start, *nl;
+  size_t len;
+
+  if (rd->pos >= rd->len)
+    return -1;
+  start = rd->buf + rd->pos;
+  nl = memchr (start, '\n', rd->len - rd->pos);
+  len = nl ? (size_t) (nl - start) + 1 : rd->len - rd->pos;
+  if (len + 1 > *bufsize)
+    {
+      *bufsize = len + 1;
+      *line = xrealloc (*line, *bufsize);
+    }
+  memcpy (*line, start, len);
+  (*line)[len] = '\0';
+  rd->pos += len;
+  return len;
+}
+
+/* Convert the Un*x-ish style directory listing read from RD to a
    linked list of fileinfo (system-independent) entries.  The contents
-   of FILE are considered to be produced by the standard Unix `ls -la'
+   of the listing are considered to be produced by the standard Unix `ls -la'
    output (whatever that might be).  BSD (no group) and SYSV (with
    group) listings are handled.
 
    The time stamps are stored in a separate variable, time_t
    compatible (I hope).  The timezones are ignored.  */
 static struct fileinfo *
-ftp_parse_unix_ls (const char *file, int ignore_perms)
+ftp_parse_unix_ls (struct listing_reader *rd, int ignore_perms)
 {
-  FILE *fp;
   static const char *months[] = {
     "Jan", "Feb", "Mar", "Apr", "May", "Jun",
     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
@@ -109,16 +141,10 @@ ftp_parse_unix_ls (const char *file, int ignore_perms)
   char *line = NULL, *tok, *ptok;      /* tokenizer */
   struct fileinfo *dir, *l, cur;       /* list creation */
 
-  fp = fopen (file, "rb");
-  if (!fp)
-    {
-      logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
-      return NULL;
-    }
   dir = l = NULL;
 
   /* Line loop to end of file: */
-  while ((len = getline (&line, &bufsize, fp)) > 0)
+  while ((len = listing_getline (&line, &bufsize, rd)) > 0)
     {
       len = clean_line (line, len);
       /* Skip if total...  */
@@ -415,14 +441,12 @@ ftp_parse_unix_ls (const char *file, int ignore_perms)
     }
 
   xfree (line);
-  fclose (fp);
   return dir;
 }
 
 static struct fileinfo *
-ftp_parse_winnt_ls (const char *file)
+ftp_parse_winnt_ls (struct listing_reader *rd)
 {
-  FILE *fp;
   int len;
   int year, month, day;         /* for time analysis */
   int hour, min;
@@ -433,16 +457,10 @@ ftp_parse_winnt_ls (const char *file)
   char *filename;
   struct fileinfo *dir, *l, cur; /* list creation */
 
-  fp = fopen (file, "rb");
-  if (!fp)
-    {
-      logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
-      return NULL;
-    }
   dir = l = NULL;
 
   /* Line loop to end of file: */
-  while ((len = getline (&line, &bufsize, fp)) > 0)
+  while ((len = listing_getline (&line, &bufsize, rd)) > 0)
     {
       len = clean_line (line, len);
 
@@ -563,15 +581,143 @@ ftp_parse_winnt_ls (const char *file)
     }
 
   xfree (line);
-  fclose(fp);
   return dir;
 }
 
 
+/* Parse the value of the "modify" fact of an MLSD listing, a UTC time
+   of the form YYYYMMDDHHMMSS[.sss].  Returns -1 if it is malformed.  */
+static time_t
+mlsd_parse_time (const char *value)
+{
+  struct tm t;
+  int i;
+
+  for (i = 0; i < 14; i++)
+    if (!c_isdigit (value[i]))
+      return -1;
+
+  xzero (t);
+  sscanf (value, "%4d%2d%2d%2d%2d%2d", &t.tm_year, &t.tm_mon, &t.tm_mday,
+          &t.tm_hour, &t.tm_min, &t.tm_sec);
+  t.tm_year -= 1900;
+  t.tm_mon -= 1;
+  return timegm (&t);
+}
+
+/* Convert the machine-readable listing sent in reply to MLSD (RFC
+   3659, section 7) to a linked list of fileinfo entries.  Each line
+   is a series of "fact=value;" pairs, a single space, and the file
+   name, so unlike the `ls' parsers above this needs no guessing: the
+   sizes are exact and the time stamps are in UTC.  */
+static struct fileinfo *
+ftp_parse_mlsd_ls (struct listing_reader *rd)
+{
+  int len;
+  size_t bufsize = 0;
+  char *line = NULL, *facts, *fact, *name;
+  struct fileinfo *dir, *l, cur;
+  bool have_perms, skip;
+
+  dir = l = NULL;
+
+  while ((len = listing_getline (&line, &bufsize, rd)) > 0)
+    {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+
+      name = strchr (line, ' ');
+      if (!name || !name[1])
+        {
+          DEBUGP (("Skipping malformed MLSD line %s\n", quote (line)));
+          continue;
+        }
+      *name++ = '\0';
 
-/* Convert the VMS-style directory listing stored in "file" to a
+      xzero (cur);
+      cur.type = FT_UNKNOWN;
+      cur.tstamp = -1;
+      cur.ptype = TT_HOUR_MIN;
+      have_perms = skip = false;
+
+      for (facts = line; (fact = strtok (facts, ";")) != NULL; facts = NULL)
+        {
+          char *value = strchr (fact, '=');
+          if (!value)
+            continue;
+          *value++ = '\0';
+
+          if (!c_strcasecmp (fact, "type"))
+            {
+              if (!c_strcasecmp (value, "file"))
+                cur.type = FT_PLAINFILE;
+              else if (!c_strcasecmp (value, "dir"))
+                cur.type = FT_DIRECTORY;
+              else if (!c_strcasecmp (value, "cdir")
+                       || !c_strcasecmp (value, "pdir"))
+                /* The directory itself and its parent.  */
+                skip = true;
+              else if (!c_strncasecmp (value, "OS.unix=slink", 13)
+                       || !c_strncasecmp (value, "OS.unix=symlink", 15))
+                {
+                  /* Some servers append ":target" to the type.  */
+                  char *target = strchr (value, ':');
+                  cur.type = FT_SYMLINK;
+                  if (target && target[1])
+                    {
+                      xfree (cur.linkto);
+                      cur.linkto = xstrdup (target + 1);
+                    }
+                }
+            }
+          else if (!c_strcasecmp (fact, "size"))
+            cur.size = str_to_wgint (value, NULL, 10);
+          else if (!c_strcasecmp (fact, "modify"))
+            cur.tstamp = mlsd_parse_time (value);
+          else if (!c_strcasecmp (fact, "UNIX.mode"))
+            {
+              cur.perms = strtol (value, NULL, 8) & 07777;
+              have_perms = true;
+            }
+        }
+
+      if (skip)
+        {
+          xfree (cur.linkto);
+          continue;
+        }
+      if (!have_perms)
+        cur.perms = cur.type == FT_DIRECTORY ? 0755 : 0644;
+      cur.name = xstrdup (name);
+      DEBUGP (("MLSD: %s, type %d, size %s, time %ld\n", quote (cur.name),
+               (int) cur.type, number_to_static_string (cur.size),
+               (long) cur.tstamp));
+
+      /* And put everything into the linked list */
+      if (!dir)
+        {
+          l = dir = xnew (struct fileinfo);
+          memcpy (l, &cur, sizeof (cur));
+          l->prev = l->next = NULL;
+        }
+      else
+        {
+          cur.prev = l;
+          l->next = xnew (struct fileinfo);
+          l = l->next;
+          memcpy (l, &cur, sizeof (cur));
+          l->next = NULL;
+        }
+    }
+
+  xfree (line);
+  return dir;
+}
+
+
+/* Convert the VMS-style directory listing read from RD to a
    linked list of fileinfo (system-independent) entries.  The contents
-   of FILE are considered to be produced by the standard VMS
+   of the listing are considered to be produced by the standard VMS
    "DIRECTORY [/SIZE [= ALL]] /DATE [/OWNER] [/PROTECTION]" command,
    more or less.  (Different VMS FTP servers may have different headers,
    and may not supply the same data, but all should be subsets of this.)
@@ -678,9 +824,8 @@ static void eat_carets( char *str)
 
 
 static struct fileinfo *
-ftp_parse_vms_ls (const char *file)
+ftp_parse_vms_ls (struct listing_reader *rd)
 {
-  FILE *fp;
   int dt, i, j, len;
   int perms;
   size_t bufsize = 0;
@@ -691,17 +836,11 @@ ftp_parse_vms_ls (const char *file)
   char *line = NULL, *tok; /* tokenizer */
   struct fileinfo *dir, *l, cur; /* list creation */
 
-  fp = fopen (file, "r");
-  if (!fp)
-    {
-      logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
-      return NULL;
-    }
   dir = l = NULL;
 
   /* Skip blank lines, Directory heading, and more blank lines. */
 
-  for (j = 0; (i = getline (&line, &bufsize, fp)) > 0; )
+  for (j = 0; (i = listing_getline (&line, &bufsize, rd)) > 0; )
     {
       i = clean_line (line, i);
       if (i <= 0)
@@ -819,7 +958,7 @@ ftp_parse_vms_ls (const char *file)
       if (tok == NULL)
         {
           DEBUGP (("Getting additional line.\n"));
-          i = getline (&line, &bufsize, fp);
+          i = listing_getline (&line, &bufsize, rd);
           if (i <= 0)
             {
               DEBUGP (("EOF.  Leaving listing parser.\n"));
@@ -991,7 +1130,7 @@ ftp_parse_vms_ls (const char *file)
           l->next = NULL;
         }
 
-      i = getline (&line, &bufsize, fp);
+      i = listing_getline (&line, &bufsize, rd);
       if (i > 0)
         {
           i = clean_line (line, i);
@@ -1004,7 +1143,6 @@ ftp_parse_vms_ls (const char *file)
     }
 
   xfree (line);
-  fclose (fp);
   return dir;
 }
 
@@ -1013,46 +1151,61 @@ ftp_parse_vms_ls (const char *file)
    the SYSTEM_TYPE. The system type should be based on the result of the
    "SYST" response of the FTP server. According to this repsonse we will
    use on of the three different listing parsers that cover the most of FTP
-   servers used nowadays.  */
+   servers used nowadays.  The listing itself is the LEN bytes at BUF.  */
 
 struct fileinfo *
-ftp_parse_ls (const char *file, const enum stype system_type)
+ftp_parse_ls_mem (const char *buf, size_t len, const enum stype system_type)
 {
+  struct listing_reader rd;
+
+  rd.buf = buf;
+  rd.len = len;
+  rd.pos = 0;
+
   switch (system_type)
     {
     case ST_UNIX:
-      return ftp_parse_unix_ls (file, 0);
+      return ftp_parse_unix_ls (&rd, 0);
     case ST_WINNT:
-      {
-        /* Detect whether the listing is simulating the UNIX format */
-        FILE *fp;
-        int   c;
-        fp = fopen (file, "rb");
-        if (!fp)
-        {
-          logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
-          return NULL;
-        }
-        c = fgetc(fp);
-        fclose(fp);
-        /* If the first character of the file is '0'-'9', it's WINNT
-           format. */
-        if (c >= '0' && c <='9')
-          return ftp_parse_winnt_ls (file);
-        else
-          return ftp_parse_unix_ls (file, 1);
-      }
+      /* Detect whether the listing is simulating the UNIX format.  If
+         the first character of the listing is '0'-'9', it's WINNT
+         format. */
+      if (len > 0 && buf[0] >= '0' && buf[0] <= '9')
+        return ftp_parse_winnt_ls (&rd);
+      else
+        return ftp_parse_unix_ls (&rd, 1);
     case ST_VMS:
-      return ftp_parse_vms_ls (file);
+      return ftp_parse_vms_ls (&rd);
     case ST_MACOS:
-      return ftp_parse_unix_ls (file, 1);
+      return ftp_parse_unix_ls (&rd, 1);
+    case ST_MLSD:
+      return ftp_parse_mlsd_ls (&rd);
     default:
       logprintf (LOG_NOTQUIET, _("\
 Unsupported listing type, trying Unix listing parser.\n"));
-      return ftp_parse_unix_ls (file, 0);
+      return ftp_parse_unix_ls (&rd, 0);
     }
 }
 
+/* Like ftp_parse_ls_mem, but parse the listing stored in FILE.  */
+
+struct fileinfo *
+ftp_parse_ls (const char *file, const enum stype system_type)
+{
+  struct file_memory *fm;
+  struct fileinfo *dir;
+
+  fm = wget_read_file (file);
+  if (!fm)
+    {
+      logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
+      return NULL;
+    }
+  dir = ftp_parse_ls_mem (fm->content, fm->length, system_type);
+  wget_read_file_free (fm);
+  return dir;
+}
+
 /* Stuff for creating FTP index. */
 
 /* The function creates an HTML index containing references to given
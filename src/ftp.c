@@ -50,12 +50,20 @@ as that of the covered work.  */
 #include "convert.h"            /* for downloaded_file */
 #include "recur.h"              /* for INFINITE_RECURSION */
 #include "warc.h"
+#include "uring.h"
+#include "exits.h"
 #include "c-strcase.h"
 
 #ifdef __VMS
 # include "vms.h"
 #endif /* def __VMS */
 
+/* Parallel retrieval needs fork.  */
+#if !defined(WINDOWS) && !defined(MSDOS) && !defined(__VMS)
+# include <sys/wait.h>
+# define ENABLE_FTP_WORKERS
+#endif
+
 
 /* File where the "ls -al" listing will be saved.  */
 #ifdef MSDOS
@@ -75,8 +83,22 @@ typedef struct
   char *id;                     /* initial directory */
   char *target;                 /* target file name */
   struct url *proxy;            /* FTWK-style proxy */
+  char *listing;                /* directory listing kept in memory */
+  size_t listing_size;          /* size of the listing */
+  int features;                 /* extensions advertised by FEAT */
+  bool feat_done;               /* whether FEAT was sent on csock */
+  bool mlsd_listing;            /* whether the listing came from MLSD */
 } ccon;
 
+/* Whether the listing being retrieved by CON is kept in memory rather
+   than written to the .listing file.  Only done when the file would be
+   removed right after parsing anyway.  */
+#ifdef HAVE_OPEN_MEMSTREAM
+# define LISTING_IN_MEMORY_P(con) (((con)->cmd & DO_LIST) && opt.remove_listing)
+#else
+# define LISTING_IN_MEMORY_P(con) false
+#endif
+
 
 /* Look for regexp "( *[0-9]+ *byte" (literal parenthesis) anywhere in
    the string S, and return the number converted to wgint, if found, 0
@@ -260,6 +282,8 @@ getftp (struct url *u, wgint passed_expected_bytes, wgint *qtyread,
   char type_char;
   bool try_again;
   bool list_a_used = false;
+  bool mlsd_used = false;
+  bool preallocated = false;
 
   assert (con != NULL);
   assert (con->target != NULL);
@@ -431,6 +455,11 @@ Error in server response, closing control connection.\n"));
           break;
         }
 
+      /* A new connection: the server's extensions are not known yet.
+         They are asked for only when a listing is needed.  */
+      con->features = 0;
+      con->feat_done = false;
+
       /* Fourth: Find the initial ftp directory */
 
       if (!opt.server_response)
@@ -824,6 +853,37 @@ Error in server response, closing control connection.\n"));
       return RETRFINISHED;
     }
 
+  /* Ask for the extensions the server supports, to see whether we
+     can get a machine-readable listing with MLSD.  Done once per
+     control connection, and only when a listing is about to be
+     retrieved.  */
+  if ((cmd & DO_LIST) && opt.ftp_mlsd && !con->feat_done)
+    {
+      if (!opt.server_response)
+        logprintf (LOG_VERBOSE, "==> FEAT ... ");
+      err = ftp_feat (csock, &con->features);
+      switch (err)
+        {
+        case FTPRERR:
+        case WRITEFAILED:
+          logputs (LOG_VERBOSE, "\n");
+          logputs (LOG_NOTQUIET, _("\
+Error in server response, closing control connection.\n"));
+          fd_close (csock);
+          con->csock = -1;
+          return err;
+        case FTPSRVERR:
+          /* FEAT unsupported -- no extensions. */
+        case FTPOK:
+          if (!opt.server_response)
+            logputs (LOG_VERBOSE, _("done.\n"));
+          break;
+        default:
+          abort ();
+        }
+      con->feat_done = true;
+    }
+
   do
   {
   try_again = false;
@@ -1093,12 +1153,23 @@ Error in server response, closing control connection.\n"));
 
   if (cmd & DO_LIST)
     {
+      bool use_mlsd = (con->features & FEAT_MLSD) != 0;
+
       if (!opt.server_response)
-        logputs (LOG_VERBOSE, "==> LIST ... ");
+        logputs (LOG_VERBOSE, use_mlsd ? "==> MLSD ... " : "==> LIST ... ");
       /* As Maciej W. Rozycki (macro@ds2.pg.gda.pl) says, `LIST'
          without arguments is better than `LIST .'; confirmed by
          RFC959.  */
-      err = ftp_list (csock, NULL, con->st&AVOID_LIST_A, con->st&AVOID_LIST, &list_a_used);
+      err = ftp_list (csock, NULL, con->st&AVOID_LIST_A, con->st&AVOID_LIST,
+                      use_mlsd, &list_a_used, &mlsd_used);
+      con->mlsd_listing = mlsd_used;
+      if (use_mlsd && !mlsd_used && err == FTPOK)
+        {
+          /* MLSD was advertised but refused while LIST worked; don't
+             bother with it again on this connection.  */
+          DEBUGP (("MLSD refused, falling back to LIST.\n"));
+          con->features &= ~FEAT_MLSD;
+        }
 
       /* FTPRERR, WRITEFAILED */
       switch (err)
@@ -1175,7 +1246,22 @@ Error in server response, closing control connection.\n"));
      there allows a open failure to be detected immediately, without first
      connecting to the server.)
   */
-  if (!output_stream || con->cmd & DO_LIST)
+  if (LISTING_IN_MEMORY_P (con))
+    {
+      xfree (con->listing);
+      con->listing_size = 0;
+      fp = open_memstream (&con->listing, &con->listing_size);
+      if (!fp)
+        {
+          logprintf (LOG_NOTQUIET, "%s: %s\n", con->target, strerror (errno));
+          fd_close (csock);
+          con->csock = -1;
+          fd_close (dtsock);
+          fd_close (local_sock);
+          return FOPENERR;
+        }
+    }
+  else if (!output_stream || con->cmd & DO_LIST)
     {
 /* On VMS, alter the name as required. */
 #ifdef __VMS
@@ -1236,7 +1322,7 @@ Error in server response, closing control connection.\n"));
               fp = fopen (con->target, "a", FOPEN_OPT_ARGS);
             }
 #else /* def __VMS */
-          fp = fopen (con->target, "ab");
+          fp = fopen_output (con->target, true);
 #endif /* def __VMS [else] */
         }
       else if (opt.noclobber || opt.always_rest || opt.timestamping || opt.dirstruct
@@ -1270,7 +1356,7 @@ Error in server response, closing control connection.\n"));
               fp = fopen (con->target, "w", FOPEN_OPT_ARGS);
             }
 #else /* def __VMS */
-          fp = fopen (con->target, "wb");
+          fp = fopen_output (con->target, false);
 #endif /* def __VMS [else] */
         }
       else
@@ -1313,14 +1399,23 @@ Error in server response, closing control connection.\n"));
   else if (expected_bytes)
     print_length (expected_bytes, restval, false);
 
+  /* Reserve the space of the file that is going to be written.  */
+  if (opt.preallocate && (cmd & DO_RETR) && fp != output_stream
+      && expected_bytes)
+    preallocated = file_preallocate (fp, expected_bytes - restval);
+
   /* Get the contents of the document.  */
   flags = 0;
   if (restval && rest_failed)
     flags |= rb_skip_startpos;
   rd_size = 0;
+  limit_bandwidth_host (u->host);
   res = fd_read_body (con->target, dtsock, fp,
                       expected_bytes ? expected_bytes - restval : 0,
-                      restval, &rd_size, qtyread, &con->dltime, flags, warc_tmp);
+                      restval, &rd_size, qtyread, &con->dltime, flags, warc_tmp,
+                      NULL);
+  if (preallocated)
+    file_trim (fp);
 
   tms = datetime_str (time (NULL));
   tmrate = retr_rate (rd_size, con->dltime);
@@ -1403,7 +1498,29 @@ Error in server response, closing control connection.\n"));
      print it out.  */
   if (con->cmd & DO_LIST)
     {
-      if (opt.server_response)
+      if (opt.server_response && LISTING_IN_MEMORY_P (con))
+        {
+          const char *line = con->listing;
+          const char *end = con->listing + con->listing_size;
+
+          while (line < end)
+            {
+              const char *eol = memchr (line, '\n', end - line);
+              const char *next = eol ? eol + 1 : end;
+              char *copy;
+
+              if (!eol)
+                eol = end;
+              while (eol > line && (eol[-1] == '\n' || eol[-1] == '\r'))
+                --eol;
+              copy = strdupdelim (line, eol);
+              logprintf (LOG_ALWAYS, "%s\n",
+                         quotearg_style (escape_quoting_style, copy));
+              xfree (copy);
+              line = next;
+            }
+        }
+      else if (opt.server_response)
         {
 /* 2005-02-25 SMS.
    Much of this work may already have been done, but repeating it should
@@ -1459,7 +1576,7 @@ Error in server response, closing control connection.\n"));
           ("LIST -a" is used to get also the hidden files)
 
           */
-      if (!(con->st & LIST_AFTER_LIST_A_CHECK_DONE))
+      if (!mlsd_used && !(con->st & LIST_AFTER_LIST_A_CHECK_DONE))
         {
           /* We still have to check "LIST" after the first "LIST -a" to see
              if with "LIST" we get more data than "LIST -a", that means
@@ -1594,7 +1711,8 @@ ftp_loop_internal (struct url *u, struct fileinfo *f, ccon *con, char **local_fi
     }
 
   /* Remove it if it's a link.  */
-  remove_link (con->target);
+  if (!LISTING_IN_MEMORY_P (con))
+    remove_link (con->target);
 
   count = 0;
 
@@ -1674,8 +1792,11 @@ ftp_loop_internal (struct url *u, struct fileinfo *f, ccon *con, char **local_fi
           strcpy (tmp, "        ");
           if (count > 1)
             sprintf (tmp, _("(try:%2d)"), count);
-          logprintf (LOG_VERBOSE, "--%s--  %s\n  %s => %s\n",
-                     tms, hurl, tmp, quote (locf));
+          if (LISTING_IN_MEMORY_P (con))
+            logprintf (LOG_VERBOSE, "--%s--  %s\n", tms, hurl);
+          else
+            logprintf (LOG_VERBOSE, "--%s--  %s\n  %s => %s\n",
+                       tms, hurl, tmp, quote (locf));
 #ifdef WINDOWS
           ws_changetitle (hurl);
 #endif
@@ -1742,14 +1863,22 @@ ftp_loop_internal (struct url *u, struct fileinfo *f, ccon *con, char **local_fi
 
       /* If we get out of the switch above without continue'ing, we've
          successfully downloaded a file.  Remember this fact. */
-      downloaded_file (FILE_DOWNLOADED_NORMALLY, locf);
+      if (!LISTING_IN_MEMORY_P (con))
+        downloaded_file (FILE_DOWNLOADED_NORMALLY, locf);
 
       if (con->st & ON_YOUR_OWN)
         {
           fd_close (con->csock);
           con->csock = -1;
         }
-      if (!opt.spider)
+      if (LISTING_IN_MEMORY_P (con))
+        {
+          /* Nothing was written to LOCF.  */
+          if (!opt.spider)
+            logprintf (LOG_VERBOSE, _("%s (%s) - listing received [%s]\n\n"),
+                       tms, tmrate, number_to_static_string (qtyread));
+        }
+      else if (!opt.spider)
         {
           bool write_to_stdout = (opt.output_document && HYPHENP (opt.output_document));
 
@@ -1761,7 +1890,7 @@ ftp_loop_internal (struct url *u, struct fileinfo *f, ccon *con, char **local_fi
                      write_to_stdout ? "" : quote (locf),
                      number_to_static_string (qtyread));
         }
-      if (!opt.verbose && !opt.quiet)
+      if (!opt.verbose && !opt.quiet && !LISTING_IN_MEMORY_P (con))
         {
           /* Need to hide the password from the URL.  The `if' is here
              so that we don't do the needless allocation every
@@ -1878,9 +2007,13 @@ ftp_get_listing (struct url *u, ccon *con, struct fileinfo **f)
   xfree (con->target);
   con->target = old_target;
 
-  if (err == RETROK)
+  if (err == RETROK && con->listing)
+    /* The listing was kept in memory; there is no file to remove.  */
+    *f = ftp_parse_ls_mem (con->listing, con->listing_size,
+                           con->mlsd_listing ? ST_MLSD : con->rs);
+  else if (err == RETROK)
     {
-      *f = ftp_parse_ls (lf, con->rs);
+      *f = ftp_parse_ls (lf, con->mlsd_listing ? ST_MLSD : con->rs);
       if (opt.remove_listing)
         {
           if (unlink (lf))
@@ -1892,6 +2025,8 @@ ftp_get_listing (struct url *u, ccon *con, struct fileinfo **f)
   else
     *f = NULL;
   xfree (lf);
+  xfree (con->listing);
+  con->listing_size = 0;
   con->cmd &= ~DO_LIST;
   return err;
 }
@@ -1901,6 +2036,443 @@ static uerr_t ftp_retrieve_glob (struct url *, ccon *, int);
 static struct fileinfo *delelement (struct fileinfo *, struct fileinfo **);
 static void freefileinfo (struct fileinfo *f);
 
+/* Set the permissions and the time stamp of the local copy TARGET of
+   F, as requested by the options.  DLTHIS tells whether the file was
+   (supposed to be) retrieved in this run.  */
+static void
+ftp_set_local_attributes (struct fileinfo *f, const char *target, bool dlthis)
+{
+  const char *actual_target = NULL;
+
+  /* 2004-12-15 SMS.
+   * Set permissions _before_ setting the times, as setting the
+   * permissions changes the modified-time, at least on VMS.
+   * Also, use the opt.output_document name here, too, as
+   * appropriate.  (Do the test once, and save the result.)
+   */
+
+  set_local_file (&actual_target, target);
+
+  /* If downloading a plain file, and the user requested it, then
+     set valid (non-zero) permissions. */
+  if (dlthis && (actual_target != NULL) &&
+   (f->type == FT_PLAINFILE) && opt.preserve_perm)
+    {
+      if (f->perms)
+        chmod (actual_target, f->perms);
+      else
+        DEBUGP (("Unrecognized permissions for %s.\n", actual_target));
+    }
+
+  /* Set the time-stamp information to the local file.  Symlinks
+     are not to be stamped because it sets the stamp on the
+     original.  :( */
+  if (actual_target != NULL)
+    {
+      if (opt.useservertimestamps
+          && !(f->type == FT_SYMLINK && !opt.retr_symlinks)
+          && f->tstamp != -1
+          && dlthis
+          && file_exists_p (target))
+        {
+          touch (actual_target, f->tstamp);
+        }
+      else if (f->tstamp == -1)
+        logprintf (LOG_NOTQUIET, _("%s: corrupt time-stamp.\n"),
+                   actual_target);
+    }
+}
+
+/* Errors after which ftp_retrieve_list stops going through the list.  */
+#define FTP_FATAL_ERROR_P(err) ((err) == QUOTEXC || (err) == HOSTERR       \
+                                || (err) == FWRITEERR || (err) == WARC_ERR \
+                                || (err) == WARC_TMP_FOPENERR            \
+                                || (err) == WARC_TMP_FWRITEERR)
+
+#ifdef ENABLE_FTP_WORKERS
+
+/* With --ftp-connections=N, plain files found in a listing are handed
+   to up to N-1 worker processes.  Each worker keeps a logged-in
+   control connection of its own and retrieves the files it is sent
+   one after another, reporting back through a pipe, while this
+   process goes on through the listing and into the directories on
+   the original connection.  Listings, recursion depth and quota
+   checks therefore all stay here; the quota is checked against the
+   files finished so far before each file is handed out.  */
+
+struct ftp_worker {
+  pid_t pid;
+  int job_fd;                   /* write end of the job pipe */
+  int result_fd;                /* read end of the result pipe */
+  char *target;                 /* file being retrieved, NULL if idle */
+};
+
+/* A job is this header, followed by the directory and the file name.  */
+struct ftp_worker_job {
+  wgint size;
+  long tstamp;
+  int perms;
+  enum ftype type;
+  bool force_full_retrieve;
+  size_t dir_len;
+  size_t file_len;
+};
+
+struct ftp_worker_result {
+  uerr_t err;
+  wgint downloaded_bytes;       /* additions to the global totals */
+  int downloaded_files;
+  double download_time;
+};
+
+static struct ftp_worker *ftp_workers;
+static int ftp_workers_count;
+
+/* Whether files should be handed to workers.  Output that has to go
+   to a single stream (-O, WARC) is only produced serially.  */
+static bool
+ftp_workers_enabled_p (void)
+{
+  return opt.ftp_connections > 1 && !opt.output_document
+    && !opt.warc_filename;
+}
+
+/* Read exactly SIZE bytes from FD into BUF.  */
+static bool
+ftp_worker_read (int fd, void *buf, size_t size)
+{
+  char *p = buf;
+
+  while (size > 0)
+    {
+      ssize_t n = read (fd, p, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      p += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* Write SIZE bytes from BUF to FD.  */
+static bool
+ftp_worker_write (int fd, const void *buf, size_t size)
+{
+  const char *p = buf;
+
+  while (size > 0)
+    {
+      ssize_t n = write (fd, p, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      p += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* The main loop of a worker: retrieve the files read from JOB_FD on a
+   connection of its own, described by CON, until JOB_FD is closed.  U
+   is this process' copy of the URL being retrieved.  */
+static void
+ftp_worker_run (struct url *u, ccon *con, int job_fd, int result_fd)
+{
+  struct ftp_worker_job job;
+
+  /* Several progress bars on one terminal would only garble each
+     other.  */
+  opt.show_progress = false;
+
+  while (ftp_worker_read (job_fd, &job, sizeof job))
+    {
+      struct ftp_worker_result r;
+      struct fileinfo f;
+      wgint bytes = total_downloaded_bytes;
+      int files = numurls;
+      double dltime = total_download_time;
+      char *dir = xmalloc (job.dir_len + 1);
+      char *file = xmalloc (job.file_len + 1);
+
+      if (!ftp_worker_read (job_fd, dir, job.dir_len)
+          || !ftp_worker_read (job_fd, file, job.file_len))
+        break;
+      dir[job.dir_len] = '\0';
+      file[job.file_len] = '\0';
+
+      if (strcmp (dir, u->dir))
+        {
+          url_set_dir (u, dir);
+          con->st &= ~DONE_CWD;
+        }
+      url_set_file (u, file);
+
+      xzero (f);
+      f.type = job.type;
+      f.name = file;
+      f.size = job.size;
+      f.tstamp = job.tstamp;
+      f.perms = job.perms;
+
+      con->cmd |= (DO_RETR | LEAVE_PENDING);
+      r.err = ftp_loop_internal (u, &f, con, NULL, job.force_full_retrieve);
+      ftp_set_local_attributes (&f, con->target, true);
+      xfree (con->target);
+
+      r.downloaded_bytes = total_downloaded_bytes - bytes;
+      r.downloaded_files = numurls - files;
+      r.download_time = total_download_time - dltime;
+      logflush ();
+      xfree (dir);
+      xfree (file);
+      if (!ftp_worker_write (result_fd, &r, sizeof r))
+        break;
+    }
+
+  if (con->csock != -1)
+    fd_close (con->csock);
+  logflush ();
+}
+
+/* Start a new worker with a control connection of its own, based on
+   CON.  Returns false if that failed.  */
+static bool
+ftp_worker_spawn (struct url *u, ccon *con)
+{
+  int jobs[2], results[2], i;
+  pid_t pid;
+
+  if (pipe (jobs) < 0)
+    return false;
+  if (pipe (results) < 0)
+    {
+      close (jobs[0]);
+      close (jobs[1]);
+      return false;
+    }
+  /* Don't let the child inherit unwritten log output.  */
+  logflush ();
+  pid = fork ();
+  if (pid < 0)
+    {
+      close (jobs[0]);
+      close (jobs[1]);
+      close (results[0]);
+      close (results[1]);
+      return false;
+    }
+
+  if (pid == 0)
+    {
+      ccon wcon;
+
+      evloop_after_fork ();
+      uring_after_fork ();
+      close (jobs[1]);
+      close (results[0]);
+      /* Let go of the descriptors that belong to this process' parent:
+         its control connection and the other workers' pipes.  */
+      if (con->csock != -1)
+        close (con->csock);
+      for (i = 0; i < ftp_workers_count; i++)
+        {
+          close (ftp_workers[i].job_fd);
+          close (ftp_workers[i].result_fd);
+        }
+
+      xzero (wcon);
+      wcon.csock = -1;
+      wcon.rs = con->rs;
+      wcon.proxy = con->proxy;
+      ftp_worker_run (u, &wcon, jobs[0], results[1]);
+      _exit (0);
+    }
+
+  close (jobs[0]);
+  close (results[1]);
+  ftp_workers[ftp_workers_count].pid = pid;
+  ftp_workers[ftp_workers_count].job_fd = jobs[1];
+  ftp_workers[ftp_workers_count].result_fd = results[0];
+  ftp_workers[ftp_workers_count].target = NULL;
+  ftp_workers_count++;
+  DEBUGP (("Started FTP worker %d.\n", (int) pid));
+  return true;
+}
+
+/* Read the result of the job the worker W has finished and merge it
+   into the totals.  Returns the error the worker reported.  */
+static uerr_t
+ftp_worker_finish (struct ftp_worker *w)
+{
+  struct ftp_worker_result r;
+
+  if (!ftp_worker_read (w->result_fd, &r, sizeof r))
+    {
+      logprintf (LOG_NOTQUIET, _("Worker for %s exited abnormally.\n"),
+                 quote (w->target));
+      r.err = FWRITEERR;
+      r.downloaded_bytes = 0;
+      r.downloaded_files = 0;
+      r.download_time = 0;
+    }
+
+  total_downloaded_bytes += r.downloaded_bytes;
+  numurls += r.downloaded_files;
+  total_download_time += r.download_time;
+  if (r.err == RETROK)
+    downloaded_file (FILE_DOWNLOADED_NORMALLY, w->target);
+  else
+    inform_exit_status (r.err);
+  xfree (w->target);
+  return r.err;
+}
+
+/* Merge the results of the workers that have finished their files,
+   first waiting for one of them if WAIT is true.  Returns a fatal
+   error reported by any of them, RETROK otherwise.  */
+static uerr_t
+ftp_workers_collect (bool wait)
+{
+  uerr_t err = RETROK;
+
+  for (;;)
+    {
+      fd_set fds;
+      struct timeval tmout, *tp = NULL;
+      int i, maxfd = -1, res;
+
+      FD_ZERO (&fds);
+      for (i = 0; i < ftp_workers_count; i++)
+        if (ftp_workers[i].target)
+          {
+            FD_SET (ftp_workers[i].result_fd, &fds);
+            maxfd = MAX (maxfd, ftp_workers[i].result_fd);
+          }
+      if (maxfd < 0)
+        break;
+      if (!wait)
+        {
+          tmout.tv_sec = tmout.tv_usec = 0;
+          tp = &tmout;
+        }
+      res = select (maxfd + 1, &fds, NULL, NULL, tp);
+      if (res < 0 && errno == EINTR)
+        continue;
+      if (res <= 0)
+        break;
+
+      for (i = 0; i < ftp_workers_count; i++)
+        if (ftp_workers[i].target
+            && FD_ISSET (ftp_workers[i].result_fd, &fds))
+          {
+            uerr_t werr = ftp_worker_finish (&ftp_workers[i]);
+            if (FTP_FATAL_ERROR_P (werr))
+              err = werr;
+          }
+      wait = false;
+    }
+  return err;
+}
+
+/* Wait for the workers to finish their files, then stop them.
+   Returns a fatal error reported by any of them, RETROK otherwise.  */
+static uerr_t
+ftp_workers_wait_all (void)
+{
+  uerr_t err = RETROK;
+  int i;
+
+  for (i = 0; i < ftp_workers_count; i++)
+    if (ftp_workers[i].target)
+      {
+        uerr_t werr = ftp_worker_finish (&ftp_workers[i]);
+        if (FTP_FATAL_ERROR_P (werr))
+          err = werr;
+      }
+  for (i = 0; i < ftp_workers_count; i++)
+    {
+      close (ftp_workers[i].job_fd);
+      close (ftp_workers[i].result_fd);
+      while (waitpid (ftp_workers[i].pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+    }
+  ftp_workers_count = 0;
+  xfree (ftp_workers);
+  limit_bandwidth_share (1);
+  return err;
+}
+
+/* Hand F, the file part of U, to an idle worker, starting one or
+   waiting for one to finish if needed.  *ERR is set to a fatal error
+   reported by a worker that finished meanwhile, or to RETROK.
+   Returns false if no worker could take the file, in which case the
+   caller retrieves it itself.  */
+static bool
+ftp_worker_start (struct url *u, struct fileinfo *f, ccon *con,
+                  bool force_full_retrieve, uerr_t *err)
+{
+  struct ftp_worker_job job;
+  struct ftp_worker *w = NULL;
+  int i;
+
+  if (!ftp_workers)
+    {
+      ftp_workers = xnew_array (struct ftp_worker, opt.ftp_connections - 1);
+      /* The workers and this process share the bandwidth limits. */
+      limit_bandwidth_share (opt.ftp_connections);
+    }
+
+  *err = ftp_workers_collect (false);
+  for (;;)
+    {
+      for (i = 0; i < ftp_workers_count && !w; i++)
+        if (!ftp_workers[i].target)
+          w = &ftp_workers[i];
+      if (w)
+        break;
+      if (ftp_workers_count < opt.ftp_connections - 1)
+        {
+          if (!ftp_worker_spawn (u, con))
+            return false;
+          continue;
+        }
+      {
+        uerr_t werr = ftp_workers_collect (true);
+        if (werr != RETROK)
+          *err = werr;
+      }
+    }
+
+  xzero (job);
+  job.size = f->size;
+  job.tstamp = f->tstamp;
+  job.perms = f->perms;
+  job.type = f->type;
+  job.force_full_retrieve = force_full_retrieve;
+  job.dir_len = strlen (u->dir);
+  job.file_len = strlen (f->name);
+  if (!ftp_worker_write (w->job_fd, &job, sizeof job)
+      || !ftp_worker_write (w->job_fd, u->dir, job.dir_len)
+      || !ftp_worker_write (w->job_fd, f->name, job.file_len))
+    return false;
+
+  w->target = url_file_name (u, NULL);
+  DEBUGP (("Handed %s to FTP worker %d.\n", quote (f->name), (int) w->pid));
+  return true;
+}
+
+#else /* not ENABLE_FTP_WORKERS */
+
+# define ftp_workers_enabled_p() false
+# define ftp_workers_collect(wait) RETROK
+# define ftp_workers_wait_all() RETROK
+# define ftp_worker_start(u, f, con, force_full_retrieve, err) false
+
+#endif /* not ENABLE_FTP_WORKERS */
+
 /* Retrieve a list of files given in struct fileinfo linked list.  If
    a file is a symbolic link, do not retrieve it, but rather try to
    set up a similar link on the local disk, if the symlinks are
@@ -1917,7 +2489,7 @@ ftp_retrieve_list (struct url *u, struct fileinfo *f, ccon *con)
   wgint local_size;
   time_t tml;
   bool dlthis; /* Download this (file). */
-  const char *actual_target = NULL;
+  bool handed_out; /* Retrieved by a worker. */
   bool force_full_retrieve = false;
 
   /* Increase the depth.  */
@@ -1951,6 +2523,10 @@ ftp_retrieve_list (struct url *u, struct fileinfo *f, ccon *con)
     {
       char *old_target, *ofile;
 
+      /* Account for the files the workers have finished.  */
+      err = ftp_workers_collect (false);
+      if (err != RETROK)
+        break;
       if (opt.quota && total_downloaded_bytes > opt.quota)
         {
           --depth;
@@ -1965,6 +2541,7 @@ ftp_retrieve_list (struct url *u, struct fileinfo *f, ccon *con)
       err = RETROK;
 
       dlthis = true;
+      handed_out = false;
       if (opt.timestamping && f->type == FT_PLAINFILE)
         {
           struct_stat st;
@@ -2079,8 +2656,11 @@ Already have correct symlink %s -> %s\n\n"),
                        quote (f->name));
           break;
         case FT_PLAINFILE:
-          /* Call the retrieve loop.  */
-          if (dlthis)
+          /* Call the retrieve loop, here or in a worker.  */
+          if (dlthis && ftp_workers_enabled_p ())
+            handed_out = ftp_worker_start (u, f, con, force_full_retrieve,
+                                           &err);
+          if (dlthis && !handed_out)
             err = ftp_loop_internal (u, f, con, NULL, force_full_retrieve);
           break;
         case FT_UNKNOWN:
@@ -2090,43 +2670,9 @@ Already have correct symlink %s -> %s\n\n"),
         }       /* switch */
 
 
-      /* 2004-12-15 SMS.
-       * Set permissions _before_ setting the times, as setting the
-       * permissions changes the modified-time, at least on VMS.
-       * Also, use the opt.output_document name here, too, as
-       * appropriate.  (Do the test once, and save the result.)
-       */
-
-      set_local_file (&actual_target, con->target);
-
-      /* If downloading a plain file, and the user requested it, then
-         set valid (non-zero) permissions. */
-      if (dlthis && (actual_target != NULL) &&
-       (f->type == FT_PLAINFILE) && opt.preserve_perm)
-        {
-          if (f->perms)
-            chmod (actual_target, f->perms);
-          else
-            DEBUGP (("Unrecognized permissions for %s.\n", actual_target));
-        }
-
-      /* Set the time-stamp information to the local file.  Symlinks
-         are not to be stamped because it sets the stamp on the
-         original.  :( */
-      if (actual_target != NULL)
-        {
-          if (opt.useservertimestamps
-              && !(f->type == FT_SYMLINK && !opt.retr_symlinks)
-              && f->tstamp != -1
-              && dlthis
-              && file_exists_p (con->target))
-            {
-              touch (actual_target, f->tstamp);
-            }
-          else if (f->tstamp == -1)
-            logprintf (LOG_NOTQUIET, _("%s: corrupt time-stamp.\n"),
-                       actual_target);
-        }
+      /* A worker sets the attributes of the files it retrieves.  */
+      if (!handed_out)
+        ftp_set_local_attributes (f, con->target, dlthis);
 
       xfree (con->target);
       con->target = old_target;
@@ -2135,9 +2681,7 @@ Already have correct symlink %s -> %s\n\n"),
       xfree (ofile);
 
       /* Break on fatals.  */
-      if (err == QUOTEXC || err == HOSTERR || err == FWRITEERR
-          || err == WARC_ERR || err == WARC_TMP_FOPENERR
-          || err == WARC_TMP_FWRITEERR)
+      if (FTP_FATAL_ERROR_P (err))
         break;
       con->cmd &= ~ (DO_CWD | DO_LOGIN);
       f = f->next;
@@ -2489,6 +3033,13 @@ ftp_loop (struct url *u, char **local_file, int *dt, struct url *proxy,
       else
         res = ftp_loop_internal (u, NULL, &con, local_file, false);
     }
+  /* Wait for the files still being retrieved by workers.  */
+  if (ftp_workers_enabled_p ())
+    {
+      uerr_t werr = ftp_workers_wait_all ();
+      if (werr != RETROK && (res == RETROK || res == FTPOK))
+        res = werr;
+    }
   if (res == FTPOK)
     res = RETROK;
   if (res == RETROK)
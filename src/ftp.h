@@ -42,7 +42,15 @@ enum stype
   ST_WINNT,
   ST_MACOS,
   ST_OS400,
-  ST_OTHER
+  ST_OTHER,
+  ST_MLSD                   /* Not reported by SYST: selects the
+                               parser for MLSD listings.  */
+};
+
+/* Extensions advertised in the FEAT response.  */
+enum wget_ftp_feature
+{
+  FEAT_MLSD     = 0x0001    /* Machine-readable listings (RFC 3659).  */
 };
 
 /* Extensions of the ST_UNIX */
@@ -67,7 +75,8 @@ uerr_t ftp_type (int, int);
 uerr_t ftp_cwd (int, const char *);
 uerr_t ftp_retr (int, const char *);
 uerr_t ftp_rest (int, wgint);
-uerr_t ftp_list (int, const char *, bool, bool, bool *);
+uerr_t ftp_list (int, const char *, bool, bool, bool, bool *, bool *);
+uerr_t ftp_feat (int, int *);
 uerr_t ftp_syst (int, enum stype *, enum ustype *);
 uerr_t ftp_pwd (int, char **);
 uerr_t ftp_size (int, const char *, wgint *);
@@ -150,6 +159,7 @@ enum wget_ftp_fstatus
 };
 
 struct fileinfo *ftp_parse_ls (const char *, const enum stype);
+struct fileinfo *ftp_parse_ls_mem (const char *, size_t, const enum stype);
 uerr_t ftp_loop (struct url *, char **, int *, struct url *, bool, bool);
 
 uerr_t ftp_index (const char *, struct url *, struct fileinfo *);
@@ -39,17 +39,13 @@ as that of the covered work.  */
 
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
-#include <sys/ioctl.h>
 
 #include "utils.h"
 #include "connect.h"
 #include "url.h"
-#include "ptimer.h"
 #include "hash.h"
 #include "ssl.h"
 
-#include <sys/fcntl.h>
-
 #ifdef WIN32
 # include "w32sock.h"
 #endif
@@ -227,81 +223,66 @@ struct wgnutls_transport_context
      actually reading.  */
   char peekbuf[512];
   int peeklen;
-};
 
-static int
-wgnutls_read_timeout (int fd, char *buf, int bufsize, void *arg, double timeout)
-{
-#ifdef F_GETFL
-  int flags = 0;
-#endif
-  int ret = 0;
-  struct ptimer *timer = NULL;
-  struct wgnutls_transport_context *ctx = arg;
-  int timed_out = 0;
+  /* What the session waits for after GNUTLS_E_AGAIN: WAIT_FOR_READ or
+     WAIT_FOR_WRITE, or 0 if it didn't return that.  */
+  int want;
 
-  if (timeout)
-    {
-#ifdef F_GETFL
-      flags = fcntl (fd, F_GETFL, 0);
-      if (flags < 0)
-        return flags;
-      if (fcntl (fd, F_SETFL, flags | O_NONBLOCK))
-        return -1;
-#else
-      /* XXX: Assume it was blocking before.  */
-      const int one = 1;
-      if (ioctl (fd, FIONBIO, &one) < 0)
-        return -1;
-#endif
-
-      timer = ptimer_new ();
-      if (timer == NULL)
-        return -1;
-    }
-
-  do
-    {
-      double next_timeout = 0;
-      if (timeout)
-        {
-          next_timeout = timeout - ptimer_measure (timer);
-          if (next_timeout < 0)
-            break;
-        }
+  char *session_key;            /* key in the TLS session cache */
+  bool session_saved;           /* whether the session has been saved */
+};
 
-      ret = GNUTLS_E_AGAIN;
-      if (timeout == 0 || gnutls_record_check_pending (ctx->session)
-          || select_fd (fd, next_timeout, WAIT_FOR_READ))
-        {
-          ret = gnutls_record_recv (ctx->session, buf, bufsize);
-          timed_out = timeout && ptimer_measure (timer) >= timeout;
-        }
-    }
-  while (ret == GNUTLS_E_INTERRUPTED || (ret == GNUTLS_E_AGAIN && !timed_out));
+/* GnuTLS doesn't tell clients how long the server will honor a
+   session, so saved sessions are assumed to last this long.  */
+#define WGNUTLS_SESSION_LIFETIME (2 * 60 * 60)
 
-  if (timeout)
-    {
-      ptimer_destroy (timer);
+/* Save SESSION to the TLS session cache under KEY, if it can be
+   resumed.  Returns true if it was saved.  */
 
-#ifdef F_GETFL
-      if (fcntl (fd, F_SETFL, flags) < 0)
-        return -1;
-#else
-      const int zero = 0;
-      if (ioctl (fd, FIONBIO, &zero) < 0)
-        return -1;
+static bool
+wgnutls_save_session (gnutls_session_t session, const char *key)
+{
+  gnutls_datum_t data;
+
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+  /* TLS 1.3 sessions are resumed with tickets that the server sends
+     after the handshake.  Until one has arrived, there is nothing to
+     save.  */
+  if (gnutls_protocol_get_version (session) == GNUTLS_TLS1_3
+      && !(gnutls_session_get_flags (session) & GNUTLS_SFLAGS_SESSION_TICKET))
+    return false;
 #endif
 
-      if (timed_out && ret == GNUTLS_E_AGAIN)
-        errno = ETIMEDOUT;
-    }
+  if (gnutls_session_get_data2 (session, &data) != GNUTLS_E_SUCCESS)
+    return false;
+  ssl_session_put (key, data.data, data.size,
+                   time (NULL) + WGNUTLS_SESSION_LIFETIME);
+  gnutls_free (data.data);
+  return true;
+}
 
+/* Map the result RET of a GnuTLS record function to the convention of
+   the transport operations: GNUTLS_E_AGAIN becomes -1 with errno set
+   to EAGAIN.  */
+static int
+wgnutls_result (struct wgnutls_transport_context *ctx, int ret)
+{
+  ctx->want = 0;
+  if (ret == GNUTLS_E_AGAIN)
+    {
+      ctx->want = gnutls_record_get_direction (ctx->session)
+        ? WAIT_FOR_WRITE : WAIT_FOR_READ;
+      ctx->last_error = 0;
+      errno = EAGAIN;
+      return -1;
+    }
+  if (ret < 0)
+    ctx->last_error = ret;
   return ret;
 }
 
 static int
-wgnutls_read (int fd, char *buf, int bufsize, void *arg)
+wgnutls_read (int fd _GL_UNUSED, char *buf, int bufsize, void *arg)
 {
   int ret = 0;
   struct wgnutls_transport_context *ctx = arg;
@@ -318,11 +299,10 @@ wgnutls_read (int fd, char *buf, int bufsize, void *arg)
       return copysize;
     }
 
-  ret = wgnutls_read_timeout (fd, buf, bufsize, arg, opt.read_timeout);
-  if (ret < 0)
-    ctx->last_error = ret;
-
-  return ret;
+  do
+    ret = gnutls_record_recv (ctx->session, buf, bufsize);
+  while (ret == GNUTLS_E_INTERRUPTED);
+  return wgnutls_result (ctx, ret);
 }
 
 static int
@@ -332,10 +312,8 @@ wgnutls_write (int fd _GL_UNUSED, char *buf, int bufsize, void *arg)
   struct wgnutls_transport_context *ctx = arg;
   do
     ret = gnutls_record_send (ctx->session, buf, bufsize);
-  while (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
-  if (ret < 0)
-    ctx->last_error = ret;
-  return ret;
+  while (ret == GNUTLS_E_INTERRUPTED);
+  return wgnutls_result (ctx, ret);
 }
 
 static int
@@ -343,60 +321,47 @@ wgnutls_poll (int fd, double timeout, int wait_for, void *arg)
 {
   struct wgnutls_transport_context *ctx = arg;
 
-  if (timeout)
-    return ctx->peeklen || gnutls_record_check_pending (ctx->session)
-      || select_fd (fd, timeout, wait_for);
-  else
-    return ctx->peeklen || gnutls_record_check_pending (ctx->session);
+  if (ctx->peeklen || gnutls_record_check_pending (ctx->session))
+    return 1;
+  return select_fd (fd, timeout, ctx->want ? ctx->want : wait_for);
 }
 
 static int
-wgnutls_peek (int fd, char *buf, int bufsize, void *arg)
+wgnutls_peek (int fd _GL_UNUSED, char *buf, int bufsize, void *arg)
 {
-  int read = 0;
+  int read;
   struct wgnutls_transport_context *ctx = arg;
-  int offset = MIN (bufsize, ctx->peeklen);
 
   if (ctx->peeklen)
     {
-      memcpy (buf, ctx->peekbuf, offset);
-      return offset;
+      int copysize = MIN (bufsize, ctx->peeklen);
+      memcpy (buf, ctx->peekbuf, copysize);
+      return copysize;
     }
 
   if (bufsize > (int) sizeof ctx->peekbuf)
     bufsize = sizeof ctx->peekbuf;
 
-  if (bufsize > offset)
-    {
-      if (opt.read_timeout && gnutls_record_check_pending (ctx->session) == 0
-          && select_fd (fd, 0.0, WAIT_FOR_READ) <= 0)
-        read = 0;
-      else
-        read = wgnutls_read_timeout (fd, buf + offset, bufsize - offset,
-                                     ctx, opt.read_timeout);
-      if (read < 0)
-        {
-          if (offset)
-            read = 0;
-          else
-            return read;
-        }
+  do
+    read = gnutls_record_recv (ctx->session, buf, bufsize);
+  while (read == GNUTLS_E_INTERRUPTED);
+  read = wgnutls_result (ctx, read);
 
-      if (read > 0)
-        {
-          memcpy (ctx->peekbuf + offset, buf + offset,
-                  read);
-          ctx->peeklen += read;
-        }
+  if (read > 0)
+    {
+      memcpy (ctx->peekbuf, buf, read);
+      ctx->peeklen = read;
     }
-
-  return offset + read;
+  return read;
 }
 
 static const char *
 wgnutls_errstr (int fd _GL_UNUSED, void *arg)
 {
   struct wgnutls_transport_context *ctx = arg;
+  /* Errors such as timeouts come from the system. */
+  if (!ctx->last_error)
+    return NULL;
   return gnutls_strerror (ctx->last_error);
 }
 
@@ -405,7 +370,11 @@ wgnutls_close (int fd, void *arg)
 {
   struct wgnutls_transport_context *ctx = arg;
   /*gnutls_bye (ctx->session, GNUTLS_SHUT_RDWR);*/
+  /* A TLS 1.3 ticket may have arrived while reading the response.  */
+  if (!ctx->session_saved)
+    wgnutls_save_session (ctx->session, ctx->session_key);
   gnutls_deinit (ctx->session);
+  xfree (ctx->session_key);
   xfree (ctx);
   close (fd);
 }
@@ -420,15 +389,15 @@ static struct transport_implementation wgnutls_transport =
 };
 
 bool
-ssl_connect_wget (int fd, const char *hostname)
+ssl_connect_wget (int fd, const char *hostname, int port)
 {
-#ifdef F_GETFL
-  int flags = 0;
-#endif
   struct wgnutls_transport_context *ctx;
   gnutls_session_t session;
   int err;
   const char *str;
+  char *key;
+  const void *saved;
+  size_t saved_size;
 
   gnutls_init (&session, GNUTLS_CLIENT);
 
@@ -531,38 +500,30 @@ ssl_connect_wget (int fd, const char *hostname)
       return false;
     }
 
-  if (opt.connect_timeout)
-    {
-#ifdef F_GETFL
-      flags = fcntl (fd, F_GETFL, 0);
-      if (flags < 0)
-        return flags;
-      if (fcntl (fd, F_SETFL, flags | O_NONBLOCK))
-        return -1;
-#else
-      /* XXX: Assume it was blocking before.  */
-      const int one = 1;
-      if (ioctl (fd, FIONBIO, &one) < 0)
-        return -1;
-#endif
-    }
+  /* Offer the session we had with this server before, if any. */
+  key = ssl_session_key (hostname, port);
+  saved = ssl_session_get (key, &saved_size);
+  if (saved)
+    gnutls_session_set_data (session, saved, saved_size);
+  xfree (key);
 
   /* We don't stop the handshake process for non-fatal errors */
   do
     {
       err = gnutls_handshake (session);
 
-      if (opt.connect_timeout && err == GNUTLS_E_AGAIN)
+      if (err == GNUTLS_E_AGAIN)
         {
+          double timeout = opt.connect_timeout ? opt.connect_timeout : -1;
           if (gnutls_record_get_direction (session))
             {
               /* wait for writeability */
-              err = select_fd (fd, opt.connect_timeout, WAIT_FOR_WRITE);
+              err = select_fd (fd, timeout, WAIT_FOR_WRITE);
             }
           else
             {
               /* wait for readability */
-              err = select_fd (fd, opt.connect_timeout, WAIT_FOR_READ);
+              err = select_fd (fd, timeout, WAIT_FOR_READ);
             }
 
           if (err <= 0)
@@ -593,18 +554,6 @@ ssl_connect_wget (int fd, const char *hostname)
     }
   while (err && gnutls_error_is_fatal (err) == 0);
 
-  if (opt.connect_timeout)
-    {
-#ifdef F_GETFL
-      if (fcntl (fd, F_SETFL, flags) < 0)
-        return -1;
-#else
-      const int zero = 0;
-      if (ioctl (fd, FIONBIO, &zero) < 0)
-        return -1;
-#endif
-    }
-
   if (err < 0)
     {
       gnutls_deinit (session);
@@ -613,6 +562,10 @@ ssl_connect_wget (int fd, const char *hostname)
 
   ctx = xnew0 (struct wgnutls_transport_context);
   ctx->session = session;
+  ctx->session_key = ssl_session_key (hostname, port);
+  if (gnutls_session_is_resumed (session))
+    DEBUGP (("Resumed TLS session for %s.\n", ctx->session_key));
+  ctx->session_saved = wgnutls_save_session (session, ctx->session_key);
   fd_register_transport (fd, &wgnutls_transport, ctx);
   return true;
 }
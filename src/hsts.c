@@ -44,12 +44,34 @@ as that of the covered work.  */
 
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <string.h>
 
 struct hsts_store {
   struct hash_table *table;
   time_t last_mtime;
+
+  /* Binary snapshot the store was opened from, if any.  Its records
+     are moved into TABLE one by one as lookups hit them; CONSUMED
+     remembers which ones, so that entries removed from TABLE later on
+     are not brought back from the snapshot.  */
+  struct file_memory *snapshot;
+  char *consumed;
+  bool changed;                 /* whether anything changed since opening */
+};
+
+/* Binary snapshot format.  The records are sorted by host and port so
+   that they can be searched in place.  */
+#define HSTS_SNAPSHOT_MAGIC "WGHSTS\0\1"
+
+struct hsts_snapshot_record {
+  uint32_t host;                /* offset in the string table */
+  int32_t explicit_port;
+  int64_t created;
+  int64_t max_age;
+  uint32_t include_subdomains;
+  uint32_t reserved;
 };
 
 struct hsts_kh {
@@ -106,6 +128,90 @@ hsts_cmp_func (const void *h1, const void *h2)
 
 /* Private functions. Feel free to make some of these public when needed. */
 
+static bool hsts_new_entry (hsts_store_t, const char *, int, time_t, time_t, bool);
+
+static int
+hsts_snapshot_cmp (const char *strings, const struct hsts_snapshot_record *r,
+                   const char *host, int explicit_port)
+{
+  int cmp = strcmp (strings + r->host, host);
+  if (cmp == 0)
+    cmp = (r->explicit_port > explicit_port) - (r->explicit_port < explicit_port);
+  return cmp;
+}
+
+/* Move the snapshot record for HOST and EXPLICIT_PORT, if there is one,
+   into the in-memory table.  */
+static void
+hsts_snapshot_fetch (hsts_store_t store, const char *host, int explicit_port)
+{
+  const struct snapshot_header *hdr;
+  const struct hsts_snapshot_record *records, *r;
+  const char *strings;
+  uint32_t lo, hi, mid;
+  int cmp;
+
+  if (!store->snapshot)
+    return;
+
+  hdr = (const struct snapshot_header *) store->snapshot->content;
+  records = SNAPSHOT_RECORDS (store->snapshot);
+  strings = SNAPSHOT_STRINGS (store->snapshot, sizeof (*records));
+
+  lo = 0;
+  hi = hdr->count;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      r = records + mid;
+      if (r->host >= hdr->strings_size)
+        return;
+      cmp = hsts_snapshot_cmp (strings, r, host, explicit_port);
+      if (cmp < 0)
+        lo = mid + 1;
+      else if (cmp > 0)
+        hi = mid;
+      else
+        {
+          if (!store->consumed[mid])
+            {
+              store->consumed[mid] = 1;
+              hsts_new_entry (store, strings + r->host, r->explicit_port,
+                              r->created, r->max_age, !!r->include_subdomains);
+            }
+          return;
+        }
+    }
+}
+
+/* Drop the snapshot.  If LOAD is true, the records that have not been
+   looked up yet are moved into the in-memory table first.  */
+static void
+hsts_snapshot_release (hsts_store_t store, bool load)
+{
+  const struct snapshot_header *hdr;
+  const struct hsts_snapshot_record *records;
+  const char *strings;
+  uint32_t i;
+
+  if (!store->snapshot)
+    return;
+
+  hdr = (const struct snapshot_header *) store->snapshot->content;
+  records = SNAPSHOT_RECORDS (store->snapshot);
+  strings = SNAPSHOT_STRINGS (store->snapshot, sizeof (*records));
+
+  for (i = 0; load && i < hdr->count; i++)
+    if (!store->consumed[i] && records[i].host < hdr->strings_size)
+      hsts_new_entry (store, strings + records[i].host, records[i].explicit_port,
+                      records[i].created, records[i].max_age,
+                      !!records[i].include_subdomains);
+
+  wget_read_file_free (store->snapshot);
+  store->snapshot = NULL;
+  xfree (store->consumed);
+}
+
 static struct hsts_kh_info *
 hsts_find_entry (hsts_store_t store,
                  const char *host, int explicit_port,
@@ -125,6 +231,7 @@ hsts_find_entry (hsts_store_t store,
   /* save pointer so that we don't get into trouble later when freeing */
   org_ptr = k->host;
 
+  hsts_snapshot_fetch (store, k->host, k->explicit_port);
   khi = (struct hsts_kh_info *) hash_table_get (store->table, k);
   if (khi)
     {
@@ -137,6 +244,7 @@ hsts_find_entry (hsts_store_t store,
       strchr (pos + 1, '.'))
     {
       k->host += (pos - k->host + 1);
+      hsts_snapshot_fetch (store, k->host, k->explicit_port);
       khi = (struct hsts_kh_info *) hash_table_get (store->table, k);
       if (khi)
         match = SUPERDOMAIN_MATCH;
@@ -266,6 +374,7 @@ static bool
 hsts_read_database (hsts_store_t store, const char *file, bool merge_with_existing_entries)
 {
   FILE *fp = NULL;
+  struct file_memory *fm;
   char *line = NULL, *p;
   size_t len = 0;
   int items_read;
@@ -279,6 +388,27 @@ hsts_read_database (hsts_store_t store, const char *file, bool merge_with_existi
 
   func = (merge_with_existing_entries ? hsts_store_merge : hsts_new_entry);
 
+  fm = (file_is_snapshot_p (file, HSTS_SNAPSHOT_MAGIC)
+        ? wget_read_file (file) : NULL);
+  if (fm && snapshot_valid_p (fm, HSTS_SNAPSHOT_MAGIC, sizeof (struct hsts_snapshot_record)))
+    {
+      const struct snapshot_header *hdr = (const struct snapshot_header *) fm->content;
+      const struct hsts_snapshot_record *records = SNAPSHOT_RECORDS (fm);
+      const char *strings = SNAPSHOT_STRINGS (fm, sizeof (*records));
+      uint32_t i;
+
+      for (i = 0; i < hdr->count; i++)
+        if (records[i].host < hdr->strings_size)
+          func (store, strings + records[i].host, records[i].explicit_port,
+                records[i].created, records[i].max_age,
+                !!records[i].include_subdomains);
+
+      wget_read_file_free (fm);
+      return true;
+    }
+  if (fm)
+    wget_read_file_free (fm);
+
   fp = fopen (file, "r");
   if (fp)
     {
@@ -310,12 +440,81 @@ hsts_read_database (hsts_store_t store, const char *file, bool merge_with_existi
   return result;
 }
 
+static const char *hsts_dump_strings;
+
+static int
+hsts_dump_cmp (const void *a, const void *b)
+{
+  const struct hsts_snapshot_record *r2 = b;
+  return hsts_snapshot_cmp (hsts_dump_strings, a,
+                            hsts_dump_strings + r2->host, r2->explicit_port);
+}
+
+static void
+hsts_store_dump_snapshot (hsts_store_t store, const char *filename)
+{
+  hash_table_iterator it;
+  struct snapshot_header *hdr;
+  struct hsts_snapshot_record *records, *r;
+  char *buf, *strings;
+  size_t count = hash_table_count (store->table), strings_size = 0, size;
+
+  for (hash_table_iterate (store->table, &it); hash_table_iter_next (&it);)
+    strings_size += strlen (((struct hsts_kh *) it.key)->host) + 1;
+
+  size = sizeof (*hdr) + count * sizeof (*records) + strings_size;
+  buf = xcalloc (1, size);
+  hdr = (struct snapshot_header *) buf;
+  memcpy (hdr->magic, HSTS_SNAPSHOT_MAGIC, sizeof (hdr->magic));
+  hdr->byte_order = SNAPSHOT_BYTE_ORDER;
+  hdr->count = count;
+  hdr->strings_size = strings_size;
+  records = (struct hsts_snapshot_record *) (buf + sizeof (*hdr));
+  strings = (char *) (records + count);
+
+  strings_size = 0;
+  r = records;
+  for (hash_table_iterate (store->table, &it); hash_table_iter_next (&it); r++)
+    {
+      struct hsts_kh *kh = (struct hsts_kh *) it.key;
+      struct hsts_kh_info *khi = (struct hsts_kh_info *) it.value;
+      size_t len = strlen (kh->host) + 1;
+
+      memcpy (strings + strings_size, kh->host, len);
+      r->host = strings_size;
+      r->explicit_port = kh->explicit_port;
+      r->created = khi->created;
+      r->max_age = khi->max_age;
+      r->include_subdomains = khi->include_subdomains;
+      strings_size += len;
+    }
+
+  hsts_dump_strings = strings;
+  qsort (records, count, sizeof (*records), hsts_dump_cmp);
+
+  if (!wget_replace_file (filename, buf, size))
+    logprintf (LOG_ALWAYS, "Could not write the HSTS database correctly.\n");
+
+  xfree (buf);
+}
+
 static void
 hsts_store_dump (hsts_store_t store, const char *filename)
 {
   FILE *fp = NULL;
   hash_table_iterator it;
 
+  if (opt.binary_snapshots)
+    {
+      hsts_store_dump_snapshot (store, filename);
+      return;
+    }
+
+  /* Other processes may have a snapshot at FILENAME mapped.  Unlink it
+     instead of truncating it under them.  */
+  if (file_is_snapshot_p (filename, HSTS_SNAPSHOT_MAGIC))
+    unlink (filename);
+
   fp = fopen (filename, "w");
   if (fp)
     {
@@ -382,7 +581,10 @@ hsts_match (hsts_store_t store, struct url *u)
                 }
             }
           else
-            hsts_remove_entry (store, kh);
+            {
+              hsts_remove_entry (store, kh);
+              store->changed = true;
+            }
         }
     }
 
@@ -428,6 +630,7 @@ hsts_store_entry (hsts_store_t store,
     {
       port = MAKE_EXPLICIT_PORT (scheme, port);
       entry = hsts_find_entry (store, host, port, &match, kh);
+      store->changed = true;
       if (entry && match == CONGRUENT_MATCH)
         {
           if (max_age == 0)
@@ -479,15 +682,32 @@ hsts_store_open (const char *filename)
 
   if (file_exists_p (filename))
     {
+      struct file_memory *fm;
+
       if (stat (filename, &st) == 0)
         store->last_mtime = st.st_mtime;
 
-      if (!hsts_read_database (store, filename, false))
+      /* A binary snapshot is kept mapped and searched lazily.  Text
+         databases are told apart by their first bytes, so that they
+         are not read twice.  */
+      fm = (file_is_snapshot_p (filename, HSTS_SNAPSHOT_MAGIC)
+            ? wget_read_file (filename) : NULL);
+      if (fm && snapshot_valid_p (fm, HSTS_SNAPSHOT_MAGIC, sizeof (struct hsts_snapshot_record)))
         {
-          /* abort! */
-          hsts_store_close (store);
-          xfree (store);
-          store = NULL;
+          store->snapshot = fm;
+          store->consumed = xcalloc (1, ((struct snapshot_header *) fm->content)->count + 1);
+        }
+      else
+        {
+          if (fm)
+            wget_read_file_free (fm);
+          if (!hsts_read_database (store, filename, false))
+            {
+              /* abort! */
+              hsts_store_close (store);
+              xfree (store);
+              store = NULL;
+            }
         }
     }
 
@@ -499,6 +719,12 @@ hsts_store_save (hsts_store_t store, const char *filename)
 {
   struct stat st;
 
+  /* An untouched snapshot is already what we would write.  Otherwise
+     bring in whatever is left of it before it is replaced.  */
+  if (store->snapshot && !store->changed && opt.binary_snapshots)
+    return;
+  hsts_snapshot_release (store, true);
+
   if (filename && hash_table_count (store->table) > 0)
     {
       /* If the file has changed, merge the changes with our in-memory data
@@ -518,6 +744,8 @@ hsts_store_close (hsts_store_t store)
 {
   hash_table_iterator it;
 
+  hsts_snapshot_release (store, false);
+
   /* free all the host fields */
   for (hash_table_iterate (store->table, &it); hash_table_iter_next (&it);)
     {
@@ -742,5 +970,46 @@ test_hsts_read_database (void)
 
   return NULL;
 }
+
+const char *
+test_hsts_snapshot (void)
+{
+  hsts_store_t s;
+  char *file = get_hsts_store_filename ();
+  bool binary = opt.binary_snapshots;
+
+  mu_assert("Could not create the HSTS test file", file != NULL);
+
+  s = hsts_store_open (file);
+  mu_assert("Could not open the HSTS store", s != NULL);
+  hsts_store_entry (s, SCHEME_HTTPS, "foo.com", 443, time(NULL) + 1234, true);
+  hsts_store_entry (s, SCHEME_HTTPS, "bar.com", 8443, time(NULL) + 1234, false);
+  hsts_store_entry (s, SCHEME_HTTPS, "baz.com", 443, time(NULL) + 1234, false);
+
+  opt.binary_snapshots = true;
+  hsts_store_save (s, file);
+  hsts_store_close (s);
+  xfree (s);
+  opt.binary_snapshots = binary;
+
+  s = hsts_store_open (file);
+  mu_assert("Could not open the HSTS snapshot", s != NULL);
+  mu_assert("The store should have been saved as a snapshot", s->snapshot != NULL);
+  mu_assert("Nothing should have been loaded yet", hash_table_count (s->table) == 0);
+
+  TEST_URL_RW (s, "www.foo.com", 80);
+  TEST_URL_RW (s, "bar.com", 8443);
+  TEST_URL_NORW (s, "bar.com", 80);
+  TEST_URL_NORW (s, "www.baz.com", 80);
+  TEST_URL_NORW (s, "qux.com", 80);
+  mu_assert("Only the hosts looked up should have been loaded", hash_table_count (s->table) == 3);
+
+  hsts_store_close (s);
+  xfree (s);
+  unlink (file);
+  xfree (file);
+
+  return NULL;
+}
 #endif /* TESTING */
 #endif /* HAVE_HSTS */
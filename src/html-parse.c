@@ -87,7 +87,11 @@ as that of the covered work.  */
    its attributes.  */
 
 /* To test as standalone, compile with `-DSTANDALONE -I.'.  You'll
-   still need Wget headers to compile.  */
+   still need Wget headers to compile.  The resulting program prints
+   the tags found in the HTML read from standard input.  When invoked
+   as `./a.out ITERATIONS FILE...', it instead times ITERATIONS parses
+   of each FILE, which is useful for benchmarking the parser over a
+   corpus of downloaded pages.  */
 
 #include "wget.h"
 
@@ -102,8 +106,12 @@ as that of the covered work.  */
 
 #include "utils.h"
 #include "html-parse.h"
+#include "scan.h"
 
 #ifdef STANDALONE
+# include <ctype.h>
+# include <time.h>
+
 # undef xmalloc
 # undef xrealloc
 # undef xfree
@@ -126,17 +134,6 @@ as that of the covered work.  */
 # define c_isalnum(x) isalnum (x)
 # define c_tolower(x) tolower (x)
 # define c_toupper(x) toupper (x)
-
-struct hash_table {
-  int dummy;
-};
-static void *
-hash_table_get (const struct hash_table *ht, void *ptr)
-{
-  return ptr;
-}
-#else  /* not STANDALONE */
-# include "hash.h"
 #endif
 
 /* Pool support.  A pool is a resizable chunk of memory.  It is first
@@ -272,92 +269,57 @@ struct pool {
    to "<foo", but "&lt,foo" to "<,foo".  */
 #define SKIP_SEMI(p, inc) (p += inc, p < end && *p == ';' ? ++p : p)
 
+/* The stack of currently open tags, used to find the contents of a
+   tag when its end tag is seen.  Like the pool, it starts out on the
+   stack of map_html_tags and only moves to the heap for documents
+   that nest deeper than that.  */
+
 struct tagstack_item {
   const char *tagname_begin;
   const char *tagname_end;
   const char *contents_begin;
-  struct tagstack_item *prev;
-  struct tagstack_item *next;
+};
+
+struct tagstack {
+  struct tagstack_item *items;
+  int size;                     /* number of allocated items */
+  int count;                    /* number of items in use */
+  bool resized;                 /* whether ITEMS was malloc'ed */
 };
 
 static struct tagstack_item *
-tagstack_push (struct tagstack_item **head, struct tagstack_item **tail)
+tagstack_push (struct tagstack *stack)
 {
-  struct tagstack_item *ts = xmalloc(sizeof(struct tagstack_item));
-  if (*head == NULL)
-    {
-      *head = *tail = ts;
-      ts->prev = ts->next = NULL;
-    }
-  else
-    {
-      (*tail)->next = ts;
-      ts->prev = *tail;
-      *tail = ts;
-      ts->next = NULL;
-    }
-
-  return ts;
+  GROW_ARRAY (stack->items, stack->size, stack->count + 1, stack->resized,
+              struct tagstack_item);
+  return &stack->items[stack->count++];
 }
 
-/* remove ts and everything after it from the stack */
+/* Remove the item at INDEX and everything after it from the stack. */
 static void
-tagstack_pop (struct tagstack_item **head, struct tagstack_item **tail,
-              struct tagstack_item *ts)
+tagstack_pop (struct tagstack *stack, int index)
 {
-  if (*head == NULL)
-    return;
-
-  if (ts == *tail)
-    {
-      if (ts == *head)
-        {
-          xfree (ts);
-          *head = *tail = NULL;
-        }
-      else
-        {
-          ts->prev->next = NULL;
-          *tail = ts->prev;
-          xfree (ts);
-        }
-    }
-  else
-    {
-      if (ts == *head)
-        {
-          *head = NULL;
-        }
-      *tail = ts->prev;
-
-      if (ts->prev)
-        {
-          ts->prev->next = NULL;
-        }
-      while (ts)
-        {
-          struct tagstack_item *p = ts->next;
-          xfree (ts);
-          ts = p;
-        }
-    }
+  stack->count = index;
 }
 
-static struct tagstack_item *
-tagstack_find (struct tagstack_item *tail, const char *tagname_begin,
+/* Return the index of the innermost open tag named [TAGNAME_BEGIN,
+   TAGNAME_END), or -1 if there is none.  */
+static int
+tagstack_find (const struct tagstack *stack, const char *tagname_begin,
                const char *tagname_end)
 {
   int len = tagname_end - tagname_begin;
-  while (tail)
+  int i;
+  for (i = stack->count - 1; i >= 0; i--)
     {
-      if (len == (tail->tagname_end - tail->tagname_begin))
+      const struct tagstack_item *ts = &stack->items[i];
+      if (len == (ts->tagname_end - ts->tagname_begin))
         {
-          if (0 == strncasecmp (tail->tagname_begin, tagname_begin, len))
-            return tail;
+          if (0 == strncasecmp (ts->tagname_begin, tagname_begin, len))
+            return i;
         }
-      tail = tail->prev;
     }
-  return NULL;
+  return -1;
 }
 
 /* Decode the HTML character entity at *PTR, considering END to be end
@@ -428,6 +390,56 @@ decode_entity (const char **ptr, const char *end)
 #undef FITS
 #undef SKIP_SEMI
 
+/* Bulk scanning.  Most of the time spent in map_html_tags() goes to
+   stepping over tag names, attribute names and attribute values one
+   character at a time, only to find the delimiter that ends them.
+   The functions below find the first delimiter of a given class in
+   [P, END) and return a pointer to it, or END if there is none.  When
+   the compiler targets SSE2 or AVX2, 16 or 32 characters are examined
+   at once (see scan.h), with the usual character loop handling the
+   remainder.
+
+   The classes correspond exactly to the tests the parser used to
+   perform character by character, so the result of parsing is not
+   affected.  */
+
+#ifdef SCAN_VECTOR
+/* Return the mask of whitespace characters in V, using the same
+   definition of whitespace as c_isspace: ' ' and \t through \r.
+   Comparisons are signed, so 8-bit characters never match.  */
+static inline scan_vec_t
+scan_ws_vec (scan_vec_t v)
+{
+  return SCAN_OR (SCAN_EQ (v, SCAN_SPLAT (' ')),
+                  SCAN_AND (SCAN_GT (v, SCAN_SPLAT ('\t' - 1)),
+                            SCAN_GT (SCAN_SPLAT ('\r' + 1), v)));
+}
+#endif
+
+/* Find the first occurrence of any of the characters C1, C2 and C3.
+   They need not be distinct.  */
+
+static inline const char *
+scan_chars (const char *p, const char *end, char c1, char c2, char c3)
+{
+#ifdef SCAN_VECTOR
+  const scan_vec_t v1 = SCAN_SPLAT (c1), v2 = SCAN_SPLAT (c2);
+  const scan_vec_t v3 = SCAN_SPLAT (c3);
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH)
+    {
+      scan_vec_t v = SCAN_LOAD (p);
+      unsigned int mask = SCAN_MASK (SCAN_OR (SCAN_EQ (v, v1),
+                                              SCAN_OR (SCAN_EQ (v, v2),
+                                                       SCAN_EQ (v, v3))));
+      if (mask)
+        return p + __builtin_ctz (mask);
+    }
+#endif
+  while (p < end && *p != c1 && *p != c2 && *p != c3)
+    ++p;
+  return p;
+}
+
 enum {
   AP_DOWNCASE           = 1,
   AP_DECODE_ENTITIES    = 2,
@@ -475,12 +487,24 @@ convert_and_copy (struct pool *pool, const char *beg, const char *end, int flags
       const char *from = beg;
       char *to;
       bool squash_newlines = !!(flags & AP_TRIM_BLANKS);
+      /* Characters that need special treatment; when newlines are
+         not squashed, just look for '&'.  */
+      char nl = squash_newlines ? '\n' : '&';
+      char cr = squash_newlines ? '\r' : '&';
 
       POOL_GROW (pool, end - beg);
       to = pool->contents + pool->tail;
 
       while (from < end)
         {
+          /* Copy the run of ordinary characters in one go.  */
+          const char *special = scan_chars (from, end, '&', nl, cr);
+          memcpy (to, from, special - from);
+          to += special - from;
+          from = special;
+          if (from == end)
+            break;
+
           if (*from == '&')
             {
               int entity = decode_entity (&from, end);
@@ -537,6 +561,57 @@ convert_and_copy (struct pool *pool, const char *beg, const char *end, int flags
                         && (x) != '=' && (x) != '<' && (x) != '>'       \
                         && (x) != '/')
 
+/* Skip characters allowed in tag and attribute names, i.e. find the
+   first character for which NAME_CHAR_P is false.  */
+
+static inline const char *
+scan_name (const char *p, const char *end)
+{
+#ifdef SCAN_VECTOR
+  const scan_vec_t low = SCAN_SPLAT (33), del = SCAN_SPLAT (127);
+  const scan_vec_t eq = SCAN_SPLAT ('='), lt = SCAN_SPLAT ('<');
+  const scan_vec_t gt = SCAN_SPLAT ('>'), slash = SCAN_SPLAT ('/');
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH)
+    {
+      scan_vec_t v = SCAN_LOAD (p);
+      /* Signed comparison: control chars, space and 8-bit chars.  */
+      scan_vec_t m = SCAN_OR (SCAN_GT (low, v), SCAN_EQ (v, del));
+      unsigned int mask;
+      m = SCAN_OR (m, SCAN_OR (SCAN_EQ (v, eq), SCAN_EQ (v, lt)));
+      m = SCAN_OR (m, SCAN_OR (SCAN_EQ (v, gt), SCAN_EQ (v, slash)));
+      mask = SCAN_MASK (m);
+      if (mask)
+        return p + __builtin_ctz (mask);
+    }
+#endif
+  while (p < end && NAME_CHAR_P (*p))
+    ++p;
+  return p;
+}
+
+/* Skip an unquoted attribute value, i.e. find the first whitespace,
+   `<' or `>'.  */
+
+static inline const char *
+scan_unquoted_value (const char *p, const char *end)
+{
+#ifdef SCAN_VECTOR
+  const scan_vec_t lt = SCAN_SPLAT ('<'), gt = SCAN_SPLAT ('>');
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH)
+    {
+      scan_vec_t v = SCAN_LOAD (p);
+      unsigned int mask = SCAN_MASK (SCAN_OR (scan_ws_vec (v),
+                                              SCAN_OR (SCAN_EQ (v, lt),
+                                                       SCAN_EQ (v, gt))));
+      if (mask)
+        return p + __builtin_ctz (mask);
+    }
+#endif
+  while (p < end && !c_isspace (*p) && *p != '<' && *p != '>')
+    ++p;
+  return p;
+}
+
 #ifdef STANDALONE
 static int comment_backout_count;
 #endif
@@ -729,6 +804,19 @@ advance_declaration (const char *beg, const char *end)
 static const char *
 find_comment_end (const char *beg, const char *end)
 {
+#ifdef SCAN_VECTOR
+  /* With vector scanning available, it is faster to look for each
+     '>' and check whether it is preceded by "--".  */
+  const char *p = beg + 2;
+
+  while ((p = scan_chars (p, end, '>', '>', '>')) < end)
+    {
+      if (p[-1] == '-' && p[-2] == '-')
+        return p + 1;
+      ++p;
+    }
+  return NULL;
+#else
   /* Open-coded Boyer-Moore search for "-->".  Examine the third char;
      if it's not '>' or '-', advance by three characters.  Otherwise,
      look at the preceding characters and try to find a match.  */
@@ -769,19 +857,29 @@ find_comment_end (const char *beg, const char *end)
           }
       }
   return NULL;
+#endif
 }
 
-/* Return true if the string containing of characters inside [b, e) is
-   present in hash table HT.  */
+/* Return true if the tag whose name spans [B, E) passes FILTER.  */
 
 static bool
-name_allowed (const struct hash_table *ht, const char *b, const char *e)
+tag_allowed (const struct html_filter *filter, const char *b, const char *e)
 {
-  char *copy;
-  if (!ht)
+  if (!filter)
     return true;
-  BOUNDED_TO_ALLOCA (b, e, copy);
-  return hash_table_get (ht, copy) != NULL;
+  return filter->tag_p (b, e - b);
+}
+
+/* Return true if the attribute whose name spans [B, E) passes
+   FILTER.  */
+
+static bool
+attr_allowed (const struct html_filter *filter, const char *b, const char *e,
+              bool interesting_tag)
+{
+  if (!filter)
+    return true;
+  return filter->attr_p (b, e - b, interesting_tag);
 }
 
 /* Advance P (a char pointer), with the explicit intent of being able
@@ -801,6 +899,22 @@ name_allowed (const struct hash_table *ht, const char *b, const char *e)
   }                                             \
 } while (0)
 
+/* Skip a tag or attribute name, if any.  */
+
+#define SKIP_NAME(p) do {                       \
+  p = scan_name (p, end);                       \
+  if (p >= end)                                 \
+    goto finish;                                \
+} while (0)
+
+/* Advance P to the first occurrence of C1, C2 or C3.  */
+
+#define SCAN_TO(p, c1, c2, c3) do {             \
+  p = scan_chars (p, end, c1, c2, c3);          \
+  if (p >= end)                                 \
+    goto finish;                                \
+} while (0)
+
 /* Skip non-whitespace, if any. */
 
 #define SKIP_NON_WS(p) do {                     \
@@ -817,10 +931,12 @@ static int tag_backout_count;
    MAPFUN will be called with two arguments: pointer to an initialized
    struct taginfo, and MAPARG.
 
-   ALLOWED_TAGS and ALLOWED_ATTRIBUTES are hash tables the keys of
-   which are the tags and attribute names that this function should
-   use.  If ALLOWED_TAGS is NULL, all tags are processed; if
-   ALLOWED_ATTRIBUTES is NULL, all attributes are returned.
+   FILTER decides which tags and attributes this function should
+   report.  If FILTER is NULL, all tags and attributes are reported.
+   A tag that is not interesting to FILTER is still reported if one of
+   its attributes is, so that e.g. style attributes can be examined on
+   any tag.  A tag with nothing to report is parsed in place, without
+   copying anything out of TEXT.
 
    (Obviously, the caller can filter out unwanted tags and attributes
    just as well, but this is just an optimization designed to avoid
@@ -830,9 +946,7 @@ static int tag_backout_count;
 void
 map_html_tags (const char *text, int size,
                void (*mapfun) (struct taginfo *, void *), void *maparg,
-               int flags,
-               const struct hash_table *allowed_tags,
-               const struct hash_table *allowed_attributes)
+               int flags, const struct html_filter *filter)
 {
   /* storage for strings passed to MAPFUN callback; if 256 bytes is
      too little, POOL_APPEND allocates more with malloc. */
@@ -847,19 +961,24 @@ map_html_tags (const char *text, int size,
   bool attr_pair_resized = false;
   struct attr_pair *pairs = attr_pair_initial_storage;
 
-  struct tagstack_item *head = NULL;
-  struct tagstack_item *tail = NULL;
+  struct tagstack_item tagstack_initial_storage[16];
+  struct tagstack tagstack;
 
   if (!size)
     return;
 
   POOL_INIT (&pool, pool_initial_storage, countof (pool_initial_storage));
 
+  tagstack.items = tagstack_initial_storage;
+  tagstack.size = countof (tagstack_initial_storage);
+  tagstack.count = 0;
+  tagstack.resized = false;
+
   {
     int nattrs, end_tag;
     const char *tag_name_begin, *tag_name_end;
     const char *tag_start_position;
-    bool uninteresting_tag;
+    bool interesting_tag, name_copied;
 
   look_for_tag:
     POOL_REWIND (&pool);
@@ -910,8 +1029,7 @@ map_html_tags (const char *text, int size,
         ADVANCE (p);
       }
     tag_name_begin = p;
-    while (NAME_CHAR_P (*p))
-      ADVANCE (p);
+    SKIP_NAME (p);
     if (p == tag_name_begin)
       goto look_for_tag;
     tag_name_end = p;
@@ -919,26 +1037,25 @@ map_html_tags (const char *text, int size,
 
     if (!end_tag)
       {
-        struct tagstack_item *ts = tagstack_push (&head, &tail);
-        if (ts)
-          {
-            ts->tagname_begin  = tag_name_begin;
-            ts->tagname_end    = tag_name_end;
-            ts->contents_begin = NULL;
-          }
+        struct tagstack_item *ts = tagstack_push (&tagstack);
+        ts->tagname_begin  = tag_name_begin;
+        ts->tagname_end    = tag_name_end;
+        ts->contents_begin = NULL;
       }
 
     if (end_tag && *p != '>' && *p != '<')
       goto backout_tag;
 
-    if (!name_allowed (allowed_tags, tag_name_begin, tag_name_end))
-      /* We can't just say "goto look_for_tag" here because we need
-         the loop below to properly advance over the tag's attributes.  */
-      uninteresting_tag = true;
-    else
+    /* Even if the tag is uninteresting, we can't just say "goto
+       look_for_tag" here because we need the loop below to properly
+       advance over the tag's attributes.  The name is copied to the
+       pool only once we know the tag will be reported.  */
+    interesting_tag = tag_allowed (filter, tag_name_begin, tag_name_end);
+    name_copied = false;
+    if (interesting_tag)
       {
-        uninteresting_tag = false;
         convert_and_copy (&pool, tag_name_begin, tag_name_end, AP_DOWNCASE);
+        name_copied = true;
       }
 
     /* Find the attributes. */
@@ -971,8 +1088,7 @@ map_html_tags (const char *text, int size,
         /* Establish bounds of attribute name. */
         attr_name_begin = p;    /* <foo bar ...> */
                                 /*      ^        */
-        while (NAME_CHAR_P (*p))
-          ADVANCE (p);
+        SKIP_NAME (p);
         attr_name_end = p;      /* <foo bar ...> */
                                 /*         ^     */
         if (attr_name_begin == attr_name_end)
@@ -997,30 +1113,22 @@ map_html_tags (const char *text, int size,
             SKIP_WS (p);
             if (*p == '\"' || *p == '\'')
               {
-                bool newline_seen = false;
                 char quote_char = *p;
                 attr_raw_value_begin = p;
                 ADVANCE (p);
                 attr_value_begin = p; /* <foo bar="baz"> */
                                       /*           ^     */
-                while (*p != quote_char)
+                SCAN_TO (p, quote_char, '\n', quote_char);
+                if (*p == '\n')
                   {
-                    if (!newline_seen && *p == '\n')
-                      {
-                        /* If a newline is seen within the quotes, it
-                           is most likely that someone forgot to close
-                           the quote.  In that case, we back out to
-                           the value beginning, and terminate the tag
-                           at either `>' or the delimiter, whichever
-                           comes first.  Such a tag terminated at `>'
-                           is discarded.  */
-                        p = attr_value_begin;
-                        newline_seen = true;
-                        continue;
-                      }
-                    else if (newline_seen && (*p == '<' || *p == '>'))
-                      break;
-                    ADVANCE (p);
+                    /* If a newline is seen within the quotes, it is
+                       most likely that someone forgot to close the
+                       quote.  In that case, we back out to the value
+                       beginning, and terminate the tag at either `>'
+                       or the delimiter, whichever comes first.  Such
+                       a tag terminated at `>' is discarded.  */
+                    p = attr_value_begin;
+                    SCAN_TO (p, quote_char, '<', '>');
                   }
                 attr_value_end = p; /* <foo bar="baz"> */
                                     /*              ^  */
@@ -1043,8 +1151,9 @@ map_html_tags (const char *text, int size,
                    violated by, for instance, `%' in `width=75%'.
                    We'll be liberal and allow just about anything as
                    an attribute value.  */
-                while (!c_isspace (*p) && *p != '<' && *p != '>')
-                  ADVANCE (p);
+                p = scan_unquoted_value (p, end);
+                if (p >= end)
+                  goto finish;
                 attr_value_end = p; /* <foo bar=baz qux=quix> */
                                     /*             ^          */
                 if (attr_value_begin == attr_value_end)
@@ -1065,17 +1174,21 @@ map_html_tags (const char *text, int size,
                                 /*          ^    */
           }
 
-        /* If we're not interested in the tag, don't bother with any
-           of the attributes.  */
-        if (uninteresting_tag)
-          continue;
-
         /* If we aren't interested in the attribute, skip it.  We
            cannot do this test any sooner, because our text pointer
            needs to correctly advance over the attribute.  */
-        if (!name_allowed (allowed_attributes, attr_name_begin, attr_name_end))
+        if (!attr_allowed (filter, attr_name_begin, attr_name_end,
+                           interesting_tag))
           continue;
 
+        /* The tag name always comes first in the pool.  */
+        if (!name_copied)
+          {
+            convert_and_copy (&pool, tag_name_begin, tag_name_end,
+                              AP_DOWNCASE);
+            name_copied = true;
+          }
+
         GROW_ARRAY (pairs, attr_pair_size, nattrs + 1, attr_pair_resized,
                     struct attr_pair);
 
@@ -1090,14 +1203,24 @@ map_html_tags (const char *text, int size,
         ++nattrs;
       }
 
-    if (!end_tag && tail && (tail->tagname_begin == tag_name_begin))
+    if (!end_tag && tagstack.count
+        && tagstack.items[tagstack.count - 1].tagname_begin == tag_name_begin)
       {
-        tail->contents_begin = p+1;
+        tagstack.items[tagstack.count - 1].contents_begin = p+1;
       }
 
-    if (uninteresting_tag)
+    if (!name_copied)
       {
-        ADVANCE (p);
+        /* Nothing to report, but the end tag still closes its start
+           tag.  */
+        if (end_tag)
+          {
+            int i = tagstack_find (&tagstack, tag_name_begin, tag_name_end);
+            if (i >= 0)
+              tagstack_pop (&tagstack, i);
+          }
+        if (*p != '<')
+          ADVANCE (p);
         goto look_for_tag;
       }
 
@@ -1106,7 +1229,6 @@ map_html_tags (const char *text, int size,
     {
       int i;
       struct taginfo taginfo;
-      struct tagstack_item *ts = NULL;
 
       taginfo.name      = pool.contents;
       taginfo.end_tag_p = end_tag;
@@ -1128,15 +1250,15 @@ map_html_tags (const char *text, int size,
 
       if (end_tag)
         {
-          ts = tagstack_find (tail, tag_name_begin, tag_name_end);
-          if (ts)
+          i = tagstack_find (&tagstack, tag_name_begin, tag_name_end);
+          if (i >= 0)
             {
-              if (ts->contents_begin)
+              if (tagstack.items[i].contents_begin)
                 {
-                  taginfo.contents_begin = ts->contents_begin;
+                  taginfo.contents_begin = tagstack.items[i].contents_begin;
                   taginfo.contents_end   = tag_start_position;
                 }
-              tagstack_pop (&head, &tail, ts);
+              tagstack_pop (&tagstack, i);
             }
         }
 
@@ -1160,12 +1282,14 @@ map_html_tags (const char *text, int size,
   POOL_FREE (&pool);
   if (attr_pair_resized)
     xfree (pairs);
-  /* pop any tag stack that's left */
-  tagstack_pop (&head, &tail, head);
+  if (tagstack.resized)
+    xfree (tagstack.items);
 }
 
 #undef ADVANCE
 #undef SKIP_WS
+#undef SKIP_NAME
+#undef SCAN_TO
 #undef SKIP_NON_WS
 
 #ifdef STANDALONE
@@ -1181,12 +1305,78 @@ test_mapper (struct taginfo *taginfo, void *arg)
   ++*(int *)arg;
 }
 
-int main ()
+static char *
+read_whole_stream (FILE *fp, int *length)
 {
   int size = 256;
   char *x = xmalloc (size);
-  int length = 0;
   int read_count;
+
+  *length = 0;
+  while ((read_count = fread (x + *length, 1, size - *length, fp)))
+    {
+      *length += read_count;
+      size <<= 1;
+      x = xrealloc (x, size);
+    }
+  return x;
+}
+
+static void
+count_mapper (struct taginfo *taginfo, void *arg)
+{
+  ++*(int *)arg;
+}
+
+/* Benchmark mode: parse each of the FILES ITERATIONS times, without
+   printing the tags, and report the parsing speed.  This is meant to
+   be run over a corpus of real-world HTML pages.  */
+
+static int
+benchmark (int iterations, int nfiles, char **files)
+{
+  double total_bytes = 0, total_secs = 0;
+  long total_tags = 0;
+  int i;
+
+  for (i = 0; i < nfiles; i++)
+    {
+      FILE *fp = fopen (files[i], "rb");
+      char *x;
+      int length, n, tag_counter = 0;
+      clock_t start;
+
+      if (!fp)
+        {
+          perror (files[i]);
+          return 1;
+        }
+      x = read_whole_stream (fp, &length);
+      fclose (fp);
+
+      start = clock ();
+      for (n = 0; n < iterations; n++)
+        map_html_tags (x, length, count_mapper, &tag_counter, 0, NULL);
+      total_secs += (double) (clock () - start) / CLOCKS_PER_SEC;
+      total_bytes += (double) length * iterations;
+      total_tags += tag_counter;
+      xfree (x);
+    }
+
+  printf ("Files:            %d\n", nfiles);
+  printf ("Bytes parsed:     %.0f\n", total_bytes);
+  printf ("Tags seen:        %ld\n", total_tags);
+  printf ("CPU seconds:      %.3f\n", total_secs);
+  if (total_secs > 0)
+    printf ("Throughput:       %.1f MB/s\n",
+            total_bytes / total_secs / (1024 * 1024));
+  return 0;
+}
+
+int main (int argc, char **argv)
+{
+  char *x;
+  int length;
   int tag_counter = 0;
 
 #ifdef ENABLE_NLS
@@ -1197,14 +1387,11 @@ int main ()
   textdomain ("wget");
 #endif /* ENABLE_NLS */
 
-  while ((read_count = fread (x + length, 1, size - length, stdin)))
-    {
-      length += read_count;
-      size <<= 1;
-      x = xrealloc (x, size);
-    }
+  if (argc > 2)
+    return benchmark (atoi (argv[1]), argc - 2, argv + 2);
 
-  map_html_tags (x, length, test_mapper, &tag_counter, 0, NULL, NULL);
+  x = read_whole_stream (stdin, &length);
+  map_html_tags (x, length, test_mapper, &tag_counter, 0, NULL);
   printf ("TAGS: %d\n", tag_counter);
   printf ("Tag backouts:     %d\n", tag_backout_count);
   printf ("Comment backouts: %d\n", comment_backout_count);
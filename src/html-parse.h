@@ -57,7 +57,23 @@ struct taginfo {
   const char *contents_end;     /* only valid if end_tag_p */
 };
 
-struct hash_table;              /* forward declaration */
+/* Functions map_html_tags uses to decide which tags and attributes
+   its caller cares about.  The name is passed as a pointer into the
+   HTML text and a length, i.e. it is not zero-terminated, and it
+   should be compared case-insensitively.  Asking before anything is
+   copied means that tags and attributes nobody looks at cost no more
+   than scanning over them.  */
+
+struct html_filter {
+  /* Return true if tags named NAME are interesting.  */
+  bool (*tag_p) (const char *name, int len);
+
+  /* Return true if the attribute named NAME is interesting.
+     INTERESTING_TAG is the result of tag_p for the tag the attribute
+     belongs to.  A tag that is not interesting itself is still
+     reported if one of its attributes is.  */
+  bool (*attr_p) (const char *name, int len, bool interesting_tag);
+};
 
 /* Flags for map_html_tags: */
 #define MHT_STRICT_COMMENTS  1  /* use strict comment interpretation */
@@ -66,6 +82,6 @@ struct hash_table;              /* forward declaration */
 
 void map_html_tags (const char *, int,
                     void (*) (struct taginfo *, void *), void *, int,
-                    const struct hash_table *, const struct hash_table *);
+                    const struct html_filter *);
 
 #endif /* HTML_PARSE_H */
@@ -41,7 +41,6 @@ as that of the covered work.  */
 #include "html-parse.h"
 #include "url.h"
 #include "utils.h"
-#include "hash.h"
 #include "convert.h"
 #include "recur.h"
 #include "html-url.h"
@@ -186,13 +185,130 @@ static const char *additional_attributes[] = {
   "style"                       /* used by check_style_attr */
 };
 
-static struct hash_table *interesting_tags;
-static struct hash_table *interesting_attributes;
+/* A name index is a perfect hash table over a fixed set of tag or
+   attribute names, built once at startup.  It lets the HTML parser
+   decide whether a name is interesting directly on the document text,
+   without copying or downcasing it first.  */
+
+struct name_index {
+  unsigned int seed;            /* hash seed that yields no collisions */
+  unsigned int mask;            /* number of slots minus one */
+  int max_len;                  /* length of the longest name */
+  struct name_slot {
+    const char *name;           /* NULL if the slot is empty */
+    int len;
+    void *value;
+  } *slots;
+};
+
+static unsigned int
+name_hash (const char *name, int len, unsigned int seed)
+{
+  unsigned int h = 2166136261U ^ seed;
+  int i;
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char) c_tolower (name[i])) * 16777619U;
+  return h ^ (h >> 15);
+}
+
+/* Try to place the COUNT names in the slots of IDX using IDX->seed.
+   Return false on the first collision.  */
+
+static bool
+name_index_fill (struct name_index *idx, const char **names, void **values,
+                 int count)
+{
+  int i;
+  memset (idx->slots, 0, (idx->mask + 1) * sizeof (struct name_slot));
+  for (i = 0; i < count; i++)
+    {
+      int len = strlen (names[i]);
+      struct name_slot *slot =
+        &idx->slots[name_hash (names[i], len, idx->seed) & idx->mask];
+      if (slot->name)
+        {
+          /* The same name may be listed more than once. */
+          if (slot->len == len && !c_strncasecmp (slot->name, names[i], len))
+            continue;
+          return false;
+        }
+      slot->name = names[i];
+      slot->len = len;
+      slot->value = values ? values[i] : (void *) names[i];
+    }
+  return true;
+}
+
+/* Build IDX over the COUNT names in NAMES, associating each with the
+   corresponding element of VALUES, or with the name itself if VALUES
+   is NULL.  */
+
+static void
+name_index_init (struct name_index *idx, const char **names, void **values,
+                 int count)
+{
+  unsigned int size = 8;
+  int i;
+
+  idx->max_len = 0;
+  for (i = 0; i < count; i++)
+    idx->max_len = MAX (idx->max_len, (int) strlen (names[i]));
+
+  while (size < 2 * (unsigned int) count)
+    size <<= 1;
+
+  idx->slots = NULL;
+  for (;; size <<= 1)
+    {
+      idx->slots = xrealloc (idx->slots, size * sizeof (struct name_slot));
+      idx->mask = size - 1;
+      /* With at least twice as many slots as names, a working seed is
+         usually found within a few dozen attempts.  */
+      for (idx->seed = 0; idx->seed < 256; idx->seed++)
+        if (name_index_fill (idx, names, values, count))
+          return;
+    }
+}
+
+/* Return the value associated with the LEN-byte NAME in IDX, or NULL
+   if NAME is not in IDX.  Case is ignored.  */
+
+static void *
+name_index_get (const struct name_index *idx, const char *name, int len)
+{
+  const struct name_slot *slot;
+  if (!idx->slots || len > idx->max_len)
+    return NULL;
+  slot = &idx->slots[name_hash (name, len, idx->seed) & idx->mask];
+  if (slot->name && slot->len == len
+      && !c_strncasecmp (slot->name, name, len))
+    return slot->value;
+  return NULL;
+}
+
+static void
+name_index_free (struct name_index *idx)
+{
+  xfree (idx->slots);
+}
+
+static struct name_index interesting_tags;
+static struct name_index interesting_attributes;
+static bool interesting_initialized;
 
 /* Will contains the (last) charset found in 'http-equiv=content-type'
    meta tags  */
 static char *meta_charset;
 
+static bool
+tag_in_list (const char *name, char **list)
+{
+  for (; *list; list++)
+    if (!c_strcasecmp (name, *list))
+      return true;
+  return false;
+}
+
 static void
 init_interesting (void)
 {
@@ -205,49 +321,63 @@ init_interesting (void)
      matches the user's preferences as specified through --ignore-tags
      and --follow-tags.  */
 
+  const char *names[countof (known_tags) + countof (tag_url_attributes)
+                    + countof (additional_attributes)];
+  void *values[countof (known_tags)];
+  int count = 0;
   size_t i;
-  interesting_tags = make_nocase_string_hash_table (countof (known_tags));
 
-  /* First, add all the tags we know hot to handle, mapped to their
-     respective entries in known_tags.  */
+  /* First, add the tags we know how to handle, mapped to their
+     respective entries in known_tags, leaving out the tags ignored
+     through --ignore-tags.  If --follow-tags is specified, use only
+     those tags.  Unknown --follow-tags entries are ignored.  */
   for (i = 0; i < countof (known_tags); i++)
-    hash_table_put (interesting_tags, known_tags[i].name, known_tags + i);
-
-  /* Then remove the tags ignored through --ignore-tags.  */
-  if (opt.ignore_tags)
     {
-      char **ignored;
-      for (ignored = opt.ignore_tags; *ignored; ignored++)
-        hash_table_remove (interesting_tags, *ignored);
-    }
-
-  /* If --follow-tags is specified, use only those tags.  */
-  if (opt.follow_tags)
-    {
-      /* Create a new table intersecting --follow-tags and known_tags,
-         and use it as interesting_tags.  */
-      struct hash_table *intersect = make_nocase_string_hash_table (0);
-      char **followed;
-      for (followed = opt.follow_tags; *followed; followed++)
-        {
-          struct known_tag *t = hash_table_get (interesting_tags, *followed);
-          if (!t)
-            continue;           /* ignore unknown --follow-tags entries. */
-          hash_table_put (intersect, *followed, t);
-        }
-      hash_table_destroy (interesting_tags);
-      interesting_tags = intersect;
+      if (opt.ignore_tags && tag_in_list (known_tags[i].name, opt.ignore_tags))
+        continue;
+      if (opt.follow_tags && !tag_in_list (known_tags[i].name, opt.follow_tags))
+        continue;
+      names[count] = known_tags[i].name;
+      values[count] = known_tags + i;
+      ++count;
     }
+  name_index_init (&interesting_tags, names, values, count);
 
   /* Add the attributes we care about. */
-  interesting_attributes = make_nocase_string_hash_table (10);
+  count = 0;
   for (i = 0; i < countof (additional_attributes); i++)
-    hash_table_put (interesting_attributes, additional_attributes[i], "1");
+    names[count++] = additional_attributes[i];
   for (i = 0; i < countof (tag_url_attributes); i++)
-    hash_table_put (interesting_attributes,
-                    tag_url_attributes[i].attr_name, "1");
+    names[count++] = tag_url_attributes[i].attr_name;
+  name_index_init (&interesting_attributes, names, NULL, count);
+
+  interesting_initialized = true;
+}
+
+/* Callbacks for map_html_tags.  Besides the interesting tags, every
+   tag with a style attribute and every style element must be seen by
+   collect_tags_mapper, because either may contain CSS with URLs.  */
+
+static bool
+interesting_tag_p (const char *name, int len)
+{
+  return (name_index_get (&interesting_tags, name, len)
+          || (len == 5 && !c_strncasecmp (name, "style", 5)));
 }
 
+static bool
+interesting_attr_p (const char *name, int len, bool interesting_tag)
+{
+  if (interesting_tag)
+    return name_index_get (&interesting_attributes, name, len) != NULL;
+  return len == 5 && !c_strncasecmp (name, "style", 5);
+}
+
+static const struct html_filter interesting_filter = {
+  interesting_tag_p,
+  interesting_attr_p
+};
+
 /* Find the value of attribute named NAME in the taginfo TAG.  If the
    attribute is not present, return NULL.  If ATTRIND is non-NULL, the
    index of the attribute in TAG will be stored there.  */
@@ -682,14 +812,11 @@ collect_tags_mapper (struct taginfo *tag, void *arg)
 {
   struct map_context *ctx = (struct map_context *)arg;
 
-  /* Find the tag in our table of tags.  This must not fail because
-     map_html_tags only returns tags found in interesting_tags.
-
-     I've changed this for now, I'm passing NULL as interesting_tags
-     to map_html_tags.  This way we can check all tags for a style
-     attribute.
-  */
-  struct known_tag *t = hash_table_get (interesting_tags, tag->name);
+  /* Find the tag in our table of tags.  This may fail, because
+     map_html_tags also returns other tags that carry a style
+     attribute, as well as style elements.  */
+  struct known_tag *t = name_index_get (&interesting_tags, tag->name,
+                                        strlen (tag->name));
 
   if (t != NULL)
     t->handler (t->tagid, tag, ctx);
@@ -734,7 +861,7 @@ get_urls_html (const char *file, const char *url, bool *meta_disallow_follow,
   ctx.document_file = file;
   ctx.nofollow = false;
 
-  if (!interesting_tags)
+  if (!interesting_initialized)
     init_interesting ();
 
   /* Specify MHT_TRIM_VALUES because of buggy HTML generators that
@@ -748,9 +875,8 @@ get_urls_html (const char *file, const char *url, bool *meta_disallow_follow,
   if (opt.strict_comments)
     flags |= MHT_STRICT_COMMENTS;
 
-  /* the NULL here used to be interesting_tags */
   map_html_tags (fm->content, fm->length, collect_tags_mapper, &ctx, flags,
-                 NULL, interesting_attributes);
+                 &interesting_filter);
 
   /* Meta charset is only valid if there was no HTTP header Content-Type charset. */
   /* This is true for HTTP 1.0 and 1.1. */
@@ -769,26 +895,58 @@ get_urls_html (const char *file, const char *url, bool *meta_disallow_follow,
 /* This doesn't really have anything to do with HTML, but it's similar
    to get_urls_html, so we put it here.  */
 
-struct urlpos *
-get_urls_file (const char *file)
+/* A reader of a file with one URL per line.  The file is read a line
+   at a time, so that downloading can start before the whole file has
+   been read, and a file of any size, or a pipe that is written to
+   while Wget runs, can be read in constant memory.  */
+
+struct url_file_reader {
+  const char *file;             /* name of the file, for messages */
+  FILE *fp;
+  char *line;                   /* the line buffer, for getline */
+  size_t bufsize;
+};
+
+/* Open FILE for reading URLs from it.  If FILE is "-", the URLs are
+   read from standard input.  Returns NULL and logs the error if the
+   file cannot be opened.  */
+
+struct url_file_reader *
+url_file_open (const char *file)
 {
-  struct file_memory *fm;
-  struct urlpos *head, *tail;
-  const char *text, *text_end;
+  struct url_file_reader *rd;
+  FILE *fp;
 
-  /* Load the file.  */
-  fm = wget_read_file (file);
-  if (!fm)
+  if (HYPHENP (file))
+    fp = stdin;
+  else
+    fp = fopen (file, "r");
+  if (!fp)
     {
       logprintf (LOG_NOTQUIET, "%s: %s\n", file, strerror (errno));
       return NULL;
     }
-  DEBUGP (("Loaded %s (size %s).\n", file, number_to_static_string (fm->length)));
+  DEBUGP (("Reading URLs from %s.\n", file));
 
-  head = tail = NULL;
-  text = fm->content;
-  text_end = fm->content + fm->length;
-  while (text < text_end)
+  rd = xnew0 (struct url_file_reader);
+  rd->file = file;
+  rd->fp = fp;
+  return rd;
+}
+
+/* Return the next URL of the file read by RD as a single urlpos, to
+   be freed with free_urlpos, or NULL at the end of the file.  Blank
+   lines are skipped, as are invalid URLs, which are reported.  */
+
+struct urlpos *
+url_file_next (struct url_file_reader *rd)
+{
+  ssize_t len;
+
+  if (!rd)
+    return NULL;
+
+  while ((len = getline (&rd->line, &rd->bufsize, rd->fp)) > 0)
     {
       int up_error_code;
       char *url_text;
@@ -796,13 +954,8 @@ get_urls_file (const char *file)
       struct urlpos *entry;
       struct url *url;
 
-      const char *line_beg = text;
-      const char *line_end = memchr (text, '\n', text_end - text);
-      if (!line_end)
-        line_end = text_end;
-      else
-        ++line_end;
-      text = line_end;
+      const char *line_beg = rd->line;
+      const char *line_end = rd->line + len;
 
       /* Strip whitespace from the beginning and end of line. */
       while (line_beg < line_end && c_isspace (*line_beg))
@@ -814,9 +967,6 @@ get_urls_file (const char *file)
         continue;
 
       /* The URL is in the [line_beg, line_end) region. */
-
-      /* We must copy the URL to a zero-terminated string, and we
-         can't use alloca because we're in a loop.  *sigh*.  */
       url_text = strdupdelim (line_beg, line_end);
 
       if (opt.base_href)
@@ -839,7 +989,7 @@ get_urls_file (const char *file)
         {
           char *error = url_error (url_text, up_error_code);
           logprintf (LOG_NOTQUIET, _("%s: Invalid URL %s: %s\n"),
-                     file, url_text, error);
+                     rd->file, url_text, error);
           xfree (url_text);
           xfree (error);
           inform_exit_status (URLERROR);
@@ -849,24 +999,36 @@ get_urls_file (const char *file)
 
       entry = xnew0 (struct urlpos);
       entry->url = url;
-
-      if (!head)
-        head = entry;
-      else
-        tail->next = entry;
-      tail = entry;
+      return entry;
     }
-  wget_read_file_free (fm);
-  return head;
+
+  if (ferror (rd->fp))
+    logprintf (LOG_NOTQUIET, "%s: %s\n", rd->file, strerror (errno));
+  return NULL;
+}
+
+/* Close the file read by RD and free RD.  */
+
+void
+url_file_close (struct url_file_reader *rd)
+{
+  if (!rd)
+    return;
+  if (rd->fp != stdin)
+    fclose (rd->fp);
+  xfree (rd->line);
+  xfree (rd);
 }
 
 void
 cleanup_html_url (void)
 {
-  /* Destroy the hash tables.  The hash table keys and values are not
-     allocated by this code, so we don't need to free them here.  */
-  if (interesting_tags)
-    hash_table_destroy (interesting_tags);
-  if (interesting_attributes)
-    hash_table_destroy (interesting_attributes);
+  /* Destroy the name indexes.  The names and values are not allocated
+     by this code, so we don't need to free them here.  */
+  if (interesting_initialized)
+    {
+      name_index_free (&interesting_tags);
+      name_index_free (&interesting_attributes);
+      interesting_initialized = false;
+    }
 }
@@ -43,7 +43,10 @@ struct map_context {
   struct urlpos *head;          /* List of URLs that is being built. */
 };
 
-struct urlpos *get_urls_file (const char *);
+struct url_file_reader;
+struct url_file_reader *url_file_open (const char *);
+struct urlpos *url_file_next (struct url_file_reader *);
+void url_file_close (struct url_file_reader *);
 struct urlpos *get_urls_html (const char *, const char *, bool *, struct iri *);
 struct urlpos *append_url (const char *, int, int, struct map_context *);
 void free_urlpos (struct urlpos *);
@@ -56,12 +56,18 @@ as that of the covered work.  */
 # include "http-ntlm.h"
 #endif
 #include "cookies.h"
+#include "res.h"
 #include "md5.h"
 #include "convert.h"
 #include "spider.h"
 #include "warc.h"
 #include "c-strcase.h"
 #include "version.h"
+#include "ptimer.h"
+#include "stats.h"
+#include "validator.h"
+#include "dedup.h"
+#include "sha256.h"
 #ifdef HAVE_METALINK
 # include "metalink.h"
 # include "xstrndup.h"
@@ -527,8 +533,12 @@ response_head_terminator (const char *start, const char *peeked, int peeklen)
   /* If at first peek, verify whether HUNK starts with "HTTP".  If
      not, this is a HTTP/0.9 request and we must bail out without
      reading anything.  */
-  if (start == peeked && 0 != memcmp (start, "HTTP", MIN (peeklen, 4)))
-    return start;
+  if (start == peeked)
+    {
+      stats_phase_end (PHASE_TTFB);
+      if (0 != memcmp (start, "HTTP", MIN (peeklen, 4)))
+        return start;
+    }
 
   /* Look for "\n[\r]\n", and return the following position if found.
      Start two chars before the current to cover the possibility that
@@ -576,12 +586,125 @@ read_http_response_head (int fd)
                        HTTP_RESPONSE_MAX_SIZE);
 }
 
+/* The response headers Wget looks at.  resp_new files every header
+   line with one of these names under it, so that looking a header up
+   doesn't need to scan and compare all the lines.  Names not listed
+   here are not looked up.  */
+
+enum resp_header_name {
+  HDR_CACHE_CONTROL,
+  HDR_CONNECTION,
+  HDR_CONTENT_DISPOSITION,
+  HDR_CONTENT_LENGTH,
+  HDR_CONTENT_RANGE,
+  HDR_CONTENT_TYPE,
+  HDR_DATE,
+  HDR_DIGEST,
+  HDR_ETAG,
+  HDR_EXPIRES,
+  HDR_LAST_MODIFIED,
+  HDR_LINK,
+  HDR_LOCATION,
+  HDR_SET_COOKIE,
+  HDR_STRICT_TRANSPORT_SECURITY,
+  HDR_TRANSFER_ENCODING,
+  HDR_WWW_AUTHENTICATE,
+  HDR_COUNT,
+  HDR_UNKNOWN = HDR_COUNT
+};
+
+/* The names of the headers above, in the same order, with their
+   lengths.  */
+static const struct {
+  const char *name;
+  int len;
+} resp_header_names[] = {
+  { "Cache-Control", 13 },
+  { "Connection", 10 },
+  { "Content-Disposition", 19 },
+  { "Content-Length", 14 },
+  { "Content-Range", 13 },
+  { "Content-Type", 12 },
+  { "Date", 4 },
+  { "Digest", 6 },
+  { "ETag", 4 },
+  { "Expires", 7 },
+  { "Last-Modified", 13 },
+  { "Link", 4 },
+  { "Location", 8 },
+  { "Set-Cookie", 10 },
+  { "Strict-Transport-Security", 25 },
+  { "Transfer-Encoding", 17 },
+  { "WWW-Authenticate", 16 },
+};
+
+/* A hash of the header name of LEN characters at NAME, which is
+   perfect for the names above: each lands in a slot of its own of
+   resp_header_slots.  */
+#define RESP_HEADER_HASH(name, len) \
+  (((len) * 2 + c_tolower ((name)[0]) * 7 + c_tolower ((name)[(len) - 1]) * 5) \
+   & 31)
+
+/* The index in resp_header_names of the name in each hash slot, or
+   -1.  */
+static signed char resp_header_slots[32];
+static bool resp_header_slots_initialized;
+
+static void
+resp_header_slots_init (void)
+{
+  int i;
+
+  memset (resp_header_slots, -1, sizeof (resp_header_slots));
+  for (i = 0; i < HDR_COUNT; i++)
+    {
+      int h = RESP_HEADER_HASH (resp_header_names[i].name,
+                                resp_header_names[i].len);
+      assert (resp_header_slots[h] == -1);
+      resp_header_slots[h] = i;
+    }
+  resp_header_slots_initialized = true;
+}
+
+/* Return the name of the header line beginning at LINE and ending
+   before END, or HDR_UNKNOWN.  Set *VALUE to where the name ends.  */
+
+static enum resp_header_name
+resp_header_classify (const char *line, const char *end, const char **value)
+{
+  const char *colon = memchr (line, ':', end - line);
+  int len, i;
+
+  if (!colon || colon == line)
+    return HDR_UNKNOWN;
+  len = colon - line;
+
+  i = resp_header_slots[RESP_HEADER_HASH (line, len)];
+  if (i < 0 || resp_header_names[i].len != len
+      || 0 != c_strncasecmp (line, resp_header_names[i].name, len))
+    return HDR_UNKNOWN;
+
+  *value = colon + 1;
+  return (enum resp_header_name) i;
+}
+
+/* A header line of a response, as split by resp_new.  */
+
+struct resp_line {
+  const char *start;            /* where the line begins */
+  enum resp_header_name name;   /* the header name, or HDR_UNKNOWN */
+  const char *value;            /* the value, without the surrounding */
+  const char *value_end;        /* whitespace, for the known headers */
+  int next;                     /* the next line with the same name,
+                                   or 0 */
+};
+
 struct response {
   /* The response data. */
   const char *data;
 
-  /* The array of pointers that indicate where each header starts.
-     For example, given this HTTP response:
+  /* The array of the header lines, where the START of each points to
+     where the header starts.  For example, given this HTTP response:
 
        HTTP/1.0 200 Ok
        Description: some
@@ -592,33 +715,43 @@ struct response {
 
      "HTTP/1.0 200 Ok\r\nDescription: some\r\n text\r\nEtag: x\r\n\r\n"
      ^                   ^                             ^          ^
-     headers[0]          headers[1]                    headers[2] headers[3]
+     lines[0]            lines[1]                      lines[2]   lines[3]
+
+     I.e. lines[0] points to the beginning of the request, lines[1]
+     points to the end of the first header and the beginning of the
+     second one, etc.  The START of the element after the last is
+     NULL.  */
 
-     I.e. headers[0] points to the beginning of the request,
-     headers[1] points to the end of the first header and the
-     beginning of the second one, etc.  */
+  struct resp_line *lines;
 
-  const char **headers;
+  /* FIRST[n] is the index of the first line with the header name n,
+     or 0 if there is none; the others follow through the NEXT of the
+     lines.  */
+  int first[HDR_COUNT];
 };
 
 /* Create a new response object from the text of the HTTP response,
-   available in HEAD.  That text is automatically split into
-   constituent header lines for fast retrieval using
-   resp_header_*.  */
+   available in HEAD.  That text is split into constituent header
+   lines, and the lines of the known headers are filed by their names,
+   in a single pass, for fast retrieval using resp_header_*.  */
 
 static struct response *
 resp_new (const char *head)
 {
   const char *hdr;
   int count, size;
+  int last[HDR_COUNT];
 
   struct response *resp = xnew0 (struct response);
   resp->data = head;
 
+  if (!resp_header_slots_initialized)
+    resp_header_slots_init ();
+
   if (*head == '\0')
     {
       /* Empty head means that we're dealing with a headerless
-         (HTTP/0.9) response.  In that case, don't set HEADERS at
+         (HTTP/0.9) response.  In that case, don't set LINES at
          all.  */
       return resp;
     }
@@ -630,8 +763,14 @@ resp_new (const char *head)
   hdr = head;
   while (1)
     {
-      DO_REALLOC (resp->headers, size, count + 1, const char *);
-      resp->headers[count++] = hdr;
+      struct resp_line *line;
+      const char *b, *e;
+
+      DO_REALLOC (resp->lines, size, count + 1, struct resp_line);
+      line = &resp->lines[count++];
+      line->start = hdr;
+      line->name = HDR_UNKNOWN;
+      line->next = 0;
 
       /* Break upon encountering an empty line. */
       if (!hdr[0] || (hdr[0] == '\r' && hdr[1] == '\n') || hdr[0] == '\n')
@@ -647,18 +786,39 @@ resp_new (const char *head)
             hdr += strlen (hdr);
         }
       while (*hdr == ' ' || *hdr == '\t');
+
+      /* File the header lines, except the status line, under their
+         names.  */
+      if (count == 1)
+        continue;
+      line->name = resp_header_classify (line->start, hdr, &b);
+      if (line->name == HDR_UNKNOWN)
+        continue;
+
+      e = hdr;
+      while (b < e && c_isspace (*b))
+        ++b;
+      while (b < e && c_isspace (e[-1]))
+        --e;
+      line->value = b;
+      line->value_end = e;
+
+      if (resp->first[line->name])
+        resp->lines[last[line->name]].next = count - 1;
+      else
+        resp->first[line->name] = count - 1;
+      last[line->name] = count - 1;
     }
-  DO_REALLOC (resp->headers, size, count + 1, const char *);
-  resp->headers[count] = NULL;
+  DO_REALLOC (resp->lines, size, count + 1, struct resp_line);
+  resp->lines[count].start = NULL;
 
   return resp;
 }
 
-/* Locate the header named NAME in the request data, starting with
-   position START.  This allows the code to loop through the request
-   data, filtering for all requests of a given name.  Returns the
-   found position, or -1 for failure.  The code that uses this
-   function typically looks like this:
+/* Locate the header NAME in the response, starting with position
+   START.  This allows the code to loop through the headers with the
+   same name.  Returns the found position, or -1 for failure.  The
+   code that uses this function typically looks like this:
 
      for (pos = 0; (pos = resp_header_locate (...)) != -1; pos++)
        ... do something with header ...
@@ -667,59 +827,44 @@ resp_new (const char *head)
    this function.  */
 
 static int
-resp_header_locate (const struct response *resp, const char *name, int start,
-                    const char **begptr, const char **endptr)
+resp_header_locate (const struct response *resp, enum resp_header_name name,
+                    int start, const char **begptr, const char **endptr)
 {
   int i;
-  const char **headers = resp->headers;
-  int name_len;
 
-  if (!headers || !headers[1])
+  if (!resp->lines)
     return -1;
 
-  name_len = strlen (name);
-  if (start > 0)
-    i = start;
+  if (start > 1 && resp->lines[start - 1].name == name)
+    /* The usual case of continuing after the previous match. */
+    i = resp->lines[start - 1].next;
   else
-    i = 1;
+    for (i = resp->first[name]; i && i < start; i = resp->lines[i].next)
+      ;
+  if (!i)
+    return -1;
 
-  for (; headers[i + 1]; i++)
-    {
-      const char *b = headers[i];
-      const char *e = headers[i + 1];
-      if (e - b > name_len
-          && b[name_len] == ':'
-          && 0 == c_strncasecmp (b, name, name_len))
-        {
-          b += name_len + 1;
-          while (b < e && c_isspace (*b))
-            ++b;
-          while (b < e && c_isspace (e[-1]))
-            --e;
-          *begptr = b;
-          *endptr = e;
-          return i;
-        }
-    }
-  return -1;
+  *begptr = resp->lines[i].value;
+  *endptr = resp->lines[i].value_end;
+  return i;
 }
 
-/* Find and retrieve the header named NAME in the request data.  If
-   found, set *BEGPTR to its starting, and *ENDPTR to its ending
-   position, and return true.  Otherwise return false.
+/* Find and retrieve the header NAME in the response.  If found, set
+   *BEGPTR to its starting, and *ENDPTR to its ending position, and
+   return true.  Otherwise return false.
 
    This function is used as a building block for resp_header_copy
    and resp_header_strdup.  */
 
 static bool
-resp_header_get (const struct response *resp, const char *name,
+resp_header_get (const struct response *resp, enum resp_header_name name,
                  const char **begptr, const char **endptr)
 {
   int pos = resp_header_locate (resp, name, 0, begptr, endptr);
   return pos != -1;
 }
 
-/* Copy the response header named NAME to buffer BUF, no longer than
+/* Copy the response header NAME to buffer BUF, no longer than
    BUFSIZE (BUFSIZE includes the terminating 0).  If the header
    exists, true is returned, false otherwise.  If there should be no
    limit on the size of the header, use resp_header_strdup instead.
@@ -728,7 +873,7 @@ resp_header_get (const struct response *resp, const char *name,
    whether the header is present is still returned.  */
 
 static bool
-resp_header_copy (const struct response *resp, const char *name,
+resp_header_copy (const struct response *resp, enum resp_header_name name,
                   char *buf, int bufsize)
 {
   const char *b, *e;
@@ -743,11 +888,11 @@ resp_header_copy (const struct response *resp, const char *name,
   return true;
 }
 
-/* Return the value of header named NAME in RESP, allocated with
-   malloc.  If such a header does not exist in RESP, return NULL.  */
+/* Return the value of header NAME in RESP, allocated with malloc.  If
+   such a header does not exist in RESP, return NULL.  */
 
 static char *
-resp_header_strdup (const struct response *resp, const char *name)
+resp_header_strdup (const struct response *resp, enum resp_header_name name)
 {
   const char *b, *e;
   if (!resp_header_get (resp, name, &b, &e))
@@ -769,7 +914,7 @@ resp_status (const struct response *resp, char **message)
   int status;
   const char *p, *end;
 
-  if (!resp->headers)
+  if (!resp->lines)
     {
       /* For a HTTP/0.9 response, assume status 200. */
       if (message)
@@ -777,8 +922,8 @@ resp_status (const struct response *resp, char **message)
       return 200;
     }
 
-  p = resp->headers[0];
-  end = resp->headers[1];
+  p = resp->lines[0].start;
+  end = resp->lines[1].start;
 
   if (!end)
     return -1;
@@ -833,7 +978,7 @@ resp_free (struct response **resp_ref)
   if (!resp)
     return;
 
-  xfree (resp->headers);
+  xfree (resp->lines);
   xfree (resp);
 
   *resp_ref = NULL;
@@ -861,12 +1006,12 @@ static void
 print_server_response (const struct response *resp, const char *prefix)
 {
   int i;
-  if (!resp->headers)
+  if (!resp->lines)
     return;
-  for (i = 0; resp->headers[i + 1]; i++)
+  for (i = 0; resp->lines[i + 1].start; i++)
     {
-      const char *b = resp->headers[i];
-      const char *e = resp->headers[i + 1];
+      const char *b = resp->lines[i].start;
+      const char *e = resp->lines[i + 1].start;
       /* Skip CRLF */
       if (b < e && e[-1] == '\n')
         --e;
@@ -1308,6 +1453,63 @@ parse_strict_transport_security (const char *header, time_t *max_age, bool *incl
 }
 #endif
 
+/* Return the number of seconds for which the response RESP may be
+   reused, according to its Cache-Control or Expires header, or -1 if
+   neither is present.  */
+
+static long
+response_lifetime (const struct response *resp)
+{
+  const char *hdr;
+  char *cc, *expires, *date;
+  long lifetime = -1;
+
+  cc = resp_header_strdup (resp, HDR_CACHE_CONTROL);
+  if (cc)
+    {
+      param_token name, value;
+      hdr = cc;
+      while (extract_param (&hdr, &name, &value, ',', NULL))
+        {
+          if (BOUNDED_EQUAL_NO_CASE (name.b, name.e, "no-store")
+              || BOUNDED_EQUAL_NO_CASE (name.b, name.e, "no-cache"))
+            {
+              lifetime = 0;
+              break;
+            }
+          if (BOUNDED_EQUAL_NO_CASE (name.b, name.e, "max-age") && value.b)
+            lifetime = MAX (0, strtol (value.b, NULL, 10));
+        }
+      xfree (cc);
+      if (lifetime != -1)
+        return lifetime;
+    }
+
+  expires = resp_header_strdup (resp, HDR_EXPIRES);
+  if (expires)
+    {
+      time_t exp_time = http_atotm (expires);
+      time_t now = time (NULL);
+
+      date = resp_header_strdup (resp, HDR_DATE);
+      if (date)
+        {
+          time_t date_time = http_atotm (date);
+          if (date_time != (time_t) -1)
+            now = date_time;
+          xfree (date);
+        }
+      /* An invalid Expires header means the response is already
+         stale.  */
+      if (exp_time == (time_t) -1 || exp_time <= now)
+        lifetime = 0;
+      else
+        lifetime = exp_time - now;
+      xfree (expires);
+    }
+  return lifetime;
+}
+
 /* Persistent connections.  Currently, we cache the most recently used
    connection as persistent, provided that the HTTP server agrees to
    make it such.  The persistence data is stored in the variables
@@ -1533,6 +1735,7 @@ struct http_stat
   char *rderrmsg;               /* error message from read error */
   char *newloc;                 /* new location (redirection) */
   char *remote_time;            /* remote time-stamp string */
+  char *etag;                   /* ETag header */
   char *error;                  /* textual HTTP error */
   int statcode;                 /* status code */
   char *message;                /* status message */
@@ -1551,6 +1754,12 @@ struct http_stat
   wgint orig_file_size;         /* size of file to compare for time-stamping */
   time_t orig_file_tstamp;      /* time-stamp of file to compare for
                                  * time-stamping */
+  char *if_none_match;          /* saved ETag of the local file */
+  char *if_modified_since;      /* saved Last-Modified of the local file */
+  unsigned char digest[SHA256_DIGEST_SIZE];
+                                /* SHA-256 of the body, for --dedup */
+  bool digest_valid;            /* whether DIGEST is that of the whole
+                                   local file */
 #ifdef HAVE_METALINK
   metalink_t *metalink;
 #endif
@@ -1561,10 +1770,13 @@ free_hstat (struct http_stat *hs)
 {
   xfree (hs->newloc);
   xfree (hs->remote_time);
+  xfree (hs->etag);
   xfree (hs->error);
   xfree (hs->rderrmsg);
   xfree (hs->local_file);
   xfree (hs->orig_file_name);
+  xfree (hs->if_none_match);
+  xfree (hs->if_modified_since);
   xfree (hs->message);
 #ifdef HAVE_METALINK
   metalink_delete (hs->metalink);
@@ -1616,6 +1828,9 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
   FILE *warc_tmp = NULL;
   int warcerr = 0;
   int flags = 0;
+  bool preallocated = false;
+  struct sha256_ctx digest_ctx;
+  struct sha256_ctx *digest = NULL;
 
   if (opt.warc_filename != NULL)
     {
@@ -1664,6 +1879,20 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
   if (chunked_transfer_encoding)
     flags |= rb_chunked_transfer_encoding;
 
+  /* Reserve the space of the body that is going to be written.  */
+  if (opt.preallocate && fp != NULL && fp != output_stream && contlen > 0)
+    preallocated = file_preallocate (fp, contlen - ((flags & rb_skip_startpos)
+                                                    ? hs->restval : 0));
+
+  /* For --dedup, hash the body if it is going to be all that the
+     local file holds.  */
+  if (opt.dedup != dedup_none && fp != NULL && fp != output_stream
+      && hs->restval == 0 && !opt.save_headers)
+    {
+      sha256_init_ctx (&digest_ctx);
+      digest = &digest_ctx;
+    }
+
   hs->len = hs->restval;
   hs->rd_size = 0;
   /* Download the response body and write it to fp.
@@ -1671,9 +1900,16 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
      response body to warc_tmp.  */
   hs->res = fd_read_body (hs->local_file, sock, fp, contlen != -1 ? contlen : 0,
                           hs->restval, &hs->rd_size, &hs->len, &hs->dltime,
-                          flags, warc_tmp);
+                          flags, warc_tmp, digest);
+  if (preallocated)
+    file_trim (fp);
   if (hs->res >= 0)
     {
+      if (digest)
+        {
+          sha256_finish_ctx (digest, hs->digest);
+          hs->digest_valid = true;
+        }
       if (warc_tmp != NULL)
         {
           /* Create a response record and write it to the WARC file.
@@ -1689,6 +1925,12 @@ read_response_body (struct http_stat *hs, int sock, FILE *fp, wgint contlen,
 
           if (! r)
             return WARC_ERR;
+
+          /* Record how long each phase of the request took.  */
+          r = warc_write_timing_record (url, warc_timestamp_str,
+                                        warc_request_uuid, warc_ip);
+          if (! r)
+            return WARC_ERR;
         }
 
       return RETRFINISHED;
@@ -1836,7 +2078,11 @@ initialize_request (struct url *u, struct http_stat *hs, int *dt, struct url *pr
       /* ... but some HTTP/1.0 caches doesn't implement Cache-Control.  */
       request_set_header (req, "Pragma", "no-cache", rel_none);
     }
-  if (*dt & IF_MODIFIED_SINCE)
+  if ((*dt & IF_MODIFIED_SINCE) && hs->if_modified_since)
+    /* Send the date the server gave, which it is sure to understand.  */
+    request_set_header (req, "If-Modified-Since", hs->if_modified_since,
+                        rel_none);
+  else if (*dt & IF_MODIFIED_SINCE)
     {
       char strtime[32];
       uerr_t err = time_to_rfc1123 (hs->orig_file_tstamp, strtime, countof (strtime));
@@ -1850,6 +2096,8 @@ initialize_request (struct url *u, struct http_stat *hs, int *dt, struct url *pr
         }
       request_set_header (req, "If-Modified-Since", xstrdup (strtime), rel_value);
     }
+  if ((*dt & IF_MODIFIED_SINCE) && hs->if_none_match)
+    request_set_header (req, "If-None-Match", hs->if_none_match, rel_none);
   if (hs->restval)
     request_set_header (req, "Range",
                         aprintf ("bytes=%s-",
@@ -2022,6 +2270,7 @@ establish_connection (struct url *u, struct url **conn_ref,
                         quotearg_style (escape_quoting_style, pconn.host),
                         pconn.port);
           DEBUGP (("Reusing fd %d.\n", sock));
+          stats_connection (true);
           if (pconn.authorized)
             /* If the connection is already authorized, the "Basic"
                authorization added by code above is unnecessary and
@@ -2131,7 +2380,12 @@ establish_connection (struct url *u, struct url **conn_ref,
 
       if (conn->scheme == SCHEME_HTTPS)
         {
-          if (!ssl_connect_wget (sock, u->host))
+          bool ssl_connected;
+
+          stats_phase_begin (PHASE_TLS);
+          ssl_connected = ssl_connect_wget (sock, u->host, u->port);
+          stats_phase_end (PHASE_TLS);
+          if (!ssl_connected)
             {
               CLOSE_INVALIDATE (sock);
               return CONSSLERR;
@@ -2151,6 +2405,19 @@ establish_connection (struct url *u, struct url **conn_ref,
   return RETROK;
 }
 
+/* Whether FILE, the local copy of U, exists.  Files the validator
+   file lists are taken to exist without looking.  */
+
+static bool
+local_file_exists_p (const struct url *u, const char *file)
+{
+  const struct validator *e = validator_get (u->url);
+
+  if (e && strcmp (e->local_file, file) == 0)
+    return true;
+  return file_exists_p (file);
+}
+
 static uerr_t
 set_file_timestamp (struct http_stat *hs)
 {
@@ -2226,7 +2493,7 @@ check_file_output (struct url *u, struct http_stat *hs,
 
       /* Honor Content-Disposition whether possible. */
       if (!opt.content_disposition
-          || !resp_header_copy (resp, "Content-Disposition",
+          || !resp_header_copy (resp, HDR_CONTENT_DISPOSITION,
                                 hdrval, hdrsize)
           || !parse_content_disposition (hdrval, &local_file))
         {
@@ -2245,7 +2512,7 @@ check_file_output (struct url *u, struct http_stat *hs,
     }
 
   /* TODO: perform this check only once. */
-  if (!hs->existence_checked && file_exists_p (hs->local_file))
+  if (!hs->existence_checked && local_file_exists_p (u, hs->local_file))
     {
       if (opt.noclobber && !opt.output_document)
         {
@@ -2295,7 +2562,7 @@ check_auth (struct url *u, char *user, char *passwd, struct response *resp,
       const char *wabeg, *waend;
       const char *digest = NULL, *basic = NULL, *ntlm = NULL;
       for (wapos = 0; !ntlm
-             && (wapos = resp_header_locate (resp, "WWW-Authenticate", wapos,
+             && (wapos = resp_header_locate (resp, HDR_WWW_AUTHENTICATE, wapos,
                                              &wabeg, &waend)) != -1;
            ++wapos)
         {
@@ -2436,7 +2703,7 @@ open_output_stream (struct http_stat *hs, int count, FILE **fp)
           open_id = 21;
           *fp = fopen (hs->local_file, "ab", FOPEN_OPT_ARGS);
 #else /* def __VMS */
-          *fp = fopen (hs->local_file, "ab");
+          *fp = fopen_output (hs->local_file, true);
 #endif /* def __VMS [else] */
         }
       else if (ALLOW_CLOBBER || count > 0)
@@ -2457,7 +2724,7 @@ open_output_stream (struct http_stat *hs, int count, FILE **fp)
           open_id = 22;
           *fp = fopen (hs->local_file, "wb", FOPEN_OPT_ARGS);
 #else /* def __VMS */
-          *fp = fopen (hs->local_file, "wb");
+          *fp = fopen_output (hs->local_file, false);
 #endif /* def __VMS [else] */
         }
       else
@@ -2538,7 +2805,7 @@ metalink_from_http (const struct response *resp, const struct http_stat *hs,
 
   /* Find all Link headers.  */
   for (i = 0;
-       (i = resp_header_locate (resp, "Link", i, &val_beg, &val_end)) != -1;
+       (i = resp_header_locate (resp, HDR_LINK, i, &val_beg, &val_end)) != -1;
        i++)
     {
       char *rel = NULL, *reltype = NULL;
@@ -2783,7 +3050,7 @@ metalink_from_http (const struct response *resp, const struct http_stat *hs,
 
   /* Find all Digest headers.  */
   for (i = 0;
-       (i = resp_header_locate (resp, "Digest", i, &val_beg, &val_end)) != -1;
+       (i = resp_header_locate (resp, HDR_DIGEST, i, &val_beg, &val_end)) != -1;
        i++)
     {
       const char *dig_pos;
@@ -2976,6 +3243,9 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
     }
 #endif /* HAVE_SSL */
 
+  stats_request_begin ();
+  limit_bandwidth_host (u->host);
+
   /* Initialize certain elements of struct http_stat.  */
   hs->len = 0;
   hs->contlen = -1;
@@ -2983,6 +3253,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   hs->rderrmsg = NULL;
   hs->newloc = NULL;
   xfree(hs->remote_time);
+  xfree (hs->etag);
+  hs->digest_valid = false;
   hs->error = NULL;
   hs->message = NULL;
 
@@ -3065,6 +3337,8 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
     }
 
   /* Send the request to server.  */
+  stats_phase_begin (PHASE_TTFB);
+  stats_phase_begin (PHASE_REQUEST);
   write_error = request_send (req, sock, warc_tmp);
 
   if (write_error >= 0)
@@ -3095,6 +3369,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
           write_error = body_file_send (sock, opt.body_file, body_data_size, warc_tmp);
         }
     }
+  stats_phase_end (PHASE_REQUEST);
 
   if (write_error < 0)
     {
@@ -3208,7 +3483,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
     }
 
   if (!opt.ignore_length
-      && resp_header_copy (resp, "Content-Length", hdrval, sizeof (hdrval)))
+      && resp_header_copy (resp, HDR_CONTENT_LENGTH, hdrval, sizeof (hdrval)))
     {
       wgint parsed;
       errno = 0;
@@ -3235,7 +3510,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   /* Check for keep-alive related responses. */
   if (!inhibit_keep_alive)
     {
-      if (resp_header_copy (resp, "Connection", hdrval, sizeof (hdrval)))
+      if (resp_header_copy (resp, HDR_CONNECTION, hdrval, sizeof (hdrval)))
         {
           if (0 == c_strcasecmp (hdrval, "Close"))
             keep_alive = false;
@@ -3243,7 +3518,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
     }
 
   chunked_transfer_encoding = false;
-  if (resp_header_copy (resp, "Transfer-Encoding", hdrval, sizeof (hdrval))
+  if (resp_header_copy (resp, HDR_TRANSFER_ENCODING, hdrval, sizeof (hdrval))
       && 0 == c_strcasecmp (hdrval, "chunked"))
     chunked_transfer_encoding = true;
 
@@ -3255,7 +3530,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
       /* The jar should have been created by now. */
       assert (wget_cookie_jar != NULL);
       for (scpos = 0;
-           (scpos = resp_header_locate (resp, "Set-Cookie", scpos,
+           (scpos = resp_header_locate (resp, HDR_SET_COOKIE, scpos,
                                         &scbeg, &scend)) != -1;
            ++scpos)
         {
@@ -3293,7 +3568,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
       if (warc_enabled)
         {
           int _err;
-          type = resp_header_strdup (resp, "Content-Type");
+          type = resp_header_strdup (resp, HDR_CONTENT_TYPE);
           _err = read_response_body (hs, sock, NULL, contlen, 0,
                                     chunked_transfer_encoding,
                                     u->url, warc_timestamp_str,
@@ -3383,7 +3658,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
 #ifdef HAVE_HSTS
   if (opt.hsts && hsts_store)
     {
-      hsts_params = resp_header_strdup (resp, "Strict-Transport-Security");
+      hsts_params = resp_header_strdup (resp, HDR_STRICT_TRANSPORT_SECURITY);
       if (parse_strict_transport_security (hsts_params, &max_age, &include_subdomains))
 	{
 	  /* process strict transport security */
@@ -3403,7 +3678,12 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
     }
 #endif
 
-  type = resp_header_strdup (resp, "Content-Type");
+  /* Tell the robots cache how long this robots.txt stays fresh. */
+  if (opt.robots_cache && statcode == HTTP_STATUS_OK
+      && is_robots_txt_url (u->url))
+    res_cache_set_lifetime (response_lifetime (resp));
+
+  type = resp_header_strdup (resp, HDR_CONTENT_TYPE);
   if (type)
     {
       char *tmp = strchr (type, ';');
@@ -3426,10 +3706,11 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
             }
         }
     }
-  hs->newloc = resp_header_strdup (resp, "Location");
-  hs->remote_time = resp_header_strdup (resp, "Last-Modified");
+  hs->newloc = resp_header_strdup (resp, HDR_LOCATION);
+  hs->remote_time = resp_header_strdup (resp, HDR_LAST_MODIFIED);
+  hs->etag = resp_header_strdup (resp, HDR_ETAG);
 
-  if (resp_header_copy (resp, "Content-Range", hdrval, sizeof (hdrval)))
+  if (resp_header_copy (resp, HDR_CONTENT_RANGE, hdrval, sizeof (hdrval)))
     {
       wgint first_byte_pos, last_byte_pos, entity_length;
       if (parse_content_range (hdrval, &first_byte_pos, &last_byte_pos,
@@ -3576,6 +3857,7 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
                      _("File %s not modified on server. Omitting download.\n\n"),
                      quote (hs->local_file));
           *dt |= RETROKF;
+          validator_refresh (u->url, hs->etag, hs->remote_time);
           CLOSE_FINISH (sock);
           retval = RETRUNNEEDED;
           goto cleanup;
@@ -3603,6 +3885,30 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         }
     }
 
+  /* Time-stamping without a preliminary HEAD: decide from the headers
+     of the GET, and skip the body if the local file is up to date.  */
+  if ((*dt & SKIP_UNNEEDED_BODY) && opt.timestamping
+      && statcode == HTTP_STATUS_OK && hs->orig_file_name && hs->remote_time)
+    {
+      time_t tmr = http_atotm (hs->remote_time);
+
+      if (tmr != (time_t) -1 && tmr <= hs->orig_file_tstamp
+          && (contlen == -1 || contlen == hs->orig_file_size))
+        {
+          logprintf (LOG_VERBOSE, _("\
+Server file no newer than local file %s -- not retrieving.\n\n"),
+                     quote (hs->orig_file_name));
+          *dt |= RETROKF;
+          if (keep_alive
+              && skip_short_body (sock, contlen, chunked_transfer_encoding))
+            CLOSE_FINISH (sock);
+          else
+            CLOSE_INVALIDATE (sock);
+          retval = RETRUNNEEDED;
+          goto cleanup;
+        }
+    }
+
   if (statcode == HTTP_STATUS_RANGE_NOT_SATISFIABLE
       || (!opt.timestamping && hs->restval > 0 && statcode == HTTP_STATUS_OK
           && contrange == 0 && contlen >= 0 && hs->restval >= contlen))
@@ -3675,8 +3981,10 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
         }
     }
 
-  /* Return if we have no intention of further downloading.  */
-  if ((!(*dt & RETROKF) && !opt.content_on_error) || head_only)
+  /* Return if we have no intention of further downloading.  A spider
+     needs only the bodies of HTML documents, to look for links.  */
+  if ((!(*dt & RETROKF) && !opt.content_on_error) || head_only
+      || ((*dt & SKIP_UNNEEDED_BODY) && opt.spider && !(*dt & TEXTHTML)))
     {
       /* In case the caller cares to look...  */
       hs->len = 0;
@@ -3758,6 +4066,52 @@ gethttp (struct url *u, struct http_stat *hs, int *dt, struct url *proxy,
   return retval;
 }
 
+/* Set up HS for time-stamping FILE_NAME, the local copy of U, from the
+   validator file rather than from the file itself, and make the conditional
+   request depend on the validators saved with it.  Return false if the
+   validator file does not list FILE_NAME as the copy of U.  */
+
+static bool
+validator_file_timestamp (const struct url *u, struct http_stat *hs,
+                          const char *file_name)
+{
+  const struct validator *e = validator_get (u->url);
+
+  if (!e || strcmp (e->local_file, file_name) != 0)
+    return false;
+  DEBUGP (("Time-stamping %s from the validator file.\n", file_name));
+  hs->orig_file_name = xstrdup (file_name);
+  hs->orig_file_size = e->size;
+  hs->orig_file_tstamp = e->mtime;
+#ifdef WINDOWS
+  /* See set_file_timestamp.  */
+  ++hs->orig_file_tstamp;
+#endif
+  hs->timestamp_checked = true;
+  hs->if_none_match = e->etag ? xstrdup (e->etag) : NULL;
+  hs->if_modified_since = e->last_modified ? xstrdup (e->last_modified) : NULL;
+  return true;
+}
+
+/* Add U, just downloaded to HS->local_file, to the validator file.  */
+
+static void
+validator_add (const struct url *u, const struct http_stat *hs)
+{
+  struct_stat st;
+
+  if (!opt.validator_file || opt.output_document || opt.delete_after
+      || opt.spider)
+    return;
+  if (hs->statcode != HTTP_STATUS_OK
+      && hs->statcode != HTTP_STATUS_PARTIAL_CONTENTS)
+    return;
+  if (stat (hs->local_file, &st) != 0)
+    return;
+  validator_put (u->url, hs->local_file, st.st_size, st.st_mtime,
+                 hs->etag, hs->remote_time);
+}
+
 /* The genuine HTTP loop!  This is the part where the retrieval is
    retried, and retried, and retried, and...  */
 uerr_t
@@ -3776,6 +4130,7 @@ http_loop (struct url *u, struct url *original_url, char **newloc,
   struct http_stat hstat;        /* HTTP status */
   struct_stat st;
   bool send_head_first = true;
+  bool expect_html;
   char *file_name;
   bool force_full_retrieve = false;
 
@@ -3821,7 +4176,8 @@ http_loop (struct url *u, struct url *original_url, char **newloc,
       got_name = true;
     }
 
-  if (got_name && file_exists_p (hstat.local_file) && opt.noclobber && !opt.output_document)
+  if (got_name && opt.noclobber && !opt.output_document
+      && local_file_exists_p (u, hstat.local_file))
     {
       /* If opt.noclobber is turned on and file already exists, do not
          retrieve the file. But if the output_document was given, then this
@@ -3834,8 +4190,9 @@ http_loop (struct url *u, struct url *original_url, char **newloc,
   /* Reset the counter. */
   count = 0;
 
-  /* Reset the document type. */
-  *dt = 0;
+  /* Reset the document type, but for the caller's hint. */
+  expect_html = !!(*dt & EXPECT_HTML);
+  *dt &= EXPECT_HTML;
 
   /* Skip preliminary HEAD request if we're not in spider mode.  */
   if (!opt.spider)
@@ -3863,23 +4220,43 @@ http_loop (struct url *u, struct url *original_url, char **newloc,
     {
       /* Use conditional get request if requested
        * and if timestamp is known at this moment.  */
-      if (opt.if_modified_since && file_exists_p (file_name) && !send_head_first)
+      bool listed = validator_file_timestamp (u, &hstat, file_name);
+
+      if (opt.if_modified_since && !send_head_first
+          && (listed || file_exists_p (file_name)))
         {
           *dt |= IF_MODIFIED_SINCE;
-          {
-            uerr_t timestamp_err = set_file_timestamp (&hstat);
-            if (timestamp_err != RETROK)
-              return timestamp_err;
-          }
+          if (!listed)
+            {
+              uerr_t timestamp_err = set_file_timestamp (&hstat);
+              if (timestamp_err != RETROK)
+                return timestamp_err;
+            }
         }
         /* Send preliminary HEAD request if -N is given and we have existing
          * destination file or content disposition is enabled.  */
-      else if (file_exists_p (file_name) || opt.content_disposition)
+      else if (listed || file_exists_p (file_name) || opt.content_disposition)
         send_head_first = true;
     }
 
   xfree (file_name);
 
+  /* With --no-head-first, the HEAD is left out where the headers of
+     the GET are enough to tell whether its body is needed: that of an
+     HTML page for a recursive spider, and that of a newer file for
+     time-stamping.  In recursive spider mode, documents which are
+     not expected to be HTML are still HEADed, as their bodies would
+     be skipped anyway.  */
+  if (send_head_first && !opt.head_first && !opt.always_rest
+      && !(*dt & METALINK_METADATA)
+      && (opt.spider
+          ? opt.recursive && !opt.timestamping && expect_html
+          : opt.timestamping))
+    {
+      send_head_first = false;
+      *dt |= SKIP_UNNEEDED_BODY;
+    }
+
   /* THE loop */
   do
     {
@@ -4136,7 +4513,11 @@ Last-modified header invalid -- time-stamp ignored.\n"));
                 time_came_from_head = true;
             }
 
-          if (send_head_first)
+          /* A spider's GET of a document that turned out not to be
+             HTML ended like a HEAD.  */
+          if (send_head_first
+              || ((*dt & SKIP_UNNEEDED_BODY) && opt.spider
+                  && !(*dt & TEXTHTML)))
             {
               /* The time-stamping section.  */
               if (opt.timestamping)
@@ -4296,6 +4677,9 @@ Remote file exists.\n\n"));
             downloaded_file (FILE_DOWNLOADED_AND_HTML_EXTENSION_ADDED, hstat.local_file);
           else
             downloaded_file (FILE_DOWNLOADED_NORMALLY, hstat.local_file);
+          if (hstat.digest_valid)
+            dedup_file (hstat.local_file, hstat.digest);
+          validator_add (u, &hstat);
 
           ret = RETROK;
           goto exit;
@@ -4329,6 +4713,9 @@ Remote file exists.\n\n"));
                 downloaded_file (FILE_DOWNLOADED_AND_HTML_EXTENSION_ADDED, hstat.local_file);
               else
                 downloaded_file (FILE_DOWNLOADED_NORMALLY, hstat.local_file);
+              if (hstat.digest_valid)
+                dedup_file (hstat.local_file, hstat.digest);
+              validator_add (u, &hstat);
 
               ret = RETROK;
               goto exit;
@@ -4832,8 +5219,12 @@ load_cookies (void)
     wget_cookie_jar = cookie_jar_new ();
   if (opt.cookies_input && !cookies_loaded_p)
     {
+      struct ptimer *timer = ptimer_new ();
       cookie_jar_load (wget_cookie_jar, opt.cookies_input);
       cookies_loaded_p = true;
+      DEBUGP (("Loaded cookies from %s in %.3f ms.\n", opt.cookies_input,
+               ptimer_measure (timer) * 1000));
+      ptimer_destroy (timer);
     }
 }
 
@@ -4891,6 +5282,83 @@ ensure_extension (struct http_stat *hs, const char *ext, int *dt)
 }
 
 #ifdef TESTING
+/* Parse the response head HEAD and look up the headers the way gethttp
+   does, for the microbenchmarks.  Returns the number of headers
+   found.  */
+int
+http_bench_response (const char *head)
+{
+  static const enum resp_header_name single[] = {
+    HDR_CONTENT_LENGTH, HDR_CONNECTION, HDR_TRANSFER_ENCODING,
+    HDR_CONTENT_TYPE, HDR_STRICT_TRANSPORT_SECURITY, HDR_LOCATION,
+    HDR_LAST_MODIFIED, HDR_CONTENT_RANGE, HDR_CONTENT_DISPOSITION,
+    HDR_CONTENT_TYPE,
+  };
+  struct response *resp = resp_new (head);
+  char hdrval[256];
+  const char *b, *e;
+  int found = 0, pos;
+  size_t i;
+
+  if (resp_status (resp, NULL) == 200)
+    found++;
+  for (i = 0; i < countof (single); i++)
+    found += resp_header_copy (resp, single[i], hdrval, sizeof (hdrval));
+  for (pos = 0; (pos = resp_header_locate (resp, HDR_SET_COOKIE, pos,
+                                           &b, &e)) != -1; pos++)
+    found++;
+  for (pos = 0; (pos = resp_header_locate (resp, HDR_LINK, pos,
+                                           &b, &e)) != -1; pos++)
+    found++;
+  resp_free (&resp);
+  return found;
+}
+
+const char *
+test_resp_header (void)
+{
+  static const char head[] =
+    "HTTP/1.1 200 OK\r\n"
+    "content-length:  42 \r\n"
+    "Set-Cookie: a=1\r\n"
+    "X-Content-Length: 7\r\n"
+    "Link: <http://example.com/a>;\r\n"
+    "  rel=duplicate\r\n"
+    "Set-Cookie: b=2\r\n"
+    "Content-Type : text/html\r\n"
+    "Set-Cookie: c=3\r\n"
+    "\r\n";
+  static const char *cookies[] = { "a=1", "b=2", "c=3" };
+  struct response *resp = resp_new (head);
+  const char *b, *e;
+  char buf[64];
+  int pos, n;
+
+  mu_assert ("test_resp_header: wrong Content-Length",
+             resp_header_copy (resp, HDR_CONTENT_LENGTH, buf, sizeof (buf))
+             && !strcmp (buf, "42"));
+  mu_assert ("test_resp_header: Content-Type with a space before the colon",
+             !resp_header_get (resp, HDR_CONTENT_TYPE, &b, &e));
+  mu_assert ("test_resp_header: wrong Link",
+             resp_header_copy (resp, HDR_LINK, buf, sizeof (buf))
+             && !strcmp (buf, "<http://example.com/a>;\r\n  rel=duplicate"));
+
+  for (n = 0, pos = 0;
+       (pos = resp_header_locate (resp, HDR_SET_COOKIE, pos, &b, &e)) != -1;
+       pos++, n++)
+    mu_assert ("test_resp_header: wrong Set-Cookie",
+               n < 3 && e - b == 3 && !memcmp (b, cookies[n], 3));
+  mu_assert ("test_resp_header: wrong number of Set-Cookie", n == 3);
+
+  /* Starting in the middle finds the following ones.  */
+  mu_assert ("test_resp_header: Set-Cookie after position 3",
+             resp_header_locate (resp, HDR_SET_COOKIE, 3, &b, &e) == 5
+             && !memcmp (b, "b=2", 3));
+
+  resp_free (&resp);
+  return NULL;
+}
+
 const char *
 test_parse_content_disposition(void)
 {
@@ -47,5 +47,9 @@ typedef struct {
 } param_token;
 bool extract_param (const char **, param_token *, param_token *, char, bool *);
 
+#ifdef TESTING
+int http_bench_response (const char *);
+#endif
+
 
 #endif /* HTTP_H */
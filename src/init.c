@@ -68,7 +68,10 @@ as that of the covered work.  */
 #include "http.h"               /* for http_cleanup */
 #include "retr.h"               /* for output_stream */
 #include "warc.h"               /* for warc_close */
+#include "stats.h"              /* for stats_cleanup */
 #include "spider.h"             /* for spider_cleanup */
+#include "evloop.h"             /* for evloop_cleanup */
+#include "uring.h"              /* for uring_cleanup */
 #include "html-url.h"           /* for cleanup_html_url */
 #include "c-strcase.h"
 
@@ -100,6 +103,7 @@ CMD_DECLARE (cmd_vector);
 CMD_DECLARE (cmd_spec_dirstruct);
 CMD_DECLARE (cmd_spec_header);
 CMD_DECLARE (cmd_spec_warc_header);
+CMD_DECLARE (cmd_spec_dedup);
 CMD_DECLARE (cmd_spec_htmlify);
 CMD_DECLARE (cmd_spec_mirror);
 CMD_DECLARE (cmd_spec_prefer_family);
@@ -141,6 +145,7 @@ static const struct {
   { "backupconverted",  &opt.backup_converted,  cmd_boolean },
   { "backups",          &opt.backups,           cmd_number },
   { "base",             &opt.base_href,         cmd_string },
+  { "binarysnapshots",  &opt.binary_snapshots,  cmd_boolean },
   { "bindaddress",      &opt.bind_address,      cmd_string },
   { "bodydata",         &opt.body_data,         cmd_string },
   { "bodyfile",         &opt.body_file,         cmd_string },
@@ -166,6 +171,8 @@ static const struct {
 #endif
   { "cutdirs",          &opt.cut_dirs,          cmd_number },
   { "debug",            &opt.debug,             cmd_boolean },
+  { "dedup",            &opt.dedup,             cmd_spec_dedup },
+  { "dedupindex",       &opt.dedup_index,       cmd_file },
   { "defaultpage",      &opt.default_page,      cmd_string },
   { "deleteafter",      &opt.delete_after,      cmd_boolean },
   { "dirprefix",        &opt.dir_prefix,        cmd_directory },
@@ -177,6 +184,7 @@ static const struct {
   { "dotsinline",       &opt.dots_in_line,      cmd_number },
   { "dotspacing",       &opt.dot_spacing,       cmd_number },
   { "dotstyle",         &opt.dot_style,         cmd_string }, /* deprecated */
+  { "dropcache",        &opt.drop_cache,        cmd_boolean },
 #ifdef HAVE_SSL
   { "egdfile",          &opt.egd_file,          cmd_file },
 #endif
@@ -185,6 +193,8 @@ static const struct {
   { "followftp",        &opt.follow_ftp,        cmd_boolean },
   { "followtags",       &opt.follow_tags,       cmd_vector },
   { "forcehtml",        &opt.force_html,        cmd_boolean },
+  { "ftpconnections",   &opt.ftp_connections,   cmd_number },
+  { "ftpmlsd",          &opt.ftp_mlsd,          cmd_boolean },
   { "ftppasswd",        &opt.ftp_passwd,        cmd_string }, /* deprecated */
   { "ftppassword",      &opt.ftp_passwd,        cmd_string },
   { "ftpproxy",         &opt.ftp_proxy,         cmd_string },
@@ -194,6 +204,7 @@ static const struct {
   { "ftpuser",          &opt.ftp_user,          cmd_string },
   { "glob",             &opt.ftp_glob,          cmd_boolean },
   { "header",           NULL,                   cmd_spec_header },
+  { "headfirst",        &opt.head_first,        cmd_boolean },
 #ifdef HAVE_HSTS
   { "hsts",             &opt.hsts,              cmd_boolean },
   { "hsts-file",        &opt.hsts_file,         cmd_file },
@@ -224,7 +235,9 @@ static const struct {
 #endif
   { "iri",              &opt.enable_iri,        cmd_boolean },
   { "keepsessioncookies", &opt.keep_session_cookies, cmd_boolean },
+  { "limitburst",       &opt.limit_burst,       cmd_bytes },
   { "limitrate",        &opt.limit_rate,        cmd_bytes },
+  { "limitrateperhost", &opt.limit_rate_per_host, cmd_bytes },
   { "loadcookies",      &opt.cookies_input,     cmd_file },
   { "localencoding",    &opt.locale,            cmd_string },
   { "logfile",          &opt.lfilename,         cmd_file },
@@ -248,6 +261,7 @@ static const struct {
   { "password",         &opt.passwd,            cmd_string },
   { "postdata",         &opt.post_data,         cmd_string },
   { "postfile",         &opt.post_file_name,    cmd_file },
+  { "preallocate",      &opt.preallocate,       cmd_boolean },
   { "preferfamily",     NULL,                   cmd_spec_prefer_family },
 #ifdef HAVE_METALINK
   { "preferred-location", &opt.preferred_location, cmd_string },
@@ -284,6 +298,7 @@ static const struct {
   { "retrsymlinks",     &opt.retr_symlinks,     cmd_boolean },
   { "retryconnrefused", &opt.retry_connrefused, cmd_boolean },
   { "robots",           &opt.use_robots,        cmd_boolean },
+  { "robotscache",      &opt.robots_cache,      cmd_file },
   { "savecookies",      &opt.cookies_output,    cmd_file },
   { "saveheaders",      &opt.save_headers,      cmd_boolean },
 #ifdef HAVE_SSL
@@ -295,9 +310,15 @@ static const struct {
   { "spanhosts",        &opt.spanhost,          cmd_boolean },
   { "spider",           &opt.spider,            cmd_boolean },
   { "startpos",         &opt.start_pos,         cmd_bytes },
+  { "statsfd",          &opt.stats_fd,          cmd_number },
+  { "statsfile",        &opt.stats_file,        cmd_file },
   { "strictcomments",   &opt.strict_comments,   cmd_boolean },
   { "timeout",          NULL,                   cmd_spec_timeout },
   { "timestamping",     &opt.timestamping,      cmd_boolean },
+  { "timinglog",        &opt.timing_log,        cmd_file },
+#ifdef HAVE_SSL
+  { "tlssessionfile",   &opt.tls_session_file,  cmd_file },
+#endif
   { "tries",            &opt.ntry,              cmd_number_inf },
   { "trustservernames", &opt.trustservernames,  cmd_boolean },
   { "unlink",           &opt.unlink,            cmd_boolean },
@@ -305,7 +326,9 @@ static const struct {
   { "user",             &opt.user,              cmd_string },
   { "useragent",        NULL,                   cmd_spec_useragent },
   { "useservertimestamps", &opt.useservertimestamps, cmd_boolean },
+  { "validatorfile",    &opt.validator_file,    cmd_file },
   { "verbose",          NULL,                   cmd_spec_verbose },
+  { "verifyvalidatorfile", &opt.verify_validator_file, cmd_boolean },
   { "wait",             &opt.wait,              cmd_time },
   { "waitretry",        &opt.waitretry,         cmd_time },
   { "warccdx",          &opt.warc_cdx_enabled,  cmd_boolean },
@@ -377,6 +400,7 @@ defaults (void)
   opt.prefer_family = prefer_none;
   opt.allow_cache = true;
   opt.if_modified_since = true;
+  opt.head_first = true;
 
   opt.read_timeout = 900;
   opt.use_robots = true;
@@ -389,6 +413,9 @@ defaults (void)
 
   opt.dns_cache = true;
   opt.ftp_pasv = true;
+  opt.ftp_mlsd = true;
+  opt.ftp_connections = 1;
+  opt.stats_fd = -1;
   /* 2014-09-07  Darshit Shah  <darnir@gmail.com>
    * opt.retr_symlinks is set to true by default. Creating symbolic links on the
    * local filesystem pose a security threat by malicious FTP Servers that
@@ -1463,6 +1490,24 @@ cmd_spec_recursive (const char *com, const char *val, void *place_ignored _GL_UN
   return true;
 }
 
+/* Validate --dedup and set the choice.  */
+
+static bool
+cmd_spec_dedup (const char *com, const char *val, void *place_ignored _GL_UNUSED)
+{
+  static const struct decode_item choices[] = {
+    { "none",     dedup_none },
+    { "reflink",  dedup_reflink },
+    { "hardlink", dedup_hardlink },
+  };
+  int dedup = dedup_none;
+  int ok = decode_string (val, choices, countof (choices), &dedup);
+  if (!ok)
+    fprintf (stderr, _("%s: %s: Invalid value %s.\n"), exec_name, com, quote (val));
+  opt.dedup = dedup;
+  return ok;
+}
+
 /* Validate --regex-type and set the choice.  */
 
 static bool
@@ -1781,6 +1826,8 @@ cleanup (void)
   if (opt.warc_filename != 0)
     warc_close ();
 
+  stats_cleanup ();
+
   log_close ();
 
   if (output_stream)
@@ -1807,6 +1854,11 @@ cleanup (void)
   host_cleanup ();
   log_cleanup ();
   netrc_cleanup ();
+  dir_cache_cleanup ();
+  iri_cleanup ();
+  limit_bandwidth_cleanup ();
+  evloop_cleanup ();
+  uring_cleanup ();
 
   xfree (opt.choose_config);
   xfree (opt.lfilename);
@@ -1845,10 +1897,14 @@ cleanup (void)
   xfree (opt.crl_file);
   xfree (opt.random_file);
   xfree (opt.egd_file);
+  xfree (opt.tls_session_file);
 # endif
   xfree (opt.bind_address);
   xfree (opt.cookies_input);
   xfree (opt.cookies_output);
+  xfree (opt.robots_cache);
+  xfree (opt.validator_file);
+  xfree (opt.dedup_index);
   xfree (opt.user);
   xfree (opt.passwd);
   xfree (opt.base_href);
@@ -1858,6 +1914,8 @@ cleanup (void)
   xfree (opt.body_data);
   xfree (opt.body_file);
   xfree (opt.rejected_log);
+  xfree (opt.stats_file);
+  xfree (opt.timing_log);
 
 #endif /* DEBUG_MALLOC */
 }
@@ -44,6 +44,7 @@ as that of the covered work.  */
 #include "c-strcase.h"
 #include "c-strcasestr.h"
 #include "xstrndup.h"
+#include "scan.h"
 
 /* RFC3987 section 3.1 mandates STD3 ASCII RULES */
 #define IDNA_FLAGS  IDNA_USE_STD3_ASCII_RULES
@@ -114,19 +115,164 @@ check_encoding_name (const char *encoding)
   return true;
 }
 
-/* Do the conversion according to the passed conversion descriptor cd. *out
-   will contain the transcoded string on success. *out content is
-   unspecified otherwise. */
+/* Return the length of the leading run of ASCII bytes in the LEN bytes
+   at S.  As URLs are mostly ASCII, many bytes are tested at a time:
+   SCAN_WIDTH with the vector scanning of scan.h, or a word's worth
+   otherwise.  */
+static size_t
+ascii_prefix_length (const char *s, size_t len)
+{
+#ifndef SCAN_VECTOR
+  const unsigned long high_bits = (unsigned long) -1 / 0xff * 0x80;
+#endif
+  size_t i = 0;
+
+#ifdef SCAN_VECTOR
+  for (; i + SCAN_WIDTH <= len; i += SCAN_WIDTH)
+    {
+      unsigned int mask = SCAN_MASK (SCAN_LOAD (s + i));
+      if (mask)
+        return i + __builtin_ctz (mask);
+    }
+#else
+  for (; i + sizeof (unsigned long) <= len; i += sizeof (unsigned long))
+    {
+      unsigned long word;
+      memcpy (&word, s + i, sizeof word);
+      if (word & high_bits)
+        break;
+    }
+#endif
+  while (i < len && !(s[i] & 0x80))
+    i++;
+  return i;
+}
+
+/* Return true if the LEN bytes at S are ASCII and contain no escapes,
+   i.e. if converting them from an ASCII-compatible encoding is a no-op. */
+static bool
+plain_ascii_p (const char *s, size_t len)
+{
+  return ascii_prefix_length (s, len) == len && !memchr (s, '%', len);
+}
+
+/* Opening a conversion descriptor is expensive with most iconv
+   implementations, and the same one or two conversions are needed for
+   every link of a document, so the descriptors are kept open in a
+   small most-recently-used cache.  Failures are cached as well.  */
+
+#define ICONV_CACHE_SIZE 4
+
+static struct iconv_cache_entry {
+  char *tocode, *fromcode;
+  iconv_t cd;
+  bool ascii_compatible;        /* ASCII converts to itself */
+} iconv_cache[ICONV_CACHE_SIZE];
+
+static int iconv_cache_count;
+
+/* Return true if CD converts the printable ASCII characters to
+   themselves, as it does for all the common encodings except UTF-7,
+   UTF-16 and friends, and EBCDIC.  */
+static bool
+iconv_ascii_compatible (iconv_t cd)
+{
+  char probe[0x7f - 0x20], out[sizeof probe * 4];
+  char *in = probe, *o = out;
+  size_t inlen = sizeof probe, outlen = sizeof out;
+  size_t i;
+  bool ok;
+
+  for (i = 0; i < sizeof probe; i++)
+    probe[i] = (char) (0x20 + i);
+  ok = iconv (cd, &in, &inlen, &o, &outlen) != (size_t)(-1)
+    && inlen == 0
+    && (size_t) (o - out) == sizeof probe
+    && !memcmp (probe, out, sizeof probe);
+  iconv (cd, NULL, NULL, NULL, NULL);
+  return ok;
+}
+
+/* Return the cache entry holding a descriptor converting FROMCODE to
+   TOCODE, opening it if needed.  The cd of the entry is (iconv_t)(-1)
+   if the conversion isn't supported.  */
+static struct iconv_cache_entry *
+iconv_cache_get (const char *tocode, const char *fromcode)
+{
+  struct iconv_cache_entry found;
+  int i;
+
+  for (i = 0; i < iconv_cache_count; i++)
+    if (!c_strcasecmp (iconv_cache[i].fromcode, fromcode)
+        && !c_strcasecmp (iconv_cache[i].tocode, tocode))
+      break;
+
+  if (i < iconv_cache_count)
+    {
+      found = iconv_cache[i];
+      /* Reset the shift state left behind by the previous user. */
+      if (found.cd != (iconv_t)(-1))
+        iconv (found.cd, NULL, NULL, NULL, NULL);
+    }
+  else
+    {
+      found.tocode = xstrdup (tocode);
+      found.fromcode = xstrdup (fromcode);
+      found.cd = iconv_open (tocode, fromcode);
+      found.ascii_compatible = found.cd != (iconv_t)(-1)
+        && iconv_ascii_compatible (found.cd);
+
+      if (iconv_cache_count < ICONV_CACHE_SIZE)
+        i = iconv_cache_count++;
+      else
+        {
+          /* Evict the least recently used descriptor. */
+          struct iconv_cache_entry *last = &iconv_cache[ICONV_CACHE_SIZE - 1];
+          if (last->cd != (iconv_t)(-1))
+            iconv_close (last->cd);
+          xfree (last->tocode);
+          xfree (last->fromcode);
+          i = ICONV_CACHE_SIZE - 1;
+        }
+    }
+
+  /* Move the entry to the front. */
+  memmove (&iconv_cache[1], &iconv_cache[0], i * sizeof iconv_cache[0]);
+  iconv_cache[0] = found;
+  return &iconv_cache[0];
+}
+
+/* Close the cached conversion descriptors. */
+void
+iri_cleanup (void)
+{
+  int i;
+
+  for (i = 0; i < iconv_cache_count; i++)
+    {
+      if (iconv_cache[i].cd != (iconv_t)(-1))
+        iconv_close (iconv_cache[i].cd);
+      xfree (iconv_cache[i].tocode);
+      xfree (iconv_cache[i].fromcode);
+    }
+  iconv_cache_count = 0;
+}
+
+/* Do the conversion from FROMCODE to TOCODE.  *out will contain the
+   transcoded string on success.  *out content is unspecified
+   otherwise. */
 static bool
 do_conversion (const char *tocode, const char *fromcode, char const *in_org, size_t inlen, char **out)
 {
+  struct iconv_cache_entry *entry;
   iconv_t cd;
   /* sXXXav : hummm hard to guess... */
   size_t len, done, outlen;
   int invalid = 0, tooshort = 0;
   char *s, *in, *in_save;
 
-  cd = iconv_open (tocode, fromcode);
+  entry = iconv_cache_get (tocode, fromcode);
+  cd = entry->cd;
   if (cd == (iconv_t)(-1))
     {
       logprintf (LOG_VERBOSE, _("Conversion from %s to UTF-8 isn't supported\n"),
@@ -135,6 +281,13 @@ do_conversion (const char *tocode, const char *fromcode, char const *in_org, siz
       return false;
     }
 
+  /* Nothing to convert. */
+  if (entry->ascii_compatible && plain_ascii_p (in_org, inlen))
+    {
+      *out = xstrndup (in_org, inlen);
+      return true;
+    }
+
   /* iconv() has to work on an unescaped string */
   in_save = in = xstrndup (in_org, inlen);
   url_unescape_except_reserved (in);
@@ -151,7 +304,6 @@ do_conversion (const char *tocode, const char *fromcode, char const *in_org, siz
           *out = s;
           *(s + len - outlen - done) = '\0';
           xfree(in_save);
-          iconv_close(cd);
           DEBUGP (("converted '%s' (%s) -> '%s' (%s)\n", in_org, fromcode, *out, tocode));
           return true;
         }
@@ -192,7 +344,6 @@ do_conversion (const char *tocode, const char *fromcode, char const *in_org, siz
     }
 
     xfree(in_save);
-    iconv_close(cd);
     DEBUGP (("converted '%s' (%s) -> '%s' (%s)\n", in_org, fromcode, *out, tocode));
     return false;
 }
@@ -233,8 +384,12 @@ locale_to_utf8 (const char *str)
 static bool
 _utf8_is_valid(const char *utf8)
 {
+  size_t len = strlen (utf8);
   const unsigned char *s = (const unsigned char *) utf8;
 
+  /* Host names are mostly ASCII: skip it quickly. */
+  s += ascii_prefix_length (utf8, len);
+
   while (*s)
     {
       if ((*s & 0x80) == 0) /* 0xxxxxxx ASCII char */
@@ -336,13 +491,12 @@ remote_to_utf8 (const struct iri *iri, const char *str, char **new)
      function. */
   if (!c_strcasecmp (iri->uri_encoding, "UTF-8"))
     {
-      const unsigned char *p;
-      for (p = (unsigned char *) str; *p; p++)
-        if (*p > 127)
-          {
-            *new = strdup (str);
-            return true;
-          }
+      size_t len = strlen (str);
+      if (ascii_prefix_length (str, len) < len)
+        {
+          *new = strdup (str);
+          return true;
+        }
       return false;
     }
 
@@ -55,6 +55,7 @@ struct iri *iri_dup (const struct iri *);
 void iri_free (struct iri *i);
 void set_uri_encoding (struct iri *i, const char *charset, bool force);
 void set_content_encoding (struct iri *i, const char *charset);
+void iri_cleanup (void);
 
 #else /* ENABLE_IRI */
 
@@ -73,6 +74,7 @@ extern struct iri dummy_iri;
 #define iri_free(a)
 #define set_uri_encoding(a,b,c)
 #define set_content_encoding(a,b)
+#define iri_cleanup()
 
 #endif /* ENABLE_IRI */
 #endif /* IRI_H */
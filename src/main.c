@@ -55,8 +55,15 @@ as that of the covered work.  */
 #include "spider.h"
 #include "http.h"               /* for save_cookies */
 #include "hsts.h"               /* for initializing hsts_store to NULL */
+#include "res.h"                /* for res_cache_save */
+#include "validator.h"          /* for validator_save */
+#include "dedup.h"              /* for dedup_index_save */
+#ifdef HAVE_SSL
+# include "ssl.h"               /* for ssl_session_cache_save */
+#endif
 #include "ptimer.h"
 #include "warc.h"
+#include "stats.h"
 #include "version.h"
 #include "c-strcase.h"
 #include "dirname.h"
@@ -246,6 +253,7 @@ static struct cmdline_option option_data[] =
     { "backup-converted", 'K', OPT_BOOLEAN, "backupconverted", -1 },
     { "backups", 0, OPT_BOOLEAN, "backups", -1 },
     { "base", 'B', OPT_VALUE, "base", -1 },
+    { "binary-snapshots", 0, OPT_BOOLEAN, "binarysnapshots", -1 },
     { "bind-address", 0, OPT_VALUE, "bindaddress", -1 },
     { "body-data", 0, OPT_VALUE, "bodydata", -1 },
     { "body-file", 0, OPT_VALUE, "bodyfile", -1 },
@@ -267,6 +275,8 @@ static struct cmdline_option option_data[] =
     { "cut-dirs", 0, OPT_VALUE, "cutdirs", -1 },
     { "debug", 'd', OPT_BOOLEAN, "debug", -1 },
     { "default-page", 0, OPT_VALUE, "defaultpage", -1 },
+    { "dedup", 0, OPT_VALUE, "dedup", -1 },
+    { "dedup-index", 0, OPT_VALUE, "dedupindex", -1 },
     { "delete-after", 0, OPT_BOOLEAN, "deleteafter", -1 },
     { "directories", 0, OPT_BOOLEAN, "dirstruct", -1 },
     { "directory-prefix", 'P', OPT_VALUE, "dirprefix", -1 },
@@ -275,6 +285,7 @@ static struct cmdline_option option_data[] =
     { "domains", 'D', OPT_VALUE, "domains", -1 },
     { "dont-remove-listing", 0, OPT__DONT_REMOVE_LISTING, NULL, no_argument },
     { "dot-style", 0, OPT_VALUE, "dotstyle", -1 }, /* deprecated */
+    { "drop-cache", 0, OPT_BOOLEAN, "dropcache", -1 },
     { "egd-file", 0, OPT_VALUE, "egdfile", -1 },
     { "exclude-directories", 'X', OPT_VALUE, "excludedirectories", -1 },
     { "exclude-domains", 0, OPT_VALUE, "excludedomains", -1 },
@@ -283,12 +294,15 @@ static struct cmdline_option option_data[] =
     { "follow-tags", 0, OPT_VALUE, "followtags", -1 },
     { "force-directories", 'x', OPT_BOOLEAN, "dirstruct", -1 },
     { "force-html", 'F', OPT_BOOLEAN, "forcehtml", -1 },
+    { "ftp-connections", 0, OPT_VALUE, "ftpconnections", -1 },
+    { "ftp-mlsd", 0, OPT_BOOLEAN, "ftpmlsd", -1 },
     { "ftp-password", 0, OPT_VALUE, "ftppassword", -1 },
 #ifdef __VMS
     { "ftp-stmlf", 0, OPT_BOOLEAN, "ftpstmlf", -1 },
 #endif /* def __VMS */
     { "ftp-user", 0, OPT_VALUE, "ftpuser", -1 },
     { "glob", 0, OPT_BOOLEAN, "glob", -1 },
+    { "head-first", 0, OPT_BOOLEAN, "headfirst", -1 },
     { "header", 0, OPT_VALUE, "header", -1 },
     { "help", 'h', OPT_FUNCALL, (void *)print_help, no_argument },
     { "host-directories", 0, OPT_BOOLEAN, "addhostdir", -1 },
@@ -318,7 +332,9 @@ static struct cmdline_option option_data[] =
     { "iri", 0, OPT_BOOLEAN, "iri", -1 },
     { "keep-session-cookies", 0, OPT_BOOLEAN, "keepsessioncookies", -1 },
     { "level", 'l', OPT_VALUE, "reclevel", -1 },
+    { "limit-burst", 0, OPT_VALUE, "limitburst", -1 },
     { "limit-rate", 0, OPT_VALUE, "limitrate", -1 },
+    { "limit-rate-per-host", 0, OPT_VALUE, "limitrateperhost", -1 },
     { "load-cookies", 0, OPT_VALUE, "loadcookies", -1 },
     { "local-encoding", 0, OPT_VALUE, "localencoding", -1 },
     { "rejected-log", 0, OPT_VALUE, "rejectedlog", -1 },
@@ -340,6 +356,7 @@ static struct cmdline_option option_data[] =
     { "password", 0, OPT_VALUE, "password", -1 },
     { "post-data", 0, OPT_VALUE, "postdata", -1 },
     { "post-file", 0, OPT_VALUE, "postfile", -1 },
+    { "preallocate", 0, OPT_BOOLEAN, "preallocate", -1 },
     { "prefer-family", 0, OPT_VALUE, "preferfamily", -1 },
 #ifdef HAVE_METALINK
     { "preferred-location", 0, OPT_VALUE, "preferred-location", -1 },
@@ -372,6 +389,7 @@ static struct cmdline_option option_data[] =
     { "restrict-file-names", 0, OPT_BOOLEAN, "restrictfilenames", -1 },
     { "retr-symlinks", 0, OPT_BOOLEAN, "retrsymlinks", -1 },
     { "retry-connrefused", 0, OPT_BOOLEAN, "retryconnrefused", -1 },
+    { "robots-cache", 0, OPT_VALUE, "robotscache", -1 },
     { "save-cookies", 0, OPT_VALUE, "savecookies", -1 },
     { "save-headers", 0, OPT_BOOLEAN, "saveheaders", -1 },
     { IF_SSL ("secure-protocol"), 0, OPT_VALUE, "secureprotocol", -1 },
@@ -379,18 +397,24 @@ static struct cmdline_option option_data[] =
     { "span-hosts", 'H', OPT_BOOLEAN, "spanhosts", -1 },
     { "spider", 0, OPT_BOOLEAN, "spider", -1 },
     { "start-pos", 0, OPT_VALUE, "startpos", -1 },
+    { "stats-fd", 0, OPT_VALUE, "statsfd", -1 },
+    { "stats-file", 0, OPT_VALUE, "statsfile", -1 },
     { "strict-comments", 0, OPT_BOOLEAN, "strictcomments", -1 },
     { "timeout", 'T', OPT_VALUE, "timeout", -1 },
     { "timestamping", 'N', OPT_BOOLEAN, "timestamping", -1 },
+    { "timing-log", 0, OPT_VALUE, "timinglog", -1 },
     { "if-modified-since", 0, OPT_BOOLEAN, "if-modified-since", -1 },
+    { IF_SSL ("tls-session-file"), 0, OPT_VALUE, "tlssessionfile", -1 },
     { "tries", 't', OPT_VALUE, "tries", -1 },
     { "unlink", 0, OPT_BOOLEAN, "unlink", -1 },
     { "trust-server-names", 0, OPT_BOOLEAN, "trustservernames", -1 },
     { "use-server-timestamps", 0, OPT_BOOLEAN, "useservertimestamps", -1 },
     { "user", 0, OPT_VALUE, "user", -1 },
     { "user-agent", 'U', OPT_VALUE, "useragent", -1 },
+    { "validator-file", 0, OPT_VALUE, "validatorfile", -1 },
     { "verbose", 'v', OPT_BOOLEAN, "verbose", -1 },
     { "verbose", 0, OPT_BOOLEAN, "verbose", -1 },
+    { "verify-validator-file", 0, OPT_BOOLEAN, "verifyvalidatorfile", -1 },
     { "version", 'V', OPT_FUNCALL, (void *) print_version, no_argument },
     { "wait", 'w', OPT_VALUE, "wait", -1 },
     { "waitretry", 0, OPT_VALUE, "waitretry", -1 },
@@ -579,6 +603,12 @@ Logging and input file:\n"),
        --no-config                 do not read any config file\n"),
     N_("\
        --rejected-log=FILE         log reasons for URL rejection to FILE\n"),
+    N_("\
+       --stats-file=FILE           write JSON transfer statistics to FILE\n"),
+    N_("\
+       --stats-fd=FD               write JSON transfer statistics to descriptor FD\n"),
+    N_("\
+       --timing-log=FILE           log the timing of each request phase to FILE\n"),
     "\n",
 
     N_("\
@@ -596,6 +626,10 @@ Download:\n"),
   -c,  --continue                  resume getting a partially-downloaded file\n"),
     N_("\
        --start-pos=OFFSET          start downloading from zero-based position OFFSET\n"),
+    N_("\
+       --preallocate               reserve the disk space of files of known size\n"),
+    N_("\
+       --drop-cache                drop downloaded data from the page cache\n"),
     N_("\
        --progress=TYPE             select progress gauge type\n"),
     N_("\
@@ -606,6 +640,18 @@ Download:\n"),
     N_("\
        --no-if-modified-since      don't use conditional if-modified-since get\n\
                                      requests in timestamping mode\n"),
+    N_("\
+       --validator-file=FILE       keep a list of the downloaded files and their\n\
+                                     validators in FILE for later -N and -nc runs\n"),
+    N_("\
+       --verify-validator-file     check the --validator-file against the local\n\
+                                     files\n"),
+    N_("\
+       --dedup=TYPE                link downloaded files identical to earlier\n\
+                                     ones; TYPE is none, reflink or hardlink\n"),
+    N_("\
+       --dedup-index=FILE          keep the digests of the downloaded files in\n\
+                                     FILE for --dedup in later runs\n"),
     N_("\
   --no-use-server-timestamps       don't set the local file's timestamp by\n\
                                      the one on the server\n"),
@@ -613,6 +659,9 @@ Download:\n"),
   -S,  --server-response           print server response\n"),
     N_("\
        --spider                    don't download anything\n"),
+    N_("\
+       --no-head-first             send GET instead of a preliminary HEAD in\n\
+                                     timestamping and recursive spider mode\n"),
     N_("\
   -T,  --timeout=SECONDS           set all timeout values to SECONDS\n"),
     N_("\
@@ -635,6 +684,10 @@ Download:\n"),
        --bind-address=ADDRESS      bind to ADDRESS (hostname or IP) on local host\n"),
     N_("\
        --limit-rate=RATE           limit download rate to RATE\n"),
+    N_("\
+       --limit-rate-per-host=RATE  limit download rate from each host to RATE\n"),
+    N_("\
+       --limit-burst=SIZE          allow bursts of SIZE bytes above the limits\n"),
     N_("\
        --no-dns-cache              disable caching DNS lookups\n"),
     N_("\
@@ -727,6 +780,8 @@ HTTP options:\n"),
        --save-cookies=FILE         save cookies to FILE after session\n"),
     N_("\
        --keep-session-cookies      load and save session (non-permanent) cookies\n"),
+    N_("\
+       --binary-snapshots          save cookies and HSTS data in binary form\n"),
     N_("\
        --post-data=STRING          use the POST method; send STRING as the data\n"),
     N_("\
@@ -772,6 +827,8 @@ HTTPS (SSL/TLS) options:\n"),
        --ca-directory=DIR          directory where hash list of CAs is stored\n"),
     N_("\
        --crl-file=FILE             file with bundle of CRLs\n"),
+    N_("\
+       --tls-session-file=FILE     keep TLS sessions in FILE between runs\n"),
 #if defined(HAVE_LIBSSL) || defined(HAVE_LIBSSL32)
     N_("\
        --random-file=FILE          file with random data for seeding the SSL PRNG\n"),
@@ -809,6 +866,10 @@ FTP options:\n"),
        --no-glob                   turn off FTP file name globbing\n"),
     N_("\
        --no-passive-ftp            disable the \"passive\" transfer mode\n"),
+    N_("\
+       --no-ftp-mlsd               don't use MLSD listings, even if supported\n"),
+    N_("\
+       --ftp-connections=NUMBER    retrieve files over up to NUMBER connections\n"),
     N_("\
        --preserve-permissions      preserve remote file permissions\n"),
     N_("\
@@ -867,6 +928,8 @@ Recursive download:\n"),
   -p,  --page-requisites           get all images, etc. needed to display HTML page\n"),
     N_("\
        --strict-comments           turn on strict (SGML) handling of HTML comments\n"),
+    N_("\
+       --robots-cache=FILE         keep robots.txt files in FILE between runs\n"),
     "\n",
 
     N_("\
@@ -1137,6 +1200,8 @@ main (int argc, char **argv)
 
   struct ptimer *timer = ptimer_new ();
   double start_time = ptimer_measure (timer);
+  /* Points in time, for the startup breakdown printed with --debug.  */
+  double wgetrc_time, options_time, log_time, hsts_time;
 
   total_downloaded_bytes = 0;
   program_name = argv[0];
@@ -1186,6 +1251,7 @@ main (int argc, char **argv)
   /* This separate getopt_long is needed to find the user config file
      option ("--config") and parse it before the other user options. */
   longindex = -1;
+  wgetrc_time = ptimer_measure (timer);
 
   while ((retconf = getopt_long (argc, argv,
                                 short_options, long_options, &longindex)) != -1)
@@ -1222,6 +1288,7 @@ main (int argc, char **argv)
   /* If the user did not specify a config, read the system wgetrc and ~/.wgetrc. */
   if (noconfig == false && use_userconfig == false)
     initialize ();
+  options_time = ptimer_measure (timer);
 
   opterr = 0;
   optind = 0;
@@ -1673,12 +1740,16 @@ for details.\n\n"));
   url[i] = NULL;
 
   /* Initialize logging.  */
+  log_time = ptimer_measure (timer);
   log_init (opt.lfilename, append_to_log);
 
   /* Open WARC file. */
   if (opt.warc_filename != 0)
     warc_init ();
 
+  /* Open the statistics output.  */
+  stats_init ();
+
   DEBUGP (("DEBUG output created by Wget %s on %s.\n\n",
            version_string, OS_TYPE));
 
@@ -1774,15 +1845,31 @@ outputting to a regular file.\n"));
      but this is the best place to do it, and it shouldn't be a critical
      performance hit.
    */
+  hsts_time = ptimer_measure (timer);
   if (opt.hsts)
     load_hsts ();
+#else
+  hsts_time = ptimer_measure (timer);
 #endif
 
+  IF_DEBUG
+    {
+      double now = ptimer_measure (timer);
+      DEBUGP (("Startup took %.3f ms: %.3f ms setup, %.3f ms wgetrc, "
+               "%.3f ms command line, %.3f ms output setup, %.3f ms HSTS.\n",
+               (now - start_time) * 1000,
+               (wgetrc_time - start_time) * 1000,
+               (options_time - wgetrc_time) * 1000,
+               (log_time - options_time) * 1000,
+               (hsts_time - log_time) * 1000,
+               (now - hsts_time) * 1000));
+    }
+
   /* Retrieve the URLs from argument list.  */
   for (t = url; *t; t++)
     {
       char *filename = NULL, *redirected_URL = NULL;
-      int dt, url_err;
+      int dt = 0, url_err;
       /* Need to do a new struct iri every time, because
        * retrieve_url may modify it in some circumstances,
        * currently. */
@@ -1931,8 +2018,18 @@ outputting to a regular file.\n"));
         logprintf (LOG_NOTQUIET,
                    _("Download quota of %s EXCEEDED!\n"),
                    human_readable (opt.quota, 10, 1));
+
+      if (dedup_linked_files)
+        logprintf (LOG_NOTQUIET,
+                   ngettext ("Deduplicated: %d file, %s saved\n",
+                             "Deduplicated: %d files, %s saved\n",
+                             dedup_linked_files),
+                   dedup_linked_files,
+                   human_readable (dedup_saved_bytes, 10, 1));
     }
 
+  stats_summary ();
+
   if (opt.cookies_output)
     save_cookies ();
 
@@ -1941,6 +2038,20 @@ outputting to a regular file.\n"));
     save_hsts ();
 #endif
 
+  if (opt.robots_cache)
+    res_cache_save ();
+
+  if (opt.validator_file)
+    validator_save ();
+
+  if (opt.dedup_index)
+    dedup_index_save ();
+
+#ifdef HAVE_SSL
+  if (opt.tls_session_file)
+    ssl_session_cache_save ();
+#endif
+
   if (opt.convert_links && !opt.delete_after)
     convert_all_links ();
 
@@ -163,6 +163,31 @@ key_type_to_ssl_type (enum keyfile_type type)
 /* SSL has been initialized */
 static int ssl_true_initialized = 0;
 
+/* Called by OpenSSL whenever the server hands out a session we can
+   resume later, either during the handshake or, with TLS 1.3 tickets,
+   after it.  The application data of CONN is the key of the session
+   in the TLS session cache.  */
+
+static int
+new_session_callback (SSL *conn, SSL_SESSION *session)
+{
+  const char *key = SSL_get_app_data (conn);
+  unsigned char *data, *p;
+  int size = i2d_SSL_SESSION (session, NULL);
+
+  if (!key || size <= 0)
+    return 0;
+  p = data = xmalloc (size);
+  i2d_SSL_SESSION (session, &p);
+  ssl_session_put (key, data, size,
+                   SSL_SESSION_get_time (session)
+                   + SSL_SESSION_get_timeout (session));
+  xfree (data);
+
+  /* We kept no reference to SESSION.  */
+  return 0;
+}
+
 /* Create an SSL Context and set default paths etc.  Called the first
    time an HTTP download is attempted.
 
@@ -322,6 +347,13 @@ ssl_init (void)
      tell it to do so.  */
   SSL_CTX_set_mode (ssl_ctx, SSL_MODE_AUTO_RETRY);
 
+  /* Keep the sessions for resumption in our own cache, keyed by host
+     and port, rather than in OpenSSL's, which is keyed by session ID
+     and not consulted by clients.  */
+  SSL_CTX_set_session_cache_mode (ssl_ctx, SSL_SESS_CACHE_CLIENT
+                                  | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb (ssl_ctx, new_session_callback);
+
   return true;
 
  error:
@@ -335,46 +367,44 @@ struct openssl_transport_context
 {
   SSL *conn;                    /* SSL connection handle */
   char *last_error;             /* last error printed with openssl_errstr */
+  char *session_key;            /* key in the TLS session cache */
+  int want;                     /* WAIT_FOR_READ or WAIT_FOR_WRITE if the
+                                   last operation would have blocked */
 };
 
-struct openssl_read_args
+/* Map the result RET of an SSL I/O function to the convention of the
+   transport operations: wanting to read or write becomes -1 with
+   errno set to EAGAIN.  */
+static int
+openssl_result (struct openssl_transport_context *ctx, int ret)
 {
-  int fd;
-  struct openssl_transport_context *ctx;
-  char *buf;
-  int bufsize;
-  int retval;
-};
+  ctx->want = 0;
+  if (ret <= 0)
+    switch (SSL_get_error (ctx->conn, ret))
+      {
+      case SSL_ERROR_WANT_READ:
+        ctx->want = WAIT_FOR_READ;
+        errno = EAGAIN;
+        return -1;
+      case SSL_ERROR_WANT_WRITE:
+        ctx->want = WAIT_FOR_WRITE;
+        errno = EAGAIN;
+        return -1;
+      }
+  return ret;
+}
 
-static void openssl_read_callback(void *arg)
+static int
+openssl_read (int fd _GL_UNUSED, char *buf, int bufsize, void *arg)
 {
-  struct openssl_read_args *args = (struct openssl_read_args *) arg;
-  struct openssl_transport_context *ctx = args->ctx;
-  SSL *conn = ctx->conn;
-  char *buf = args->buf;
-  int bufsize = args->bufsize;
   int ret;
-
+  struct openssl_transport_context *ctx = arg;
+  SSL *conn = ctx->conn;
   do
     ret = SSL_read (conn, buf, bufsize);
   while (ret == -1 && SSL_get_error (conn, ret) == SSL_ERROR_SYSCALL
          && errno == EINTR);
-  args->retval = ret;
-}
-
-static int
-openssl_read (int fd, char *buf, int bufsize, void *arg)
-{
-  struct openssl_read_args args;
-  args.fd = fd;
-  args.buf = buf;
-  args.bufsize = bufsize;
-  args.ctx = (struct openssl_transport_context*) arg;
-
-  if (run_with_timeout(opt.read_timeout, openssl_read_callback, &args)) {
-    return -1;
-  }
-  return args.retval;
+  return openssl_result (ctx, ret);
 }
 
 static int
@@ -388,7 +418,7 @@ openssl_write (int fd _GL_UNUSED, char *buf, int bufsize, void *arg)
   while (ret == -1
          && SSL_get_error (conn, ret) == SSL_ERROR_SYSCALL
          && errno == EINTR);
-  return ret;
+  return openssl_result (ctx, ret);
 }
 
 static int
@@ -398,25 +428,21 @@ openssl_poll (int fd, double timeout, int wait_for, void *arg)
   SSL *conn = ctx->conn;
   if (SSL_pending (conn))
     return 1;
-  if (timeout == 0)
-    return 1;
-  return select_fd (fd, timeout, wait_for);
+  return select_fd (fd, timeout, ctx->want ? ctx->want : wait_for);
 }
 
 static int
-openssl_peek (int fd, char *buf, int bufsize, void *arg)
+openssl_peek (int fd _GL_UNUSED, char *buf, int bufsize, void *arg)
 {
   int ret;
   struct openssl_transport_context *ctx = arg;
   SSL *conn = ctx->conn;
-  if (! openssl_poll (fd, 0.0, WAIT_FOR_READ, arg))
-    return 0;
   do
     ret = SSL_peek (conn, buf, bufsize);
   while (ret == -1
          && SSL_get_error (conn, ret) == SSL_ERROR_SYSCALL
          && errno == EINTR);
-  return ret;
+  return openssl_result (ctx, ret);
 }
 
 static const char *
@@ -477,6 +503,7 @@ openssl_close (int fd, void *arg)
   SSL_shutdown (conn);
   SSL_free (conn);
   xfree (ctx->last_error);
+  xfree (ctx->session_key);
   xfree (ctx);
 
   close (fd);
@@ -492,19 +519,6 @@ static struct transport_implementation openssl_transport = {
   openssl_peek, openssl_errstr, openssl_close
 };
 
-struct scwt_context
-{
-  SSL *ssl;
-  int result;
-};
-
-static void
-ssl_connect_with_timeout_callback(void *arg)
-{
-  struct scwt_context *ctx = (struct scwt_context *)arg;
-  ctx->result = SSL_connect(ctx->ssl);
-}
-
 /* Perform the SSL handshake on file descriptor FD, which is assumed
    to be connected to an SSL server.  The SSL handle provided by
    OpenSSL is registered with the file descriptor FD using
@@ -514,11 +528,15 @@ ssl_connect_with_timeout_callback(void *arg)
    Returns true on success, false on failure.  */
 
 bool
-ssl_connect_wget (int fd, const char *hostname)
+ssl_connect_wget (int fd, const char *hostname, int port)
 {
   SSL *conn;
-  struct scwt_context scwt_ctx;
   struct openssl_transport_context *ctx;
+  double timeout = opt.read_timeout ? opt.read_timeout : -1;
+  int ret;
+  char *key;
+  const void *saved;
+  size_t saved_size;
 
   DEBUGP (("Initiating SSL handshake.\n"));
 
@@ -546,17 +564,52 @@ ssl_connect_wget (int fd, const char *hostname)
     goto error;
   SSL_set_connect_state (conn);
 
-  scwt_ctx.ssl = conn;
-  if (run_with_timeout(opt.read_timeout, ssl_connect_with_timeout_callback,
-                       &scwt_ctx)) {
-    DEBUGP (("SSL handshake timed out.\n"));
-    goto timeout;
-  }
-  if (scwt_ctx.result <= 0 || SSL_state(conn) != SSL_ST_OK)
+  /* Offer the session we had with this server before, if any.  KEY
+     is freed along with the transport context, or below on failure. */
+  key = ssl_session_key (hostname, port);
+  SSL_set_app_data (conn, key);
+  saved = ssl_session_get (key, &saved_size);
+  if (saved)
+    {
+      const unsigned char *p = saved;
+      SSL_SESSION *session = d2i_SSL_SESSION (NULL, &p, saved_size);
+      if (session)
+        {
+          SSL_set_session (conn, session);
+          SSL_SESSION_free (session);
+        }
+    }
+
+  /* The socket is non-blocking: wait for it whenever the handshake
+     needs to read or write.  */
+  while ((ret = SSL_connect (conn)) <= 0)
+    {
+      int test, err = SSL_get_error (conn, ret);
+      if (err == SSL_ERROR_WANT_READ)
+        test = select_fd (fd, timeout, WAIT_FOR_READ);
+      else if (err == SSL_ERROR_WANT_WRITE)
+        test = select_fd (fd, timeout, WAIT_FOR_WRITE);
+      else if (err == SSL_ERROR_SYSCALL && errno == EINTR)
+        continue;
+      else
+        goto error;
+      if (test == 0)
+        {
+          DEBUGP (("SSL handshake timed out.\n"));
+          goto timeout;
+        }
+      if (test < 0)
+        goto error;
+    }
+  if (SSL_state(conn) != SSL_ST_OK)
     goto error;
 
+  if (SSL_session_reused (conn))
+    DEBUGP (("Resumed TLS session for %s.\n", key));
+
   ctx = xnew0 (struct openssl_transport_context);
   ctx->conn = conn;
+  ctx->session_key = key;
 
   /* Register FD with Wget's transport layer, i.e. arrange that our
      functions are used for reading, writing, and polling.  */
@@ -570,7 +623,11 @@ ssl_connect_wget (int fd, const char *hostname)
   print_errors ();
  timeout:
   if (conn)
-    SSL_free (conn);
+    {
+      key = SSL_get_app_data (conn);
+      xfree (key);
+      SSL_free (conn);
+    }
   return false;
 }
 
@@ -126,6 +126,9 @@ struct options
   bool netrc;                   /* Whether to read .netrc. */
   bool ftp_glob;                /* FTP globbing */
   bool ftp_pasv;                /* Passive FTP. */
+  bool ftp_mlsd;                /* Use MLSD listings when available. */
+  int ftp_connections;          /* Maximum number of control
+                                   connections for recursive FTP. */
 
   char *http_user;              /* HTTP username. */
   char *http_passwd;            /* HTTP password. */
@@ -151,9 +154,15 @@ struct options
   double wait;                  /* The wait period between retrievals. */
   double waitretry;             /* The wait period between retries. - HEH */
   bool use_robots;              /* Do we heed robots.txt? */
+  char *robots_cache;           /* File to keep robots.txt files in
+                                   between runs. */
 
   wgint limit_rate;             /* Limit the download rate to this
                                    many bps. */
+  wgint limit_rate_per_host;    /* Limit the download rate from each
+                                   host to this many bps. */
+  wgint limit_burst;            /* Bytes that may be read at once
+                                   before the limits apply. */
   SUM_SIZE_INT quota;           /* Maximum file size to download and
                                    store. */
 
@@ -171,9 +180,26 @@ struct options
 
   bool timestamping;            /* Whether to use time-stamping. */
   bool if_modified_since;       /* Whether to use conditional get requests.  */
+  bool head_first;              /* Whether to send HEAD before GET when
+                                   the headers may make the body unneeded. */
+  char *validator_file;         /* File to keep the list of downloaded
+                                   files and their validators in. */
+  bool verify_validator_file;   /* Check the validator file against
+                                   the local files when loading it. */
+  enum {
+    dedup_none,
+    dedup_reflink,
+    dedup_hardlink
+  } dedup;                      /* How to link identical downloads. */
+  char *dedup_index;            /* File to keep the digests of the
+                                   downloaded files in. */
 
   bool backup_converted;        /* Do we save pre-converted files as *.orig? */
   int backups;                  /* Are numeric backups made? */
+  bool preallocate;             /* Reserve the disk space of files of
+                                   known size before writing them? */
+  bool drop_cache;              /* Drop downloaded data from the page
+                                   cache as it is written? */
 
   char *useragent;              /* User-Agent string, which can be set
                                    to something other than Wget. */
@@ -229,6 +255,8 @@ struct options
   char *random_file;            /* file with random data to seed the PRNG */
   char *egd_file;               /* file name of the egd daemon socket */
   bool https_only;              /* whether to follow HTTPS only */
+  char *tls_session_file;       /* file to keep TLS sessions in
+                                   between runs. */
 #endif /* HAVE_SSL */
 
   bool cookies;                 /* whether cookies are used. */
@@ -236,6 +264,8 @@ struct options
   char *cookies_output;         /* file we're saving the cookies to. */
   bool keep_session_cookies;    /* whether session cookies should be
                                    saved and loaded. */
+  bool binary_snapshots;        /* whether cookies and HSTS data are
+                                   saved as binary snapshots. */
 
   char *post_data;              /* POST query string */
   char *post_file_name;         /* File to post */
@@ -298,6 +328,12 @@ struct options
 
   char *rejected_log;           /* The file to log rejected URLS to. */
 
+  char *stats_file;             /* Where to write JSON statistics, */
+  int stats_fd;                 /* or the descriptor to write them to,
+                                   -1 if none. */
+  char *timing_log;             /* The file to log per-URL phase
+                                   timings to. */
+
 #ifdef HAVE_HSTS
   bool hsts;
   char *hsts_file;
@@ -506,6 +506,27 @@ static volatile sig_atomic_t received_sigwinch;
    This allows ETA to change approximately once per second.  */
 #define ETA_REFRESH_INTERVAL 0.99
 
+/* The history ring of recent download speeds.  See
+   speed_ring_update() for details.  */
+struct bar_progress_hist {
+  int pos;
+  double times[DLSPEED_HISTORY_SIZE];
+  wgint bytes[DLSPEED_HISTORY_SIZE];
+
+  /* The sum of times and bytes respectively, maintained for
+     efficiency. */
+  double total_time;
+  wgint total_bytes;
+
+  double recent_start;          /* timestamp of beginning of current
+                                   position. */
+  wgint recent_bytes;           /* bytes downloaded so far. */
+
+  bool stalled;                 /* set when no data arrives for longer
+                                   than STALL_START_TIME, then reset
+                                   when new data arrives. */
+};
+
 struct bar_progress {
   const char *f_download;       /* Filename of the downloaded file */
   wgint initial_length;         /* how many bytes have been downloaded
@@ -531,27 +552,8 @@ struct bar_progress {
                                    progress bar where the total size
                                    is not known. */
 
-  /* The following variables (kept in a struct for namespace reasons)
-     keep track of recent download speeds.  See bar_update() for
-     details.  */
-  struct bar_progress_hist {
-    int pos;
-    double times[DLSPEED_HISTORY_SIZE];
-    wgint bytes[DLSPEED_HISTORY_SIZE];
-
-    /* The sum of times and bytes respectively, maintained for
-       efficiency. */
-    double total_time;
-    wgint total_bytes;
-  } hist;
-
-  double recent_start;          /* timestamp of beginning of current
-                                   position. */
-  wgint recent_bytes;           /* bytes downloaded so far. */
-
-  bool stalled;                 /* set when no data arrives for longer
-                                   than STALL_START_TIME, then reset
-                                   when new data arrives. */
+  /* Recent download speeds. */
+  struct bar_progress_hist hist;
 
   /* create_image() uses these to make sure that ETA information
      doesn't flicker. */
@@ -604,7 +606,6 @@ bar_create (const char *f_download, wgint initial, wgint total)
   return bp;
 }
 
-static void update_speed_ring (struct bar_progress *, wgint, double);
 
 static void
 bar_update (void *progress, wgint howmuch, double dltime)
@@ -622,7 +623,7 @@ bar_update (void *progress, wgint howmuch, double dltime)
        equal to the expected size doesn't abort.  */
     bp->total_length = bp->initial_length + bp->count;
 
-  update_speed_ring (bp, howmuch, dltime);
+  speed_ring_update (&bp->hist, howmuch, dltime);
 }
 
 static void
@@ -697,14 +698,14 @@ bar_finish (void *progress, double dltime)
    is good because slow downloads tend to fluctuate more and a
    3-second average would be too erratic.  */
 
-static void
-update_speed_ring (struct bar_progress *bp, wgint howmuch, double dltime)
+void
+speed_ring_update (struct bar_progress_hist *hist, wgint howmuch,
+                   double dltime)
 {
-  struct bar_progress_hist *hist = &bp->hist;
-  double recent_age = dltime - bp->recent_start;
+  double recent_age = dltime - hist->recent_start;
 
   /* Update the download count. */
-  bp->recent_bytes += howmuch;
+  hist->recent_bytes += howmuch;
 
   /* For very small time intervals, we return after having updated the
      "recent" download count.  When its age reaches or exceeds minimum
@@ -723,9 +724,10 @@ update_speed_ring (struct bar_progress *bp, wgint howmuch, double dltime)
           /* If we're stalling, reset the ring contents because it's
              stale and because it will make bar_update stop printing
              the (bogus) current bandwidth.  */
-          bp->stalled = true;
+          double recent_start = hist->recent_start;
           xzero (*hist);
-          bp->recent_bytes = 0;
+          hist->recent_start = recent_start;
+          hist->stalled = true;
         }
       return;
     }
@@ -733,9 +735,9 @@ update_speed_ring (struct bar_progress *bp, wgint howmuch, double dltime)
   /* We now have a non-zero amount of to store to the speed ring.  */
 
   /* If the stall status was acquired, reset it. */
-  if (bp->stalled)
+  if (hist->stalled)
     {
-      bp->stalled = false;
+      hist->stalled = false;
       /* "recent_age" includes the entired stalled period, which
          could be very long.  Don't update the speed ring with that
          value because the current bandwidth would start too small.
@@ -754,13 +756,13 @@ update_speed_ring (struct bar_progress *bp, wgint howmuch, double dltime)
 
   /* Now store the new data and update the totals. */
   hist->times[hist->pos] = recent_age;
-  hist->bytes[hist->pos] = bp->recent_bytes;
+  hist->bytes[hist->pos] = hist->recent_bytes;
   hist->total_time  += recent_age;
-  hist->total_bytes += bp->recent_bytes;
+  hist->total_bytes += hist->recent_bytes;
 
   /* Start a new "recent" period. */
-  bp->recent_start = dltime;
-  bp->recent_bytes = 0;
+  hist->recent_start = dltime;
+  hist->recent_bytes = 0;
 
   /* Advance the current ring position. */
   if (++hist->pos == DLSPEED_HISTORY_SIZE)
@@ -788,6 +790,36 @@ update_speed_ring (struct bar_progress *bp, wgint howmuch, double dltime)
 #endif
 }
 
+/* The speed ring is also used outside of the bar gauge, to report
+   the current download speed in the statistics output.  */
+
+struct bar_progress_hist *
+speed_ring_new (void)
+{
+  return xnew0 (struct bar_progress_hist);
+}
+
+void
+speed_ring_free (struct bar_progress_hist *hist)
+{
+  xfree (hist);
+}
+
+/* Return the current download speed in bytes per second, DLTIME
+   being the time since the beginning of the download, or -1 if it is
+   not known, e.g. because the download has stalled.  */
+
+double
+speed_ring_rate (const struct bar_progress_hist *hist, double dltime)
+{
+  double time;
+
+  if (hist->total_time <= 0 || !hist->total_bytes)
+    return -1;
+  time = hist->total_time + (dltime - hist->recent_start);
+  return time > 0 ? (hist->total_bytes + hist->recent_bytes) / time : -1;
+}
+
 #if USE_NLS_PROGRESS_BAR
 static int
 count_cols (const char *mbs)
@@ -1101,8 +1133,8 @@ create_image (struct bar_progress *bp, double dl_total_time, bool done)
       int units = 0;
       /* Calculate the download speed using the history ring and
          recent data that hasn't made it to the ring yet.  */
-      wgint dlquant = hist->total_bytes + bp->recent_bytes;
-      double dltime = hist->total_time + (dl_total_time - bp->recent_start);
+      wgint dlquant = hist->total_bytes + hist->recent_bytes;
+      double dltime = hist->total_time + (dl_total_time - hist->recent_start);
       double dlspeed = calc_rate (dlquant, dltime, &units);
       sprintf (p, " %4.*f%s", dlspeed >= 99.95 ? 0 : dlspeed >= 9.995 ? 1 : 2,
                dlspeed,  !opt.report_bps ? short_units[units] : short_units_bits[units]);
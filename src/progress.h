@@ -42,4 +42,10 @@ void progress_finish (void *, double);
 
 void progress_handle_sigwinch (int);
 
+struct bar_progress_hist;
+struct bar_progress_hist *speed_ring_new (void);
+void speed_ring_free (struct bar_progress_hist *);
+void speed_ring_update (struct bar_progress_hist *, wgint, double);
+double speed_ring_rate (const struct bar_progress_hist *, double);
+
 #endif /* PROGRESS_H */
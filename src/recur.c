@@ -328,6 +328,8 @@ retrieve_tree (struct url *start_url_parsed, struct iri *pi)
           else
             {
 
+              if (html_allowed)
+                dt |= EXPECT_HTML;
               status = retrieve_url (url_parsed, url, &file, &redirected, referer,
                                      &dt, false, i, true);
 
@@ -719,9 +721,12 @@ download_child (const struct urlpos *upos, struct url *parent, int depth,
       if (!specs)
         {
           char *rfile;
-          if (res_retrieve_file (url, &rfile, iri))
+          /* Use the specs saved by an earlier run, if still fresh. */
+          specs = res_get_cached_specs (u->host, u->port);
+          if (!specs && res_retrieve_file (url, &rfile, iri))
             {
               specs = res_parse_from_file (rfile);
+              res_cache_file (u->host, u->port, rfile);
 
               /* Delete the robots.txt file if we chose to either delete the
                  files after downloading or we're just running a spider. */
@@ -735,7 +740,7 @@ download_child (const struct urlpos *upos, struct url *parent, int depth,
 
               xfree (rfile);
             }
-          else
+          else if (!specs)
             {
               /* If we cannot get real specs, at least produce
                  dummy ones so that we can register them and stop
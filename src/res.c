@@ -58,11 +58,16 @@ as that of the covered work.  */
 
    * We don't recognize sole CR as the line ending.
 
-   * We don't implement expiry mechanism for /robots.txt specs.  I
-     consider it non-necessary for a relatively short-lived
-     application such as Wget.  Besides, it is highly questionable
-     whether anyone deploys the recommended expiry scheme for
-     robots.txt.
+   * Within a run, /robots.txt specs never expire.  I consider it
+     non-necessary for a relatively short-lived application such as
+     Wget.  Across runs, the files can be kept in the cache named by
+     --robots-cache, where they expire according to the HTTP caching
+     headers they were served with, and after a day at the latest.
+
+   * As an extension widely supported by other crawlers, `*' in a
+     path matches any sequence of characters, and a trailing `$'
+     anchors the path to the end of the URL path.  The first matching
+     path in the file still decides, as the draft specifies.
 
    Entry points are functions res_parse, res_parse_from_file,
    res_match_path, res_register_specs, res_get_specs, and
@@ -75,6 +80,8 @@ as that of the covered work.  */
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "utils.h"
 #include "hash.h"
@@ -93,10 +100,35 @@ struct path_info {
   bool user_agent_exact_p;
 };
 
+/* The paths are compiled into a trie so that a URL path can be
+   matched against all of them in a single walk.  The nodes live in a
+   single array and refer to each other by index.  */
+
+struct res_node {
+  int child;                    /* first child, or -1 */
+  int sibling;                  /* next sibling, or -1 */
+  int star;                     /* child reached through `*', or -1 */
+  int rule;                     /* first path ending here, or -1 */
+  int rule_eol;                 /* first path ending here with `$', or -1 */
+  int min_rule;                 /* first path ending in this subtree */
+  char c;                       /* character leading to this node */
+};
+
 struct robot_specs {
   int count;
   int size;
   struct path_info *paths;
+
+  struct res_node *nodes;       /* the trie; nodes[0] is the root */
+  int node_count;
+  int node_size;
+
+  /* Scratch space for matching, allocated on the first match and
+     reused by the following ones.  */
+  int *match_nodes;             /* the node lists of struct res_match */
+  unsigned int *match_mark;     /* the step a node was last added in */
+  unsigned int *match_starred;  /* the walk a node was last starred in */
+  unsigned int match_stamp;     /* the last walk or step number used */
 };
 
 /* Parsing the robot spec. */
@@ -177,6 +209,107 @@ prune_non_exact (struct robot_specs *specs)
   specs->size  = cnt;
 }
 
+/* If C is '%' and (ptr[1], ptr[2]) form a hexadecimal number, and if
+   that number is not a numerical representation of '/', decode C and
+   advance the pointer.  */
+
+#define DECODE_MAYBE(c, ptr) do {                               \
+  if (c == '%' && c_isxdigit (ptr[1]) && c_isxdigit (ptr[2]))       \
+    {                                                           \
+      char decoded = X2DIGITS_TO_NUM (ptr[1], ptr[2]);          \
+      if (decoded != '/')                                       \
+        {                                                       \
+          c = decoded;                                          \
+          ptr += 2;                                             \
+        }                                                       \
+    }                                                           \
+} while (0)
+
+/* Append a new node for character C whose subtree begins with path
+   number RULE, and return its index.  */
+
+static int
+new_node (struct robot_specs *specs, char c, int rule)
+{
+  struct res_node *node;
+  if (specs->node_count == specs->node_size)
+    {
+      specs->node_size = specs->node_size ? specs->node_size << 1 : 16;
+      specs->nodes = xrealloc (specs->nodes,
+                               specs->node_size * sizeof (struct res_node));
+    }
+  node = &specs->nodes[specs->node_count];
+  node->child = node->sibling = node->star = -1;
+  node->rule = node->rule_eol = -1;
+  node->min_rule = rule;
+  node->c = c;
+  return specs->node_count++;
+}
+
+/* Return the child of node N reached through character C, creating
+   it if necessary.  */
+
+static int
+find_or_add_child (struct robot_specs *specs, int n, char c, int rule)
+{
+  int child, last = -1;
+  for (child = specs->nodes[n].child; child != -1;
+       child = specs->nodes[child].sibling)
+    {
+      if (specs->nodes[child].c == c)
+        return child;
+      last = child;
+    }
+  child = new_node (specs, c, rule);
+  if (last == -1)
+    specs->nodes[n].child = child;
+  else
+    specs->nodes[last].sibling = child;
+  return child;
+}
+
+/* Build the trie out of SPECS->paths.  Because the paths are added in
+   order, a node's min_rule is the path that created it.  */
+
+static void
+compile_specs (struct robot_specs *specs)
+{
+  int i;
+  new_node (specs, '\0', 0);
+  for (i = 0; i < specs->count; i++)
+    {
+      const char *rp = specs->paths[i].path;
+      int n = 0;
+      for (; *rp; ++rp)
+        {
+          char c = *rp;
+          if (c == '$' && !rp[1])
+            break;
+          if (c == '*')
+            {
+              while (rp[1] == '*')
+                ++rp;
+              if (specs->nodes[n].star == -1)
+                {
+                  int star = new_node (specs, '*', i);
+                  specs->nodes[n].star = star;
+                }
+              n = specs->nodes[n].star;
+              continue;
+            }
+          DECODE_MAYBE (c, rp);
+          n = find_or_add_child (specs, n, c, i);
+        }
+      if (*rp == '$')
+        {
+          if (specs->nodes[n].rule_eol == -1)
+            specs->nodes[n].rule_eol = i;
+        }
+      else if (specs->nodes[n].rule == -1)
+        specs->nodes[n].rule = i;
+    }
+}
+
 #define EOL(p) ((p) >= lineend)
 
 #define SKIP_SPACE(p) do {              \
@@ -376,6 +509,7 @@ res_parse (const char *source, int length)
       specs->size = specs->count;
     }
 
+  compile_specs (specs);
   return specs;
 }
 
@@ -405,71 +539,175 @@ free_specs (struct robot_specs *specs)
   for (i = 0; i < specs->count; i++)
     xfree (specs->paths[i].path);
   xfree (specs->paths);
+  xfree (specs->nodes);
+  xfree (specs->match_nodes);
+  xfree (specs->match_mark);
+  xfree (specs->match_starred);
   xfree (specs);
 }
 
 /* Matching of a path according to the specs. */
 
-/* If C is '%' and (ptr[1], ptr[2]) form a hexadecimal number, and if
-   that number is not a numerical representation of '/', decode C and
-   advance the pointer.  */
+/* The trie is matched against a URL path one character at a time,
+   keeping the set of nodes that the path read so far leads to.  A node
+   reached through `*' matches any sequence of characters, including
+   the empty one, so once reached it stays in the set until the end of
+   the path.  Each node is visited at most once per character, which
+   keeps the match linear in the length of the path however many `*'
+   the rules have.  The node sets are kept in scratch arrays of the
+   specs, stamped with a number that changes with every walk and every
+   step, so that nothing but the nodes visited needs to be touched.  The rules for matching literal characters are
+   described at <http://www.robotstxt.org/wc/norobots-rfc.txt>, section
+   3.2.2.  */
+
+struct res_match {
+  const struct robot_specs *specs;
+  int *cur, ncur;               /* nodes reached by the last character */
+  int *next, nnext;             /* nodes reached by the current one */
+  int *stars, nstars;           /* nodes reached through `*' so far */
+  unsigned int *mark;           /* the step a node was last added in */
+  unsigned int *starred;        /* the walk a node was last starred in */
+  unsigned int walk, step;
+  int best;                     /* first matching path so far */
+};
 
-#define DECODE_MAYBE(c, ptr) do {                               \
-  if (c == '%' && c_isxdigit (ptr[1]) && c_isxdigit (ptr[2]))       \
-    {                                                           \
-      char decoded = X2DIGITS_TO_NUM (ptr[1], ptr[2]);          \
-      if (decoded != '/')                                       \
-        {                                                       \
-          c = decoded;                                          \
-          ptr += 2;                                             \
-        }                                                       \
-    }                                                           \
-} while (0)
+/* Add node N to the nodes reached by the current character, and
+   the node reached from it through `*' to the starred nodes.  */
 
-/* The inner matching engine: return true if RECORD_PATH matches
-   URL_PATH.  The rules for matching are described at
-   <http://www.robotstxt.org/wc/norobots-rfc.txt>, section 3.2.2.  */
+static void
+match_add (struct res_match *m, int n)
+{
+  const struct res_node *node = &m->specs->nodes[n];
+
+  /* Nothing below this node can beat what we already have. */
+  if (node->min_rule >= m->best || m->mark[n] == m->step)
+    return;
+  m->mark[n] = m->step;
+  m->next[m->nnext++] = n;
+  if (node->rule != -1 && node->rule < m->best)
+    m->best = node->rule;
+
+  n = node->star;
+  if (n != -1 && m->starred[n] != m->walk
+      && m->specs->nodes[n].min_rule < m->best)
+    {
+      node = &m->specs->nodes[n];
+      m->starred[n] = m->walk;
+      m->stars[m->nstars++] = n;
+      if (node->rule != -1 && node->rule < m->best)
+        m->best = node->rule;
+    }
+}
+
+/* Add the children of node N reached through character C.  */
 
-static bool
-matches (const char *record_path, const char *url_path)
+static void
+match_step (struct res_match *m, int n, char c)
 {
-  const char *rp = record_path;
-  const char *up = url_path;
-
-  for (; ; ++rp, ++up)
-    {
-      char rc = *rp;
-      char uc = *up;
-      if (!rc)
-        return true;
-      if (!uc)
-        return false;
-      DECODE_MAYBE(rc, rp);
-      DECODE_MAYBE(uc, up);
-      if (rc != uc)
-        return false;
+  if (m->specs->nodes[n].min_rule >= m->best)
+    return;
+  for (n = m->specs->nodes[n].child; n != -1; n = m->specs->nodes[n].sibling)
+    if (m->specs->nodes[n].c == c)
+      {
+        match_add (m, n);
+        break;
+      }
+}
+
+/* Return the first path of SPECS matching the URL path UP, or
+   SPECS->count if none does.  */
+
+static int
+match_path (struct robot_specs *specs, const char *up)
+{
+  struct res_match m;
+  int *tmp, i, nstars;
+  size_t len = strlen (up);
+
+  if (!specs->match_nodes)
+    {
+      specs->match_nodes = xnew_array (int, 3 * specs->node_count);
+      specs->match_mark = xnew0_array (unsigned int, specs->node_count);
+      specs->match_starred = xnew0_array (unsigned int, specs->node_count);
+    }
+  /* Each walk uses a stamp, plus one per character of the path.  When
+     they are about to run out, start over from zero.  */
+  if (len >= UINT_MAX - 1 - specs->match_stamp)
+    {
+      memset (specs->match_mark, 0,
+              specs->node_count * sizeof *specs->match_mark);
+      memset (specs->match_starred, 0,
+              specs->node_count * sizeof *specs->match_starred);
+      specs->match_stamp = 0;
+    }
+
+  m.specs = specs;
+  m.cur = specs->match_nodes;
+  m.next = m.cur + specs->node_count;
+  m.stars = m.next + specs->node_count;
+  m.mark = specs->match_mark;
+  m.starred = specs->match_starred;
+  m.ncur = m.nnext = m.nstars = 0;
+  m.walk = m.step = ++specs->match_stamp;
+  m.best = specs->count;
+
+  match_add (&m, 0);
+  for (;;)
+    {
+      char uc;
+
+      tmp = m.cur, m.cur = m.next, m.next = tmp;
+      m.ncur = m.nnext, m.nnext = 0;
+      if (!*up || (!m.ncur && !m.nstars))
+        break;
+      uc = *up;
+      DECODE_MAYBE (uc, up);
+      ++up;
+      ++m.step;
+      /* Nodes starred by this character only match from the next. */
+      nstars = m.nstars;
+      for (i = 0; i < m.ncur; i++)
+        match_step (&m, m.cur[i], uc);
+      for (i = 0; i < nstars; i++)
+        match_step (&m, m.stars[i], uc);
+    }
+
+  /* Paths ending in `$' match only if the whole URL path was read. */
+  if (!*up)
+    {
+      for (i = 0; i < m.ncur; i++)
+        if (specs->nodes[m.cur[i]].rule_eol != -1
+            && specs->nodes[m.cur[i]].rule_eol < m.best)
+          m.best = specs->nodes[m.cur[i]].rule_eol;
+      for (i = 0; i < m.nstars; i++)
+        if (specs->nodes[m.stars[i]].rule_eol != -1
+            && specs->nodes[m.stars[i]].rule_eol < m.best)
+          m.best = specs->nodes[m.stars[i]].rule_eol;
     }
+
+  specs->match_stamp = m.step;
+  return m.best;
 }
 
-/* Iterate through all paths in SPECS.  For the first one that
-   matches, return its allow/reject status.  If none matches,
-   retrieval is by default allowed.  */
+/* Find the first path in SPECS that matches PATH, and return its
+   allow/reject status.  If none matches, retrieval is by default
+   allowed.  */
 
 bool
-res_match_path (const struct robot_specs *specs, const char *path)
+res_match_path (struct robot_specs *specs, const char *path)
 {
-  int i;
+  int best;
   if (!specs)
     return true;
-  for (i = 0; i < specs->count; i++)
-    if (matches (specs->paths[i].path, path))
-      {
-        bool allowedp = specs->paths[i].allowedp;
-        DEBUGP (("%s path %s because of rule %s.\n",
-                 allowedp ? "Allowing" : "Rejecting",
-                 path, quote (specs->paths[i].path)));
-        return allowedp;
-      }
+  best = match_path (specs, path);
+  if (best < specs->count)
+    {
+      bool allowedp = specs->paths[best].allowedp;
+      DEBUGP (("%s path %s because of rule %s.\n",
+               allowedp ? "Allowing" : "Rejecting",
+               path, quote (specs->paths[best].path)));
+      return allowedp;
+    }
   return true;
 }
 
@@ -523,6 +761,251 @@ res_get_specs (const char *host, int port)
   return hash_table_get (registered_specs, hp);
 }
 
+/* Caching the robots files between runs.
+
+   With --robots-cache=FILE, every robots.txt retrieved is remembered
+   in FILE together with the time it expires, so that the next run
+   can use the specs without contacting the server.  The lifetime is
+   taken from the Cache-Control or Expires header of the response,
+   but is never longer than a day.
+
+   The file consists of entries of the form
+
+       HOST:PORT EXPIRES LENGTH
+       <LENGTH bytes of robots.txt>
+
+   each followed by a newline.  Lines beginning with `#' before the
+   first entry are comments.  */
+
+#define RES_CACHE_MAX_LIFETIME (24 * 60 * 60)
+
+struct res_cache_entry {
+  char *text;
+  int length;
+  time_t expires;
+};
+
+static struct hash_table *res_cache;
+
+/* Lifetime of the robots.txt being retrieved, as reported by the HTTP
+   code through res_cache_set_lifetime, or -1 if unknown.  */
+static long res_cache_lifetime = -1;
+
+static void
+res_cache_put (const char *hp, const char *text, int length, time_t expires)
+{
+  struct res_cache_entry *entry, *old;
+  char *hp_old;
+
+  entry = xnew (struct res_cache_entry);
+  entry->text = xmalloc (length + 1);
+  memcpy (entry->text, text, length);
+  entry->text[length] = '\0';
+  entry->length = length;
+  entry->expires = expires;
+
+  if (hash_table_get_pair (res_cache, hp, &hp_old, &old))
+    {
+      xfree (old->text);
+      xfree (old);
+      hash_table_put (res_cache, hp_old, entry);
+    }
+  else
+    hash_table_put (res_cache, xstrdup (hp), entry);
+}
+
+/* Read the cache from opt.robots_cache, dropping the entries that
+   have expired.  A missing file is not an error.  */
+
+static void
+res_cache_load (void)
+{
+  struct file_memory *fm;
+  const char *p, *end;
+  time_t now = time (NULL);
+
+  res_cache = make_nocase_string_hash_table (0);
+
+  if (!file_exists_p (opt.robots_cache))
+    return;
+  fm = wget_read_file (opt.robots_cache);
+  if (!fm)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 opt.robots_cache, strerror (errno));
+      return;
+    }
+
+  p = fm->content;
+  end = p + fm->length;
+  while (p < end && *p == '#')
+    {
+      const char *eol = memchr (p, '\n', end - p);
+      p = eol ? eol + 1 : end;
+    }
+
+  while (p < end)
+    {
+      const char *eol = memchr (p, '\n', end - p);
+      char *line, *hp_end, *tail;
+      long expires, length;
+
+      if (!eol)
+        break;
+      line = strdupdelim (p, eol);
+      hp_end = strchr (line, ' ');
+      if (!hp_end)
+        goto malformed;
+      *hp_end++ = '\0';
+      expires = strtol (hp_end, &tail, 10);
+      if (tail == hp_end || *tail != ' ')
+        goto malformed;
+      hp_end = tail + 1;
+      length = strtol (hp_end, &tail, 10);
+      if (tail == hp_end || *tail || length < 0 || length >= end - eol)
+        goto malformed;
+
+      p = eol + 1;
+      if (expires > now)
+        res_cache_put (line, p, length, expires);
+      p += length + 1;
+      xfree (line);
+      continue;
+
+    malformed:
+      logprintf (LOG_NOTQUIET, _("%s: ignoring malformed robots cache entry.\n"),
+                 opt.robots_cache);
+      xfree (line);
+      break;
+    }
+
+  DEBUGP (("Loaded %d robots.txt files from %s.\n",
+           hash_table_count (res_cache), opt.robots_cache));
+  wget_read_file_free (fm);
+}
+
+/* Return the specs for HOST:PORT from the robots cache, or NULL if
+   the cache is not in use or has no fresh copy for that server.  */
+
+struct robot_specs *
+res_get_cached_specs (const char *host, int port)
+{
+  struct res_cache_entry *entry;
+  char *hp;
+
+  if (!opt.robots_cache)
+    return NULL;
+  if (!res_cache)
+    res_cache_load ();
+
+  SET_HOSTPORT (host, port, hp);
+  entry = hash_table_get (res_cache, hp);
+  if (!entry || entry->expires <= time (NULL))
+    return NULL;
+
+  DEBUGP (("Using cached robots.txt for %s.\n", hp));
+  return res_parse (entry->text, entry->length);
+}
+
+/* Called from the HTTP code with the number of SECONDS for which the
+   robots.txt just received may be reused, or -1 if the response does
+   not say.  */
+
+void
+res_cache_set_lifetime (long seconds)
+{
+  res_cache_lifetime = seconds;
+}
+
+/* Remember the contents of FILE, just retrieved from HOST:PORT, in the
+   robots cache.  */
+
+void
+res_cache_file (const char *host, int port, const char *file)
+{
+  struct file_memory *fm;
+  long lifetime = res_cache_lifetime;
+  char *hp;
+
+  if (!opt.robots_cache)
+    return;
+  if (!res_cache)
+    res_cache_load ();
+
+  SET_HOSTPORT (host, port, hp);
+  if (lifetime < 0 || lifetime > RES_CACHE_MAX_LIFETIME)
+    lifetime = RES_CACHE_MAX_LIFETIME;
+  if (lifetime == 0)
+    {
+      DEBUGP (("Not caching robots.txt for %s.\n", hp));
+      return;
+    }
+
+  fm = wget_read_file (file);
+  if (!fm)
+    return;
+  res_cache_put (hp, fm->content, fm->length, time (NULL) + lifetime);
+  wget_read_file_free (fm);
+}
+
+/* Write the robots cache back to opt.robots_cache.  The cache is
+   written to a temporary file which is then renamed over it, so that
+   an interrupted run or another Wget saving at the same time cannot
+   leave a truncated cache behind.  */
+
+void
+res_cache_save (void)
+{
+  hash_table_iterator iter;
+  time_t now = time (NULL);
+  char *tmp;
+  FILE *fp;
+  bool ok;
+
+  /* Nothing was looked up or added in this run.  */
+  if (!res_cache)
+    return;
+
+  tmp = aprintf ("%s.%ld.tmp", opt.robots_cache, (long) getpid ());
+  fp = fopen (tmp, "wb");
+  if (!fp)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 tmp, strerror (errno));
+      xfree (tmp);
+      return;
+    }
+  fputs ("# Wget robots.txt cache.  Edit at your own risk.\n", fp);
+  for (hash_table_iterate (res_cache, &iter); hash_table_iter_next (&iter); )
+    {
+      struct res_cache_entry *entry = iter.value;
+      if (entry->expires <= now)
+        continue;
+      fprintf (fp, "%s %ld %d\n", (char *) iter.key, (long) entry->expires,
+               entry->length);
+      fwrite (entry->text, 1, entry->length, fp);
+      fputc ('\n', fp);
+    }
+
+  ok = !ferror (fp);
+  if (fclose (fp) == EOF)
+    ok = false;
+#ifdef WINDOWS
+  /* rename() does not replace existing files on Windows.  */
+  if (ok)
+    unlink (opt.robots_cache);
+#endif
+  if (ok && rename (tmp, opt.robots_cache) != 0)
+    ok = false;
+  if (!ok)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot write to %s: %s\n"),
+                 opt.robots_cache, strerror (errno));
+      unlink (tmp);
+    }
+  xfree (tmp);
+}
+
 /* Loading the robots file.  */
 
 #define RES_SPECS_LOCATION "/robots.txt"
@@ -550,6 +1033,7 @@ res_retrieve_file (const char *url, char **file, struct iri *iri)
 
   logputs (LOG_VERBOSE, _("Loading robots.txt; please ignore errors.\n"));
   *file = NULL;
+  res_cache_lifetime = -1;
   opt.timestamping = false;
   opt.spider       = false;
 
@@ -610,6 +1094,21 @@ res_cleanup (void)
       hash_table_destroy (registered_specs);
       registered_specs = NULL;
     }
+  if (res_cache)
+    {
+      hash_table_iterator iter;
+      for (hash_table_iterate (res_cache, &iter);
+           hash_table_iter_next (&iter);
+           )
+        {
+          struct res_cache_entry *entry = iter.value;
+          xfree (iter.key);
+          xfree (entry->text);
+          xfree (entry);
+        }
+      hash_table_destroy (res_cache);
+      res_cache = NULL;
+    }
 }
 
 #ifdef TESTING
@@ -636,6 +1135,66 @@ test_is_robots_txt_url(void)
   return NULL;
 }
 
+const char *
+test_res_match_path(void)
+{
+  unsigned i;
+  static const char robots[] =
+    "User-agent: *\n"
+    "Allow: /private/public\n"
+    "Disallow: /private\n"
+    "Disallow: /*.cgi$\n"
+    "Disallow: /tmp*/cache\n"
+    "Disallow: /a%3cb\n"
+    "Disallow: /exact$\n";
+  static const struct {
+    const char *path;
+    bool expected_result;
+  } test_array[] = {
+    { "", true },
+    { "private", false },
+    { "private/public/x", true },
+    { "private/x", false },
+    { "bin/run.cgi", false },
+    { "bin/run.cgi/x", true },
+    { "tmp/cache", false },
+    { "tmp/x/y/cache/z", false },
+    { "tmp/x", true },
+    { "a<b", false },
+    { "a%3Cb", false },
+    { "exact", false },
+    { "exactly", true },
+  };
+  /* Many stars must not make matching exponential in the path.  */
+  static const char stars[] =
+    "User-agent: *\n"
+    "Disallow: /*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b\n";
+  char path[4096];
+  struct robot_specs *specs = res_parse (robots, sizeof (robots) - 1);
+
+  for (i = 0; i < countof(test_array); ++i)
+    {
+      mu_assert ("test_res_match_path: wrong result",
+                 res_match_path (specs, test_array[i].path) == test_array[i].expected_result);
+    }
+  free_specs (specs);
+
+  specs = res_parse (stars, sizeof (stars) - 1);
+  memset (path, 'a', sizeof (path) - 1);
+  path[sizeof (path) - 1] = '\0';
+  mu_assert ("test_res_match_path: a path without `b' should be allowed",
+             res_match_path (specs, path));
+  path[sizeof (path) - 2] = 'b';
+  mu_assert ("test_res_match_path: a path ending in `b' should be rejected",
+             !res_match_path (specs, path));
+  path[10] = 'b', path[11] = '\0';
+  mu_assert ("test_res_match_path: a path with too few `a' should be allowed",
+             res_match_path (specs, path));
+  free_specs (specs);
+
+  return NULL;
+}
+
 #endif /* TESTING */
 
 /*
@@ -36,13 +36,18 @@ struct robot_specs;
 struct robot_specs *res_parse (const char *, int);
 struct robot_specs *res_parse_from_file (const char *);
 
-bool res_match_path (const struct robot_specs *, const char *);
+bool res_match_path (struct robot_specs *, const char *);
 
 void res_register_specs (const char *, int, struct robot_specs *);
 struct robot_specs *res_get_specs (const char *, int);
 
 bool res_retrieve_file (const char *, char **, struct iri *);
 
+struct robot_specs *res_get_cached_specs (const char *, int);
+void res_cache_file (const char *, int, const char *);
+void res_cache_set_lifetime (long);
+void res_cache_save (void);
+
 bool is_robots_txt_url (const char *);
 
 void res_cleanup (void);
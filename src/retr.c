@@ -36,6 +36,7 @@ as that of the covered work.  */
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #ifdef VMS
 # include <unixio.h>            /* For delete(). */
@@ -57,6 +58,9 @@ as that of the covered work.  */
 #include "html-url.h"
 #include "iri.h"
 #include "hsts.h"
+#include "stats.h"
+#include "uring.h"
+#include "sha256.h"
 
 /* Total size of downloaded files.  Used to enforce quota.  */
 SUM_SIZE_INT total_downloaded_bytes;
@@ -72,69 +76,183 @@ FILE *output_stream;
    i.e. not `-' or a device file. */
 bool output_stream_regular;
 
-static struct {
-  wgint chunk_bytes;
-  double chunk_start;
-  double sleep_adjust;
-} limit_data;
+/* Bandwidth limiting uses token buckets: a bucket fills at RATE bytes
+   per second up to BURST bytes, and every byte read takes a token out
+   of it.  When a bucket runs dry, Wget sleeps until it is refilled.
+   The buckets live for the whole run, so that the limit is enforced
+   over many small files as well as over a single large one.
+
+   One bucket enforces --limit-rate over all the transfers, and one
+   bucket per host enforces --limit-rate-per-host.  */
+
+struct token_bucket {
+  double rate;                  /* bytes per second */
+  double burst;                 /* capacity of the bucket */
+  double tokens;                /* bytes that may be read right now;
+                                   negative when in debt */
+  double updated;               /* time of the last refill */
+};
+
+static struct token_bucket global_bucket;
+
+/* Maps host names to their buckets.  */
+static struct hash_table *host_buckets;
+
+/* The bucket of the host currently being downloaded from, if any. */
+static struct token_bucket *host_bucket;
+
+static struct ptimer *limit_timer;
+
+/* The number of processes downloading in parallel, which share the
+   limits evenly.  */
+static int limit_share = 1;
 
 static void
-limit_bandwidth_reset (void)
+token_bucket_init (struct token_bucket *b, wgint rate)
 {
-  xzero (limit_data);
+  b->rate = (double) rate / limit_share;
+  /* By default allow a burst of one second's worth of data. */
+  b->burst = (double) (opt.limit_burst ? opt.limit_burst : rate) / limit_share;
+  b->tokens = b->burst;
+  b->updated = ptimer_measure (limit_timer);
+}
+
+/* Change the share of the limits given to bucket B. */
+
+static void
+token_bucket_rescale (struct token_bucket *b, int old_share, int new_share)
+{
+  b->rate = b->rate * old_share / new_share;
+  b->burst = b->burst * old_share / new_share;
+  b->tokens = b->tokens * old_share / new_share;
+}
+
+/* Refill bucket B up to time NOW, take BYTES out of it, and return
+   the number of seconds to wait until it is no longer in debt. */
+
+static double
+token_bucket_take (struct token_bucket *b, double now, wgint bytes)
+{
+  b->tokens += (now - b->updated) * b->rate;
+  if (b->tokens > b->burst)
+    b->tokens = b->burst;
+  b->updated = now;
+  b->tokens -= bytes;
+  return b->tokens < 0 ? -b->tokens / b->rate : 0;
+}
+
+/* Return the lowest of the configured rate limits, or 0 if the
+   bandwidth isn't limited.  */
+
+wgint
+limit_bandwidth_rate (void)
+{
+  wgint rate = opt.limit_rate;
+  if (opt.limit_rate_per_host && (!rate || opt.limit_rate_per_host < rate))
+    rate = opt.limit_rate_per_host;
+  return rate;
+}
+
+/* Split the limits evenly among N processes, such as the FTP
+   workers, which download in parallel and inherit the buckets.
+   Calling this with 1 restores the whole limits.  */
+
+void
+limit_bandwidth_share (int n)
+{
+  if (n == limit_share)
+    return;
+  if (global_bucket.rate)
+    token_bucket_rescale (&global_bucket, limit_share, n);
+  if (host_buckets)
+    {
+      hash_table_iterator iter;
+      for (hash_table_iterate (host_buckets, &iter);
+           hash_table_iter_next (&iter); )
+        token_bucket_rescale (iter.value, limit_share, n);
+    }
+  limit_share = n;
+}
+
+/* Charge the following transfers to the bucket of HOST.  */
+
+void
+limit_bandwidth_host (const char *host)
+{
+  if (!opt.limit_rate_per_host)
+    return;
+  if (!limit_timer)
+    limit_timer = ptimer_new ();
+  if (!host_buckets)
+    host_buckets = make_nocase_string_hash_table (0);
+  host_bucket = hash_table_get (host_buckets, host);
+  if (!host_bucket)
+    {
+      host_bucket = xnew (struct token_bucket);
+      token_bucket_init (host_bucket, opt.limit_rate_per_host);
+      hash_table_put (host_buckets, xstrdup (host), host_bucket);
+    }
 }
 
 /* Limit the bandwidth by pausing the download for an amount of time.
-   BYTES is the number of bytes received from the network, and TIMER
-   is the timer that started at the beginning of download.  */
+   BYTES is the number of bytes received from the network.  */
 
 static void
-limit_bandwidth (wgint bytes, struct ptimer *timer)
+limit_bandwidth (wgint bytes)
 {
-  double delta_t = ptimer_read (timer) - limit_data.chunk_start;
-  double expected;
+  double now, slp = 0;
+
+  if (!limit_timer)
+    limit_timer = ptimer_new ();
+  now = ptimer_measure (limit_timer);
+
+  if (opt.limit_rate)
+    {
+      if (!global_bucket.rate)
+        token_bucket_init (&global_bucket, opt.limit_rate);
+      slp = token_bucket_take (&global_bucket, now, bytes);
+    }
+  if (host_bucket)
+    {
+      double host_slp = token_bucket_take (host_bucket, now, bytes);
+      if (host_slp > slp)
+        slp = host_slp;
+    }
+
+  /* Short sleeps are imprecise and costly; the debt is carried over
+     to the next read instead.  */
+  if (slp < 0.2)
+    return;
 
-  limit_data.chunk_bytes += bytes;
+  DEBUGP (("\nsleeping %.2f ms for %s bytes\n",
+           slp * 1000, number_to_static_string (bytes)));
+  xsleep (slp);
+  /* Any oversleeping is compensated by the refill at the next read. */
+}
 
-  /* Calculate the amount of time we expect downloading the chunk
-     should take.  If in reality it took less time, sleep to
-     compensate for the difference.  */
-  expected = (double) limit_data.chunk_bytes / opt.limit_rate;
+/* Free the token buckets.  */
 
-  if (expected > delta_t)
+void
+limit_bandwidth_cleanup (void)
+{
+  if (host_buckets)
     {
-      double slp = expected - delta_t + limit_data.sleep_adjust;
-      double t0, t1;
-      if (slp < 0.2)
+      hash_table_iterator iter;
+      for (hash_table_iterate (host_buckets, &iter);
+           hash_table_iter_next (&iter); )
         {
-          DEBUGP (("deferring a %.2f ms sleep (%s/%.2f).\n",
-                   slp * 1000, number_to_static_string (limit_data.chunk_bytes),
-                   delta_t));
-          return;
+          xfree (iter.key);
+          xfree (iter.value);
         }
-      DEBUGP (("\nsleeping %.2f ms for %s bytes, adjust %.2f ms\n",
-               slp * 1000, number_to_static_string (limit_data.chunk_bytes),
-               limit_data.sleep_adjust));
-
-      t0 = ptimer_read (timer);
-      xsleep (slp);
-      t1 = ptimer_measure (timer);
-
-      /* Due to scheduling, we probably slept slightly longer (or
-         shorter) than desired.  Calculate the difference between the
-         desired and the actual sleep, and adjust the next sleep by
-         that amount.  */
-      limit_data.sleep_adjust = slp - (t1 - t0);
-      /* If sleep_adjust is very large, it's likely due to suspension
-         and not clock inaccuracy.  Don't enforce those.  */
-      if (limit_data.sleep_adjust > 0.5)
-        limit_data.sleep_adjust = 0.5;
-      else if (limit_data.sleep_adjust < -0.5)
-        limit_data.sleep_adjust = -0.5;
+      hash_table_destroy (host_buckets);
+      host_buckets = NULL;
     }
-
-  limit_data.chunk_bytes = 0;
-  limit_data.chunk_start = ptimer_read (timer);
+  host_bucket = NULL;
+  xzero (global_bucket);
+  limit_share = 1;
+  if (limit_timer)
+    ptimer_destroy (limit_timer);
+  limit_timer = NULL;
 }
 
 /* Write data in BUF to OUT.  However, if *SKIP is non-zero, skip that
@@ -197,6 +315,10 @@ write_data (FILE *out, FILE *out2, const char *buf, int bufsize,
     return 0;
 }
 
+/* With --drop-cache, how much data is written between the requests to
+   drop it from the page cache.  */
+#define DROP_CACHE_INTERVAL (8 * 1024 * 1024)
+
 /* Read the contents of file descriptor FD until it the connection
    terminates or a read error occurs.  The data is read in portions of
    up to 16K and written to OUT as it arrives.  If opt.verbose is set,
@@ -217,6 +339,9 @@ write_data (FILE *out, FILE *out2, const char *buf, int bufsize,
    response, everything -- including the chunk headers -- is written
    to OUT2.  (OUT will only get the unchunked response.)
 
+   If DIGEST is non-NULL, the (unchunked) data read is also added to
+   the SHA-256 digest it points to.
+
    The function exits and returns the amount of data read.  In case of
    error while reading data, -1 is returned.  In case of error while
    writing data to OUT, -2 is returned.  In case of error while writing
@@ -226,7 +351,7 @@ int
 fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread, wgint startpos,
 
               wgint *qtyread, wgint *qtywritten, double *elapsed, int flags,
-              FILE *out2)
+              FILE *out2, struct sha256_ctx *digest)
 {
   int ret = 0;
 #undef max
@@ -257,6 +382,15 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
   wgint sum_written = 0;
   wgint remaining_chunk_size = 0;
 
+  /* How much has been written since the page cache was last dropped. */
+  wgint undropped = 0;
+
+  /* The bandwidth limit, or 0 if unlimited. */
+  wgint limit_rate = limit_bandwidth_rate ();
+
+  /* Set when the body is received through io_uring. */
+  struct uring_body *ub = NULL;
+
   if (flags & rb_skip_startpos)
     skip = startpos;
 
@@ -275,13 +409,14 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
       progress_interactive = progress_interactive_p (progress);
     }
 
-  if (opt.limit_rate)
-    limit_bandwidth_reset ();
+  if (opt.drop_cache && out != NULL)
+    file_advise_sequential (out);
 
-  /* A timer is needed for tracking progress, for throttling, and for
-     tracking elapsed time.  If either of these are requested, start
-     the timer.  */
-  if (progress || opt.limit_rate || elapsed)
+  stats_transfer_begin (downloaded_filename, startpos, toread);
+
+  /* A timer is needed for tracking progress and for tracking elapsed
+     time.  If either of these are requested, start the timer.  */
+  if (progress || elapsed)
     {
       timer = ptimer_new ();
       last_successful_read_tm = 0;
@@ -291,8 +426,13 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
      with --limit-rate=2k, it doesn't make sense to slurp in 16K of
      data and then sleep for 8s.  With buffer size equal to the limit,
      we never have to sleep for more than one second.  */
-  if (opt.limit_rate && opt.limit_rate < dlbufsize)
-    dlbufsize = opt.limit_rate;
+  if (limit_rate && limit_rate < dlbufsize)
+    dlbufsize = limit_rate;
+
+  /* Plain bodies written to a file as they arrive can do without the
+     read and write system calls of every chunk.  */
+  if (out && !out2 && !chunked && !skip && !limit_rate)
+    ub = uring_body_new (fd, out);
 
   /* Read from FD while there is data to read.  Normally toread==0
      means that it is unknown how much data is to arrive.  However, if
@@ -302,6 +442,7 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
     {
       int rdsize;
       double tmout = opt.read_timeout;
+      char *buf = dlbuf;
 
       if (chunked)
         {
@@ -338,6 +479,9 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
 
           rdsize = MIN (remaining_chunk_size, dlbufsize);
         }
+      else if (ub)
+        /* uring_body_read reads as much as its buffers hold. */
+        rdsize = exact ? MIN (toread - sum_read, INT_MAX) : INT_MAX;
       else
         rdsize = exact ? MIN (toread - sum_read, dlbufsize) : dlbufsize;
 
@@ -364,14 +508,21 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
                 }
             }
         }
-      ret = fd_read (fd, dlbuf, rdsize, tmout);
+      if (ub)
+        {
+          ret = uring_body_read (ub, &buf, rdsize, tmout);
+          if (ret == -2)
+            goto out;           /* error writing an earlier chunk */
+        }
+      else
+        ret = fd_read (fd, dlbuf, rdsize, tmout);
 
       if (progress_interactive && ret < 0 && errno == ETIMEDOUT)
         ret = 0;                /* interactive timeout, handled above */
       else if (ret <= 0)
         break;                  /* EOF or read error */
 
-      if (progress || opt.limit_rate || elapsed)
+      if (progress || elapsed)
         {
           ptimer_measure (timer);
           if (ret > 0)
@@ -383,12 +534,28 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
           int write_res;
 
           sum_read += ret;
-          write_res = write_data (out, out2, dlbuf, ret, &skip, &sum_written);
+          stats_transfer_update (ret);
+          if (digest)
+            sha256_process_bytes (buf, ret, digest);
+          if (ub)
+            {
+              uring_body_write (ub, ret);
+              sum_written += ret;
+              write_res = 0;
+            }
+          else
+            write_res = write_data (out, out2, buf, ret, &skip, &sum_written);
           if (write_res < 0)
             {
               ret = (write_res == -3) ? -3 : -2;
               goto out;
             }
+          if (opt.drop_cache && out != NULL
+              && (undropped += ret) >= DROP_CACHE_INTERVAL)
+            {
+              file_drop_cache (out);
+              undropped = 0;
+            }
           if (chunked)
             {
               remaining_chunk_size -= ret;
@@ -410,8 +577,8 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
             }
         }
 
-      if (opt.limit_rate)
-        limit_bandwidth (ret, timer);
+      if (limit_rate)
+        limit_bandwidth (ret);
 
       if (progress)
         progress_update (progress, ret, ptimer_read (timer));
@@ -425,6 +592,14 @@ fd_read_body (const char *downloaded_filename, int fd, FILE *out, wgint toread,
     ret = -1;
 
  out:
+  if (ub && uring_body_finish (ub) < 0 && ret >= -1)
+    ret = -2;
+
+  if (opt.drop_cache && out != NULL)
+    file_drop_cache (out);
+
+  stats_transfer_end (ret >= 0);
+
   if (progress)
     progress_finish (progress, ptimer_read (timer));
 
@@ -708,7 +883,8 @@ calc_rate (wgint bytes, double secs, int *units)
 static char *getproxy (struct url *);
 
 /* Retrieve the given URL.  Decides which loop to call -- HTTP, FTP,
-   FTP, proxy, etc.  */
+   FTP, proxy, etc.  The caller may set EXPECT_HTML in *DT if the link
+   to the URL suggests that it is an HTML document.  */
 
 /* #### This function should be rewritten so it doesn't return from
    multiple points. */
@@ -746,6 +922,8 @@ retrieve_url (struct url * orig_parsed, const char *origurl, char **file,
   if (file)
     *file = NULL;
 
+  stats_retrieval_begin (url);
+
   if (!refurl)
     refurl = opt.referer;
 
@@ -1001,15 +1179,83 @@ retrieve_url (struct url * orig_parsed, const char *origurl, char **file,
   RESTORE_METHOD;
 
 bail:
+  stats_retrieval_end (result == RETROK);
   if (register_status)
     inform_exit_status (result);
 
   return result;
 }
 
+/* Retrieve CUR_URL, read from an input file, the way
+   retrieve_from_file does and store the result in *STATUS.  Returns
+   false if the retrieval was not attempted because the quota has been
+   exceeded, meaning that the remaining URLs should not be either.  */
+
+static bool
+retrieve_input_url (struct urlpos *cur_url, struct iri *iri, uerr_t *status)
+{
+  char *filename = NULL, *new_file = NULL, *proxy;
+  int dt = 0;
+  struct iri *tmpiri;
+  struct url *parsed_url = NULL;
+
+  if (cur_url->ignore_when_downloading)
+    return true;
+
+  if (opt.quota && total_downloaded_bytes > opt.quota)
+    {
+      *status = QUOTEXC;
+      return false;
+    }
+
+  tmpiri = iri_dup (iri);
+  parsed_url = url_parse (cur_url->url->url, NULL, tmpiri, true);
+
+  proxy = getproxy (cur_url->url);
+  if ((opt.recursive || opt.page_requisites)
+      && (cur_url->url->scheme != SCHEME_FTP || proxy))
+    {
+      int old_follow_ftp = opt.follow_ftp;
+
+      /* Turn opt.follow_ftp on in case of recursive FTP retrieval */
+      if (cur_url->url->scheme == SCHEME_FTP)
+        opt.follow_ftp = 1;
+
+      *status = retrieve_tree (parsed_url ? parsed_url : cur_url->url,
+                               tmpiri);
+
+      opt.follow_ftp = old_follow_ftp;
+    }
+  else
+    *status = retrieve_url (parsed_url ? parsed_url : cur_url->url,
+                            cur_url->url->url, &filename,
+                            &new_file, NULL, &dt, opt.recursive, tmpiri,
+                            true);
+  xfree (proxy);
+
+  if (parsed_url)
+      url_free (parsed_url);
+
+  if (filename && opt.delete_after && file_exists_p (filename))
+    {
+      DEBUGP (("\
+Removing file due to --delete-after in retrieve_from_file():\n"));
+      logprintf (LOG_VERBOSE, _("Removing %s.\n"), filename);
+      if (unlink (filename))
+        logprintf (LOG_NOTQUIET, "unlink: %s\n", strerror (errno));
+      dt &= ~RETROKF;
+    }
+
+  xfree (new_file);
+  xfree (filename);
+  iri_free (tmpiri);
+  return true;
+}
+
 /* Find the URLs in the file and call retrieve_url() for each of them.
    If HTML is true, treat the file as HTML, and construct the URLs
-   accordingly.
+   accordingly.  Otherwise the URLs are read and retrieved one at a
+   time.
 
    If opt.recursive is set, call retrieve_tree() for each file.  */
 
@@ -1017,7 +1263,6 @@ uerr_t
 retrieve_from_file (const char *file, bool html, int *count)
 {
   uerr_t status;
-  struct urlpos *url_list, *cur_url;
   struct iri *iri = iri_new();
 
   char *input_file, *url_file = NULL;
@@ -1032,7 +1277,7 @@ retrieve_from_file (const char *file, bool html, int *count)
 
   if (url_valid_scheme (url))
     {
-      int dt,url_err;
+      int dt = 0, url_err;
       struct url *url_parsed = url_parse (url, &url_err, iri, true);
       if (!url_parsed)
         {
@@ -1070,72 +1315,36 @@ retrieve_from_file (const char *file, bool html, int *count)
   else
     input_file = (char *) file;
 
-  url_list = (html ? get_urls_html (input_file, NULL, NULL, iri)
-              : get_urls_file (input_file));
-
-  xfree (url_file);
-
-  for (cur_url = url_list; cur_url; cur_url = cur_url->next, ++*count)
+  if (html)
     {
-      char *filename = NULL, *new_file = NULL, *proxy;
-      int dt = 0;
-      struct iri *tmpiri = iri_dup (iri);
-      struct url *parsed_url = NULL;
+      struct urlpos *url_list, *cur_url;
 
-      if (cur_url->ignore_when_downloading)
-        continue;
-
-      if (opt.quota && total_downloaded_bytes > opt.quota)
-        {
-          status = QUOTEXC;
+      url_list = get_urls_html (input_file, NULL, NULL, iri);
+      for (cur_url = url_list; cur_url; cur_url = cur_url->next, ++*count)
+        if (!retrieve_input_url (cur_url, iri, &status))
           break;
-        }
-
-      parsed_url = url_parse (cur_url->url->url, NULL, tmpiri, true);
-
-      proxy = getproxy (cur_url->url);
-      if ((opt.recursive || opt.page_requisites)
-          && (cur_url->url->scheme != SCHEME_FTP || proxy))
-        {
-          int old_follow_ftp = opt.follow_ftp;
-
-          /* Turn opt.follow_ftp on in case of recursive FTP retrieval */
-          if (cur_url->url->scheme == SCHEME_FTP)
-            opt.follow_ftp = 1;
-
-          status = retrieve_tree (parsed_url ? parsed_url : cur_url->url,
-                                  tmpiri);
-
-          opt.follow_ftp = old_follow_ftp;
-        }
-      else
-        status = retrieve_url (parsed_url ? parsed_url : cur_url->url,
-                               cur_url->url->url, &filename,
-                               &new_file, NULL, &dt, opt.recursive, tmpiri,
-                               true);
-      xfree (proxy);
-
-      if (parsed_url)
-          url_free (parsed_url);
+      free_urlpos (url_list);
+    }
+  else
+    {
+      /* Read the URLs one by one, and retrieve each before reading
+         the next, so that the file can be arbitrarily large, or a
+         pipe being written to by another program.  */
+      struct url_file_reader *rd = url_file_open (input_file);
+      struct urlpos *cur_url;
 
-      if (filename && opt.delete_after && file_exists_p (filename))
+      while ((cur_url = url_file_next (rd)) != NULL)
         {
-          DEBUGP (("\
-Removing file due to --delete-after in retrieve_from_file():\n"));
-          logprintf (LOG_VERBOSE, _("Removing %s.\n"), filename);
-          if (unlink (filename))
-            logprintf (LOG_NOTQUIET, "unlink: %s\n", strerror (errno));
-          dt &= ~RETROKF;
+          bool go_on = retrieve_input_url (cur_url, iri, &status);
+          free_urlpos (cur_url);
+          if (!go_on)
+            break;
+          ++*count;
         }
-
-      xfree (new_file);
-      xfree (filename);
-      iri_free (tmpiri);
+      url_file_close (rd);
     }
 
-  /* Free the linked list of URL-s.  */
-  free_urlpos (url_list);
-
+  xfree (url_file);
   iri_free (iri);
 
   return status;
@@ -1160,6 +1369,9 @@ sleep_between_retrievals (int count)
 {
   static bool first_retrieval = true;
 
+  if (count > 1)
+    stats_retry ();
+
   if (first_retrieval)
     {
       /* Don't sleep before the very first retrieval. */
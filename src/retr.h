@@ -52,7 +52,14 @@ enum {
   rb_chunked_transfer_encoding = 4
 };
 
-int fd_read_body (const char *, int, FILE *, wgint, wgint, wgint *, wgint *, double *, int, FILE *);
+wgint limit_bandwidth_rate (void);
+void limit_bandwidth_share (int);
+void limit_bandwidth_host (const char *);
+void limit_bandwidth_cleanup (void);
+
+struct sha256_ctx;
+int fd_read_body (const char *, int, FILE *, wgint, wgint, wgint *, wgint *, double *, int, FILE *,
+                  struct sha256_ctx *);
 
 typedef const char *(*hunk_terminator_t) (const char *, const char *, int);
 
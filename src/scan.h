@@ -0,0 +1,66 @@
+/* Vector primitives for scanning text in bulk.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/* When the compiler targets SSE2 or AVX2, SCAN_VECTOR is defined and
+   the macros below operate on SCAN_WIDTH characters at a time.  Their
+   users keep a character loop for the remainder, and for other
+   targets.  SCAN_MASK has a bit set for every byte whose high bit is
+   set, so comparison results and 8-bit characters can both be tested
+   through it.  */
+
+#if defined __GNUC__ && defined __AVX2__
+# include <immintrin.h>
+# define SCAN_VECTOR
+typedef __m256i scan_vec_t;
+# define SCAN_WIDTH 32
+# define SCAN_LOAD(p) _mm256_loadu_si256 ((const __m256i *) (p))
+# define SCAN_SPLAT(c) _mm256_set1_epi8 (c)
+# define SCAN_EQ(a, b) _mm256_cmpeq_epi8 (a, b)
+# define SCAN_GT(a, b) _mm256_cmpgt_epi8 (a, b)
+# define SCAN_OR(a, b) _mm256_or_si256 (a, b)
+# define SCAN_AND(a, b) _mm256_and_si256 (a, b)
+# define SCAN_MASK(v) ((unsigned int) _mm256_movemask_epi8 (v))
+#elif defined __GNUC__ && defined __SSE2__
+# include <emmintrin.h>
+# define SCAN_VECTOR
+typedef __m128i scan_vec_t;
+# define SCAN_WIDTH 16
+# define SCAN_LOAD(p) _mm_loadu_si128 ((const __m128i *) (p))
+# define SCAN_SPLAT(c) _mm_set1_epi8 (c)
+# define SCAN_EQ(a, b) _mm_cmpeq_epi8 (a, b)
+# define SCAN_GT(a, b) _mm_cmpgt_epi8 (a, b)
+# define SCAN_OR(a, b) _mm_or_si128 (a, b)
+# define SCAN_AND(a, b) _mm_and_si128 (a, b)
+# define SCAN_MASK(v) ((unsigned int) _mm_movemask_epi8 (v))
+#endif
+
+#endif /* SCAN_H */
@@ -0,0 +1,258 @@
+/* TLS session cache shared by the SSL backends.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+/* A connection to a host we have talked to before can skip most of
+   the TLS handshake by presenting the session it negotiated the last
+   time, either as a session ID or as a session ticket.  The backends
+   serialize their sessions and keep them here, keyed by host and
+   port.  With --tls-session-file, the sessions are also kept on disk
+   so that later runs can resume them too.  */
+
+#include "wget.h"
+
+#ifdef HAVE_SSL
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "hash.h"
+#include "ssl.h"
+
+/* Sessions are not kept longer than this, whatever the server says. */
+#define SSL_SESSION_MAX_LIFETIME (24 * 60 * 60)
+
+struct ssl_session_entry {
+  unsigned char *data;          /* serialized session */
+  size_t size;
+  time_t expires;
+};
+
+/* Sessions indexed by "HOST:PORT". */
+static struct hash_table *ssl_sessions;
+
+static void
+ssl_session_store (const char *key, const void *data, size_t size,
+                   time_t expires)
+{
+  struct ssl_session_entry *entry, *old;
+  char *old_key;
+
+  entry = xnew (struct ssl_session_entry);
+  entry->data = xmalloc (size);
+  memcpy (entry->data, data, size);
+  entry->size = size;
+  entry->expires = expires;
+
+  if (hash_table_get_pair (ssl_sessions, key, &old_key, &old))
+    {
+      xfree (old->data);
+      xfree (old);
+      hash_table_put (ssl_sessions, old_key, entry);
+    }
+  else
+    hash_table_put (ssl_sessions, xstrdup (key), entry);
+}
+
+/* Read the sessions saved in opt.tls_session_file, dropping the ones
+   that have expired.  A missing file is not an error.  */
+
+static void
+ssl_session_cache_load (void)
+{
+  struct file_memory *fm;
+  const char *p, *end;
+  time_t now = time (NULL);
+
+  if (!file_exists_p (opt.tls_session_file))
+    return;
+  fm = wget_read_file (opt.tls_session_file);
+  if (!fm)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 opt.tls_session_file, strerror (errno));
+      return;
+    }
+
+  for (p = fm->content, end = p + fm->length; p < end; )
+    {
+      const char *eol = memchr (p, '\n', end - p);
+      char *line, *key, *tail, *data;
+      long expires;
+      ssize_t size;
+
+      if (!eol)
+        eol = end;
+      line = strdupdelim (p, eol);
+      p = eol + 1;
+
+      /* Lines look like "HOST:PORT EXPIRES BASE64-SESSION". */
+      key = line;
+      tail = strchr (key, ' ');
+      if (*line == '#' || !tail)
+        goto next;
+      *tail++ = '\0';
+      expires = strtol (tail, &tail, 10);
+      if (*tail++ != ' ' || expires <= now)
+        goto next;
+
+      data = xmalloc (strlen (tail) + 1);
+      size = base64_decode (tail, data);
+      if (size > 0)
+        ssl_session_store (key, data, size, expires);
+      xfree (data);
+
+    next:
+      xfree (line);
+    }
+
+  wget_read_file_free (fm);
+}
+
+static void
+ssl_session_cache_init (void)
+{
+  if (ssl_sessions)
+    return;
+  ssl_sessions = make_nocase_string_hash_table (0);
+  if (opt.tls_session_file)
+    ssl_session_cache_load ();
+}
+
+/* Return the key under which the sessions with HOST:PORT are kept.
+   The caller frees it.  */
+
+char *
+ssl_session_key (const char *host, int port)
+{
+  return aprintf ("%s:%d", host, port);
+}
+
+/* Return the session saved for KEY and store its size to *SIZE, or
+   return NULL if there is none.  */
+
+const void *
+ssl_session_get (const char *key, size_t *size)
+{
+  struct ssl_session_entry *entry;
+
+  ssl_session_cache_init ();
+  entry = hash_table_get (ssl_sessions, key);
+  if (!entry || entry->expires <= time (NULL))
+    return NULL;
+  *size = entry->size;
+  return entry->data;
+}
+
+/* Remember the SIZE bytes of session DATA for KEY, until EXPIRES.  */
+
+void
+ssl_session_put (const char *key, const void *data, size_t size,
+                 time_t expires)
+{
+  time_t now = time (NULL);
+
+  ssl_session_cache_init ();
+  if (expires > now + SSL_SESSION_MAX_LIFETIME)
+    expires = now + SSL_SESSION_MAX_LIFETIME;
+  if (size == 0 || expires <= now)
+    return;
+  ssl_session_store (key, data, size, expires);
+  DEBUGP (("Saved TLS session for %s.\n", key));
+}
+
+/* Write the sessions that have not expired to opt.tls_session_file.
+   Sessions hold the keys of the connections they belong to, so the
+   file is only made readable by its owner.  */
+
+void
+ssl_session_cache_save (void)
+{
+  hash_table_iterator iter;
+  time_t now = time (NULL);
+  char *tmp;
+  FILE *fp;
+  int fd;
+  bool ok;
+
+  /* No TLS connection was made in this run.  */
+  if (!ssl_sessions)
+    return;
+
+  tmp = aprintf ("%s.%ld.tmp", opt.tls_session_file, (long) getpid ());
+  fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  fp = fd < 0 ? NULL : fdopen (fd, "w");
+  if (!fp)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 tmp, strerror (errno));
+      if (fd >= 0)
+        close (fd);
+      xfree (tmp);
+      return;
+    }
+
+  fputs ("# TLS sessions saved by Wget.  Edit at your own risk.\n", fp);
+  for (hash_table_iterate (ssl_sessions, &iter); hash_table_iter_next (&iter); )
+    {
+      struct ssl_session_entry *entry = iter.value;
+      char *encoded;
+
+      if (entry->expires <= now)
+        continue;
+      encoded = xmalloc (BASE64_LENGTH (entry->size) + 1);
+      base64_encode (entry->data, entry->size, encoded);
+      fprintf (fp, "%s %ld %s\n", (char *) iter.key, (long) entry->expires,
+               encoded);
+      xfree (encoded);
+    }
+
+  ok = !ferror (fp);
+  if (fclose (fp) == EOF)
+    ok = false;
+#ifdef WINDOWS
+  /* rename() does not replace existing files on Windows.  */
+  if (ok)
+    unlink (opt.tls_session_file);
+#endif
+  if (ok && rename (tmp, opt.tls_session_file) != 0)
+    ok = false;
+  if (!ok)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot write to %s: %s\n"),
+                 opt.tls_session_file, strerror (errno));
+      unlink (tmp);
+    }
+  xfree (tmp);
+}
+#endif /* HAVE_SSL */
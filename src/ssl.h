@@ -33,7 +33,13 @@ as that of the covered work.  */
 #define GEN_SSLFUNC_H
 
 bool ssl_init (void);
-bool ssl_connect_wget (int, const char *);
+bool ssl_connect_wget (int, const char *, int);
 bool ssl_check_certificate (int, const char *);
 
+/* Defined in ssl-session.c. */
+char *ssl_session_key (const char *, int);
+const void *ssl_session_get (const char *, size_t *);
+void ssl_session_put (const char *, const void *, size_t, time_t);
+void ssl_session_cache_save (void);
+
 #endif /* GEN_SSLFUNC_H */
@@ -0,0 +1,553 @@
+/* Machine-readable transfer statistics.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+/* With --stats-file or --stats-fd, Wget writes one JSON object per
+   line describing what it is doing, for programs that monitor it:
+
+   - "progress" records, at most once per STATS_INTERVAL, while a
+     file is being transferred;
+   - a "transfer" record after each transferred file;
+   - a "url" record after each URL is retrieved, with the time spent
+     in each phase of the retrieval and the number of retries and of
+     connections used;
+   - a "summary" record at the end.
+
+   Every record has the "event" and "time" (seconds since the Epoch)
+   members, and "elapsed", the seconds since Wget started.
+
+   The phase timings are also shown with --debug, written to the
+   --timing-log file, and stored in a metadata record after each
+   response in the WARC file.  They are only measured when one of
+   these outputs is in use.  */
+
+#include "wget.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "utils.h"
+#include "exits.h"
+#include "ptimer.h"
+#include "progress.h"
+#include "retr.h"
+#include "stats.h"
+
+/* Minimum time between two "progress" records of a transfer. */
+#define STATS_INTERVAL 1.0
+
+static const char *phase_names[PHASE_COUNT] = {
+  "dns", "connect", "tls", "request", "ttfb", "body"
+};
+
+static FILE *stats_fp;
+static FILE *timing_log_fp;
+static struct ptimer *stats_timer;
+
+/* Whether the phases are timed. */
+static bool timing;
+
+/* The phases of the current HTTP request. */
+static double req_phase[PHASE_COUNT];
+
+/* The retrieval of the current URL. */
+static struct {
+  char *url;
+  double start;
+  double phase[PHASE_COUNT];        /* time spent, or -1 */
+  double phase_start[PHASE_COUNT];  /* start of the phase under way,
+                                       or -1 */
+  int retries;
+  int opened, reused;               /* connections */
+} cur;
+
+/* The file being transferred. */
+static struct {
+  bool active;
+  char *file;
+  wgint size;                   /* expected size, or -1 */
+  wgint bytes;                  /* bytes transferred so far */
+  wgint offset;                 /* bytes there were before */
+  double start;
+  double last_report;
+  struct bar_progress_hist *ring;
+} xfer;
+
+/* Totals over the whole run. */
+static struct {
+  wgint bytes;
+  int urls, failed_urls;
+  int transfers, failed_transfers;
+  int retries;
+  int opened, reused;
+  double phase[PHASE_COUNT];
+} totals;
+
+static double
+stats_now (void)
+{
+  return ptimer_measure (stats_timer);
+}
+
+static void
+reset_phases (void)
+{
+  int i;
+  for (i = 0; i < PHASE_COUNT; i++)
+    cur.phase[i] = cur.phase_start[i] = req_phase[i] = -1;
+}
+
+/* Open the statistics output requested by --stats-fd or
+   --stats-file, and the --timing-log file.  */
+
+void
+stats_init (void)
+{
+  if (opt.stats_fd >= 0)
+    {
+      stats_fp = fdopen (opt.stats_fd, "w");
+      if (!stats_fp)
+        {
+          logprintf (LOG_NOTQUIET,
+                     _("Cannot write statistics to descriptor %d: %s\n"),
+                     opt.stats_fd, strerror (errno));
+          exit (WGET_EXIT_GENERIC_ERROR);
+        }
+    }
+  else if (opt.stats_file)
+    {
+      if (HYPHENP (opt.stats_file))
+        stats_fp = stdout;
+      else
+        stats_fp = fopen (opt.stats_file, "w");
+      if (!stats_fp)
+        {
+          logprintf (LOG_NOTQUIET, "%s: %s\n", opt.stats_file,
+                     strerror (errno));
+          exit (WGET_EXIT_GENERIC_ERROR);
+        }
+    }
+
+  if (opt.timing_log)
+    {
+      timing_log_fp = fopen (opt.timing_log, "w");
+      if (!timing_log_fp)
+        {
+          logprintf (LOG_NOTQUIET, "%s: %s\n", opt.timing_log,
+                     strerror (errno));
+          exit (WGET_EXIT_GENERIC_ERROR);
+        }
+      /* Note: Update this header when columns change in any way. */
+      fputs ("TIME\tURL\tRESULT\tRETRIES\tDNS\tCONNECT\tTLS\tREQUEST"
+             "\tTTFB\tBODY\tTOTAL\n", timing_log_fp);
+    }
+
+  timing = stats_fp || timing_log_fp || opt.warc_filename;
+  IF_DEBUG
+    timing = true;
+  if (!timing)
+    return;
+
+  stats_timer = ptimer_new ();
+  reset_phases ();
+}
+
+void
+stats_cleanup (void)
+{
+  if (!timing)
+    return;
+  if (stats_fp && stats_fp != stdout)
+    fclose (stats_fp);
+  stats_fp = NULL;
+  if (timing_log_fp)
+    fclose (timing_log_fp);
+  timing_log_fp = NULL;
+  timing = false;
+  ptimer_destroy (stats_timer);
+  xfree (cur.url);
+  xfree (xfer.file);
+  if (xfer.ring)
+    speed_ring_free (xfer.ring);
+  xfer.ring = NULL;
+}
+
+/* Writing of the records.  The members are written directly to the
+   stream; each record is flushed as soon as it is complete, so that
+   it can be read while Wget is still running.  */
+
+static void
+put_string (const char *s)
+{
+  putc ('"', stats_fp);
+  for (; *s; s++)
+    {
+      unsigned char c = *s;
+      if (c == '"' || c == '\\')
+        {
+          putc ('\\', stats_fp);
+          putc (c, stats_fp);
+        }
+      else if (c < 0x20)
+        fprintf (stats_fp, "\\u%04x", c);
+      else
+        putc (c, stats_fp);
+    }
+  putc ('"', stats_fp);
+}
+
+static void
+record_begin (const char *event)
+{
+  fprintf (stats_fp, "{\"event\":\"%s\",\"time\":%s,\"elapsed\":%.3f",
+           event, number_to_static_string (time (NULL)), stats_now ());
+}
+
+static void
+record_end (void)
+{
+  fputs ("}\n", stats_fp);
+  fflush (stats_fp);
+}
+
+static void
+put_str_member (const char *name, const char *value)
+{
+  fprintf (stats_fp, ",\"%s\":", name);
+  if (value)
+    put_string (value);
+  else
+    fputs ("null", stats_fp);
+}
+
+/* Write member NAME with value N, or null if N is negative.  */
+static void
+put_num_member (const char *name, wgint n)
+{
+  if (n >= 0)
+    fprintf (stats_fp, ",\"%s\":%s", name, number_to_static_string (n));
+  else
+    fprintf (stats_fp, ",\"%s\":null", name);
+}
+
+/* Write member NAME with value D in seconds, or null if D is
+   negative.  */
+static void
+put_time_member (const char *name, double d)
+{
+  if (d >= 0)
+    fprintf (stats_fp, ",\"%s\":%.6f", name, d);
+  else
+    fprintf (stats_fp, ",\"%s\":null", name);
+}
+
+static void
+put_bool_member (const char *name, bool b)
+{
+  fprintf (stats_fp, ",\"%s\":%s", name, b ? "true" : "false");
+}
+
+static void
+put_connections (int opened, int reused)
+{
+  fprintf (stats_fp, ",\"connections\":{\"opened\":%d,\"reused\":%d}",
+           opened, reused);
+}
+
+static void
+put_timings (const double *phase)
+{
+  int i;
+  fputs (",\"timings\":{", stats_fp);
+  for (i = 0; i < PHASE_COUNT; i++)
+    {
+      if (phase[i] >= 0)
+        fprintf (stats_fp, "%s\"%s\":%.6f", i ? "," : "", phase_names[i],
+                 phase[i]);
+      else
+        fprintf (stats_fp, "%s\"%s\":null", i ? "," : "", phase_names[i]);
+    }
+  putc ('}', stats_fp);
+}
+
+/* Average rate of BYTES in TIME seconds, in bytes per second, or -1
+   if unknown. */
+static wgint
+rate (wgint bytes, double time)
+{
+  return time > 0 ? (wgint) (bytes / time) : -1;
+}
+
+/* Phase timing.  A phase may happen several times during a retrieval
+   (on retries, redirections, or when several addresses are tried);
+   the times are added up.  */
+
+void
+stats_phase_begin (enum stats_phase phase)
+{
+  if (!timing)
+    return;
+  cur.phase_start[phase] = stats_now ();
+}
+
+void
+stats_phase_end (enum stats_phase phase)
+{
+  double time;
+
+  if (!timing || cur.phase_start[phase] < 0)
+    return;
+  time = stats_now () - cur.phase_start[phase];
+  cur.phase[phase] = MAX (cur.phase[phase], 0) + time;
+  req_phase[phase] = MAX (req_phase[phase], 0) + time;
+  cur.phase_start[phase] = -1;
+}
+
+/* Start timing the phases of an HTTP request on their own, for the
+   WARC metadata record.  */
+
+void
+stats_request_begin (void)
+{
+  int i;
+  for (i = 0; i < PHASE_COUNT; i++)
+    req_phase[i] = -1;
+}
+
+/* Write the phase timings of the current HTTP request to FP, in the
+   "application/warc-fields" format.  */
+
+void
+stats_write_request_timings (FILE *fp)
+{
+  int i;
+
+  if (!timing)
+    return;
+  for (i = 0; i < PHASE_COUNT; i++)
+    if (req_phase[i] >= 0)
+      fprintf (fp, "wget-%s-time: %.6f\r\n", phase_names[i], req_phase[i]);
+}
+
+/* Count a connection being opened, or reused if REUSED is set. */
+
+void
+stats_connection (bool reused)
+{
+  if (!timing)
+    return;
+  if (reused)
+    cur.reused++;
+  else
+    cur.opened++;
+}
+
+void
+stats_retry (void)
+{
+  if (!timing)
+    return;
+  cur.retries++;
+}
+
+/* Retrieval of a URL, including redirections and retries. */
+
+void
+stats_retrieval_begin (const char *url)
+{
+  if (!timing)
+    return;
+  xfree (cur.url);
+  cur.url = xstrdup (url);
+  cur.start = stats_now ();
+  cur.retries = cur.opened = cur.reused = 0;
+  reset_phases ();
+}
+
+void
+stats_retrieval_end (bool ok)
+{
+  double duration;
+  int i;
+
+  if (!timing || !cur.url)
+    return;
+
+  duration = stats_now () - cur.start;
+  IF_DEBUG
+    {
+      debug_logprintf ("Timings of %s:", cur.url);
+      for (i = 0; i < PHASE_COUNT; i++)
+        if (cur.phase[i] >= 0)
+          debug_logprintf (" %s %.6fs,", phase_names[i], cur.phase[i]);
+      debug_logprintf (" total %.6fs.\n", duration);
+    }
+
+  if (timing_log_fp)
+    {
+      fprintf (timing_log_fp, "%s\t%s\t%s\t%d", datetime_str (time (NULL)),
+               cur.url, ok ? "OK" : "FAILED", cur.retries);
+      for (i = 0; i < PHASE_COUNT; i++)
+        if (cur.phase[i] >= 0)
+          fprintf (timing_log_fp, "\t%.6f", cur.phase[i]);
+        else
+          fputs ("\t", timing_log_fp);
+      fprintf (timing_log_fp, "\t%.6f\n", duration);
+      fflush (timing_log_fp);
+    }
+
+  if (stats_fp)
+    {
+      record_begin ("url");
+      put_str_member ("url", cur.url);
+      put_bool_member ("ok", ok);
+      put_time_member ("duration", duration);
+      put_num_member ("retries", cur.retries);
+      put_connections (cur.opened, cur.reused);
+      put_timings (cur.phase);
+      record_end ();
+    }
+
+  totals.urls++;
+  if (!ok)
+    totals.failed_urls++;
+  totals.retries += cur.retries;
+  totals.opened += cur.opened;
+  totals.reused += cur.reused;
+  for (i = 0; i < PHASE_COUNT; i++)
+    if (cur.phase[i] > 0)
+      totals.phase[i] += cur.phase[i];
+  xfree (cur.url);
+}
+
+/* Transfer of a file.  FILE is the local file name, OFFSET the
+   amount of data it already had, and SIZE the amount expected to be
+   transferred, or 0 if unknown.  */
+
+void
+stats_transfer_begin (const char *file, wgint offset, wgint size)
+{
+  stats_phase_begin (PHASE_BODY);
+  if (!stats_fp)
+    return;
+  xfree (xfer.file);
+  xfer.file = file ? xstrdup (file) : NULL;
+  xfer.offset = offset;
+  xfer.size = size ? offset + size : -1;
+  xfer.bytes = 0;
+  xfer.start = xfer.last_report = stats_now ();
+  if (xfer.ring)
+    speed_ring_free (xfer.ring);
+  xfer.ring = speed_ring_new ();
+  xfer.active = true;
+}
+
+/* Account for BYTES more bytes of the current transfer, and write a
+   "progress" record if it is time for one.  */
+
+void
+stats_transfer_update (wgint bytes)
+{
+  double now, dltime;
+  wgint total_bytes;
+
+  if (!stats_fp || !xfer.active)
+    return;
+
+  now = stats_now ();
+  dltime = now - xfer.start;
+  xfer.bytes += bytes;
+  speed_ring_update (xfer.ring, bytes, dltime);
+  if (now - xfer.last_report < STATS_INTERVAL)
+    return;
+  xfer.last_report = now;
+
+  total_bytes = totals.bytes + xfer.bytes;
+  record_begin ("progress");
+  put_str_member ("url", cur.url);
+  put_str_member ("file", xfer.file);
+  put_num_member ("bytes", xfer.offset + xfer.bytes);
+  put_num_member ("size", xfer.size);
+  put_num_member ("rate", (wgint) speed_ring_rate (xfer.ring, dltime));
+  put_num_member ("total_bytes", total_bytes);
+  put_num_member ("total_rate", rate (total_bytes, now));
+  record_end ();
+}
+
+void
+stats_transfer_end (bool ok)
+{
+  double duration;
+
+  stats_phase_end (PHASE_BODY);
+  if (!stats_fp || !xfer.active)
+    return;
+
+  duration = stats_now () - xfer.start;
+  record_begin ("transfer");
+  put_str_member ("url", cur.url);
+  put_str_member ("file", xfer.file);
+  put_bool_member ("ok", ok);
+  put_num_member ("bytes", xfer.bytes);
+  put_num_member ("size", xfer.size);
+  put_time_member ("duration", duration);
+  put_num_member ("rate", rate (xfer.bytes, duration));
+  record_end ();
+
+  totals.bytes += xfer.bytes;
+  totals.transfers++;
+  if (!ok)
+    totals.failed_transfers++;
+  xfer.active = false;
+}
+
+/* Write the final "summary" record. */
+
+void
+stats_summary (void)
+{
+  if (!stats_fp)
+    return;
+
+  record_begin ("summary");
+  put_num_member ("urls", totals.urls);
+  put_num_member ("failed_urls", totals.failed_urls);
+  put_num_member ("files", numurls);
+  put_num_member ("transfers", totals.transfers);
+  put_num_member ("failed_transfers", totals.failed_transfers);
+  put_num_member ("bytes", total_downloaded_bytes);
+  put_time_member ("download_time", total_download_time);
+  put_num_member ("rate", rate (total_downloaded_bytes, total_download_time));
+  put_num_member ("retries", totals.retries);
+  put_connections (totals.opened, totals.reused);
+  put_timings (totals.phase);
+  record_end ();
+}
@@ -0,0 +1,65 @@
+/* Declarations for stats.c.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+#ifndef STATS_H
+#define STATS_H
+
+/* The phases of a retrieval whose duration is measured. */
+enum stats_phase {
+  PHASE_DNS,                    /* looking up the host name */
+  PHASE_CONNECT,                /* establishing the TCP connection */
+  PHASE_TLS,                    /* the TLS handshake */
+  PHASE_REQUEST,                /* sending the request */
+  PHASE_TTFB,                   /* from sending the request to the
+                                   first byte of the response */
+  PHASE_BODY,                   /* transferring the body */
+  PHASE_COUNT
+};
+
+void stats_init (void);
+void stats_cleanup (void);
+
+void stats_phase_begin (enum stats_phase);
+void stats_phase_end (enum stats_phase);
+void stats_connection (bool);
+void stats_retry (void);
+
+void stats_request_begin (void);
+void stats_write_request_timings (FILE *);
+
+void stats_retrieval_begin (const char *);
+void stats_retrieval_end (bool);
+
+void stats_transfer_begin (const char *, wgint, wgint);
+void stats_transfer_update (wgint);
+void stats_transfer_end (bool);
+
+void stats_summary (void);
+
+#endif /* STATS_H */
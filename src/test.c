@@ -54,19 +54,26 @@ all_tests(void)
   mu_run_test (test_has_key);
 #endif
   mu_run_test (test_parse_content_disposition);
+  mu_run_test (test_resp_header);
   mu_run_test (test_subdir_p);
   mu_run_test (test_dir_matches_p);
+  mu_run_test (test_dir_cache);
   mu_run_test (test_commands_sorted);
   mu_run_test (test_cmd_spec_restrict_file_names);
   mu_run_test (test_path_simplify);
   mu_run_test (test_append_uri_pathel);
   mu_run_test (test_are_urls_equal);
   mu_run_test (test_is_robots_txt_url);
+  mu_run_test (test_res_match_path);
+  mu_run_test (test_validator_file);
+  mu_run_test (test_dedup);
+  mu_run_test (test_cookie_snapshot);
 #ifdef HAVE_HSTS
   mu_run_test (test_hsts_new_entry);
   mu_run_test (test_hsts_url_rewrite_superdomain);
   mu_run_test (test_hsts_url_rewrite_congruent);
   mu_run_test (test_hsts_read_database);
+  mu_run_test (test_hsts_snapshot);
 #endif
 
   return NULL;
@@ -48,18 +48,25 @@ const char *test_has_key (void);
 const char *test_find_key_value (void);
 const char *test_find_key_values (void);
 const char *test_parse_content_disposition(void);
+const char *test_resp_header(void);
 const char *test_commands_sorted(void);
 const char *test_cmd_spec_restrict_file_names(void);
 const char *test_is_robots_txt_url(void);
+const char *test_res_match_path(void);
 const char *test_path_simplify (void);
 const char *test_append_uri_pathel(void);
 const char *test_are_urls_equal(void);
 const char *test_subdir_p(void);
 const char *test_dir_matches_p(void);
+const char *test_dir_cache(void);
+const char *test_validator_file(void);
+const char *test_dedup(void);
+const char *test_cookie_snapshot(void);
 const char *test_hsts_new_entry(void);
 const char *test_hsts_url_rewrite_superdomain(void);
 const char *test_hsts_url_rewrite_congruent(void);
 const char *test_hsts_read_database(void);
+const char *test_hsts_snapshot(void);
 
 #endif /* TEST_H */
 
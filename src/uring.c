@@ -0,0 +1,558 @@
+/* Receiving bodies through io_uring.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+/* On Linux, the body of a download over a plain connection can be
+   received and written to a regular file through io_uring, rather
+   than with a read and a write system call for every chunk.  Each
+   io_uring_enter call submits the write of the last chunk received
+   together with the receive of the next one, so that the disk write
+   goes on while waiting for the network, and the chunks go through
+   buffers registered with the kernel once and for all.
+
+   The ring is set up when first needed.  When io_uring is not
+   available, for instance with older kernels or where it is filtered
+   out by seccomp, uring_body_new returns NULL and fd_read_body reads
+   the body in the classic way.  */
+
+#include "wget.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "utils.h"
+#include "connect.h"
+#include "uring.h"
+
+/* The receive buffers.  While a buffer is being written out, the
+   next chunks are received into the following ones.  */
+#define URING_BUFFERS 4
+#define URING_BUFFER_SIZE (64 * 1024)
+
+/* Room for the write of every buffer plus a receive and its timeout. */
+#define URING_ENTRIES 8
+
+/* The operations, as stored in the user_data of the requests along
+   with the index of their buffer.  */
+enum {
+  OP_RECV = 1,
+  OP_TIMEOUT,
+  OP_WRITE
+};
+#define USER_DATA(op, i) (((__u64) (op) << 8) | (i))
+
+static struct {
+  int fd;                       /* -1 if not set up */
+  bool unavailable;             /* whether setting it up failed */
+  bool fixed;                   /* whether the buffers are registered */
+
+  unsigned *sq_tail, *sq_mask;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  unsigned sqe_tail;            /* tail including the unsubmitted SQEs */
+  unsigned to_submit;           /* SQEs not submitted yet */
+  unsigned inflight;            /* requests submitted and not completed */
+
+  void *sq_map, *cq_map;
+  size_t sq_map_size, cq_map_size, sqes_size;
+  char *buffers;
+} ring = { -1 };
+
+struct uring_body {
+  int sock;                     /* the connection */
+  int sock_flags;               /* its file status flags */
+  FILE *out;                    /* the file written to */
+  int file;
+  off_t offset;                 /* where the next chunk goes */
+  int next;                     /* the buffer to receive into next */
+
+  struct {
+    bool busy;                  /* whether it is being written */
+    int size;
+    off_t offset;
+  } chunks[URING_BUFFERS];
+
+  struct __kernel_timespec ts;  /* the receive timeout */
+  bool received;                /* whether the receive completed */
+  int recv_res;                 /* and its result */
+  int write_errno;              /* the first write error */
+};
+
+static int
+sys_io_uring_setup (unsigned entries, struct io_uring_params *p)
+{
+  return syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter (int fd, unsigned to_submit, unsigned min_complete,
+                    unsigned flags)
+{
+  return syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                  NULL, 0);
+}
+
+static int
+sys_io_uring_register (int fd, unsigned opcode, void *arg, unsigned nargs)
+{
+  return syscall (__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+/* Unmap the ring and close it.  */
+
+static void
+ring_teardown (void)
+{
+  if (ring.sqes)
+    munmap (ring.sqes, ring.sqes_size);
+  if (ring.cq_map && ring.cq_map != ring.sq_map)
+    munmap (ring.cq_map, ring.cq_map_size);
+  if (ring.sq_map)
+    munmap (ring.sq_map, ring.sq_map_size);
+  if (ring.fd >= 0)
+    close (ring.fd);
+  /* The kernel may still write into the buffers of the requests that
+     were not waited for; leak them in that case.  */
+  if (!ring.inflight)
+    xfree (ring.buffers);
+  xzero (ring);
+  ring.fd = -1;
+}
+
+/* Return whether the kernel supports all the operations in OPS,
+   which is terminated by -1.  */
+
+static bool
+ring_supports (const int *ops)
+{
+  size_t size = sizeof (struct io_uring_probe)
+    + 256 * sizeof (struct io_uring_probe_op);
+  struct io_uring_probe *probe = xcalloc (1, size);
+  bool ok = sys_io_uring_register (ring.fd, IORING_REGISTER_PROBE,
+                                   probe, 256) == 0;
+
+  for (; ok && *ops >= 0; ops++)
+    ok = *ops <= probe->last_op
+      && (probe->ops[*ops].flags & IO_URING_OP_SUPPORTED);
+  xfree (probe);
+  return ok;
+}
+
+/* Set up the ring, unless it already is.  Return false if io_uring
+   cannot be used.  */
+
+static bool
+ring_setup (void)
+{
+  static const int fixed_ops[] = {
+    IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_LINK_TIMEOUT, -1
+  };
+  static const int plain_ops[] = {
+    IORING_OP_READ, IORING_OP_WRITE, IORING_OP_LINK_TIMEOUT, -1
+  };
+  struct io_uring_params p;
+  struct iovec iov[URING_BUFFERS];
+  unsigned *sq_array;
+  unsigned i;
+  char *sq, *cq;
+
+  if (ring.fd >= 0)
+    return true;
+  if (ring.unavailable)
+    return false;
+
+  xzero (p);
+  ring.fd = sys_io_uring_setup (URING_ENTRIES, &p);
+  if (ring.fd < 0)
+    {
+      DEBUGP (("io_uring is not available: %s\n", strerror (errno)));
+      goto fail;
+    }
+
+  ring.sq_map_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  ring.cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring.sq_map_size = ring.cq_map_size = MAX (ring.sq_map_size,
+                                               ring.cq_map_size);
+  ring.sq_map = mmap (NULL, ring.sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+  if (ring.sq_map == MAP_FAILED)
+    {
+      ring.sq_map = NULL;
+      goto fail;
+    }
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring.cq_map = ring.sq_map;
+  else
+    {
+      ring.cq_map = mmap (NULL, ring.cq_map_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring.fd,
+                          IORING_OFF_CQ_RING);
+      if (ring.cq_map == MAP_FAILED)
+        {
+          ring.cq_map = NULL;
+          goto fail;
+        }
+    }
+  ring.sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  ring.sqes = mmap (NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+  if (ring.sqes == MAP_FAILED)
+    {
+      ring.sqes = NULL;
+      goto fail;
+    }
+
+  sq = ring.sq_map;
+  cq = ring.cq_map;
+  ring.sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  ring.sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+  sq_array = (unsigned *) (sq + p.sq_off.array);
+  ring.cq_head = (unsigned *) (cq + p.cq_off.head);
+  ring.cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  ring.cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+  ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  ring.sqe_tail = *ring.sq_tail;
+
+  /* The SQEs are always used in order. */
+  for (i = 0; i < p.sq_entries; i++)
+    sq_array[i] = i;
+
+  ring.buffers = xmalloc (URING_BUFFERS * URING_BUFFER_SIZE);
+  for (i = 0; i < URING_BUFFERS; i++)
+    {
+      iov[i].iov_base = ring.buffers + i * URING_BUFFER_SIZE;
+      iov[i].iov_len = URING_BUFFER_SIZE;
+    }
+  /* Registering the buffers can fail if they exceed RLIMIT_MEMLOCK,
+     in which case they are passed with every request instead.  */
+  ring.fixed = sys_io_uring_register (ring.fd, IORING_REGISTER_BUFFERS,
+                                      iov, URING_BUFFERS) == 0;
+  if (!ring_supports (ring.fixed ? fixed_ops : plain_ops))
+    {
+      DEBUGP (("io_uring lacks the operations needed.\n"));
+      goto fail;
+    }
+
+  DEBUGP (("Set up io_uring with %d %sbuffers of %d bytes.\n",
+           URING_BUFFERS, ring.fixed ? "registered " : "",
+           URING_BUFFER_SIZE));
+  return true;
+
+ fail:
+  ring_teardown ();
+  ring.unavailable = true;
+  return false;
+}
+
+/* Return a new SQE, to be submitted by the next ring_wait.  */
+
+static struct io_uring_sqe *
+ring_get_sqe (void)
+{
+  struct io_uring_sqe *sqe = &ring.sqes[ring.sqe_tail & *ring.sq_mask];
+  ++ring.sqe_tail;
+  ++ring.to_submit;
+  memset (sqe, 0, sizeof *sqe);
+  return sqe;
+}
+
+/* Fill in SQE to transfer SIZE bytes between buffer I and FD, with
+   OPCODE or its fixed buffer version.  */
+
+static void
+prep_rw (struct io_uring_sqe *sqe, int opcode, int fd, int i, int size,
+         off_t offset)
+{
+  if (ring.fixed)
+    {
+      sqe->opcode = opcode == IORING_OP_READ ? IORING_OP_READ_FIXED
+                                             : IORING_OP_WRITE_FIXED;
+      sqe->buf_index = i;
+    }
+  else
+    sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t) (ring.buffers + i * URING_BUFFER_SIZE);
+  sqe->len = size;
+  sqe->off = offset;
+}
+
+/* Handle the completion of the request identified by USER_DATA, whose
+   result is RES.  */
+
+static void
+complete (struct uring_body *b, __u64 user_data, int res)
+{
+  int i = user_data & 0xff;
+
+  switch (user_data >> 8)
+    {
+    case OP_RECV:
+      b->received = true;
+      b->recv_res = res;
+      break;
+    case OP_WRITE:
+      /* Short writes are rare enough to be finished off here. */
+      while (res >= 0 && res < b->chunks[i].size)
+        {
+          int n = pwrite (b->file,
+                          ring.buffers + i * URING_BUFFER_SIZE + res,
+                          b->chunks[i].size - res, b->chunks[i].offset + res);
+          if (n < 0 && errno == EINTR)
+            continue;
+          res = n < 0 ? -errno : res + n;
+          if (n == 0)
+            res = -EIO;
+        }
+      if (res < 0 && !b->write_errno)
+        b->write_errno = -res;
+      b->chunks[i].busy = false;
+      break;
+    default:
+      /* Completions of the timeouts tell nothing. */
+      break;
+    }
+}
+
+/* Submit the queued requests, wait for at least one completion and
+   handle the completions.  Return false on error.  */
+
+static bool
+ring_wait (struct uring_body *b)
+{
+  unsigned head, tail;
+
+  __atomic_store_n (ring.sq_tail, ring.sqe_tail, __ATOMIC_RELEASE);
+  for (;;)
+    {
+      int ret = sys_io_uring_enter (ring.fd, ring.to_submit, 1,
+                                    IORING_ENTER_GETEVENTS);
+      if (ret >= 0)
+        {
+          ring.to_submit -= ret;
+          ring.inflight += ret;
+          if (!ring.to_submit)
+            break;
+        }
+      else if (errno != EINTR)
+        return false;
+      else if (!ring.to_submit)
+        break;
+    }
+
+  head = *ring.cq_head;
+  tail = __atomic_load_n (ring.cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++)
+    {
+      struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+      complete (b, cqe->user_data, cqe->res);
+      --ring.inflight;
+    }
+  __atomic_store_n (ring.cq_head, head, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Start receiving a body from SOCK into OUT through io_uring.  Return
+   NULL if it cannot be done, in which case the body is to be read the
+   classic way.  */
+
+struct uring_body *
+uring_body_new (int sock, FILE *out)
+{
+  struct uring_body *b;
+  struct stat st;
+  int file = fileno (out), flags;
+  off_t offset;
+
+  /* The data of TLS connections, say, needs to go through their
+     transport.  Only regular files can be written at an offset.  */
+  if (fd_transport_context (sock))
+    return NULL;
+  if (fflush (out) != 0
+      || fstat (file, &st) < 0 || !S_ISREG (st.st_mode))
+    return NULL;
+  /* The kernel ignores the offset of writes to a file opened for
+     appending, as with -c, and the writes in flight could then land
+     in any order.  */
+  flags = fcntl (file, F_GETFL);
+  if (flags < 0 || (flags & O_APPEND))
+    return NULL;
+  offset = ftello (out);
+  if (offset < 0)
+    return NULL;
+  if (!ring_setup ())
+    return NULL;
+
+  b = xnew0 (struct uring_body);
+  b->sock = sock;
+  b->out = out;
+  b->file = file;
+  b->offset = offset;
+  /* The receives are to wait in the kernel rather than fail with
+     EAGAIN.  */
+  b->sock_flags = fcntl (sock, F_GETFL);
+  if (b->sock_flags >= 0 && (b->sock_flags & O_NONBLOCK))
+    fcntl (sock, F_SETFL, b->sock_flags & ~O_NONBLOCK);
+  return b;
+}
+
+/* Receive no more than SIZE bytes of the body, for at most TIMEOUT
+   seconds if it is positive, and store the address of the data to
+   *BUF.  The write of the previous chunk, if any, is submitted along.
+   Return the number of bytes received, 0 at the end of file, -1 on
+   error with errno set (to ETIMEDOUT on timeout), or -2 if a previous
+   write failed.  */
+
+int
+uring_body_read (struct uring_body *b, char **buf, int size, double timeout)
+{
+  struct io_uring_sqe *sqe;
+  int i = b->next, res;
+
+  /* Wait for the buffer to be written out, in case it still is. */
+  while (b->chunks[i].busy)
+    if (!ring_wait (b))
+      return -1;
+  if (b->write_errno)
+    {
+      errno = b->write_errno;
+      return -2;
+    }
+
+  sqe = ring_get_sqe ();
+  prep_rw (sqe, IORING_OP_READ, b->sock, i, MIN (size, URING_BUFFER_SIZE), 0);
+  sqe->user_data = USER_DATA (OP_RECV, i);
+  if (timeout > 0)
+    {
+      sqe->flags |= IOSQE_IO_LINK;
+      b->ts.tv_sec = (long long) timeout;
+      b->ts.tv_nsec = (long long) ((timeout - b->ts.tv_sec) * 1e9);
+      sqe = ring_get_sqe ();
+      sqe->opcode = IORING_OP_LINK_TIMEOUT;
+      sqe->fd = -1;
+      sqe->addr = (uintptr_t) &b->ts;
+      sqe->len = 1;
+      sqe->user_data = USER_DATA (OP_TIMEOUT, 0);
+    }
+
+  b->received = false;
+  while (!b->received)
+    if (!ring_wait (b))
+      return -1;
+
+  res = b->recv_res;
+  if (res == -ECANCELED || res == -EINTR)
+    {
+      /* Canceled by the timeout. */
+      errno = ETIMEDOUT;
+      return -1;
+    }
+  if (res < 0)
+    {
+      errno = -res;
+      return -1;
+    }
+  *buf = ring.buffers + i * URING_BUFFER_SIZE;
+  return res;
+}
+
+/* Write the SIZE bytes just received.  The write is submitted with
+   the next receive, or by uring_body_finish.  */
+
+void
+uring_body_write (struct uring_body *b, int size)
+{
+  int i = b->next;
+  struct io_uring_sqe *sqe = ring_get_sqe ();
+
+  prep_rw (sqe, IORING_OP_WRITE, b->file, i, size, b->offset);
+  sqe->user_data = USER_DATA (OP_WRITE, i);
+  b->chunks[i].busy = true;
+  b->chunks[i].size = size;
+  b->chunks[i].offset = b->offset;
+  b->offset += size;
+  b->next = (i + 1) % URING_BUFFERS;
+}
+
+/* Wait for the writes of body B to complete and free B.  OUT is left
+   positioned at the end of the data written.  Return 0, or -1 with
+   errno set if writing failed.  */
+
+int
+uring_body_finish (struct uring_body *b)
+{
+  int ret = 0;
+
+  while (ring.to_submit || ring.inflight)
+    if (!ring_wait (b))
+      {
+        b->write_errno = errno;
+        ring_teardown ();
+        ring.unavailable = true;
+        break;
+      }
+  if (b->sock_flags >= 0 && (b->sock_flags & O_NONBLOCK))
+    fcntl (b->sock, F_SETFL, b->sock_flags);
+  if (fseeko (b->out, b->offset, SEEK_SET) < 0 && !b->write_errno)
+    b->write_errno = errno;
+  if (b->write_errno)
+    {
+      errno = b->write_errno;
+      ret = -1;
+    }
+  xfree (b);
+  return ret;
+}
+
+/* Drop the ring inherited from the parent in a child process: the two
+   cannot share it.  */
+
+void
+uring_after_fork (void)
+{
+  ring.inflight = 0;
+  ring_teardown ();
+}
+
+/* Free the ring.  */
+
+void
+uring_cleanup (void)
+{
+  if (ring.fd >= 0)
+    ring_teardown ();
+}
@@ -0,0 +1,57 @@
+/* Declarations for uring.c.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+#ifndef URING_H
+#define URING_H
+
+#ifdef ENABLE_IO_URING
+
+struct uring_body;
+
+struct uring_body *uring_body_new (int, FILE *);
+int uring_body_read (struct uring_body *, char **, int, double);
+void uring_body_write (struct uring_body *, int);
+int uring_body_finish (struct uring_body *);
+
+void uring_after_fork (void);
+void uring_cleanup (void);
+
+#else /* not ENABLE_IO_URING */
+
+struct uring_body;
+
+#define uring_body_new(a,b)         NULL
+#define uring_body_read(a,b,c,d)    (-1)
+#define uring_body_write(a,b)       ((void)0)
+#define uring_body_finish(a)        0
+#define uring_after_fork()
+#define uring_cleanup()
+
+#endif /* not ENABLE_IO_URING */
+#endif /* URING_H */
@@ -1218,7 +1218,9 @@ url_free (struct url *url)
 }
 
 /* Create all the necessary directories for PATH (a file).  Calls
-   make_directory internally.  */
+   make_directory internally.  Directories that are found or created
+   are remembered in the directory cache, so that saving further files
+   into them costs no system calls.  */
 int
 mkalldirs (const char *path)
 {
@@ -1236,11 +1238,18 @@ mkalldirs (const char *path)
     return 0;
   t = strdupdelim (path, p);
 
+  if (dir_cache_known_p (t))
+    {
+      xfree (t);
+      return 0;
+    }
+
   /* Check whether the directory exists.  */
   if ((stat (t, &st) == 0))
     {
       if (S_ISDIR (st.st_mode))
         {
+          dir_cache_add (t);
           xfree (t);
           return 0;
         }
@@ -1260,11 +1269,14 @@ mkalldirs (const char *path)
              anyway.  */
           DEBUGP (("Removing %s because of directory danger!\n", t));
           unlink (t);
+          dir_cache_forget (t);
         }
     }
   res = make_directory (t);
   if (res != 0)
     logprintf (LOG_NOTQUIET, "%s: %s", t, strerror (errno));
+  else
+    dir_cache_add (t);
   xfree (t);
   return res;
 }
@@ -551,6 +551,214 @@ touch (const char *file, time_t tm)
 #endif
 }
 
+/* Cache of directories known to exist, because Wget has either
+   created them or found them in place while saving a file into them.
+   mkalldirs() consults it before stat()ing the directory of each file
+   it saves, and make_directory() before checking each component of
+   the path it creates.
+
+   Where openat() is available, the cached directories are also held
+   open, and files in them are checked for and created relative to
+   the descriptor rather than by having the kernel resolve the whole
+   path again.  To bound the number of descriptors, at most
+   DIR_CACHE_SIZE directories are kept; the least recently used one is
+   closed and dropped when room is needed.
+
+   Paths removed by Wget itself are dropped through dir_cache_forget.
+   A directory that disappears behind Wget's back is dropped as soon
+   as creating a file in it fails.  */
+
+#if defined HAVE_OPENAT && defined HAVE_FACCESSAT && defined O_DIRECTORY
+# define ENABLE_DIR_FDS
+#endif
+
+#ifndef O_CLOEXEC
+# define O_CLOEXEC 0
+#endif
+
+#define DIR_CACHE_SIZE 64
+
+struct dir_cache_entry {
+  char *path;
+  int fd;                       /* open descriptor, or -1 */
+
+  /* List of the entries in the order of use, most recent first. */
+  struct dir_cache_entry *prev, *next;
+};
+
+static struct hash_table *dir_cache;
+static struct dir_cache_entry *dir_cache_head, *dir_cache_tail;
+
+static void
+dir_cache_unchain (struct dir_cache_entry *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    dir_cache_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    dir_cache_tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void
+dir_cache_push (struct dir_cache_entry *e)
+{
+  e->prev = NULL;
+  e->next = dir_cache_head;
+  if (dir_cache_head)
+    dir_cache_head->prev = e;
+  else
+    dir_cache_tail = e;
+  dir_cache_head = e;
+}
+
+static void
+dir_cache_remove (struct dir_cache_entry *e)
+{
+  DEBUGP (("Forgetting directory %s.\n", quote (e->path)));
+  hash_table_remove (dir_cache, e->path);
+  dir_cache_unchain (e);
+  if (e->fd >= 0)
+    close (e->fd);
+  xfree (e->path);
+  xfree (e);
+}
+
+/* Return the cache entry for DIR, marking it as the most recently
+   used one, or NULL if DIR is not known to exist.  */
+
+static struct dir_cache_entry *
+dir_cache_lookup (const char *dir)
+{
+  struct dir_cache_entry *e;
+
+  if (!dir_cache)
+    return NULL;
+  e = hash_table_get (dir_cache, dir);
+  if (e && e != dir_cache_head)
+    {
+      dir_cache_unchain (e);
+      dir_cache_push (e);
+    }
+  return e;
+}
+
+/* Is DIR known to be an existing directory?  */
+
+bool
+dir_cache_known_p (const char *dir)
+{
+  return dir_cache_lookup (dir) != NULL;
+}
+
+/* Remember that DIR exists and is a directory.  */
+
+void
+dir_cache_add (const char *dir)
+{
+  struct dir_cache_entry *e;
+
+  if (dir_cache_lookup (dir))
+    return;
+  if (!dir_cache)
+    dir_cache = make_string_hash_table (DIR_CACHE_SIZE);
+  else if (hash_table_count (dir_cache) >= DIR_CACHE_SIZE)
+    dir_cache_remove (dir_cache_tail);
+
+  e = xnew0 (struct dir_cache_entry);
+  e->path = xstrdup (dir);
+#ifdef ENABLE_DIR_FDS
+  e->fd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#else
+  e->fd = -1;
+#endif
+  hash_table_put (dir_cache, e->path, e);
+  dir_cache_push (e);
+}
+
+/* Forget PATH and every directory below it.  To be called whenever
+   Wget removes or replaces something that might have been cached,
+   such as a symbolic link pointing to a directory.  */
+
+void
+dir_cache_forget (const char *path)
+{
+  size_t len = strlen (path);
+  struct dir_cache_entry *e, *next;
+
+  for (e = dir_cache_head; e; e = next)
+    {
+      next = e->next;
+      if (!strncmp (e->path, path, len)
+          && (e->path[len] == '\0' || e->path[len] == '/'))
+        dir_cache_remove (e);
+    }
+}
+
+void
+dir_cache_cleanup (void)
+{
+  while (dir_cache_head)
+    dir_cache_remove (dir_cache_head);
+  if (dir_cache)
+    {
+      hash_table_destroy (dir_cache);
+      dir_cache = NULL;
+    }
+}
+
+#ifdef ENABLE_DIR_FDS
+/* If the directory part of FILE is cached with an open descriptor,
+   return its entry and point *BASE to the last component of FILE.
+   Otherwise return NULL.  */
+
+static struct dir_cache_entry *
+dir_cache_at (const char *file, const char **base)
+{
+  const char *slash;
+  struct dir_cache_entry *e;
+  char *dir;
+
+  if (!dir_cache)
+    return NULL;
+  slash = strrchr (file, '/');
+  if (!slash || slash == file || !slash[1])
+    return NULL;
+  BOUNDED_TO_ALLOCA (file, slash, dir);
+  e = dir_cache_lookup (dir);
+  if (!e || e->fd < 0)
+    return NULL;
+  *base = slash + 1;
+  return e;
+}
+#endif /* ENABLE_DIR_FDS */
+
+/* Like open (FNAME, FLAGS, 0666), except that a cached descriptor of
+   the directory FNAME is in is used if there is one.  */
+
+static int
+open_in_dir (const char *fname, int flags)
+{
+#ifdef ENABLE_DIR_FDS
+  const char *base;
+  struct dir_cache_entry *e = dir_cache_at (fname, &base);
+  if (e)
+    {
+      int fd = openat (e->fd, base, flags, 0666);
+      if (fd >= 0 || errno != ENOENT)
+        return fd;
+      /* The directory has been removed behind our back; the file
+         cannot be created relative to it.  Fall back to the path,
+         which may name a new directory by now.  */
+      dir_cache_remove (e);
+    }
+#endif
+  return open (fname, flags, 0666);
+}
+
 /* Checks if FILE is a symbolic link, and removes it if it is.  Does
    nothing under MS-Windows.  */
 int
@@ -566,6 +774,8 @@ remove_link (const char *file)
       if (err != 0)
         logprintf (LOG_VERBOSE, _("Failed to unlink symlink %s: %s\n"),
                    quote (file), strerror (errno));
+      else
+        dir_cache_forget (file);
     }
   return err;
 }
@@ -580,6 +790,12 @@ remove_link (const char *file)
 bool
 file_exists_p (const char *filename)
 {
+#ifdef ENABLE_DIR_FDS
+  const char *base;
+  struct dir_cache_entry *e = dir_cache_at (filename, &base);
+  if (e)
+    return faccessat (e->fd, base, F_OK, 0) >= 0;
+#endif
 #ifdef HAVE_ACCESS
   return access (filename, F_OK) >= 0;
 #else
@@ -601,6 +817,103 @@ file_non_directory_p (const char *path)
   return S_ISDIR (buf.st_mode) ? false : true;
 }
 
+/* Reserve disk space for LEN more bytes to be written to the end of
+   FP, so that large files are not extended (and fragmented) a few
+   kilobytes at a time.  Return true if space was reserved, in which
+   case file_trim should be called once the writing is done.
+
+   Where fallocate() can reserve the space without changing the size
+   of the file, that is preferred, as an interrupted download then
+   leaves a file of the right size behind for --continue.  Otherwise
+   posix_fallocate() extends the file to its final size, which is only
+   done for files not opened for appending.  */
+
+bool
+file_preallocate (FILE *fp, wgint len)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+  int fd = fileno (fp);
+  int flags, err;
+  struct_stat st;
+
+  if (len <= 0 || fflush (fp) != 0 || fstat (fd, &st) != 0
+      || !S_ISREG (st.st_mode))
+    return false;
+# if defined HAVE_FALLOCATE && defined FALLOC_FL_KEEP_SIZE
+  if (fallocate (fd, FALLOC_FL_KEEP_SIZE, st.st_size, len) == 0)
+    return true;
+# endif
+  /* Writes to a file opened with O_APPEND would go past the space
+     posix_fallocate reserves.  */
+  flags = fcntl (fd, F_GETFL);
+  if (flags == -1 || (flags & O_APPEND))
+    return false;
+  err = posix_fallocate (fd, st.st_size, len);
+  if (err != 0)
+    {
+      DEBUGP (("Cannot preallocate %s bytes: %s\n",
+               number_to_static_string (len), strerror (err)));
+      return false;
+    }
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* Cut FP, for which file_preallocate has reserved space, back to the
+   data actually written to it.  This releases the space that a short
+   or failed download did not use.  */
+
+void
+file_trim (FILE *fp)
+{
+  int fd = fileno (fp);
+  int flags;
+  struct_stat st;
+  wgint size;
+
+  if (fflush (fp) != 0 || fstat (fd, &st) != 0)
+    return;
+  /* The position of an append stream is not meaningful before it is
+     first written to; its data always ends at the end of the file.  */
+  flags = fcntl (fd, F_GETFL);
+  if (flags != -1 && (flags & O_APPEND))
+    size = st.st_size;
+  else
+#ifdef HAVE_FTELLO
+    size = ftello (fp);
+#else
+    size = ftell (fp);
+#endif
+  if (size >= 0 && ftruncate (fd, size) != 0)
+    DEBUGP (("Cannot truncate file to %s bytes: %s\n",
+             number_to_static_string (size), strerror (errno)));
+}
+
+/* Tell the kernel that FP will be written sequentially and its pages
+   will not be needed again soon.  */
+
+void
+file_advise_sequential (FILE *fp)
+{
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_SEQUENTIAL
+  posix_fadvise (fileno (fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+/* Drop what has been written to FP from the page cache.  Pages that
+   are still dirty are not dropped, but their write-back is started,
+   so that a later call drops them.  */
+
+void
+file_drop_cache (FILE *fp)
+{
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_DONTNEED
+  posix_fadvise (fileno (fp), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
 /* Return the size of file named by FILENAME, or -1 if it cannot be
    opened or seeked into. */
 wgint
@@ -799,7 +1112,7 @@ fopen_excl (const char *fname, int binary)
   if (binary)
     flags |= O_BINARY;
 # endif
-  fd = open (fname, flags, 0666);
+  fd = open_in_dir (fname, flags);
 # endif /* def __VMS [else] */
 
   if (fd < 0)
@@ -818,6 +1131,95 @@ fopen_excl (const char *fname, int binary)
 #endif /* not O_EXCL */
 }
 
+/* If FNAME is one of several hard links to a file, as --dedup=hardlink
+   makes them, give it a file of its own, so that writing to it does
+   not change the other names.  If it is to be truncated, unlinking it
+   is enough; if it is to be appended to, it is replaced by a copy.
+   Returns false if the copy could not be made.  */
+
+static bool
+unshare_file (const char *fname, bool copy)
+{
+  struct_stat st;
+  char buf[8192];
+  char *tmp;
+  FILE *in, *out;
+  size_t n;
+  bool ok;
+
+  if (lstat (fname, &st) != 0 || !S_ISREG (st.st_mode) || st.st_nlink < 2)
+    return true;
+  if (!copy)
+    {
+      unlink (fname);
+      return true;
+    }
+
+  tmp = aprintf ("%s.%ld.unshare", fname, (long) getpid ());
+  in = fopen (fname, "rb");
+  out = in ? fopen (tmp, "wb") : NULL;
+  ok = out != NULL;
+  while (ok && (n = fread (buf, 1, sizeof (buf), in)) > 0)
+    ok = fwrite (buf, 1, n, out) == n;
+  if (in)
+    {
+      if (ferror (in))
+        ok = false;
+      fclose (in);
+    }
+  if (out && fclose (out) == EOF)
+    ok = false;
+  if (ok)
+    {
+      chmod (tmp, st.st_mode & 0777);
+      touch (tmp, st.st_mtime);
+      ok = rename (tmp, fname) == 0;
+    }
+  if (!ok)
+    {
+      int save_errno = errno;
+      if (out)
+        unlink (tmp);
+      errno = save_errno;
+    }
+  xfree (tmp);
+  return ok;
+}
+
+/* Open FNAME for writing in binary mode, truncating it, or appending
+   to it if APPEND is set.  This is equivalent to fopen's "wb" and
+   "ab", except that the file is opened relative to its directory if
+   that is held in the directory cache.  */
+
+FILE *
+fopen_output (const char *fname, bool append)
+{
+#ifdef ENABLE_DIR_FDS
+  int fd;
+  FILE *fp;
+#endif
+
+  if (opt.dedup == dedup_hardlink && !unshare_file (fname, append))
+    return NULL;
+
+#ifdef ENABLE_DIR_FDS
+  fd = open_in_dir (fname, O_WRONLY | O_CREAT
+                    | (append ? O_APPEND : O_TRUNC));
+  if (fd < 0)
+    return NULL;
+  fp = fdopen (fd, append ? "ab" : "wb");
+  if (!fp)
+    {
+      int save_errno = errno;
+      close (fd);
+      errno = save_errno;
+    }
+  return fp;
+#else
+  return fopen (fname, append ? "ab" : "wb");
+#endif
+}
+
 /* Create DIRECTORY.  If some of the pathname components of DIRECTORY
    are missing, create them first.  In case any mkdir() call fails,
    return its error status.  Returns 0 on successful completion.
@@ -846,7 +1248,7 @@ make_directory (const char *directory)
       /* Check whether the directory already exists.  Allow creation of
          of intermediate directories to fail, as the initial path components
          are not necessarily directories!  */
-      if (!file_exists_p (dir))
+      if (!dir_cache_known_p (dir) && !file_exists_p (dir))
         ret = mkdir (dir, 0777);
       else
         ret = 0;
@@ -1275,6 +1677,86 @@ wget_read_file_free (struct file_memory *fm)
   xfree (fm);
 }
 
+/* Return true if FM holds a well-formed binary snapshot whose header
+   carries MAGIC (8 bytes) and whose records are RECORD_SIZE bytes
+   long.  Snapshots are only valid on the architecture that wrote
+   them; anything else is rejected rather than byte-swapped.  */
+bool
+snapshot_valid_p (const struct file_memory *fm, const char *magic,
+                  size_t record_size)
+{
+  const struct snapshot_header *hdr;
+  const char *strings;
+  size_t avail;
+
+  if (!fm || fm->length < (long) sizeof (struct snapshot_header))
+    return false;
+  hdr = (const struct snapshot_header *) fm->content;
+  if (memcmp (hdr->magic, magic, sizeof (hdr->magic)) != 0
+      || hdr->byte_order != SNAPSHOT_BYTE_ORDER)
+    return false;
+
+  avail = fm->length - sizeof (struct snapshot_header);
+  if (avail / record_size < hdr->count)
+    return false;
+  avail -= hdr->count * record_size;
+  if (avail != hdr->strings_size)
+    return false;
+
+  /* Every string must be terminated within the table, so it is enough
+     for the table itself to end in a NUL.  */
+  strings = SNAPSHOT_STRINGS (fm, record_size);
+  return hdr->strings_size == 0 || strings[hdr->strings_size - 1] == '\0';
+}
+
+/* Return true if FILE starts with the 8-byte snapshot MAGIC.  */
+bool
+file_is_snapshot_p (const char *file, const char *magic)
+{
+  char buf[8];
+  bool result = false;
+  FILE *fp = fopen (file, "rb");
+
+  if (fp)
+    {
+      result = (fread (buf, 1, sizeof (buf), fp) == sizeof (buf)
+                && memcmp (buf, magic, sizeof (buf)) == 0);
+      fclose (fp);
+    }
+  return result;
+}
+
+/* Replace the contents of FILE with the LENGTH bytes at DATA.  The data
+   is written to a temporary file next to FILE, which is then renamed
+   over it, so other processes that have the old FILE mapped through
+   wget_read_file keep a consistent view of it.  */
+bool
+wget_replace_file (const char *file, const char *data, size_t length)
+{
+  char *tmp = aprintf ("%s.%ld.tmp", file, (long) getpid ());
+  FILE *fp = fopen (tmp, "wb");
+  bool result = false;
+
+  if (fp)
+    {
+      result = fwrite (data, 1, length, fp) == length;
+      if (fclose (fp) != 0)
+        result = false;
+#ifdef WINDOWS
+      /* rename() does not replace existing files on Windows.  */
+      if (result)
+        unlink (file);
+#endif
+      if (result && rename (tmp, file) != 0)
+        result = false;
+      if (!result)
+        unlink (tmp);
+    }
+
+  xfree (tmp);
+  return result;
+}
+
 /* Free the pointers in a NULL-terminated vector of pointers, then
    free the pointer itself.  */
 void
@@ -2585,4 +3067,44 @@ test_dir_matches_p(void)
   return NULL;
 }
 
+const char *
+test_dir_cache (void)
+{
+  char name[32];
+  int i;
+
+  dir_cache_add ("wget-dc");
+  dir_cache_add ("wget-dc/sub");
+  dir_cache_add ("wget-dcx");
+  mu_assert ("test_dir_cache: directory not cached",
+             dir_cache_known_p ("wget-dc/sub"));
+
+  /* Forgetting a directory forgets what is below it, and only that.  */
+  dir_cache_forget ("wget-dc");
+  mu_assert ("test_dir_cache: forgotten directory still cached",
+             !dir_cache_known_p ("wget-dc"));
+  mu_assert ("test_dir_cache: subdirectory still cached",
+             !dir_cache_known_p ("wget-dc/sub"));
+  mu_assert ("test_dir_cache: sibling forgotten",
+             dir_cache_known_p ("wget-dcx"));
+
+  /* Filling the cache drops the least recently used entry.  */
+  for (i = 0; i < DIR_CACHE_SIZE - 1; i++)
+    {
+      sprintf (name, "wget-dc%d", i);
+      dir_cache_add (name);
+    }
+  dir_cache_known_p ("wget-dcx");
+  dir_cache_add ("wget-dc-last");
+  mu_assert ("test_dir_cache: recently used entry dropped",
+             dir_cache_known_p ("wget-dcx"));
+  mu_assert ("test_dir_cache: least recently used entry kept",
+             !dir_cache_known_p ("wget-dc0"));
+  mu_assert ("test_dir_cache: new entry not cached",
+             dir_cache_known_p ("wget-dc-last"));
+
+  dir_cache_cleanup ();
+  return NULL;
+}
+
 #endif /* TESTING */
@@ -59,6 +59,25 @@ struct file_memory {
   int mmap_p;
 };
 
+/* Header of the binary snapshots written with --binary-snapshots.  It
+   is followed by COUNT fixed-size records and a string table of
+   STRINGS_SIZE bytes which the records refer to by offset.  */
+struct snapshot_header {
+  char magic[8];
+  uint32_t byte_order;          /* SNAPSHOT_BYTE_ORDER, as written */
+  uint32_t count;
+  uint32_t strings_size;
+  uint32_t reserved;
+};
+
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+#define SNAPSHOT_RECORDS(fm) \
+  ((const void *) ((fm)->content + sizeof (struct snapshot_header)))
+#define SNAPSHOT_STRINGS(fm, record_size) \
+  ((const char *) SNAPSHOT_RECORDS (fm) \
+   + ((const struct snapshot_header *) (fm)->content)->count * (record_size))
+
 #define HYPHENP(x) (*(x) == '-' && !*((x) + 1))
 
 char *time_str (time_t);
@@ -79,10 +98,19 @@ int remove_link (const char *);
 bool file_exists_p (const char *);
 bool file_non_directory_p (const char *);
 wgint file_size (const char *);
+bool file_preallocate (FILE *, wgint);
+void file_trim (FILE *);
+void file_advise_sequential (FILE *);
+void file_drop_cache (FILE *);
 int make_directory (const char *);
+bool dir_cache_known_p (const char *);
+void dir_cache_add (const char *);
+void dir_cache_forget (const char *);
+void dir_cache_cleanup (void);
 char *unique_name (const char *, bool);
 FILE *unique_create (const char *, bool, char **);
 FILE *fopen_excl (const char *, int);
+FILE *fopen_output (const char *, bool);
 char *file_merge (const char *, const char *);
 
 int fnmatch_nocase (const char *, const char *, int);
@@ -97,6 +125,9 @@ bool has_html_suffix_p (const char *);
 
 struct file_memory *wget_read_file (const char *);
 void wget_read_file_free (struct file_memory *);
+bool snapshot_valid_p (const struct file_memory *, const char *, size_t);
+bool file_is_snapshot_p (const char *, const char *);
+bool wget_replace_file (const char *, const char *, size_t);
 
 void free_vec (char **);
 char **merge_vecs (char **, char **);
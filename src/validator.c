@@ -0,0 +1,642 @@
+/* Validators of downloaded files, kept between runs.
+   Copyright (C) 2015 Free Software Foundation, Inc.
+
+This file is part of GNU Wget.
+
+GNU Wget is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+GNU Wget is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wget.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permission under GNU GPL version 3 section 7
+
+If you modify this program, or any covered work, by linking or
+combining it with the OpenSSL project's OpenSSL library (or a
+modified version of that library), containing parts covered by the
+terms of the OpenSSL or SSLeay licenses, the Free Software Foundation
+grants you additional permission to convey the resulting work.
+Corresponding Source for a non-source form of such a combination
+shall include the source code for the parts of OpenSSL used as well
+as that of the covered work.  */
+
+/* With --validator-file, Wget keeps a list of the files it has
+   downloaded over HTTP: for every URL, the name, size and modification
+   time of the local copy, and the ETag and Last-Modified headers it was
+   served with.  When a mirror is refreshed with -N or -nc, whether the
+   local copy exists and how old it is are answered from this list,
+   rather than by looking at the file system for every URL.  Requests
+   for files the list knows are made conditional on the saved
+   validators: a server whose Last-Modified header is unreliable can
+   still answer 304 Not Modified thanks to If-None-Match, and the
+   If-Modified-Since date is the one the server sent.
+
+   The file holds a line for every URL, with the URL, the local file
+   name, the size, the modification time, the ETag and the
+   Last-Modified header separated by tabs.  Missing validators are left
+   empty.  The lines are sorted by URL, so that loading the file only
+   maps it: entries are looked up by a binary search of the mapped
+   text, and only the ones looked up or changed are parsed into
+   VALIDATORS.  Saving merges the changed entries back into the mapped
+   lines.
+
+   Whoever changes the files behind Wget's back makes the list lie.
+   --verify-validator-file compares every entry with the file it
+   describes when the list is loaded, and corrects it.  */
+
+#include "wget.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "hash.h"
+#include "validator.h"
+
+#ifdef TESTING
+#include "test.h"
+#include "init.h"                /* for home_dir */
+#endif
+
+#define VALIDATOR_FIELDS 6
+
+/* The entries looked up or changed in this run, indexed by URL.
+   Removed entries are kept with a NULL local_file, so that saving
+   drops their lines.  */
+static struct hash_table *validators;
+
+/* The validator file as it was loaded, and the entry lines in it. */
+static struct file_memory *validator_map;
+static const char *map_begin, *map_end;
+
+/* Whether VALIDATORS has changes that the file does not have. */
+static bool validators_changed;
+
+static void
+validator_free (struct validator *e)
+{
+  xfree (e->local_file);
+  xfree (e->etag);
+  xfree (e->last_modified);
+  xfree (e);
+}
+
+/* Whether S can be stored as a field of the validator file.  */
+
+static bool
+field_ok_p (const char *s)
+{
+  return !s || !s[strcspn (s, "\t\r\n")];
+}
+
+static char *
+field_dup (const char *s)
+{
+  return s && *s ? xstrdup (s) : NULL;
+}
+
+static void
+validator_store (const char *url, struct validator *e)
+{
+  struct validator *old;
+  char *old_url;
+
+  if (hash_table_get_pair (validators, url, &old_url, &old))
+    {
+      validator_free (old);
+      hash_table_put (validators, old_url, e);
+    }
+  else
+    hash_table_put (validators, xstrdup (url), e);
+}
+
+/* Compare URL with the URL of the validator file line at LINE, which is LEN
+   characters long, the way strcmp would.  */
+
+static int
+url_cmp (const char *url, const char *line, size_t len)
+{
+  int cmp = strncmp (url, line, len);
+  if (cmp)
+    return cmp;
+  return url[len] ? 1 : 0;
+}
+
+static const char *
+line_end (const char *p)
+{
+  const char *eol = memchr (p, '\n', map_end - p);
+  return eol ? eol : map_end;
+}
+
+static size_t
+line_url_length (const char *p, const char *eol)
+{
+  const char *tab = memchr (p, '\t', eol - p);
+  return (tab ? tab : eol) - p;
+}
+
+/* Parse the validator file line from P to EOL into a new entry, storing the
+   URL to *URL if it is not NULL.  Return NULL if the line is
+   malformed.  */
+
+static struct validator *
+parse_line (const char *p, const char *eol, char **url)
+{
+  char *line = strdupdelim (p, eol);
+  char *field[VALIDATOR_FIELDS], *tail;
+  struct validator *e = NULL;
+  wgint size;
+  long mtime;
+  int i;
+
+  field[0] = line;
+  for (i = 1; i < VALIDATOR_FIELDS; i++)
+    {
+      field[i] = strchr (field[i - 1], '\t');
+      if (!field[i])
+        goto out;
+      *field[i]++ = '\0';
+    }
+  if (!*field[0] || !*field[1])
+    goto out;
+  size = str_to_wgint (field[2], &tail, 10);
+  if (tail == field[2] || *tail || size < 0)
+    goto out;
+  mtime = strtol (field[3], &tail, 10);
+  if (tail == field[3] || *tail)
+    goto out;
+
+  e = xnew (struct validator);
+  e->local_file = xstrdup (field[1]);
+  e->size = size;
+  e->mtime = mtime;
+  e->etag = field_dup (field[4]);
+  e->last_modified = field_dup (field[5]);
+  if (url)
+    *url = xstrdup (field[0]);
+
+ out:
+  xfree (line);
+  return e;
+}
+
+/* Return the line of the mapped validator file for URL, or NULL.  */
+
+static const char *
+map_find (const char *url)
+{
+  const char *lo = map_begin, *hi = map_end;
+
+  /* LO and HI are always at the beginning of a line.  */
+  while (lo < hi)
+    {
+      const char *mid = lo + (hi - lo) / 2;
+      const char *eol;
+      int cmp;
+
+      while (mid > lo && mid[-1] != '\n')
+        --mid;
+      eol = line_end (mid);
+      cmp = url_cmp (url, mid, line_url_length (mid, eol));
+      if (cmp == 0)
+        return mid;
+      if (cmp < 0)
+        hi = mid;
+      else
+        lo = eol < map_end ? eol + 1 : map_end;
+    }
+  return NULL;
+}
+
+/* Compare every entry of the mapped validator file with its file, and
+   correct the ones that do not match: files that have disappeared are
+   removed from the list, and the sizes and times of files that
+   have changed are updated.  Their validators are dropped, as they
+   describe what was downloaded rather than what is there now.  */
+
+static void
+validator_verify (void)
+{
+  const char *p, *eol;
+  int count = 0, missing = 0, changed = 0;
+
+  for (p = map_begin; p < map_end; p = eol < map_end ? eol + 1 : map_end)
+    {
+      struct validator *e;
+      char *url;
+      struct_stat st;
+
+      eol = line_end (p);
+      e = parse_line (p, eol, &url);
+      if (!e)
+        continue;
+      ++count;
+
+      if (stat (e->local_file, &st) != 0 || !S_ISREG (st.st_mode))
+        {
+          DEBUGP (("Validator file: %s is missing.\n", e->local_file));
+          xfree (e->local_file);
+          validator_store (url, e);
+          ++missing;
+        }
+      else if (st.st_size != e->size || st.st_mtime != e->mtime)
+        {
+          DEBUGP (("Validator file: %s has changed.\n", e->local_file));
+          e->size = st.st_size;
+          e->mtime = st.st_mtime;
+          xfree (e->etag);
+          xfree (e->last_modified);
+          validator_store (url, e);
+          ++changed;
+        }
+      else
+        validator_free (e);
+      xfree (url);
+    }
+
+  if (missing || changed)
+    validators_changed = true;
+  logprintf (LOG_VERBOSE,
+             _("Verified %d validator entries: %d missing, %d changed.\n"),
+             count, missing, changed);
+}
+
+/* Map opt.validator_file.  A missing file is not an error.  */
+
+static void
+validator_load (void)
+{
+  struct file_memory *fm;
+  const char *p, *end;
+
+  if (!file_exists_p (opt.validator_file))
+    return;
+  fm = wget_read_file (opt.validator_file);
+  if (!fm)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 opt.validator_file, strerror (errno));
+      return;
+    }
+
+  p = fm->content;
+  end = p + fm->length;
+  while (p < end && *p == '#')
+    {
+      const char *eol = memchr (p, '\n', end - p);
+      p = eol ? eol + 1 : end;
+    }
+  validator_map = fm;
+  map_begin = p;
+  map_end = end;
+  /* Ignore the newline ending the last line.  */
+  if (map_end > map_begin && map_end[-1] == '\n')
+    --map_end;
+
+  if (opt.verify_validator_file)
+    validator_verify ();
+}
+
+static void
+validator_init (void)
+{
+  if (validators)
+    return;
+  validators = make_string_hash_table (0);
+  validator_load ();
+}
+
+/* Return the entry for URL, parsing it from the mapped validator file if it
+   has not been looked up before.  */
+
+static struct validator *
+validator_lookup (const char *url)
+{
+  struct validator *e;
+  const char *line;
+
+  validator_init ();
+  e = hash_table_get (validators, url);
+  if (e || !validator_map)
+    return e;
+
+  line = map_find (url);
+  if (!line)
+    return NULL;
+  e = parse_line (line, line_end (line), NULL);
+  if (!e)
+    {
+      logprintf (LOG_NOTQUIET, _("%s: ignoring malformed validator entry.\n"),
+                 opt.validator_file);
+      return NULL;
+    }
+  hash_table_put (validators, xstrdup (url), e);
+  return e;
+}
+
+/* Return the entry for URL, or NULL if there is none or
+   --validator-file is not in use.  */
+
+const struct validator *
+validator_get (const char *url)
+{
+  struct validator *e;
+
+  if (!opt.validator_file)
+    return NULL;
+  e = validator_lookup (url);
+  return e && e->local_file ? e : NULL;
+}
+
+/* Remember that URL was downloaded to LOCAL_FILE, which is SIZE bytes
+   long and was last modified at MTIME, with the ETAG and
+   LAST_MODIFIED headers, either of which may be NULL.  */
+
+void
+validator_put (const char *url, const char *local_file, wgint size,
+               time_t mtime, const char *etag, const char *last_modified)
+{
+  struct validator *e;
+
+  if (!opt.validator_file)
+    return;
+  validator_init ();
+  validators_changed = true;
+
+  e = xnew0 (struct validator);
+  if (field_ok_p (url) && field_ok_p (local_file))
+    {
+      e->local_file = xstrdup (local_file);
+      e->size = size;
+      e->mtime = mtime;
+      e->etag = field_ok_p (etag) ? field_dup (etag) : NULL;
+      e->last_modified = (field_ok_p (last_modified)
+                          ? field_dup (last_modified) : NULL);
+    }
+  /* Otherwise leave it removed, as it cannot be saved.  */
+  validator_store (url, e);
+}
+
+/* Update the validators of URL with the ETAG and LAST_MODIFIED headers
+   of a 304 Not Modified response.  A NULL header leaves the saved one
+   as it is.  */
+
+void
+validator_refresh (const char *url, const char *etag,
+                   const char *last_modified)
+{
+  struct validator *e;
+
+  if (!opt.validator_file)
+    return;
+  e = validator_lookup (url);
+  if (!e || !e->local_file)
+    return;
+
+  if (etag && field_ok_p (etag)
+      && (!e->etag || strcmp (etag, e->etag) != 0))
+    {
+      xfree (e->etag);
+      e->etag = field_dup (etag);
+      validators_changed = true;
+    }
+  if (last_modified && field_ok_p (last_modified)
+      && (!e->last_modified || strcmp (last_modified, e->last_modified) != 0))
+    {
+      xfree (e->last_modified);
+      e->last_modified = field_dup (last_modified);
+      validators_changed = true;
+    }
+}
+
+static void
+write_entry (FILE *fp, const char *url, const struct validator *e)
+{
+  fprintf (fp, "%s\t%s\t%s\t%ld\t%s\t%s\n", url, e->local_file,
+           number_to_static_string (e->size), (long) e->mtime,
+           e->etag ? e->etag : "", e->last_modified ? e->last_modified : "");
+}
+
+static int
+cmp_urls (const void *a, const void *b)
+{
+  return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/* Write the validators to opt.validator_file, if it has changed.  The
+   entries in VALIDATORS are sorted and merged with the lines of the
+   mapped file.  The new file is written next to the old one
+   and renamed over it, so that an interrupted run does not lose the
+   validators of the previous ones.  */
+
+void
+validator_save (void)
+{
+  hash_table_iterator iter;
+  char **urls, *tmp;
+  const char *p;
+  int count, i;
+  FILE *fp;
+  bool ok;
+
+  if (!validators || !validators_changed)
+    return;
+
+  tmp = aprintf ("%s.%ld.tmp", opt.validator_file, (long) getpid ());
+  fp = fopen (tmp, "w");
+  if (!fp)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot open %s: %s\n"),
+                 tmp, strerror (errno));
+      xfree (tmp);
+      return;
+    }
+
+  count = hash_table_count (validators);
+  urls = xnew_array (char *, count);
+  i = 0;
+  for (hash_table_iterate (validators, &iter); hash_table_iter_next (&iter); )
+    urls[i++] = iter.key;
+  qsort (urls, count, sizeof (*urls), cmp_urls);
+
+  fputs ("# Wget validator file.  Edit at your own risk.\n", fp);
+  p = map_begin;
+  i = 0;
+  while (p < map_end || i < count)
+    {
+      const char *eol = p < map_end ? line_end (p) : NULL;
+      int cmp;
+
+      if (!eol)
+        cmp = 1;
+      else if (i == count)
+        cmp = -1;
+      else
+        cmp = -url_cmp (urls[i], p, line_url_length (p, eol));
+
+      if (cmp < 0)
+        {
+          /* An entry this run did not change.  */
+          fwrite (p, 1, eol - p, fp);
+          fputc ('\n', fp);
+        }
+      else
+        {
+          struct validator *e = hash_table_get (validators, urls[i]);
+          if (e->local_file)
+            write_entry (fp, urls[i], e);
+          ++i;
+        }
+      if (cmp <= 0)
+        p = eol < map_end ? eol + 1 : map_end;
+    }
+  xfree (urls);
+
+  ok = !ferror (fp);
+  if (fclose (fp) == EOF)
+    ok = false;
+#ifdef WINDOWS
+  /* rename() does not replace existing files on Windows, nor files
+     that are mapped.  */
+  if (ok && validator_map)
+    {
+      wget_read_file_free (validator_map);
+      validator_map = NULL;
+      map_begin = map_end = NULL;
+    }
+  if (ok)
+    unlink (opt.validator_file);
+#endif
+  if (ok && rename (tmp, opt.validator_file) != 0)
+    ok = false;
+  if (!ok)
+    {
+      logprintf (LOG_NOTQUIET, _("Cannot write to %s: %s\n"),
+                 opt.validator_file, strerror (errno));
+      unlink (tmp);
+    }
+  else
+    validators_changed = false;
+  xfree (tmp);
+}
+
+#ifdef TESTING
+
+static void
+validator_forget (void)
+{
+  hash_table_iterator iter;
+
+  for (hash_table_iterate (validators, &iter); hash_table_iter_next (&iter); )
+    {
+      xfree (iter.key);
+      validator_free (iter.value);
+    }
+  hash_table_destroy (validators);
+  validators = NULL;
+  if (validator_map)
+    wget_read_file_free (validator_map);
+  validator_map = NULL;
+  map_begin = map_end = NULL;
+  validators_changed = false;
+}
+
+const char *
+test_validator_file (void)
+{
+  static const char *urls[] = {
+    "http://a/", "http://a/b", "http://a/b/c", "http://a/c", "http://b/"
+  };
+  const struct validator *e;
+  char *file = aprintf ("%s/.wget-validator-test", home_dir ());
+  char *local = aprintf ("%s/.wget-validator-test-file", home_dir ());
+  char *saved = opt.validator_file;
+  bool verify = opt.verify_validator_file;
+  struct_stat st;
+  FILE *fp;
+  int i;
+
+  opt.validator_file = file;
+  opt.verify_validator_file = false;
+  unlink (file);
+
+  /* Put the URLs out of order, to be sorted by validator_save.  */
+  for (i = countof (urls) - 1; i >= 0; i--)
+    validator_put (urls[i], urls[i] + 7, i, 1000 + i, i % 2 ? "\"e\"" : NULL,
+                   "Sat, 01 Jan 2000 00:00:00 GMT");
+  validator_put ("http://a/t", "a/\tt", 0, 0, NULL, NULL);
+  validator_save ();
+  validator_forget ();
+
+  for (i = 0; i < countof (urls); i++)
+    {
+      e = validator_get (urls[i]);
+      mu_assert ("A saved URL should have been found", e != NULL);
+      mu_assert ("Wrong local file", !strcmp (e->local_file, urls[i] + 7));
+      mu_assert ("Wrong size or time", e->size == i && e->mtime == 1000 + i);
+      mu_assert ("Wrong ETag", i % 2 ? e->etag && !strcmp (e->etag, "\"e\"")
+                                     : !e->etag);
+    }
+  mu_assert ("A URL never saved should not have been found",
+             validator_get ("http://a/bb") == NULL);
+  mu_assert ("A file name with a tab should not have been saved",
+             validator_get ("http://a/t") == NULL);
+  validator_forget ();
+
+  /* Change one entry without looking the others up, and merge.  */
+  validator_refresh ("http://a/c", "\"f\"", NULL);
+  validator_put ("http://a/a", "a/a", 5, 5, NULL, NULL);
+  validator_save ();
+  validator_forget ();
+  e = validator_get ("http://a/c");
+  mu_assert ("The ETag of a 304 response should have been saved",
+             e && e->etag && !strcmp (e->etag, "\"f\"") && e->size == 3);
+  mu_assert ("The new entry should have been merged",
+             validator_get ("http://a/a") != NULL);
+  for (i = 0; i < countof (urls); i++)
+    mu_assert ("The other entries should have been kept",
+               validator_get (urls[i]) != NULL);
+  validator_forget ();
+
+  /* Verify an entry of a file that changed and one that is missing.  */
+  fp = fopen (local, "w");
+  mu_assert ("Could not create the validator test file", fp != NULL);
+  fputs ("data", fp);
+  fclose (fp);
+  stat (local, &st);
+  unlink (file);
+  validator_put ("http://c/1", local, 3, st.st_mtime, "\"1\"", NULL);
+  validator_put ("http://c/2", "/nonexistent/file", 3, 0, NULL, NULL);
+  validator_save ();
+  validator_forget ();
+  opt.verify_validator_file = true;
+  e = validator_get ("http://c/1");
+  mu_assert ("The size of a changed file should have been corrected",
+             e && e->size == 4 && e->mtime == st.st_mtime && !e->etag);
+  mu_assert ("A missing file should have been removed",
+             validator_get ("http://c/2") == NULL);
+  validator_forget ();
+
+  unlink (file);
+  unlink (local);
+  xfree (file);
+  xfree (local);
+  opt.validator_file = saved;
+  opt.verify_validator_file = verify;
+
+  return NULL;
+}
+
+#endif /* TESTING */
@@ -53,6 +53,7 @@ as that of the covered work.  */
 
 #include "warc.h"
 #include "exits.h"
+#include "stats.h"
 
 #ifdef WINDOWS
 /* we need this on Windows to have O_TEMPORARY defined */
@@ -1602,3 +1603,24 @@ warc_write_metadata_record (const char *record_uuid, const char *url,
       record_uuid, url, timestamp_str, concurrent_to_uuid,
       ip, content_type, body, payload_offset);
 }
+
+/* Writes a metadata record with the time taken by each phase of the
+   current request (see stats.c), as "wget-PHASE-time" fields.
+   url  is the target uri of the request,
+   timestamp_str  is the timestamp of the request,
+   concurrent_to_uuid  is the uuid of the request record,
+   ip  is the ip address of the server (or NULL).
+   Returns true on success, false on error. */
+bool
+warc_write_timing_record (const char *url, const char *timestamp_str,
+                          const char *concurrent_to_uuid, ip_address *ip)
+{
+  FILE *body = warc_tempfile ();
+  if (body == NULL)
+    return false;
+
+  stats_write_request_timings (body);
+  return warc_write_metadata_record (NULL, url, timestamp_str,
+                                     concurrent_to_uuid, ip,
+                                     "application/warc-fields", body, -1);
+}
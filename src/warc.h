@@ -23,5 +23,7 @@ bool warc_write_resource_record (const char *resource_uuid, const char *url,
 bool warc_write_metadata_record (const char *record_uuid, const char *url,
   const char *timestamp_str, const char *concurrent_to_uuid, ip_address *ip,
   const char *content_type, FILE *body, off_t payload_offset);
+bool warc_write_timing_record (const char *url, const char *timestamp_str,
+  const char *concurrent_to_uuid, ip_address *ip);
 
 #endif /* WARC_H */
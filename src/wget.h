@@ -334,7 +334,11 @@ enum
   ADDED_HTML_EXTENSION = 0x0020,        /* added ".html" extension due to -E */
   TEXTCSS              = 0x0040,        /* document is of type text/css */
   IF_MODIFIED_SINCE    = 0x0080,        /* use if-modified-since header */
-  METALINK_METADATA    = 0x0100         /* use HTTP response for Metalink metadata */
+  METALINK_METADATA    = 0x0100,        /* use HTTP response for Metalink metadata */
+  EXPECT_HTML          = 0x0200,        /* the link to the document suggests
+                                           it is HTML; set by the caller */
+  SKIP_UNNEEDED_BODY   = 0x0400         /* GET instead of a preliminary HEAD,
+                                           skipping the body if unneeded */
 };
 
 /* Universal error type -- used almost everywhere.  Error reporting of
@@ -51,6 +51,10 @@ my %_commands = (
 
     # From ftpexts Internet Draft.
     'SIZE' => $_connection_states{LOGGEDIN} | $_connection_states{TWOSOCKS},
+
+    # From RFC 2389 and RFC 3659.
+    'FEAT' => $_connection_states{LOGGEDIN} | $_connection_states{TWOSOCKS},
+    'MLSD' => $_connection_states{TWOSOCKS},
 );
 
 # COMMAND-HANDLING ROUTINES
@@ -74,11 +78,78 @@ sub _CWD_command
     print {$conn->{socket}} "200 directory changed to $new_path.\r\n";
 }
 
+sub _FEAT_command
+{
+    my ($conn, $cmd, $dummy) = @_;
+
+    unless ($conn->{'paths'}->GetBehavior('mlsd'))
+    {
+        print {$conn->{socket}} "500 Unrecognized command.\r\n";
+        return;
+    }
+
+    print {$conn->{socket}} "211-Features:\r\n";
+    print {$conn->{socket}} " MLST type*;size*;modify*;\r\n";
+    print {$conn->{socket}} " SIZE\r\n";
+    print {$conn->{socket}} "211 End\r\n";
+}
+
+sub _MLSD_command
+{
+    my ($conn, $cmd, $path) = @_;
+    my $paths = $conn->{'paths'};
+
+    unless ($paths->GetBehavior('mlsd'))
+    {
+        print {$conn->{socket}} "500 Unrecognized command.\r\n";
+        return;
+    }
+
+    my $dir = FTPPaths::path_merge($conn->{'dir'}, $path);
+    my $listing = $paths->get_mlsd_list($dir);
+    unless ($listing)
+    {
+        print {$conn->{socket}} "550 File or directory not found.\r\n";
+        return;
+    }
+
+    print {$conn->{socket}} "150 Opening data connection for file listing.\r\n";
+
+    # Open a path back to the client.
+    my $sock = __open_data_connection($conn);
+    unless ($sock)
+    {
+        print {$conn->{socket}} "425 Can't open data connection.\r\n";
+        return;
+    }
+
+    for my $item (@$listing)
+    {
+        print $sock "$item\r\n";
+    }
+
+    unless ($sock->close)
+    {
+        print {$conn->{socket}} "550 Error closing data connection: $!\r\n";
+        return;
+    }
+
+    print {$conn->{socket}}
+      "226 Listing complete. Data connection has been closed.\r\n";
+}
+
 sub _LIST_command
 {
     my ($conn, $cmd, $path) = @_;
     my $paths = $conn->{'paths'};
 
+    if ($paths->GetBehavior('mlsd'))
+    {
+        # Make sure the client sticks to MLSD.
+        print {$conn->{socket}} "500 Use MLSD.\r\n";
+        return;
+    }
+
     my $ReturnEmptyList =
       ($paths->GetBehavior('list_empty_if_list_a') && $path eq '-a');
     my $SkipHiddenFiles =
@@ -624,8 +695,16 @@ sub run
     my $server_sock = $self->{_server_sock};
 
     # the accept loop
-    while (my $client_addr = accept(my $socket, $server_sock))
+    while (1)
     {
+        my $client_addr = accept(my $socket, $server_sock);
+        unless ($client_addr)
+        {
+            # A worker of ours may have just exited.
+            next if $!{EINTR};
+            last;
+        }
+
         # turn buffering off on $socket
         select((select($socket), $| = 1)[0]);
 
@@ -636,15 +715,20 @@ sub run
         # print who connected
         print STDERR "got a connection from: $client_ipnum\n" if $log;
 
-        # fork off a process to handle this connection.
-        # my $pid = fork();
-        # unless (defined $pid) {
-        #     warn "fork: $!";
-        #     sleep 5; # Back off in case system is overloaded.
-        #     next;
-        # }
+        # fork off a process to handle this connection, if the test
+        # wants concurrent connections; otherwise handle it here.
+        my $pid = 0;
+        if ($self->{_server_behavior}{concurrent})
+        {
+            $pid = fork();
+            unless (defined $pid)
+            {
+                warn "fork: $!";
+                next;
+            }
+        }
 
-        if (1)
+        if (!$pid)
         {    # Child process.
 
             # install signals
@@ -751,6 +835,7 @@ sub run
                 # Run the command.
                 &{$command_table->{$cmd}}($conn, $cmd, $rest);
             }
+            exit 0 if $pid == 0 && $self->{_server_behavior}{concurrent};
         }
         else
         {    # Father
@@ -969,6 +1054,32 @@ sub get_list
     return $list;
 }
 
+sub get_mlsd_list
+{
+    my ($self, $path) = @_;
+    my $info = $self->get_info($path);
+    return unless defined $info && $info->{'_type'} eq 'd';
+
+    my $list = ["type=cdir;modify=20000101000000; ."];
+    for my $item (keys %$info)
+    {
+        next if $item =~ /^_/;
+        my $node = $info->{$item};
+        my $modify = strftime("%Y%m%d%H%M%S",
+                              gmtime($node->{'timestamp'} || time));
+        if ($node->{'_type'} eq 'd')
+        {
+            push @$list, "type=dir;modify=$modify; $item";
+        }
+        else
+        {
+            my $size = length $node->{'content'};
+            push @$list, "type=file;size=$size;modify=$modify; $item";
+        }
+    }
+    return $list;
+}
+
 # 2013-10-17 Andrea Urbani (matfanjol)
 # It returns the behavior of the given name.
 # In this file I handle also the following behaviors:
@@ -987,6 +1098,8 @@ sub get_list
 #                          to the url files
 #  syst_response         : if defined, its content is printed
 #                          out as SYST response
+#  mlsd                  : if defined, FEAT advertises MLST, MLSD
+#                          works and LIST is refused
 sub GetBehavior
 {
     my ($self, $name) = @_;